@@ -1,5 +1,6 @@
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <string.h>
@@ -22,6 +23,16 @@ void test_hook_io_function(const char* file_name) {
     } else {
         fprintf(stdout, "write file: %s success, write bytes: %lu\n", file_name, res);
     }
+    // 聚集写，一次调用写入多个缓冲区
+    char head[] = "hello ";
+    char tail[] = "iovec!\n";
+    struct iovec iov[2] = {{head, strlen(head)}, {tail, strlen(tail)}};
+    res = writev(fd, iov, 2);
+    if (res < 0) {
+        fprintf(stderr, "call writev failed, err: %s\n", strerror(errno));
+    } else {
+        fprintf(stdout, "writev file: %s success, write bytes: %lu\n", file_name, res);
+    }
     fsync(fd);
     close(fd);
 
@@ -56,6 +67,29 @@ int main() {
     for (const auto& info : file_infos) {
         fprintf(stdout, "file r/w info: tid: %lu, name: %s, read(B): %lu, write(B): %lu\n",
             info.tid, info.file_name.c_str(), info.read_b, info.write_b);
+        if (info.writev_call_num != 0) {
+            fprintf(stdout, "    writev calls: %lu, iovecs: %lu\n", info.writev_call_num, info.writev_iov_num);
+        }
+        if (info.sync_batch.sync_num != 0) {
+            fprintf(stdout, "    syncs: %lu, bytes written between syncs p50: %lu, p99: %lu, max: %lu\n",
+                info.sync_batch.sync_num, info.sync_batch.p50_b, info.sync_batch.p99_b, info.sync_batch.max_b);
+        }
+        const char* pattern_names[file_io_hook::ACCESS_PATTERN_COUNT] = {"sequential", "reverse", "strided", "random"};
+        const file_io_hook::AccessPatternStat* patterns[2] = {&info.read_pattern, &info.write_pattern};
+        for (int i = 0; i < 2; ++i) {
+            const auto* pattern = patterns[i];
+            if (pattern->dominant == file_io_hook::ACCESS_PATTERN_COUNT) continue;
+            fprintf(stdout, "    %s pattern: %s, accesses seq/rev/strided/random: %lu/%lu/%lu/%lu, "
+                "longest sequential run: %lu\n", i == 0 ? "read" : "write", pattern_names[pattern->dominant],
+                pattern->access_num[0], pattern->access_num[1], pattern->access_num[2], pattern->access_num[3],
+                pattern->max_run_len[file_io_hook::ACCESS_SEQUENTIAL]);
+        }
+        for (int op = 0; op < file_io_hook::FILE_OPERATE_TYPE_COUNT; ++op) {
+            const auto& latency = info.latency[op];
+            if (latency.call_num == 0) continue;
+            fprintf(stdout, "    %-8s calls: %lu, p50(ns): %lu, p99(ns): %lu, p999(ns): %lu, max(ns): %lu\n",
+                file_io_hook::FILE_OPERATE_TYPE_NAMES[op], latency.call_num, latency.p50_ns, latency.p99_ns, latency.p999_ns, latency.max_ns);
+        }
     }
     return 0;
 }
@@ -0,0 +1,231 @@
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include "hook_io_handle.h"
+
+/*
+ * 不依赖 liburing，直接通过 io_uring_setup/io_uring_enter 系统调用读写 tmpfs 上的文件
+ * 运行方式：LD_PRELOAD=./libio_hook.so ./example_io_uring [dir]
+ * 统计结果与提交的请求不一致时返回 1，可以作为测试运行；系统不支持 io_uring 时返回 EXAMPLE_SKIP_CODE
+ */
+
+// 系统不支持（或者禁止）io_uring 时的返回值，测试中视为跳过
+#define EXAMPLE_SKIP_CODE (77)
+
+// 每个文件预期的统计结果：4 个 4096 字节的写加上一次 writev（"hello " + "io_uring!\n"），读 1024 字节，刷盘一次
+#define EXPECTED_WRITE_BYTES (4 * 4096 + 16)
+#define EXPECTED_READ_BYTES (1024)
+#define EXPECTED_WRITEV_CALLS (1)
+#define EXPECTED_WRITEV_IOVECS (2)
+#define EXPECTED_SYNCS (1)
+
+struct SimpleRing {
+    int ring_fd = -1;
+    void* sq_ptr = nullptr;
+    void* cq_ptr = nullptr;
+    size_t sq_size = 0;
+    size_t cq_size = 0;
+    struct io_uring_sqe* sqes = nullptr;
+    size_t sqes_size = 0;
+    unsigned* sq_tail = nullptr;
+    unsigned* sq_mask = nullptr;
+    unsigned* sq_array = nullptr;
+    unsigned* cq_head = nullptr;
+    unsigned* cq_tail = nullptr;
+    unsigned* cq_mask = nullptr;
+    struct io_uring_cqe* cqes = nullptr;
+};
+
+static bool ring_init(SimpleRing* ring, unsigned entries) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    ring->ring_fd = static_cast<int>(syscall(SYS_io_uring_setup, entries, &params));
+    if (ring->ring_fd < 0) {
+        // 调用方根据 errno 判断是否支持 io_uring
+        int err = errno;
+        fprintf(stderr, "call io_uring_setup failed, err: %s\n", strerror(err));
+        errno = err;
+        return false;
+    }
+    ring->sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    ring->sq_ptr = mmap(nullptr, ring->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+        ring->ring_fd, IORING_OFF_SQ_RING);
+    ring->cq_ptr = mmap(nullptr, ring->cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+        ring->ring_fd, IORING_OFF_CQ_RING);
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    void* sqes = mmap(nullptr, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+        ring->ring_fd, IORING_OFF_SQES);
+    if (ring->sq_ptr == MAP_FAILED || ring->cq_ptr == MAP_FAILED || sqes == MAP_FAILED) {
+        fprintf(stderr, "call mmap failed, err: %s\n", strerror(errno));
+        return false;
+    }
+    char* sq = static_cast<char*>(ring->sq_ptr);
+    char* cq = static_cast<char*>(ring->cq_ptr);
+    ring->sqes = static_cast<struct io_uring_sqe*>(sqes);
+    ring->sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    ring->sq_mask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    ring->sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    ring->cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    ring->cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    ring->cq_mask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    ring->cqes = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+    return true;
+}
+
+static void ring_exit(SimpleRing* ring) {
+    munmap(ring->sqes, ring->sqes_size);
+    munmap(ring->cq_ptr, ring->cq_size);
+    munmap(ring->sq_ptr, ring->sq_size);
+    close(ring->ring_fd);
+}
+
+static struct io_uring_sqe* ring_get_sqe(SimpleRing* ring) {
+    unsigned tail = *ring->sq_tail;
+    unsigned index = tail & *ring->sq_mask;
+    struct io_uring_sqe* sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sq_array[index] = index;
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    return sqe;
+}
+
+// 提交并等待全部完成，返回最后一个请求的结果
+static int ring_submit_and_wait(SimpleRing* ring, unsigned count) {
+    long ret = syscall(SYS_io_uring_enter, ring->ring_fd, count, count, IORING_ENTER_GETEVENTS, nullptr, 0);
+    if (ret < 0) {
+        fprintf(stderr, "call io_uring_enter failed, err: %s\n", strerror(errno));
+        return -1;
+    }
+    int res = 0;
+    unsigned head = *ring->cq_head;
+    unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+    for (; head != tail; ++head) {
+        struct io_uring_cqe* cqe = &ring->cqes[head & *ring->cq_mask];
+        res = cqe->res;
+        if (res < 0) {
+            fprintf(stderr, "request %llu failed, err: %s\n", cqe->user_data, strerror(-res));
+        }
+    }
+    __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+    return res;
+}
+
+static void test_io_uring_function(SimpleRing* ring, const char* file_name) {
+    struct io_uring_sqe* sqe = ring_get_sqe(ring);
+    sqe->opcode = IORING_OP_OPENAT;
+    sqe->fd = AT_FDCWD;
+    sqe->addr = reinterpret_cast<uintptr_t>(file_name);
+    sqe->open_flags = O_CREAT | O_RDWR | O_TRUNC;
+    sqe->len = 0644;
+    sqe->user_data = 1;
+    int fd = ring_submit_and_wait(ring, 1);
+    if (fd < 0) {
+        return;
+    }
+    fprintf(stdout, "openat file: %s success, fd: %d\n", file_name, fd);
+
+    // 一次提交多个写请求
+    static char block[4096];
+    memset(block, 'a', sizeof(block));
+    for (int i = 0; i < 4; ++i) {
+        sqe = ring_get_sqe(ring);
+        sqe->opcode = IORING_OP_WRITE;
+        sqe->fd = fd;
+        sqe->addr = reinterpret_cast<uintptr_t>(block);
+        sqe->len = sizeof(block);
+        sqe->off = i * sizeof(block);
+        sqe->user_data = 10 + i;
+    }
+    char head[] = "hello ";
+    char tail[] = "io_uring!\n";
+    struct iovec iov[2] = {{head, strlen(head)}, {tail, strlen(tail)}};
+    sqe = ring_get_sqe(ring);
+    sqe->opcode = IORING_OP_WRITEV;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uintptr_t>(iov);
+    sqe->len = 2;
+    sqe->off = 4 * sizeof(block);
+    sqe->user_data = 20;
+    ring_submit_and_wait(ring, 5);
+
+    sqe = ring_get_sqe(ring);
+    sqe->opcode = IORING_OP_FSYNC;
+    sqe->fd = fd;
+    sqe->user_data = 30;
+    ring_submit_and_wait(ring, 1);
+
+    char receive_buf[1024];
+    sqe = ring_get_sqe(ring);
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uintptr_t>(receive_buf);
+    sqe->len = sizeof(receive_buf);
+    sqe->off = 0;
+    sqe->user_data = 40;
+    int res = ring_submit_and_wait(ring, 1);
+    fprintf(stdout, "read file: %s, read bytes: %d\n", file_name, res);
+
+    sqe = ring_get_sqe(ring);
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->fd = fd;
+    sqe->user_data = 50;
+    ring_submit_and_wait(ring, 1);
+    unlink(file_name);
+}
+
+int main(int argc, char* argv[]) {
+    const char* dir = argc > 1 ? argv[1] : "/dev/shm";
+    SimpleRing ring;
+    if (!ring_init(&ring, 8)) {
+        return (errno == ENOSYS || errno == EPERM) ? EXAMPLE_SKIP_CODE : 1;
+    }
+    const int ARR_SIZE = 2;
+    const char* test_file_arr[ARR_SIZE] = {"io_uring_test_01.txt", "io_uring_test_02.txt"};
+    for (int i = 0; i < ARR_SIZE; ++i) {
+        char file_name[256];
+        snprintf(file_name, sizeof(file_name), "%s/%s", dir, test_file_arr[i]);
+        test_io_uring_function(&ring, file_name);
+    }
+    ring_exit(&ring);
+
+    // 获取文件读写信息，io_uring 的读写与同步 IO 一样按文件统计
+    auto& file_infos = file_io_hook::FileIoInfoHandler::get_instance().consume_and_parse();
+    int failed_num = 0;
+    if (file_infos.size() != ARR_SIZE) {
+        fprintf(stderr, "expect %d files, got %zu\n", ARR_SIZE, file_infos.size());
+        failed_num++;
+    }
+    for (const auto& info : file_infos) {
+        fprintf(stdout, "file r/w info: tid: %lu, name: %s, read(B): %lu, write(B): %lu\n",
+            info.tid, info.file_name.c_str(), info.read_b, info.write_b);
+        if (info.writev_call_num != 0) {
+            fprintf(stdout, "    writev calls: %lu, iovecs: %lu\n", info.writev_call_num, info.writev_iov_num);
+        }
+        if (info.sync_batch.sync_num != 0) {
+            fprintf(stdout, "    syncs: %lu, bytes written between syncs p50: %lu, p99: %lu, max: %lu\n",
+                info.sync_batch.sync_num, info.sync_batch.p50_b, info.sync_batch.p99_b, info.sync_batch.max_b);
+        }
+        for (int op = 0; op < file_io_hook::FILE_OPERATE_TYPE_COUNT; ++op) {
+            const auto& latency = info.latency[op];
+            if (latency.call_num == 0) continue;
+            fprintf(stdout, "    %-8s calls: %lu, p50(ns): %lu, p99(ns): %lu, p999(ns): %lu, max(ns): %lu\n",
+                file_io_hook::FILE_OPERATE_TYPE_NAMES[op], latency.call_num, latency.p50_ns, latency.p99_ns, latency.p999_ns, latency.max_ns);
+        }
+        if (info.write_b != EXPECTED_WRITE_BYTES || info.read_b != EXPECTED_READ_BYTES
+            || info.writev_call_num != EXPECTED_WRITEV_CALLS || info.writev_iov_num != EXPECTED_WRITEV_IOVECS
+            || info.sync_batch.sync_num != EXPECTED_SYNCS) {
+            fprintf(stderr, "unexpected result of %s, expect read(B): %d, write(B): %d, writev calls: %d, "
+                "iovecs: %d, syncs: %d\n", info.file_name.c_str(), EXPECTED_READ_BYTES, EXPECTED_WRITE_BYTES,
+                EXPECTED_WRITEV_CALLS, EXPECTED_WRITEV_IOVECS, EXPECTED_SYNCS);
+            failed_num++;
+        }
+    }
+    return failed_num == 0 ? 0 : 1;
+}
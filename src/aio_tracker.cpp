@@ -0,0 +1,56 @@
+#include <errno.h>
+#include "common/common.h"
+#include "aio_tracker.h"
+
+namespace file_io_hook {
+
+void AioTracker::on_submit(uint64_t key, int fd, FileOperateType type, int iov_count) {
+    // 同一个控制块再次提交时，上一次的请求已经不会再完成，回收它占用的深度
+    AioPending pending;
+    take(key, pending);
+    pending.fd = fd;
+    pending.type = type;
+    pending.iov_count = iov_count;
+    AioFdSlot* slot = inflight_.get_or_create(fd);
+    pending.depth = slot ? slot->inflight.fetch_add(1, std::memory_order_relaxed) + 1 : 1;
+    pending.start_ns = Util::get_time_ns();
+    pending_.insert(key, pending);
+}
+
+void AioTracker::on_cancel(uint64_t key) {
+    AioPending pending;
+    take(key, pending);
+}
+
+void AioTracker::on_complete(uint64_t key, int64_t res) {
+    AioPending pending;
+    if (!take(key, pending)) {
+        return;
+    }
+    uint64_t cost_ns = Util::get_time_ns() - pending.start_ns;
+    if (res < 0) {
+        // 在 io_getevents、aio_return 中调用，不能改变它们返回给业务的 errno
+        int saved_errno = errno;
+        FileIoInfoHandler::get_instance().add_error_hook_info(pending.type, pending.fd,
+            static_cast<int>(-res), cost_ns);
+        errno = saved_errno;
+        return;
+    }
+    size_t size = pending.type == SYNC_TYPE ? 0 : static_cast<size_t>(res);
+    FileIoInfoHandler::get_instance().add_async_hook_info(pending.type, pending.fd, size,
+        pending.iov_count, pending.depth, cost_ns);
+}
+
+bool AioTracker::take(uint64_t key, AioPending& pending) {
+    if (!pending_.find(key, pending)) {
+        return false;
+    }
+    pending_.erase(key);
+    AioFdSlot* slot = inflight_.find(pending.fd);
+    if (slot != nullptr) {
+        slot->inflight.fetch_sub(1, std::memory_order_relaxed);
+    }
+    return true;
+}
+
+}  // namespace file_io_hook
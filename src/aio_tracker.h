@@ -0,0 +1,153 @@
+/**
+ * @file aio_tracker.h
+ * @author noahyzhang
+ * @brief 用于收集异步 IO（Linux native AIO、POSIX AIO）的 IO 信息
+ * @version 0.1
+ * @date 2023-04-18
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include "common/concurrent_hash_map.h"
+#include "common/fd_table.h"
+#include "hook_io_handle.h"
+
+namespace file_io_hook {
+
+// 未完成请求表的初始桶数量
+#define AIO_PENDING_BUCKET_SIZE (1021)
+
+/**
+ * @brief 跟踪异步 IO 请求从提交到完成的过程
+ *  两类异步 IO 都以请求控制块的地址作为请求的标识：
+ *  1. native AIO：io_submit 提交 iocb，io_getevents 返回的 io_event.obj 即为 iocb 的地址
+ *  2. POSIX AIO：aio_read/aio_write 提交 aiocb，应用通过 aio_return 获取结果
+ *  提交时记录 (fd, 操作类型, 提交时间)，并把该 fd 上未完成的请求数加一作为队列深度
+ *  完成时把字节数、耗时和提交时的队列深度记录到 FileIoInfoHandler 的数据池中
+ *
+ *  限制：
+ *  1. 耗时为提交到观察到完成（io_getevents/aio_return 返回）的时间，是实际耗时的上界
+ *  2. io_destroy 丢弃的请求、从不调用 aio_return 的请求不会完成，
+ *     在控制块被再次提交时回收
+ */
+class AioTracker {
+public:
+    ~AioTracker() = default;
+    AioTracker(const AioTracker&) = delete;
+    AioTracker& operator=(const AioTracker&) = delete;
+    AioTracker(AioTracker&&) = delete;
+    AioTracker& operator=(AioTracker&&) = delete;
+
+    static AioTracker& get_instance() {
+        static AioTracker instance;
+        return instance;
+    }
+
+public:
+    /**
+     * @brief 请求提交前调用
+     *  需要在真实提交之前记录，否则其他线程可能先观察到完成
+     *
+     * @param key 请求控制块的地址
+     * @param fd
+     * @param type READ_TYPE/WRITE_TYPE/SYNC_TYPE
+     * @param iov_count 向量读写的 iovec 数量
+     */
+    void on_submit(uint64_t key, int fd, FileOperateType type, int iov_count);
+
+    /**
+     * @brief 请求没有提交成功或者被取消时调用，不记录任何信息
+     *
+     * @param key
+     */
+    void on_cancel(uint64_t key);
+
+    /**
+     * @brief 观察到请求完成时调用
+     *
+     * @param key
+     * @param res 请求的结果，读写为字节数，失败为负的错误码
+     */
+    void on_complete(uint64_t key, int64_t res);
+
+public:
+    /**
+     * @brief fork 前在父进程上下文执行
+     *
+     */
+    void lock_prefork() {
+        // 节点在桶锁内分配，分配器的锁在桶的锁之后获取
+        pending_.lock_prefork();
+        decltype(pending_)::lock_allocator_prefork();
+    }
+
+    /**
+     * @brief fork 返回前，在父进程上下文执行
+     *
+     */
+    void lock_postfork_parent() {
+        decltype(pending_)::lock_allocator_postfork_parent();
+        pending_.lock_postfork_parent();
+    }
+
+    /**
+     * @brief fork 返回前，在子进程上下文执行
+     *  子进程不继承父进程的 AIO 上下文和未完成的请求，清空即可
+     *  这些请求在子进程中不会再被取出，各个 fd 上未完成的请求数也要清零，否则之后记录的队列深度一直偏大
+     */
+    void lock_postfork_child() {
+        decltype(pending_)::lock_allocator_postfork_child();
+        pending_.lock_postfork_child();
+        pending_.clear();
+        inflight_.for_each_in_range(0, inflight_.max_fd() - 1, [](int, AioFdSlot& slot) {
+            slot.inflight.store(0, std::memory_order_relaxed);
+        });
+    }
+
+private:
+    AioTracker() : pending_(AIO_PENDING_BUCKET_SIZE) {}
+
+    /**
+     * @brief 未完成的请求
+     *
+     */
+    struct AioPending {
+        int fd = -1;
+        FileOperateType type = READ_TYPE;
+        int iov_count = 0;
+        // 提交时该 fd 上未完成的请求数，包括自己
+        uint32_t depth = 0;
+        uint64_t start_ns = 0;
+    };
+
+    /**
+     * @brief fd 表中的元素，该 fd 上未完成的请求数
+     *
+     */
+    struct AioFdSlot {
+        std::atomic<uint32_t> inflight{0};
+    };
+
+    /**
+     * @brief 取出并删除请求，同时减少对应 fd 上未完成的请求数
+     *
+     * @param key
+     * @param pending
+     * @return true
+     * @return false
+     */
+    bool take(uint64_t key, AioPending& pending);
+
+private:
+    // 控制块地址 -> 未完成的请求
+    ConcurrentHashMap<uint64_t, AioPending> pending_;
+    // 每个 fd 上未完成的请求数，以 fd 为下标
+    FdTable<AioFdSlot> inflight_;
+};
+
+}  // namespace file_io_hook
@@ -0,0 +1,128 @@
+#include <time.h>
+#include "hook_guard.h"
+#include "background_collector.h"
+
+namespace file_io_hook {
+
+std::atomic<bool> g_collector_pending{false};
+
+void BackgroundCollector::start_lazily(uint32_t interval_ms) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    interval_ms_.store(interval_ms == 0 ? DEFAULT_COLLECT_INTERVAL_MS : interval_ms, std::memory_order_relaxed);
+    if (state_.load(std::memory_order_relaxed) == COLLECTOR_IDLE) {
+        state_.store(COLLECTOR_PENDING, std::memory_order_relaxed);
+        g_collector_pending.store(true, std::memory_order_release);
+    }
+}
+
+bool BackgroundCollector::start(uint32_t interval_ms) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    interval_ms_.store(interval_ms == 0 ? DEFAULT_COLLECT_INTERVAL_MS : interval_ms, std::memory_order_relaxed);
+    if (state_.load(std::memory_order_relaxed) == COLLECTOR_RUNNING) {
+        return true;
+    }
+    return create_thread();
+}
+
+void BackgroundCollector::start_if_pending() {
+    if (state_.load(std::memory_order_acquire) != COLLECTOR_PENDING) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (state_.load(std::memory_order_relaxed) == COLLECTOR_PENDING) {
+        create_thread();
+    }
+}
+
+bool BackgroundCollector::create_thread() {
+    // 不论成功与否都不再尝试，创建失败时不应该让每次 IO 都重试
+    g_collector_pending.store(false, std::memory_order_relaxed);
+    stop_.store(false, std::memory_order_relaxed);
+    if (pthread_create(&thread_, nullptr, &BackgroundCollector::thread_main, this) != 0) {
+        state_.store(COLLECTOR_IDLE, std::memory_order_release);
+        return false;
+    }
+    state_.store(COLLECTOR_RUNNING, std::memory_order_release);
+    return true;
+}
+
+void BackgroundCollector::stop() {
+    pthread_t thread;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        int state = state_.load(std::memory_order_relaxed);
+        state_.store(COLLECTOR_IDLE, std::memory_order_release);
+        g_collector_pending.store(false, std::memory_order_relaxed);
+        if (state != COLLECTOR_RUNNING) {
+            return;
+        }
+        stop_.store(true, std::memory_order_relaxed);
+        thread = thread_;
+    }
+    if (pthread_equal(thread, pthread_self())) {
+        pthread_detach(thread);
+        return;
+    }
+    pthread_join(thread, nullptr);
+}
+
+void BackgroundCollector::add_sink(std::shared_ptr<SnapshotSink> sink) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    sinks_.push_back(std::move(sink));
+}
+
+void BackgroundCollector::lock_postfork_child() {
+    if (state_.load(std::memory_order_relaxed) == COLLECTOR_RUNNING) {
+        state_.store(COLLECTOR_PENDING, std::memory_order_relaxed);
+        g_collector_pending.store(true, std::memory_order_release);
+    }
+    stop_.store(false, std::memory_order_relaxed);
+    for (auto& sink : sinks_) {
+        sink->reset_after_fork();
+    }
+    mutex_.unlock();
+}
+
+void* BackgroundCollector::thread_main(void* arg) {
+    // 整个线程都在 HookGuard 的作用域内，收集和输出过程中的 IO 都直接调用真实函数
+    HookGuard guard;
+    static_cast<BackgroundCollector*>(arg)->run();
+    return nullptr;
+}
+
+void BackgroundCollector::run() {
+    for (;;) {
+        // 分段睡眠，及时响应停止
+        uint32_t slept_ms = 0;
+        for (; slept_ms < interval_ms_.load(std::memory_order_relaxed)
+            && !stop_.load(std::memory_order_relaxed); slept_ms += COLLECT_STOP_CHECK_MS) {
+            struct timespec ts = {0, COLLECT_STOP_CHECK_MS * 1000000L};
+            nanosleep(&ts, nullptr);
+        }
+        if (stop_.load(std::memory_order_relaxed)) {
+            return;
+        }
+        collect_once();
+    }
+}
+
+void BackgroundCollector::collect_once() {
+    std::vector<FileInfo> infos = FileIoInfoHandler::get_instance().consume_and_parse();
+    // 复制一份再输出，回调中可以注册新的输出方式
+    std::vector<std::shared_ptr<SnapshotSink>> sinks;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        sinks = sinks_;
+    }
+    std::string text;
+    bool formatted = false;
+    for (auto& sink : sinks) {
+        if (sink->need_text() && !formatted) {
+            SnapshotSink::format(infos, text);
+            formatted = true;
+        }
+        sink->write(infos, text);
+    }
+}
+
+}  // namespace file_io_hook
@@ -0,0 +1,165 @@
+/**
+ * @file background_collector.h
+ * @author noahyzhang
+ * @brief 库内部的后台收集线程
+ * @version 0.1
+ * @date 2023-04-18
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#pragma once
+
+#include <pthread.h>
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "snapshot_sink.h"
+
+namespace file_io_hook {
+
+// 默认的收集间隔
+#define DEFAULT_COLLECT_INTERVAL_MS (1000)
+
+// 收集线程检查退出标志的间隔，决定了停止收集时最多需要等待的时间
+#define COLLECT_STOP_CHECK_MS (50)
+
+/**
+ * @brief 有待启动的收集线程，写线程只读取这个标志，为 true 时才访问 BackgroundCollector
+ *  定义在 background_collector.cpp 中
+ */
+extern std::atomic<bool> g_collector_pending;
+
+/**
+ * @brief 后台收集线程
+ *  按固定间隔调用 consume_and_parse，把快照交给所有注册的 SnapshotSink
+ *  1. 库的构造函数中只登记配置，不创建线程，第一次记录 IO 时才启动，避免在动态库加载期间创建线程
+ *  2. fork 出的子进程中没有收集线程，同样在子进程第一次记录 IO 时重新启动
+ *  3. 收集线程全程处于 HookGuard 的作用域内，自己（包括各个 sink）的 IO 不会被统计
+ *  收集线程运行期间，业务不能再调用 consume_and_parse，两者只能有一个消费者
+ */
+class BackgroundCollector {
+public:
+    ~BackgroundCollector() {
+        stop();
+    }
+    BackgroundCollector(const BackgroundCollector&) = delete;
+    BackgroundCollector& operator=(const BackgroundCollector&) = delete;
+    BackgroundCollector(BackgroundCollector&&) = delete;
+    BackgroundCollector& operator=(BackgroundCollector&&) = delete;
+
+    static BackgroundCollector& get_instance() {
+        static BackgroundCollector instance;
+        return instance;
+    }
+
+public:
+    /**
+     * @brief 登记收集间隔，在下一次记录 IO 时启动收集线程
+     *
+     * @param interval_ms
+     */
+    void start_lazily(uint32_t interval_ms);
+
+    /**
+     * @brief 立即启动收集线程，已经启动时只修改间隔
+     *
+     * @param interval_ms
+     * @return true
+     * @return false 创建线程失败
+     */
+    bool start(uint32_t interval_ms);
+
+    /**
+     * @brief 有待启动的收集线程时启动
+     *
+     */
+    void start_if_pending();
+
+    /**
+     * @brief 停止收集线程，等待它退出
+     *  在收集线程中（比如回调里）调用时不等待
+     *
+     */
+    void stop();
+
+    /**
+     * @brief 注册一个输出方式
+     *
+     * @param sink
+     */
+    void add_sink(std::shared_ptr<SnapshotSink> sink);
+
+public:
+    /**
+     * @brief fork 前在父进程上下文执行
+     *  consume_and_parse 由 FileIoInfoHandler 自己与 fork 互斥，这里只保护状态和输出方式
+     */
+    void lock_prefork() {
+        mutex_.lock();
+    }
+
+    /**
+     * @brief fork 返回前，在父进程上下文执行
+     *
+     */
+    void lock_postfork_parent() {
+        mutex_.unlock();
+    }
+
+    /**
+     * @brief fork 返回前，在子进程上下文执行
+     *  子进程中没有收集线程，父进程中正在运行时，子进程在第一次记录 IO 时重新启动
+     */
+    void lock_postfork_child();
+
+private:
+    BackgroundCollector() = default;
+
+    /**
+     * @brief 创建收集线程，需要持有 mutex_
+     *
+     * @return true
+     * @return false
+     */
+    bool create_thread();
+
+    /**
+     * @brief 收集线程的主循环
+     *
+     */
+    void run();
+
+    /**
+     * @brief 收集一次，交给所有的输出方式
+     *
+     */
+    void collect_once();
+
+    static void* thread_main(void* arg);
+
+private:
+    /**
+     * @brief 收集线程的状态
+     *
+     */
+    enum CollectorState {
+        COLLECTOR_IDLE = 0,
+        COLLECTOR_PENDING,
+        COLLECTOR_RUNNING
+    };
+
+private:
+    // 保护状态、线程和输出方式的列表
+    std::mutex mutex_;
+    std::atomic<int> state_{COLLECTOR_IDLE};
+    std::atomic<bool> stop_{false};
+    std::atomic<uint32_t> interval_ms_{DEFAULT_COLLECT_INTERVAL_MS};
+    pthread_t thread_;
+    std::vector<std::shared_ptr<SnapshotSink>> sinks_;
+};
+
+}  // namespace file_io_hook
@@ -0,0 +1,150 @@
+/**
+ * @file access_pattern.h
+ * @author noahyzhang
+ * @brief 文件访问模式的识别
+ * @version 0.1
+ * @date 2023-04-18
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+
+namespace file_io_hook {
+
+// 一个连续段累积多少次访问后先上报一部分，避免很长的顺序读写迟迟不出现在统计中
+#define ACCESS_RUN_REPORT_LEN (1024)
+
+/**
+ * @brief 访问模式，每次访问根据与上一次访问的关系分类
+ *
+ */
+enum AccessPattern {
+    // 紧接着上一次访问的末尾
+    ACCESS_SEQUENTIAL = 0,
+    // 紧挨着上一次访问的开头，从后往前
+    ACCESS_REVERSE,
+    // 与上一次访问的偏移差和上上次相同，比如每次跳过固定大小读取记录头
+    ACCESS_STRIDED,
+    // 以上都不是
+    ACCESS_RANDOM,
+    // 模式的数量，新增模式需要放在此之前
+    ACCESS_PATTERN_COUNT
+};
+
+/**
+ * @brief 需要上报的连续段
+ *  同一模式的连续访问组成一个连续段（run），run_len 不为 0 时表示连续段已经结束
+ */
+struct AccessRunReport {
+    AccessPattern pattern;
+    // 本次上报的访问次数，与之前的上报不重叠
+    uint64_t access_num;
+    // 结束的连续段的总长度（访问次数），0 为连续段还没有结束
+    uint64_t run_len;
+};
+
+/**
+ * @brief 单个 fd 上单个方向（读或者写）的访问模式识别
+ *  只保存上一次访问的偏移、字节数、偏移差和当前连续段，每次访问常数时间，不分配内存
+ *  同一个 fd 被多个线程并发读写时分类可能不准确，但字段都是原子变量，不会出现未定义行为
+ *  文件打开后的第一次访问从偏移 0 开始时算作顺序访问，否则算作随机访问
+ */
+class AccessPatternDetector {
+public:
+    /**
+     * @brief 记录一次访问
+     *
+     * @param offset
+     * @param size 大于 0
+     * @param report 需要上报时填充
+     * @return true 需要上报
+     * @return false
+     */
+    bool access(uint64_t offset, uint64_t size, AccessRunReport* report) {
+        uint64_t last_offset = last_offset_.load(std::memory_order_relaxed);
+        AccessPattern pattern = ACCESS_RANDOM;
+        if (last_offset == UNKNOWN_OFFSET) {
+            pattern = offset == 0 ? ACCESS_SEQUENTIAL : ACCESS_RANDOM;
+        } else {
+            int64_t stride = static_cast<int64_t>(offset - last_offset);
+            if (offset == last_offset + last_size_.load(std::memory_order_relaxed)) {
+                pattern = ACCESS_SEQUENTIAL;
+            } else if (offset + size == last_offset) {
+                pattern = ACCESS_REVERSE;
+            } else if (stride != 0 && stride == last_stride_.load(std::memory_order_relaxed)) {
+                pattern = ACCESS_STRIDED;
+            }
+            last_stride_.store(stride, std::memory_order_relaxed);
+        }
+        last_offset_.store(offset, std::memory_order_relaxed);
+        last_size_.store(size, std::memory_order_relaxed);
+
+        uint64_t run_len = run_len_.load(std::memory_order_relaxed);
+        uint32_t run_pattern = run_pattern_.load(std::memory_order_relaxed);
+        if (run_len != 0 && run_pattern == static_cast<uint32_t>(pattern)) {
+            run_len_.store(run_len + 1, std::memory_order_relaxed);
+            uint64_t unreported = unreported_.load(std::memory_order_relaxed) + 1;
+            if (unreported < ACCESS_RUN_REPORT_LEN) {
+                unreported_.store(unreported, std::memory_order_relaxed);
+                return false;
+            }
+            unreported_.store(0, std::memory_order_relaxed);
+            *report = AccessRunReport{pattern, unreported, 0};
+            return true;
+        }
+        // 模式变化，上一个连续段结束
+        bool has_report = finish(report);
+        run_pattern_.store(static_cast<uint32_t>(pattern), std::memory_order_relaxed);
+        run_len_.store(1, std::memory_order_relaxed);
+        unreported_.store(1, std::memory_order_relaxed);
+        return has_report;
+    }
+
+    /**
+     * @brief 结束当前的连续段，关闭文件时调用
+     *
+     * @param report 需要上报时填充
+     * @return true 需要上报
+     * @return false 没有连续段
+     */
+    bool finish(AccessRunReport* report) {
+        uint64_t run_len = run_len_.exchange(0, std::memory_order_relaxed);
+        if (run_len == 0) {
+            return false;
+        }
+        *report = AccessRunReport{static_cast<AccessPattern>(run_pattern_.load(std::memory_order_relaxed)),
+            unreported_.exchange(0, std::memory_order_relaxed), run_len};
+        return true;
+    }
+
+    /**
+     * @brief 重新开始识别，打开文件时调用
+     *
+     */
+    void reset() {
+        last_offset_.store(UNKNOWN_OFFSET, std::memory_order_relaxed);
+        last_size_.store(0, std::memory_order_relaxed);
+        last_stride_.store(0, std::memory_order_relaxed);
+        run_len_.store(0, std::memory_order_relaxed);
+        unreported_.store(0, std::memory_order_relaxed);
+    }
+
+private:
+    static const uint64_t UNKNOWN_OFFSET = UINT64_MAX;
+
+    std::atomic<uint64_t> last_offset_{UNKNOWN_OFFSET};
+    std::atomic<uint64_t> last_size_{0};
+    std::atomic<int64_t> last_stride_{0};
+    // 当前连续段的长度，0 为没有连续段
+    std::atomic<uint64_t> run_len_{0};
+    // 当前连续段中还没有上报的访问次数
+    std::atomic<uint64_t> unreported_{0};
+    std::atomic<uint32_t> run_pattern_{ACCESS_RANDOM};
+};
+
+}  // namespace file_io_hook
@@ -12,11 +12,49 @@
 #pragma once
 
 #include <sys/syscall.h>
+#include <time.h>
 #include <unistd.h>
 #include <stdint.h>
 
 namespace file_io_hook {
 
+/**
+ * @brief 文件操作的类型
+ * 
+ */
+enum FileOperateType {
+    OPEN_TYPE = 0,
+    READ_TYPE,
+    WRITE_TYPE,
+    CLOSE_TYPE,
+    // 零拷贝传输（sendfile/splice/copy_file_range 等）的源文件和目标文件
+    ZERO_COPY_READ_TYPE,
+    ZERO_COPY_WRITE_TYPE,
+    // 刷盘（fsync 等），没有字节数，只记录次数和耗时
+    SYNC_TYPE,
+    // 操作类型的数量，新增类型需要放在此之前，并在 FILE_OPERATE_TYPE_NAMES 中增加名字
+    FILE_OPERATE_TYPE_COUNT
+};
+
+/**
+ * @brief 文件操作类型的名字，以 FileOperateType 为下标
+ *  快照的输出、示例以及 fio_collector/fio_analyze 等工具都使用这一份，新增类型时在这里同步增加
+ */
+static const char* const FILE_OPERATE_TYPE_NAMES[] = {
+    "open", "read", "write", "close", "zc_read", "zc_write", "sync"};
+static_assert(sizeof(FILE_OPERATE_TYPE_NAMES) / sizeof(FILE_OPERATE_TYPE_NAMES[0]) == FILE_OPERATE_TYPE_COUNT,
+    "FILE_OPERATE_TYPE_NAMES must match FileOperateType");
+
+/**
+ * @brief 文件操作类型的名字，超出范围时为 "unknown"
+ *
+ * @param type
+ * @return const char*
+ */
+inline const char* file_operate_type_name(uint32_t type) {
+    return type < FILE_OPERATE_TYPE_COUNT ? FILE_OPERATE_TYPE_NAMES[type] : "unknown";
+}
+
 /**
  * @brief hook 相关的工具类
  * 
@@ -29,12 +67,38 @@ public:
      * @return int64_t 
      */
     static int64_t get_tid() {
-        static __thread int64_t tid = -1;
+        int64_t& tid = cached_tid();
         if (tid == -1) {
             tid = syscall(SYS_gettid);
         }
         return tid;
     }
+
+    /**
+     * @brief 清除缓存的 tid，fork 返回前在子进程上下文中调用，否则子进程中拿到的是父进程线程的 tid
+     * 
+     */
+    static void reset_tid() {
+        cached_tid() = -1;
+    }
+
+    /**
+     * @brief 获取单调时钟的纳秒时间戳，用于计算耗时
+     *  CLOCK_MONOTONIC 通过 vDSO 实现，不会陷入内核
+     * 
+     * @return uint64_t 
+     */
+    static uint64_t get_time_ns() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+    }
+
+private:
+    static int64_t& cached_tid() {
+        static __thread int64_t tid = -1;
+        return tid;
+    }
 };
 
 }  // namespace file_io_hook
@@ -16,21 +16,33 @@
 #include <thread>
 #include <vector>
 #include <mutex>
+#include <new>
+#include "common/slab_allocator.h"
 // #include "rw_spin_lock.h"
 
 namespace file_io_hook {
 
 // 默认的哈希桶的数量，注意取一个质数可以使哈希表有更好的性能
 #define DEFAULT_HASH_BUCKET_SIZE (3037)
+// 默认的最大负载因子（平均每个桶中节点的数量），超过后触发扩容
+#define DEFAULT_MAX_LOAD_FACTOR (2.0)
+// 扩容期间，每次操作顺带迁移的桶的数量
+#define HASH_REHASH_STEP (2)
 
 template <typename K, typename V> class HashNode;
 template <typename K, typename V> class HashBucket;
+template <typename K, typename V> struct HashTable;
 template <typename K, typename V, typename F> class ConstIterator;
 
 /**
  * @brief 线程安全的哈希表
  *        以哈希桶作为实现，每个桶是一个单链表
  *        我们加锁的临界区为桶，所以多个线程可以并发写入哈希表中的不同桶
+ *
+ *        节点数量超过 桶数量 * 最大负载因子 时自动扩容为原来的两倍左右
+ *        扩容是渐进式的：新的桶数组发布之后，旧桶中的节点由后续的每次操作顺带迁移几个桶，没有全表停顿
+ *        迁移期间，旧桶还没有迁移时操作在旧桶中完成，已经迁移时在新桶中完成，两者都只持有一个桶锁
+ *        被替换的桶数组不会立即释放（其他线程可能还在访问），在 shrink 或者析构时统一释放
  * 
  * @tparam K 哈希表的键
  * @tparam V 哈希表的值
@@ -39,12 +51,20 @@ template <typename K, typename V, typename F> class ConstIterator;
 template <typename K, typename V, typename F = std::hash<K>>
 class ConcurrentHashMap {
 public:
-    explicit ConcurrentHashMap(size_t hash_bucket_size = DEFAULT_HASH_BUCKET_SIZE)
-        : hash_bucket_size_(hash_bucket_size) {
-        hash_table_ = new HashBucket<K, V>[hash_bucket_size];
+    /**
+     * @brief 构造函数
+     *
+     * @param hash_bucket_size 初始的桶数量，shrink 时不会低于这个值
+     * @param max_load_factor 最大负载因子，小于等于 0 时不会扩容
+     */
+    explicit ConcurrentHashMap(size_t hash_bucket_size = DEFAULT_HASH_BUCKET_SIZE,
+        double max_load_factor = DEFAULT_MAX_LOAD_FACTOR)
+        : initial_bucket_size_(hash_bucket_size ? hash_bucket_size : 1), max_load_factor_(max_load_factor) {
+        table_.store(new HashTable<K, V>(initial_bucket_size_), std::memory_order_relaxed);
     }
     ~ConcurrentHashMap() {
-        delete[] hash_table_;
+        free_retired_tables();
+        delete table_.load(std::memory_order_relaxed);
     }
     ConcurrentHashMap(const ConcurrentHashMap&) = delete;
     ConcurrentHashMap& operator=(const ConcurrentHashMap&) = delete;
@@ -61,8 +81,10 @@ public:
      * @return false 
      */
     bool find(const K& key, V& value) const {
-        size_t hash_val = hash_fn_(key) % hash_bucket_size_;
-        return hash_table_[hash_val].find(key, value);
+        HashBucket<K, V>* bucket = lock_bucket(hash_fn_(key));
+        bool res = bucket->find(key, value);
+        bucket->unlock();
+        return res;
     }
 
     /**
@@ -72,8 +94,12 @@ public:
      * @param value 
      */
     void insert(const K& key, const V& value) {
-        size_t hash_val = hash_fn_(key) % hash_bucket_size_;
-        hash_table_[hash_val].insert(key, value);
+        HashBucket<K, V>* bucket = lock_bucket(hash_fn_(key));
+        bool is_new = bucket->insert(key, value);
+        bucket->unlock();
+        if (is_new) {
+            on_node_added();
+        }
     }
 
     /**
@@ -83,8 +109,30 @@ public:
      * @param value 
      */
     void insert_and_inc(const K& key, const V& value) {
-        size_t hash_val = hash_fn_(key) % hash_bucket_size_;
-        hash_table_[hash_val].insert_and_inc(key, value);
+        HashBucket<K, V>* bucket = lock_bucket(hash_fn_(key));
+        bool is_new = bucket->insert_and_inc(key, value);
+        bucket->unlock();
+        if (is_new) {
+            on_node_added();
+        }
+    }
+
+    /**
+     * @brief 在桶锁内对 key 对应的值执行 fn，键不存在时先插入一个默认构造的值
+     *        适合值较大、不便于构造临时对象再累加的场景，比如直方图
+     *
+     * @tparam Fn 形如 void(V&)
+     * @param key
+     * @param fn
+     */
+    template <typename Fn>
+    void update(const K& key, Fn fn) {
+        HashBucket<K, V>* bucket = lock_bucket(hash_fn_(key));
+        bool is_new = bucket->update(key, fn);
+        bucket->unlock();
+        if (is_new) {
+            on_node_added();
+        }
     }
 
     /**
@@ -93,18 +141,84 @@ public:
      * @param key 
      */
     void erase(const K& key) {
-        size_t hash_val = hash_fn_(key) % hash_bucket_size_;
-        hash_table_[hash_val].erase(key);
+        HashBucket<K, V>* bucket = lock_bucket(hash_fn_(key));
+        bool erased = bucket->erase(key);
+        bucket->unlock();
+        if (erased) {
+            size_.fetch_sub(1, std::memory_order_relaxed);
+        }
     }
 
     /**
      * @brief 清空哈希表
+     *        记录清空前的节点数量，作为 shrink 时的参考
      * 
      */
     void clear() {
-        for (size_t i = 0; i < hash_bucket_size_; ++i) {
-            hash_table_[i].clear();
+        last_size_ = size_.exchange(0, std::memory_order_relaxed);
+        HashTable<K, V>* table = table_.load(std::memory_order_acquire);
+        HashTable<K, V>* prev = table->prev.load(std::memory_order_acquire);
+        if (prev != nullptr) {
+            for (size_t i = 0; i < prev->size; ++i) {
+                prev->buckets[i].clear();
+            }
+        }
+        for (size_t i = 0; i < table->size; ++i) {
+            table->buckets[i].clear();
+        }
+    }
+
+    /**
+     * @brief 收缩哈希表，一般在 clear 之后调用
+     *        释放所有被替换的桶数组，如果当前桶数组相对于上一轮的节点数量过大，则换成较小的桶数组
+     *        注意：调用者需要保证没有其他线程同时访问此哈希表，fork 前的 lock_prefork 也算在内，
+     *        它会在另一个线程中遍历并锁住当前和被替换的桶数组，调用者需要与 fork 前的加锁互斥
+     *
+     */
+    void shrink() {
+        HashTable<K, V>* table = table_.load(std::memory_order_relaxed);
+        // 完成未结束的迁移
+        HashTable<K, V>* prev = table->prev.load(std::memory_order_relaxed);
+        if (prev != nullptr) {
+            for (size_t i = 0; i < prev->size; ++i) {
+                migrate_bucket(prev, i, table);
+            }
+            table->prev.store(nullptr, std::memory_order_relaxed);
+        }
+        free_retired_tables();
+        size_t target = initial_bucket_size_;
+        if (max_load_factor_ > 0) {
+            for (; target < last_size_ / max_load_factor_;) {
+                target = target * 2 + 1;
+            }
+        }
+        if (table->size <= target) {
+            return;
         }
+        HashTable<K, V>* small = new HashTable<K, V>(target);
+        for (size_t i = 0; i < table->size; ++i) {
+            migrate_bucket(table, i, small);
+        }
+        table_.store(small, std::memory_order_release);
+        delete table;
+    }
+
+    /**
+     * @brief 哈希表中节点的数量
+     *
+     * @return size_t
+     */
+    size_t size() const {
+        return size_.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief 当前桶的数量
+     *
+     * @return size_t
+     */
+    size_t bucket_size() const {
+        return table_.load(std::memory_order_acquire)->size;
     }
 
     /**
@@ -119,12 +233,17 @@ public:
 public:
     /**
      * @brief fork 调用创建子进程之前被执行，在父进程的上下文空间执行
+     *        先锁旧桶再锁新桶，与迁移时的加锁顺序一致
+     *        记录加锁时的桶数组，fork 之后解锁同一批桶
+     *        桶数组只会被 shrink 释放，调用者需要保证两者不会并发
      * 
      */
     void lock_prefork() {
-        for (size_t i = 0; i < hash_bucket_size_; ++i) {
-            hash_table_[i].lock_prefork();
-        }
+        fork_table_ = table_.load(std::memory_order_acquire);
+        fork_prev_ = fork_table_->prev.load(std::memory_order_acquire);
+        for_each_fork_bucket([](HashBucket<K, V>& bucket) {
+            bucket.lock_prefork();
+        });
     }
 
     /**
@@ -132,9 +251,11 @@ public:
      * 
      */
     void lock_postfork_parent() {
-        for (size_t i = 0; i < hash_bucket_size_; ++i) {
-            hash_table_[i].lock_postfork_parent();
-        }
+        for_each_fork_bucket([](HashBucket<K, V>& bucket) {
+            bucket.lock_postfork_parent();
+        });
+        fork_table_ = nullptr;
+        fork_prev_ = nullptr;
     }
 
     /**
@@ -142,24 +263,235 @@ public:
      * 
      */
     void lock_postfork_child() {
-        for (size_t i = 0; i < hash_bucket_size_; ++i) {
-            hash_table_[i].lock_postfork_child();
+        for_each_fork_bucket([](HashBucket<K, V>& bucket) {
+            bucket.lock_postfork_child();
+        });
+        fork_table_ = nullptr;
+        fork_prev_ = nullptr;
+    }
+
+    /**
+     * @brief 对节点分配器的仓库加锁，同一种节点的所有哈希表共用一个分配器
+     *        节点在桶锁内分配，必须在这种哈希表的所有桶都加锁之后调用：桶的锁 -> 仓库的锁
+     *        由哈希表的持有者在自己的 fork 处理函数中调用，每种节点只能调用一次
+     *
+     */
+    static void lock_allocator_prefork() {
+        SlabAllocator<HashNode<K, V>>::lock_prefork();
+    }
+
+    /**
+     * @brief 与 lock_allocator_prefork 对应，在解锁桶之前调用
+     *
+     */
+    static void lock_allocator_postfork_parent() {
+        SlabAllocator<HashNode<K, V>>::lock_postfork_parent();
+    }
+
+    /**
+     * @brief 与 lock_allocator_prefork 对应，在解锁桶之前调用
+     *
+     */
+    static void lock_allocator_postfork_child() {
+        SlabAllocator<HashNode<K, V>>::lock_postfork_child();
+    }
+
+private:
+    /**
+     * @brief 找到 key 当前所在的桶并加锁
+     *        迁移期间，旧桶还没有迁移则使用旧桶，否则使用新桶
+     *        加锁后发现桶已经被迁移走（桶数组被替换），重新查找
+     *
+     * @param hash_val
+     * @return HashBucket<K, V>* 已经加锁的桶
+     */
+    HashBucket<K, V>* lock_bucket(size_t hash_val) const {
+        for (;;) {
+            HashTable<K, V>* table = table_.load(std::memory_order_acquire);
+            HashTable<K, V>* prev = table->prev.load(std::memory_order_acquire);
+            if (prev != nullptr) {
+                help_rehash(table, prev);
+                HashBucket<K, V>* old_bucket = &prev->buckets[hash_val % prev->size];
+                old_bucket->lock();
+                if (!old_bucket->migrated_) {
+                    return old_bucket;
+                }
+                old_bucket->unlock();
+            }
+            HashBucket<K, V>* bucket = &table->buckets[hash_val % table->size];
+            bucket->lock();
+            if (__glibc_likely(!bucket->migrated_)) {
+                return bucket;
+            }
+            bucket->unlock();
+        }
+    }
+
+    /**
+     * @brief 顺带迁移几个旧桶，最后一个桶迁移完成后结束本轮扩容
+     *
+     * @param table
+     * @param prev
+     */
+    void help_rehash(HashTable<K, V>* table, HashTable<K, V>* prev) const {
+        for (size_t n = 0; n < HASH_REHASH_STEP; ++n) {
+            size_t pos = table->migrate_pos.fetch_add(1, std::memory_order_relaxed);
+            if (pos >= prev->size) {
+                return;
+            }
+            migrate_bucket(prev, pos, table);
+            if (table->migrated.fetch_add(1, std::memory_order_acq_rel) + 1 == prev->size) {
+                table->prev.store(nullptr, std::memory_order_release);
+            }
+        }
+    }
+
+    /**
+     * @brief 把旧桶中的节点全部移动到新的桶数组中，只移动指针，不重新分配节点
+     *
+     * @param from
+     * @param pos
+     * @param to
+     */
+    void migrate_bucket(HashTable<K, V>* from, size_t pos, HashTable<K, V>* to) const {
+        HashBucket<K, V>& old_bucket = from->buckets[pos];
+        old_bucket.lock();
+        HashNode<K, V>* node = old_bucket.head_;
+        for (; node != nullptr;) {
+            HashNode<K, V>* next = node->next_;
+            HashBucket<K, V>& bucket = to->buckets[hash_fn_(node->get_key()) % to->size];
+            bucket.lock();
+            node->next_ = bucket.head_;
+            bucket.head_ = node;
+            bucket.unlock();
+            node = next;
+        }
+        old_bucket.head_ = nullptr;
+        old_bucket.migrated_ = true;
+        old_bucket.unlock();
+    }
+
+    /**
+     * @brief 新增节点之后检查负载因子，超过时发布一个更大的桶数组开始渐进式迁移
+     *        上一轮迁移还没有结束时不会再次扩容
+     *
+     */
+    void on_node_added() {
+        size_t size = size_.fetch_add(1, std::memory_order_relaxed) + 1;
+        if (max_load_factor_ <= 0) {
+            return;
+        }
+        HashTable<K, V>* table = table_.load(std::memory_order_acquire);
+        if (__glibc_likely(size <= table->size * max_load_factor_)
+            || table->prev.load(std::memory_order_acquire) != nullptr) {
+            return;
+        }
+        HashTable<K, V>* bigger = new HashTable<K, V>(table->size * 2 + 1);
+        bigger->prev.store(table, std::memory_order_relaxed);
+        if (!table_.compare_exchange_strong(table, bigger, std::memory_order_acq_rel)) {
+            // 其他线程已经完成了扩容
+            delete bigger;
+            return;
+        }
+        // 旧桶数组可能还有其他线程在访问，放入回收链表，在 shrink 或者析构时释放
+        HashTable<K, V>* head = retired_.load(std::memory_order_relaxed);
+        do {
+            table->retired_next = head;
+        } while (!retired_.compare_exchange_weak(head, table, std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    /**
+     * @brief 释放所有被替换的桶数组，调用者需要保证没有其他线程访问
+     *
+     */
+    void free_retired_tables() {
+        HashTable<K, V>* table = retired_.exchange(nullptr, std::memory_order_acquire);
+        for (; table != nullptr;) {
+            HashTable<K, V>* next = table->retired_next;
+            delete table;
+            table = next;
+        }
+    }
+
+    /**
+     * @brief 遍历 fork 前记录的桶数组中所有的桶，先旧桶数组后新桶数组
+     *
+     * @tparam Fn
+     * @param fn
+     */
+    template <typename Fn>
+    void for_each_fork_bucket(Fn fn) {
+        // 在 fork 的准备阶段之后才创建的哈希表没有被加锁，跳过
+        if (fork_table_ == nullptr) {
+            return;
+        }
+        if (fork_prev_ != nullptr) {
+            for (size_t i = 0; i < fork_prev_->size; ++i) {
+                fn(fork_prev_->buckets[i]);
+            }
+        }
+        for (size_t i = 0; i < fork_table_->size; ++i) {
+            fn(fork_table_->buckets[i]);
         }
     }
 
 private:
-    // 哈希桶，以数组的形式实现
-    HashBucket<K, V>* hash_table_;
+    // 当前的桶数组
+    std::atomic<HashTable<K, V>*> table_;
+    // 被替换的桶数组的回收链表
+    std::atomic<HashTable<K, V>*> retired_ = ATOMIC_VAR_INIT(nullptr);
     // 哈希函数
     F hash_fn_;
-    // 哈希桶的个数
-    size_t hash_bucket_size_;
+    // 节点的数量
+    std::atomic<size_t> size_ = ATOMIC_VAR_INIT(0);
+    // 上一次 clear 前节点的数量
+    size_t last_size_ = 0;
+    // 初始的桶数量
+    size_t initial_bucket_size_;
+    // 最大负载因子
+    double max_load_factor_;
+    // fork 前加锁的桶数组
+    HashTable<K, V>* fork_table_ = nullptr;
+    HashTable<K, V>* fork_prev_ = nullptr;
     friend class ConstIterator<K, V, F>;
 };
 
+/**
+ * @brief 桶数组
+ *        扩容期间新的桶数组通过 prev 指向正在被迁移的旧桶数组
+ *
+ * @tparam K
+ * @tparam V
+ */
+template <typename K, typename V>
+struct HashTable {
+    explicit HashTable(size_t bucket_size) : size(bucket_size) {
+        buckets = new HashBucket<K, V>[bucket_size];
+    }
+    ~HashTable() {
+        delete[] buckets;
+    }
+    HashTable(const HashTable&) = delete;
+    HashTable& operator=(const HashTable&) = delete;
+
+    // 哈希桶，以数组的形式实现
+    HashBucket<K, V>* buckets;
+    // 哈希桶的个数
+    size_t size;
+    // 正在迁移到此桶数组的旧桶数组，迁移完成后置空
+    std::atomic<HashTable*> prev = ATOMIC_VAR_INIT(nullptr);
+    // 下一个待迁移的旧桶下标
+    std::atomic<size_t> migrate_pos = ATOMIC_VAR_INIT(0);
+    // 已经迁移完成的旧桶数量
+    std::atomic<size_t> migrated = ATOMIC_VAR_INIT(0);
+    // 回收链表中的下一个
+    HashTable* retired_next = nullptr;
+};
+
 /**
  * @brief 哈希桶的实现
  *        每个桶是以一个单链表的形式实现
+ *        除了 clear 之外，桶的操作都需要调用者先加锁，以便和迁移状态的检查放在同一个临界区中
  * 
  * @tparam K 
  * @tparam V 
@@ -177,6 +509,14 @@ public:
     HashBucket& operator=(HashBucket&&) = delete;
 
 public:
+    void lock() {
+        mtx_.lock();
+    }
+
+    void unlock() {
+        mtx_.unlock();
+    }
+
     /**
      * @brief 查找某个键值，返回 bool 值
      *        如果存在，则给 value 赋值
@@ -187,21 +527,14 @@ public:
      * @return false 
      */
     bool find(const K& key, V& value) {
-        // 加读锁
-        // rw_spin_lock_.read_lock();
-        mtx_.lock();
         HashNode<K, V>* node = head_;
         for (; node != nullptr;) {
             if (node->get_key() == key) {
                 value = node->get_value();
-                // rw_spin_lock_.read_unlock();
-                mtx_.unlock();
                 return true;
             }
             node = node->next_;
         }
-        // rw_spin_lock_.read_unlock();
-        mtx_.unlock();
         return false;
     }
 
@@ -210,11 +543,10 @@ public:
      * 
      * @param key 
      * @param value 
+     * @return true 新增了节点
+     * @return false 键已经存在，修改了值
      */
-    void insert(const K& key, const V& value) {
-        // 加写锁
-        // rw_spin_lock_.write_lock();
-        mtx_.lock();
+    bool insert(const K& key, const V& value) {
         HashNode<K, V>* prev = nullptr, *node = head_;
         for (; node != nullptr && node->get_key() != key;) {
             prev = node;
@@ -229,12 +561,11 @@ public:
             } else {
                 prev->next_ = new HashNode<K, V>(key, value);
             }
-        } else {
-            // 桶中存在 key，直接修改
-            node->set_value(value);
+            return true;
         }
-        // rw_spin_lock_.write_unlock();
-        mtx_.unlock();
+        // 桶中存在 key，直接修改
+        node->set_value(value);
+        return false;
     }
 
     /**
@@ -242,11 +573,10 @@ public:
      * 
      * @param key 
      * @param value 
+     * @return true 新增了节点
+     * @return false 键已经存在，增加了值
      */
-    void insert_and_inc(const K& key, const V& value) {
-        // 加写锁
-        // rw_spin_lock_.write_lock();
-        mtx_.lock();
+    bool insert_and_inc(const K& key, const V& value) {
         HashNode<K, V>* prev = nullptr, *node = head_;
         for (; node != nullptr && node->get_key() != key;) {
             prev = node;
@@ -261,23 +591,50 @@ public:
             } else {
                 prev->next_ = new HashNode<K, V>(key, value);
             }
-        } else {
-            // 桶中存在 key，给他增加
-            node->get_value() += value;
+            return true;
         }
-        // rw_spin_lock_.write_unlock();
-        mtx_.unlock();
+        // 桶中存在 key，给他增加
+        node->get_value() += value;
+        return false;
+    }
+
+    /**
+     * @brief 对键对应的值执行 fn，如果键不存在，先插入一个默认构造的值
+     *
+     * @tparam Fn
+     * @param key
+     * @param fn
+     * @return true 新增了节点
+     * @return false 键已经存在
+     */
+    template <typename Fn>
+    bool update(const K& key, Fn& fn) {
+        HashNode<K, V>* prev = nullptr, *node = head_;
+        for (; node != nullptr && node->get_key() != key;) {
+            prev = node;
+            node = node->next_;
+        }
+        bool is_new = (node == nullptr);
+        if (is_new) {
+            node = new HashNode<K, V>(key);
+            if (head_ == nullptr) {
+                head_ = node;
+            } else {
+                prev->next_ = node;
+            }
+        }
+        fn(node->get_value());
+        return is_new;
     }
 
     /**
      * @brief 删除某个键值
      * 
      * @param key 
+     * @return true 删除了节点
+     * @return false 键不存在
      */
-    void erase(const K& key) {
-        // 加写锁
-        // rw_spin_lock_.write_lock();
-        mtx_.lock();
+    bool erase(const K& key) {
         HashNode<K, V>* prev = nullptr, *node = head_;
         for (; node != nullptr && node->get_key() != key;) {
             prev = node;
@@ -285,40 +642,30 @@ public:
         }
         // key 没有找到，直接返回
         if (node == nullptr) {
-            // rw_spin_lock_.write_unlock();
-            mtx_.unlock();
-            return;
+            return false;
+        }
+        // 找到 key，分情况处理
+        // 1. 如果此节点是头节点 2. 如果此节点不是头节点
+        if (head_ == node) {
+            head_ = node->next_;
         } else {
-            // 找到 key，分情况处理
-            // 1. 如果此节点是头节点 2. 如果此节点不是头节点
-            if (head_ == node) {
-                head_ = node->next_;
-            } else {
-                prev->next_ = node->next_;
-            }
-            delete node;
+            prev->next_ = node->next_;
         }
-        // rw_spin_lock_.write_unlock();
-        mtx_.unlock();
+        delete node;
+        return true;
     }
 
     /**
-     * @brief 清理桶中所有元素
+     * @brief 清理桶中所有元素，内部加锁
+     *        只在锁内摘下整条链表，节点在锁外析构，并一次性归还给分配器
      * 
      */
     void clear() {
-        // 加写锁
-        // rw_spin_lock_.write_lock();
         mtx_.lock();
-        HashNode<K, V>* prev = nullptr, *node = head_;
-        for (; node != nullptr;) {
-            prev = node;
-            node = node->next_;
-            delete prev;
-        }
+        HashNode<K, V>* node = head_;
         head_ = nullptr;
-        // rw_spin_lock_.write_unlock();
         mtx_.unlock();
+        HashNode<K, V>::destroy_list(node);
     }
 
 public:
@@ -332,7 +679,6 @@ public:
      * 避免多线程遇到多进程时锁
      */
     void lock_prefork() {
-        // rw_spin_lock_.write_lock();
         mtx_.lock();
     }
 
@@ -341,7 +687,6 @@ public:
      * 
      */
     void lock_postfork_parent() {
-        // rw_spin_lock_.write_unlock();
         mtx_.unlock();
     }
 
@@ -350,19 +695,16 @@ public:
      * 
      */
     void lock_postfork_child() {
-        // rw_spin_lock_.write_unlock();
         mtx_.unlock();
     }
 
 public:
     // 桶中单链表的头节点
     HashNode<K, V>* head_ = nullptr;
+    // 桶中的节点是否已经迁移到新的桶数组，迁移后此桶不再使用
+    bool migrated_ = false;
 
 private:
-    // 自旋读写锁
-    // 这里替换掉 pthread_rwlock_t 系统提供的读写锁
-    // 原因是系统读写锁性能不佳，自旋时不释放 CPU，CPU 占有会冲高
-    // RWSpinLock rw_spin_lock_;
     std::mutex mtx_;
 };
 
@@ -377,6 +719,7 @@ class HashNode {
 public:
     HashNode() = default;
     HashNode(K key, V value) : key_(key), value_(value) {}
+    explicit HashNode(K key) : key_(key), value_() {}
     ~HashNode() {
         next_ = nullptr;
     }
@@ -385,6 +728,53 @@ public:
     HashNode(HashNode&&) = delete;
     HashNode& operator=(HashNode&&) = delete;
 
+public:
+    /**
+     * @brief 节点的内存由 slab 分配器管理，不经过宿主进程的 malloc
+     *
+     * @param size
+     * @return void*
+     */
+    static void* operator new(size_t) {
+        void* ptr = SlabAllocator<HashNode>::allocate();
+        if (__glibc_unlikely(ptr == nullptr)) {
+            throw std::bad_alloc();
+        }
+        return ptr;
+    }
+
+    static void operator delete(void* ptr) {
+        if (ptr != nullptr) {
+            SlabAllocator<HashNode>::deallocate(ptr);
+        }
+    }
+
+    /**
+     * @brief 析构一整条链表，并一次性归还给分配器
+     *
+     * @param head
+     */
+    static void destroy_list(HashNode* head) {
+        typedef typename SlabAllocator<HashNode>::FreeNode FreeNode;
+        FreeNode* free_head = nullptr;
+        FreeNode* free_tail = nullptr;
+        size_t count = 0;
+        for (; head != nullptr; ++count) {
+            HashNode* next = head->next_;
+            head->~HashNode();
+            FreeNode* free_node = reinterpret_cast<FreeNode*>(head);
+            free_node->next = nullptr;
+            if (free_tail == nullptr) {
+                free_head = free_node;
+            } else {
+                free_tail->next = free_node;
+            }
+            free_tail = free_node;
+            head = next;
+        }
+        SlabAllocator<HashNode>::deallocate_list(free_head, free_tail, count);
+    }
+
 public:
     /**
      * @brief 获取节点的键
@@ -449,15 +839,15 @@ class ConstIterator {
 public:
     ConstIterator() = delete;
     ~ConstIterator() = default;
-    explicit ConstIterator(ConcurrentHashMap<K, V, F>* cmp) : cmp_(cmp) {
-        for (; hash_node_ == nullptr && bucket_pos_ < cmp_->hash_bucket_size_;) {
-            HashNode<K, V>* node = cmp_->hash_table_[bucket_pos_].head_;
-            if (node != nullptr) {
-                hash_node_ = node;
-                break;
-            }
-            if (++bucket_pos_ >= cmp_->hash_bucket_size_) break;
+    explicit ConstIterator(ConcurrentHashMap<K, V, F>* cmp) {
+        // 迁移期间先遍历旧桶数组中还没有迁移的桶，再遍历新桶数组
+        HashTable<K, V>* table = cmp->table_.load(std::memory_order_acquire);
+        HashTable<K, V>* prev = table->prev.load(std::memory_order_acquire);
+        if (prev != nullptr) {
+            tables_[table_count_++] = prev;
         }
+        tables_[table_count_++] = table;
+        seek_bucket();
     }
     // 拷贝函数使用浅拷贝是没有问题的
     ConstIterator(const ConstIterator&) = default;
@@ -531,15 +921,9 @@ public:
             return *this;
         }
         // 如果 hash_node 是当前桶中最后一个元素，寻找下一个桶的非空头节点
-        ++bucket_pos_;
-        for (; bucket_pos_ < cmp_->hash_bucket_size_; ++bucket_pos_) {
-            HashNode<K, V>* node = cmp_->hash_table_[bucket_pos_].head_;
-            if (node != nullptr) {
-                hash_node_ = node;
-                return *this;
-            }
-        }
         hash_node_ = nullptr;
+        ++bucket_pos_;
+        seek_bucket();
         return *this;
     }
 
@@ -553,8 +937,29 @@ public:
     }
 
 private:
-    // hash map 的指针
-    ConcurrentHashMap<K, V, F>* cmp_;
+    /**
+     * @brief 从当前位置开始寻找下一个非空桶的头节点
+     *
+     */
+    void seek_bucket() {
+        for (; table_pos_ < table_count_; ++table_pos_, bucket_pos_ = 0) {
+            HashTable<K, V>* table = tables_[table_pos_];
+            for (; bucket_pos_ < table->size; ++bucket_pos_) {
+                HashNode<K, V>* node = table->buckets[bucket_pos_].head_;
+                if (node != nullptr) {
+                    hash_node_ = node;
+                    return;
+                }
+            }
+        }
+    }
+
+private:
+    // 需要遍历的桶数组，迁移期间有两个
+    HashTable<K, V>* tables_[2] = {nullptr, nullptr};
+    size_t table_count_ = 0;
+    // 当前处于那个桶数组
+    size_t table_pos_ = 0;
     // 当前处于那个 bucket 位置
     uint64_t bucket_pos_ = 0;
     // 当前指向的 node
@@ -0,0 +1,169 @@
+/**
+ * @file fd_table.h
+ * @author noahyzhang
+ * @brief
+ * @version 0.1
+ * @date 2023-04-18
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#pragma once
+
+#include <sys/resource.h>
+#include <stdint.h>
+#include <atomic>
+
+namespace file_io_hook {
+
+// 每个分块中 fd 的数量为 2^FD_TABLE_CHUNK_SHIFT
+#define FD_TABLE_CHUNK_SHIFT (10)
+#define FD_TABLE_CHUNK_SIZE (1 << FD_TABLE_CHUNK_SHIFT)
+#define FD_TABLE_CHUNK_MASK (FD_TABLE_CHUNK_SIZE - 1)
+// RLIMIT_NOFILE 为无限制时，fd 表能容纳的最大 fd
+#define FD_TABLE_MAX_FD (1 << 24)
+
+/**
+ * @brief 以 fd 为下标直接索引的表
+ *  文件描述符是较小且稠密的整数，因此用数组代替哈希表，查找不需要计算哈希，也不需要加锁
+ *  数组按块分配，第一次写入某个块中的 fd 时才分配这个块，上限为 RLIMIT_NOFILE 的硬限制
+ *  块一旦分配就不再释放，因此查找只需要两次原子读：块指针和块中的元素
+ *  也可以指定上限，以其他从 0 开始的稠密整数（比如文件 id）为下标
+ *
+ * @tparam T 表中的元素，需要可以默认构造，并发访问的字段需要是原子变量
+ */
+template <typename T>
+class FdTable {
+public:
+    FdTable() {
+        struct rlimit limit;
+        uint64_t max_fd = FD_TABLE_MAX_FD;
+        if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_max != RLIM_INFINITY
+            && limit.rlim_max < FD_TABLE_MAX_FD) {
+            max_fd = limit.rlim_max;
+        }
+        init(max_fd);
+    }
+
+    /**
+     * @brief 指定下标的上限（不包含），向上取整到块的大小
+     *
+     * @param max_index
+     */
+    explicit FdTable(uint64_t max_index) {
+        init(max_index);
+    }
+    ~FdTable() {
+        for (size_t i = 0; i < chunk_count_; ++i) {
+            delete[] chunks_[i].load(std::memory_order_relaxed);
+        }
+        delete[] chunks_;
+    }
+    FdTable(const FdTable&) = delete;
+    FdTable& operator=(const FdTable&) = delete;
+    FdTable(FdTable&&) = delete;
+    FdTable& operator=(FdTable&&) = delete;
+
+private:
+    void init(uint64_t max_fd) {
+        chunk_count_ = (max_fd + FD_TABLE_CHUNK_SIZE - 1) >> FD_TABLE_CHUNK_SHIFT;
+        if (chunk_count_ == 0) {
+            chunk_count_ = 1;
+        }
+        max_fd_ = chunk_count_ << FD_TABLE_CHUNK_SHIFT;
+        chunks_ = new std::atomic<T*>[chunk_count_];
+        for (size_t i = 0; i < chunk_count_; ++i) {
+            chunks_[i].store(nullptr, std::memory_order_relaxed);
+        }
+    }
+
+public:
+    /**
+     * @brief 查找 fd 对应的元素，不分配内存
+     *  fd 超出范围或者所在的块还没有分配时返回 nullptr
+     *
+     * @param fd
+     * @return T*
+     */
+    T* find(int fd) const {
+        if (__glibc_unlikely(fd < 0 || static_cast<uint64_t>(fd) >= max_fd_)) {
+            return nullptr;
+        }
+        T* chunk = chunks_[fd >> FD_TABLE_CHUNK_SHIFT].load(std::memory_order_acquire);
+        if (__glibc_unlikely(chunk == nullptr)) {
+            return nullptr;
+        }
+        return &chunk[fd & FD_TABLE_CHUNK_MASK];
+    }
+
+    /**
+     * @brief 获取 fd 对应的元素，所在的块不存在时分配
+     *  多个线程同时分配同一个块时，只有一个线程的块会被发布
+     *
+     * @param fd
+     * @return T* fd 超出范围时返回 nullptr
+     */
+    T* get_or_create(int fd) {
+        if (__glibc_unlikely(fd < 0 || static_cast<uint64_t>(fd) >= max_fd_)) {
+            return nullptr;
+        }
+        std::atomic<T*>& slot = chunks_[fd >> FD_TABLE_CHUNK_SHIFT];
+        T* chunk = slot.load(std::memory_order_acquire);
+        if (chunk == nullptr) {
+            T* new_chunk = new T[FD_TABLE_CHUNK_SIZE]();
+            if (slot.compare_exchange_strong(chunk, new_chunk, std::memory_order_acq_rel)) {
+                chunk = new_chunk;
+            } else {
+                delete[] new_chunk;
+            }
+        }
+        return &chunk[fd & FD_TABLE_CHUNK_MASK];
+    }
+
+    /**
+     * @brief 对 [first, last] 范围内的元素执行 fn，跳过没有分配的块
+     *  用于 close_range 等批量关闭，代价与范围内已分配的块成正比
+     *
+     * @tparam Fn 形如 void(int fd, T& value)
+     * @param first
+     * @param last 包含，超出上限时截断
+     * @param fn
+     */
+    template <typename Fn>
+    void for_each_in_range(uint64_t first, uint64_t last, Fn fn) {
+        if (last >= max_fd_) {
+            last = max_fd_ - 1;
+        }
+        uint64_t fd = first;
+        while (fd <= last) {
+            uint64_t chunk_end = (fd | FD_TABLE_CHUNK_MASK) < last ? (fd | FD_TABLE_CHUNK_MASK) : last;
+            T* chunk = chunks_[fd >> FD_TABLE_CHUNK_SHIFT].load(std::memory_order_acquire);
+            if (chunk != nullptr) {
+                for (; fd <= chunk_end; ++fd) {
+                    fn(static_cast<int>(fd), chunk[fd & FD_TABLE_CHUNK_MASK]);
+                }
+            }
+            fd = chunk_end + 1;
+        }
+    }
+
+    /**
+     * @brief fd 表能容纳的 fd 上限（不包含）
+     *
+     * @return uint64_t
+     */
+    uint64_t max_fd() const {
+        return max_fd_;
+    }
+
+private:
+    // 块指针数组，长度为 chunk_count_
+    std::atomic<T*>* chunks_ = nullptr;
+    // 块的数量
+    uint64_t chunk_count_ = 0;
+    // 能容纳的 fd 上限
+    uint64_t max_fd_ = 0;
+};
+
+}  // namespace file_io_hook
@@ -0,0 +1,473 @@
+/**
+ * @file lock_free_hash_map.h
+ * @author noahyzhang
+ * @brief
+ * @version 0.1
+ * @date 2023-04-18
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <functional>
+#include <type_traits>
+
+namespace file_io_hook {
+
+// 默认的槽位数量，会向上取整为 2 的幂
+#define DEFAULT_LOCK_FREE_HASH_CAPACITY (4096)
+
+template <typename K, typename V, typename F> class LockFreeConstIterator;
+
+/**
+ * @brief 无锁的哈希表，接口与 ConcurrentHashMap 一致
+ *        以开放寻址（线性探测）作为实现，槽位通过 CAS 认领，不分配节点
+ *        值按 64 位整数逐个字段原子累加，因此 insert_and_inc 不需要加锁
+ *
+ *  限制：
+ *  1. K 和 V 需要是可以按位拷贝的 POD 类型，V 的每个字段都是 uint64_t 计数（比如 FileRWInfo）
+ *  2. 容量固定，槽位用尽之后新的 key 会被丢弃，并计入 overflow_num
+ *  3. 被删除的槽位成为墓碑，只有同一个 key 再次插入时才会复用，clear 时全部回收
+ *     槽位中的 key 在第一次认领之后不再改变，墓碑复活只需要一次 state 上的 CAS（SLOT_DELETED -> SLOT_READY），
+ *     值在删除时清零，复活时不再写入，并发复活同一个墓碑的线程中只有一个成功，其余的线程直接使用复活后的槽位
+ *  4. clear 和迭代器不能与写操作并发，需要由使用者保证，比如 DoubleBallModule 中只在快照上调用
+ *
+ * @tparam K 哈希表的键
+ * @tparam V 哈希表的值
+ * @tparam F 哈希函数，默认使用 stl 提供的哈希函数
+ */
+template <typename K, typename V, typename F = std::hash<K>>
+class LockFreeHashMap {
+    static_assert(std::is_trivially_copyable<K>::value, "key of LockFreeHashMap must be trivially copyable");
+    static_assert(std::is_trivially_copyable<V>::value, "value of LockFreeHashMap must be trivially copyable");
+    static_assert(sizeof(V) % sizeof(uint64_t) == 0, "value of LockFreeHashMap must consist of uint64_t fields");
+
+public:
+    explicit LockFreeHashMap(size_t capacity = DEFAULT_LOCK_FREE_HASH_CAPACITY) {
+        capacity_ = 1;
+        for (; capacity_ < capacity;) {
+            capacity_ <<= 1;
+        }
+        mask_ = capacity_ - 1;
+        slots_ = new Slot[capacity_];
+    }
+    ~LockFreeHashMap() {
+        delete[] slots_;
+    }
+    LockFreeHashMap(const LockFreeHashMap&) = delete;
+    LockFreeHashMap& operator=(const LockFreeHashMap&) = delete;
+    LockFreeHashMap(LockFreeHashMap&&) = delete;
+    LockFreeHashMap& operator=(LockFreeHashMap&&) = delete;
+
+public:
+    /**
+     * @brief 查找哈希表中是否有 key，返回 bool 值
+     *        如果存在的话，则给 value 赋值
+     *        注意：value 的各个字段是分别读取的，与并发的 insert_and_inc 之间不保证整体一致
+     * @param key
+     * @param value
+     * @return true
+     * @return false
+     */
+    bool find(const K& key, V& value) const {
+        const Slot* slot = lookup(key);
+        if (slot == nullptr || slot->state.load(std::memory_order_acquire) != SLOT_READY) {
+            return false;
+        }
+        slot->load(value);
+        return true;
+    }
+
+    /**
+     * @brief 插入一对键值，键存在时覆盖
+     *
+     * @param key
+     * @param value
+     */
+    void insert(const K& key, const V& value) {
+        Slot* slot = claim(key);
+        if (slot == nullptr) return;
+        slot->store(value);
+    }
+
+    /**
+     * @brief 插入一对键值，如果键存在，则增加值
+     *
+     * @param key
+     * @param value
+     */
+    void insert_and_inc(const K& key, const V& value) {
+        Slot* slot = claim(key);
+        if (slot == nullptr) return;
+        slot->add(value);
+    }
+
+    /**
+     * @brief 删除某个键，槽位成为墓碑
+     *        清零期间槽位处于 SLOT_BUSY，复活时看到的值一定为 0
+     *        注意：与删除并发的 insert_and_inc 可能丢失，也可能累加到复活后的值上
+     *
+     * @param key
+     */
+    void erase(const K& key) {
+        Slot* slot = const_cast<Slot*>(lookup(key));
+        if (slot == nullptr) return;
+        uint32_t expected = SLOT_READY;
+        if (slot->state.compare_exchange_strong(expected, SLOT_BUSY, std::memory_order_acquire)) {
+            V zero;
+            memset(&zero, 0, sizeof(V));
+            slot->store(zero);
+            slot->state.store(SLOT_DELETED, std::memory_order_release);
+            size_.fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * @brief 清空哈希表，不能与其他操作并发
+     *
+     */
+    void clear() {
+        if (used_.load(std::memory_order_relaxed) == 0) {
+            return;
+        }
+        for (size_t i = 0; i < capacity_; ++i) {
+            slots_[i].reset();
+        }
+        used_.store(0, std::memory_order_relaxed);
+        size_.store(0, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief 容量固定，无需收缩，保持与 ConcurrentHashMap 一致的接口
+     *
+     */
+    void shrink() {}
+
+    /**
+     * @brief 获取迭代器
+     *
+     * @return LockFreeConstIterator
+     */
+    LockFreeConstIterator<K, V, F> get_iterator() {
+        return LockFreeConstIterator<K, V, F>(this);
+    }
+
+    /**
+     * @brief 哈希表中键的数量
+     *
+     * @return size_t
+     */
+    size_t size() const {
+        return size_.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief 因为槽位用尽而被丢弃的插入次数
+     *
+     * @return uint64_t
+     */
+    uint64_t overflow_num() const {
+        return overflow_num_.load(std::memory_order_relaxed);
+    }
+
+public:
+    /**
+     * @brief 没有锁，fork 前后无需处理，保持与 ConcurrentHashMap 一致的接口
+     *
+     */
+    void lock_prefork() {}
+    void lock_postfork_parent() {}
+    void lock_postfork_child() {}
+    static void lock_allocator_prefork() {}
+    static void lock_allocator_postfork_parent() {}
+    static void lock_allocator_postfork_child() {}
+
+private:
+    enum SlotState {
+        SLOT_EMPTY = 0,
+        // 正在写入 key 或者删除时正在清零，其他线程需要等待它变为 SLOT_READY 或 SLOT_DELETED
+        SLOT_BUSY,
+        SLOT_READY,
+        SLOT_DELETED
+    };
+
+    static const size_t VALUE_WORDS = sizeof(V) / sizeof(uint64_t);
+
+    /**
+     * @brief 槽位，值按 64 位整数拆分存储
+     *
+     */
+    struct Slot {
+        std::atomic<uint32_t> state;
+        K key;
+        std::atomic<uint64_t> words[VALUE_WORDS];
+
+        Slot() {
+            reset();
+        }
+
+        void reset() {
+            state.store(SLOT_EMPTY, std::memory_order_relaxed);
+            for (size_t i = 0; i < VALUE_WORDS; ++i) {
+                words[i].store(0, std::memory_order_relaxed);
+            }
+        }
+
+        void load(V& value) const {
+            uint64_t buf[VALUE_WORDS];
+            for (size_t i = 0; i < VALUE_WORDS; ++i) {
+                buf[i] = words[i].load(std::memory_order_relaxed);
+            }
+            memcpy(&value, buf, sizeof(V));
+        }
+
+        void store(const V& value) {
+            uint64_t buf[VALUE_WORDS];
+            memcpy(buf, &value, sizeof(V));
+            for (size_t i = 0; i < VALUE_WORDS; ++i) {
+                words[i].store(buf[i], std::memory_order_relaxed);
+            }
+        }
+
+        void add(const V& value) {
+            uint64_t buf[VALUE_WORDS];
+            memcpy(buf, &value, sizeof(V));
+            for (size_t i = 0; i < VALUE_WORDS; ++i) {
+                if (buf[i] != 0) {
+                    words[i].fetch_add(buf[i], std::memory_order_relaxed);
+                }
+            }
+        }
+    };
+
+    /**
+     * @brief 自旋等待时让出流水线，降低对同一缓存行的争抢
+     *
+     */
+    static void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#elif defined(__aarch64__)
+        __asm__ __volatile__("yield" ::: "memory");
+#endif
+    }
+
+    /**
+     * @brief 等待槽位中的 key 写入完成，返回槽位的状态
+     *
+     * @param slot
+     * @return uint32_t
+     */
+    static uint32_t wait_ready(const Slot* slot) {
+        uint32_t state = slot->state.load(std::memory_order_acquire);
+        for (; state == SLOT_BUSY;) {
+            cpu_relax();
+            state = slot->state.load(std::memory_order_acquire);
+        }
+        return state;
+    }
+
+    /**
+     * @brief 查找 key 所在的槽位，包括墓碑
+     *
+     * @param key
+     * @return const Slot* 不存在时返回 nullptr
+     */
+    const Slot* lookup(const K& key) const {
+        size_t pos = hash_fn_(key) & mask_;
+        for (size_t i = 0; i < capacity_; ++i, pos = (pos + 1) & mask_) {
+            const Slot* slot = &slots_[pos];
+            uint32_t state = wait_ready(slot);
+            if (state == SLOT_EMPTY) {
+                return nullptr;
+            }
+            if (slot->key == key) {
+                return slot;
+            }
+        }
+        return nullptr;
+    }
+
+    /**
+     * @brief 查找 key 所在的槽位，不存在时通过 CAS 认领一个空槽位
+     *
+     * @param key
+     * @return Slot* 槽位用尽时返回 nullptr
+     */
+    Slot* claim(const K& key) {
+        size_t pos = hash_fn_(key) & mask_;
+        for (size_t i = 0; i < capacity_; ++i, pos = (pos + 1) & mask_) {
+            Slot* slot = &slots_[pos];
+            uint32_t state = wait_ready(slot);
+            if (state == SLOT_EMPTY) {
+                if (slot->state.compare_exchange_strong(state, SLOT_BUSY, std::memory_order_acquire)) {
+                    slot->key = key;
+                    slot->state.store(SLOT_READY, std::memory_order_release);
+                    used_.fetch_add(1, std::memory_order_relaxed);
+                    size_.fetch_add(1, std::memory_order_relaxed);
+                    return slot;
+                }
+                // 被其他线程抢先认领，重新检查这个槽位
+                state = wait_ready(slot);
+            }
+            if (!(slot->key == key)) {
+                continue;
+            }
+            // 复用同一个 key 的墓碑，值已经在删除时清零
+            for (; state != SLOT_READY;) {
+                if (state == SLOT_DELETED
+                    && slot->state.compare_exchange_weak(state, SLOT_READY, std::memory_order_acq_rel)) {
+                    size_.fetch_add(1, std::memory_order_relaxed);
+                    break;
+                }
+                // 被其他线程抢先复活，或者正在被删除
+                cpu_relax();
+                state = wait_ready(slot);
+            }
+            return slot;
+        }
+        overflow_num_.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+private:
+    // 槽位数组，长度为 capacity_
+    Slot* slots_ = nullptr;
+    size_t capacity_ = 0;
+    size_t mask_ = 0;
+    // 哈希函数
+    F hash_fn_;
+    // 被使用过的槽位数量（包括墓碑）
+    std::atomic<size_t> used_ = ATOMIC_VAR_INIT(0);
+    // 键的数量
+    std::atomic<size_t> size_ = ATOMIC_VAR_INIT(0);
+    // 因为槽位用尽而被丢弃的插入次数
+    std::atomic<uint64_t> overflow_num_ = ATOMIC_VAR_INIT(0);
+    friend class LockFreeConstIterator<K, V, F>;
+};
+
+/**
+ * @brief 迭代器中的节点，保存槽位中键值的拷贝
+ *        提供与 HashNode 一致的 get_key/get_value 接口
+ *
+ * @tparam K
+ * @tparam V
+ */
+template <typename K, typename V>
+struct LockFreeHashNode {
+    K key;
+    V value;
+
+    const K& get_key() const {
+        return key;
+    }
+
+    const V& get_value() const {
+        return value;
+    }
+};
+
+/**
+ * @brief 迭代器，接口与 ConstIterator 一致
+ *  注意：此迭代器非线程安全，特别注意
+ * @tparam K
+ * @tparam V
+ * @tparam F
+ */
+template <typename K, typename V, typename F>
+class LockFreeConstIterator {
+public:
+    LockFreeConstIterator() = delete;
+    ~LockFreeConstIterator() = default;
+    explicit LockFreeConstIterator(LockFreeHashMap<K, V, F>* map) : map_(map) {
+        seek(0);
+    }
+    LockFreeConstIterator(const LockFreeConstIterator&) = default;
+    LockFreeConstIterator& operator=(const LockFreeConstIterator&) = default;
+    LockFreeConstIterator(LockFreeConstIterator&&) = default;
+    LockFreeConstIterator& operator=(LockFreeConstIterator&&) = default;
+
+public:
+    /**
+     * @brief 运算符 == 重载
+     *  比较是否指向同一个槽位
+     * @param other
+     * @return true
+     * @return false
+     */
+    bool operator==(const LockFreeConstIterator& other) const {
+        return map_ == other.map_ && pos_ == other.pos_;
+    }
+
+    /**
+     * @brief 运算符 == 重载
+     *  与 nullptr 比较时判断是否已经遍历结束
+     * @param point
+     * @return true
+     * @return false
+     */
+    bool operator==(void* point) const {
+        return (pos_ >= map_->capacity_ ? nullptr : const_cast<LockFreeHashNode<K, V>*>(&node_)) == point;
+    }
+
+    bool operator!=(const LockFreeConstIterator& other) const {
+        return !LockFreeConstIterator::operator==(other);
+    }
+
+    bool operator!=(void* point) const {
+        return !LockFreeConstIterator::operator==(point);
+    }
+
+    /**
+     * @brief 运算符 ++ 重载
+     *
+     * @return LockFreeConstIterator&
+     */
+    LockFreeConstIterator& operator++(int) {
+        if (pos_ < map_->capacity_) {
+            seek(pos_ + 1);
+        }
+        return *this;
+    }
+
+    /**
+     * @brief 运算符 -> 重载
+     *  返回当前键值的拷贝
+     * @return const LockFreeHashNode<K, V>*
+     */
+    const LockFreeHashNode<K, V>* operator->() const {
+        return &node_;
+    }
+
+private:
+    /**
+     * @brief 从 pos 开始寻找下一个有效的槽位
+     *
+     * @param pos
+     */
+    void seek(size_t pos) {
+        for (pos_ = pos; pos_ < map_->capacity_; ++pos_) {
+            const auto& slot = map_->slots_[pos_];
+            if (slot.state.load(std::memory_order_acquire) == LockFreeHashMap<K, V, F>::SLOT_READY) {
+                node_.key = slot.key;
+                slot.load(node_.value);
+                return;
+            }
+        }
+    }
+
+private:
+    // hash map 的指针
+    LockFreeHashMap<K, V, F>* map_;
+    // 当前所在的槽位
+    size_t pos_ = 0;
+    // 当前槽位中键值的拷贝
+    LockFreeHashNode<K, V> node_;
+};
+
+}  // namespace file_io_hook
@@ -0,0 +1,162 @@
+/**
+ * @file log_linear_histogram.h
+ * @author noahyzhang
+ * @brief
+ * @version 0.1
+ * @date 2023-04-18
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+namespace file_io_hook {
+
+// 每个 2 的幂区间内线性划分的子桶数量为 2^HISTOGRAM_SUB_BUCKET_BITS，相对误差不超过 1/8
+#define HISTOGRAM_SUB_BUCKET_BITS (3)
+#define HISTOGRAM_SUB_BUCKET_COUNT (1 << HISTOGRAM_SUB_BUCKET_BITS)
+// 能区分的值的上界为 2^HISTOGRAM_MAX_EXPONENT，不小于它的值都计入最后一个桶（纳秒时约为 68 秒）
+#define HISTOGRAM_MAX_EXPONENT (36)
+// 桶的数量：小于 2^(SUB_BITS+1) 的值每个值一个桶，之后每个 2 的幂区间 SUB_BUCKET_COUNT 个桶
+#define HISTOGRAM_BUCKET_COUNT \
+    ((HISTOGRAM_MAX_EXPONENT - HISTOGRAM_SUB_BUCKET_BITS + 1) * HISTOGRAM_SUB_BUCKET_COUNT)
+
+/**
+ * @brief 对数线性直方图（HDR 风格）
+ *  值域按 2 的幂分段，每段再线性划分为若干子桶，因此任意量级的值相对误差都有上界
+ *  大小固定，记录时只有几次位运算和一次加法，不分配内存，可以直接作为哈希表的值
+ *  多个直方图可以直接按桶相加合并，用于汇总不同线程的数据
+ */
+class LogLinearHistogram {
+public:
+    LogLinearHistogram() {
+        reset();
+    }
+
+public:
+    /**
+     * @brief 记录一个值
+     *
+     * @param value
+     * @param count 这个值出现的次数
+     */
+    void record(uint64_t value, uint64_t count = 1) {
+        counts_[bucket_index(value)] += count;
+        total_ += count;
+        if (value > max_) {
+            max_ = value;
+        }
+    }
+
+    /**
+     * @brief 合并另一个直方图
+     *
+     * @param other
+     */
+    void merge(const LogLinearHistogram& other) {
+        for (size_t i = 0; i < HISTOGRAM_BUCKET_COUNT; ++i) {
+            counts_[i] += other.counts_[i];
+        }
+        total_ += other.total_;
+        if (other.max_ > max_) {
+            max_ = other.max_;
+        }
+    }
+
+    /**
+     * @brief 获取分位数对应的值，返回所在桶的上界，不超过记录过的最大值
+     *
+     * @param quantile 取值范围 [0, 1]，比如 0.99
+     * @return uint64_t 没有记录时返回 0
+     */
+    uint64_t percentile(double quantile) const {
+        if (total_ == 0) {
+            return 0;
+        }
+        uint64_t rank = static_cast<uint64_t>(quantile * total_ + 0.5);
+        if (rank == 0) {
+            rank = 1;
+        }
+        uint64_t seen = 0;
+        for (size_t i = 0; i < HISTOGRAM_BUCKET_COUNT; ++i) {
+            seen += counts_[i];
+            if (seen >= rank) {
+                uint64_t upper = bucket_upper_bound(i);
+                return upper < max_ ? upper : max_;
+            }
+        }
+        return max_;
+    }
+
+    /**
+     * @brief 记录的总次数
+     *
+     * @return uint64_t
+     */
+    uint64_t count() const {
+        return total_;
+    }
+
+    /**
+     * @brief 记录过的最大值
+     *
+     * @return uint64_t
+     */
+    uint64_t max() const {
+        return max_;
+    }
+
+    void reset() {
+        memset(counts_, 0, sizeof(counts_));
+        total_ = 0;
+        max_ = 0;
+    }
+
+public:
+    /**
+     * @brief 值所在的桶
+     *
+     * @param value
+     * @return size_t
+     */
+    static size_t bucket_index(uint64_t value) {
+        if (value < (2 << HISTOGRAM_SUB_BUCKET_BITS)) {
+            return static_cast<size_t>(value);
+        }
+        int exponent = 63 - __builtin_clzll(value);
+        if (__glibc_unlikely(exponent >= HISTOGRAM_MAX_EXPONENT)) {
+            return HISTOGRAM_BUCKET_COUNT - 1;
+        }
+        // 最高位之后的 SUB_BITS 位作为子桶下标
+        size_t sub = static_cast<size_t>(value >> (exponent - HISTOGRAM_SUB_BUCKET_BITS)) & (HISTOGRAM_SUB_BUCKET_COUNT - 1);
+        return (exponent - HISTOGRAM_SUB_BUCKET_BITS + 1) * HISTOGRAM_SUB_BUCKET_COUNT + sub;
+    }
+
+    /**
+     * @brief 桶中能容纳的最大值
+     *
+     * @param index
+     * @return uint64_t
+     */
+    static uint64_t bucket_upper_bound(size_t index) {
+        if (index < (2 << HISTOGRAM_SUB_BUCKET_BITS)) {
+            return index;
+        }
+        int exponent = static_cast<int>(index / HISTOGRAM_SUB_BUCKET_COUNT) + HISTOGRAM_SUB_BUCKET_BITS - 1;
+        uint64_t sub = index & (HISTOGRAM_SUB_BUCKET_COUNT - 1);
+        uint64_t width = 1ULL << (exponent - HISTOGRAM_SUB_BUCKET_BITS);
+        return (1ULL << exponent) + (sub + 1) * width - 1;
+    }
+
+private:
+    // 每个桶的计数，采样时每次记录的权重可以达到 2^32，32 位会回绕
+    uint64_t counts_[HISTOGRAM_BUCKET_COUNT];
+    uint64_t total_;
+    uint64_t max_;
+};
+
+}  // namespace file_io_hook
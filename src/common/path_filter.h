@@ -0,0 +1,258 @@
+/**
+ * @file path_filter.h
+ * @author noahyzhang
+ * @brief 文件路径的过滤规则
+ * @version 0.1
+ * @date 2023-04-18
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+namespace file_io_hook {
+
+// 规则之间的分隔符
+#define PATH_FILTER_SEPARATOR (',')
+
+/**
+ * @brief 字节前缀树
+ *  用于一次遍历判断字符串是否以某一组字符串中的任意一个开头
+ *  节点存放在数组中，子节点按字节有序，路径规则的数量有限，线性查找即可
+ */
+class BytePrefixTrie {
+public:
+    BytePrefixTrie() : nodes_(1) {}
+
+    /**
+     * @brief 插入一个前缀
+     *
+     * @param str
+     * @param len
+     * @param reverse 为 true 时按从后往前的顺序插入，用于后缀匹配
+     */
+    void insert(const char* str, size_t len, bool reverse = false) {
+        uint32_t node = 0;
+        for (size_t i = 0; i < len; ++i) {
+            unsigned char c = static_cast<unsigned char>(reverse ? str[len - 1 - i] : str[i]);
+            uint32_t child = find_child(node, c);
+            if (child == 0) {
+                child = static_cast<uint32_t>(nodes_.size());
+                nodes_.emplace_back();
+                auto& children = nodes_[node].children;
+                auto pos = children.begin();
+                for (; pos != children.end() && pos->first < c; ++pos) {}
+                children.insert(pos, std::make_pair(c, child));
+            }
+            node = child;
+        }
+        nodes_[node].is_end = true;
+        empty_ = false;
+    }
+
+    /**
+     * @brief 字符串（或者其反转）是否以某个已插入的前缀开头
+     *
+     * @param str
+     * @param len
+     * @param reverse
+     * @return true
+     * @return false
+     */
+    bool match(const char* str, size_t len, bool reverse = false) const {
+        if (empty_) {
+            return false;
+        }
+        uint32_t node = 0;
+        for (size_t i = 0; ; ++i) {
+            if (nodes_[node].is_end) {
+                return true;
+            }
+            if (i == len) {
+                return false;
+            }
+            unsigned char c = static_cast<unsigned char>(reverse ? str[len - 1 - i] : str[i]);
+            node = find_child(node, c);
+            if (node == 0) {
+                return false;
+            }
+        }
+    }
+
+    bool empty() const {
+        return empty_;
+    }
+
+private:
+    // 根节点不会是任何节点的子节点，因此用 0 表示不存在
+    uint32_t find_child(uint32_t node, unsigned char c) const {
+        for (const auto& child : nodes_[node].children) {
+            if (child.first == c) {
+                return child.second;
+            }
+            if (child.first > c) {
+                break;
+            }
+        }
+        return 0;
+    }
+
+private:
+    struct Node {
+        bool is_end = false;
+        std::vector<std::pair<unsigned char, uint32_t>> children;
+    };
+    std::vector<Node> nodes_;
+    bool empty_ = true;
+};
+
+/**
+ * @brief 路径的包含/排除规则
+ *  规则以逗号分隔，按形式分为三类，构造时编译，之后只读，可以被多个线程同时使用：
+ *  1. 不含通配符：前缀，比如 "/data/"、"/proc/"，编译进前缀树
+ *  2. 只有开头一个 '*'：后缀，比如 "*.so"、"*.log"，反转后编译进另一棵前缀树
+ *  3. 其他含有 '*'、'?' 的：通配，比如 "/data/db?/wal*.log"（'*' 可以匹配 '/'），逐条匹配
+ *  路径被统计的条件：没有包含规则或者匹配任意一条包含规则，并且不匹配任何排除规则
+ *  规则匹配的是传给 open 的路径，相对路径只能被后缀和通配规则匹配
+ */
+class PathFilter {
+public:
+    /**
+     * @brief 构造函数
+     *
+     * @param include 包含规则，可以为空
+     * @param exclude 排除规则，可以为空
+     */
+    PathFilter(const char* include, const char* exclude) {
+        include_.compile(include);
+        exclude_.compile(exclude);
+    }
+    ~PathFilter() = default;
+    PathFilter(const PathFilter&) = delete;
+    PathFilter& operator=(const PathFilter&) = delete;
+    PathFilter(PathFilter&&) = delete;
+    PathFilter& operator=(PathFilter&&) = delete;
+
+    /**
+     * @brief 路径是否需要统计
+     *
+     * @param path
+     * @return true
+     * @return false
+     */
+    bool match(const char* path) const {
+        size_t len = strlen(path);
+        if (!include_.empty() && !include_.match(path, len)) {
+            return false;
+        }
+        return !exclude_.match(path, len);
+    }
+
+    /**
+     * @brief 没有任何规则
+     *
+     * @return true
+     * @return false
+     */
+    bool empty() const {
+        return include_.empty() && exclude_.empty();
+    }
+
+    /**
+     * @brief 通配符匹配，'*' 匹配任意长度（包括 '/'）的字符串，'?' 匹配任意一个字符
+     *
+     * @param pattern
+     * @param str
+     * @return true
+     * @return false
+     */
+    static bool glob_match(const char* pattern, const char* str) {
+        // 回溯到最近一个 '*' 的位置，时间复杂度为 O(模式长度 * 字符串长度)
+        const char* star = nullptr;
+        const char* star_str = nullptr;
+        for (; *str != '\0';) {
+            if (*pattern == '*') {
+                star = pattern++;
+                star_str = str;
+            } else if (*pattern == '?' || *pattern == *str) {
+                ++pattern;
+                ++str;
+            } else if (star != nullptr) {
+                pattern = star + 1;
+                str = ++star_str;
+            } else {
+                return false;
+            }
+        }
+        for (; *pattern == '*'; ++pattern) {}
+        return *pattern == '\0';
+    }
+
+private:
+    /**
+     * @brief 一组规则
+     *
+     */
+    struct RuleSet {
+        void compile(const char* rules) {
+            if (rules == nullptr) {
+                return;
+            }
+            for (const char* begin = rules; *begin != '\0';) {
+                const char* end = strchr(begin, PATH_FILTER_SEPARATOR);
+                size_t len = end ? static_cast<size_t>(end - begin) : strlen(begin);
+                add(begin, len);
+                begin += end ? len + 1 : len;
+            }
+        }
+
+        void add(const char* rule, size_t len) {
+            if (len == 0) {
+                return;
+            }
+            if (!has_wildcard(rule, len)) {
+                prefixes.insert(rule, len);
+            } else if (rule[0] == '*' && len > 1 && !has_wildcard(rule + 1, len - 1)) {
+                suffixes.insert(rule + 1, len - 1, true);
+            } else {
+                globs.emplace_back(rule, len);
+            }
+        }
+
+        static bool has_wildcard(const char* rule, size_t len) {
+            return memchr(rule, '*', len) != nullptr || memchr(rule, '?', len) != nullptr;
+        }
+
+        bool match(const char* path, size_t len) const {
+            if (prefixes.match(path, len) || suffixes.match(path, len, true)) {
+                return true;
+            }
+            for (const auto& glob : globs) {
+                if (glob_match(glob.c_str(), path)) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        bool empty() const {
+            return prefixes.empty() && suffixes.empty() && globs.empty();
+        }
+
+        BytePrefixTrie prefixes;
+        BytePrefixTrie suffixes;
+        std::vector<std::string> globs;
+    };
+
+private:
+    RuleSet include_;
+    RuleSet exclude_;
+};
+
+}  // namespace file_io_hook
@@ -0,0 +1,83 @@
+/**
+ * @file real_func_table.h
+ * @author noahyzhang
+ * @brief 被 hook 函数的真实函数指针表
+ * @version 0.1
+ * @date 2023-04-18
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#pragma once
+
+#include <dlfcn.h>
+#include <stddef.h>
+
+namespace file_io_hook {
+
+/**
+ * @brief 以编译期常量为下标的真实函数指针表
+ *  1. 构造函数是 constexpr 的，静态对象在常量初始化阶段就已经就绪，早于任何构造函数执行，
+ *     因此不需要函数内的局部静态变量，也就没有每次调用时的初始化守卫检查
+ *  2. 库的构造函数中调用 resolve_all 一次性解析所有函数
+ *  3. 构造函数执行前就被调用（比如其他库的构造函数中做 IO）时，在第一次未命中时解析，
+ *     不会像局部静态变量那样永久缓存空指针
+ *  命中时只是一次对常量地址的读取，调用方再通过函数指针间接调用
+ *
+ * @tparam N 函数的数量
+ */
+template <size_t N>
+class RealFuncTable {
+public:
+    /**
+     * @brief 构造函数
+     *
+     * @param names 函数名数组，长度为 N，需要是静态存储期的
+     */
+    explicit constexpr RealFuncTable(const char* const* names) : names_(names), funcs_() {}
+    RealFuncTable(const RealFuncTable&) = delete;
+    RealFuncTable& operator=(const RealFuncTable&) = delete;
+    RealFuncTable(RealFuncTable&&) = delete;
+    RealFuncTable& operator=(RealFuncTable&&) = delete;
+
+    /**
+     * @brief 获取真实函数指针，未解析时解析一次
+     *
+     * @tparam FuncType 函数指针类型
+     * @param index 下标
+     * @return FuncType 找不到该函数时为空
+     */
+    template <typename FuncType>
+    FuncType get(size_t index) {
+        void* func = __atomic_load_n(&funcs_[index], __ATOMIC_RELAXED);
+        if (__glibc_unlikely(func == nullptr)) {
+            func = resolve(index);
+        }
+        return reinterpret_cast<FuncType>(func);
+    }
+
+    /**
+     * @brief 解析所有函数
+     *
+     */
+    void resolve_all() {
+        for (size_t i = 0; i < N; ++i) {
+            resolve(i);
+        }
+    }
+
+private:
+    // 多个线程同时解析时得到的是同一个地址，重复写入没有问题
+    __attribute__((noinline)) void* resolve(size_t index) {
+        void* func = dlsym(RTLD_NEXT, names_[index]);
+        __atomic_store_n(&funcs_[index], func, __ATOMIC_RELAXED);
+        return func;
+    }
+
+private:
+    const char* const* names_;
+    void* funcs_[N];
+};
+
+}  // namespace file_io_hook
@@ -101,6 +101,16 @@ public:
         head_.fetch_add(shared_step, std::memory_order_release);
     }
 
+    /**
+     * @brief 恢复为未加锁的状态，只能在 fork 出的子进程中调用
+     *        按票号排队，fork 时正在等待的其他线程已经取了票号，它们在子进程中不存在，只解锁会一直等不到
+     *
+     */
+    void reset() noexcept {
+        head_.store(0, std::memory_order_relaxed);
+        tail_.store(0, std::memory_order_relaxed);
+    }
+
 private:
     using base_type = std::uint32_t;
     static constexpr base_type shared_step = 1 << (8 * sizeof(base_type) / 2);
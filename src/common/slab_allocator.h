@@ -0,0 +1,284 @@
+/**
+ * @file slab_allocator.h
+ * @author noahyzhang
+ * @brief
+ * @version 0.1
+ * @date 2023-04-18
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#pragma once
+
+#include <sys/mman.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <atomic>
+#include <new>
+#include "common/rw_spin_lock.h"
+
+namespace file_io_hook {
+
+// 每次向系统申请的 slab 的大小
+#define SLAB_SIZE (64 * 1024)
+// 线程缓存中对象的数量上限，超过后归还一批到全局仓库
+#define SLAB_THREAD_CACHE_MAX (512)
+// 线程缓存与全局仓库之间每次转移的对象数量
+#define SLAB_BATCH_SIZE (128)
+
+/**
+ * @brief 固定大小对象的 slab 分配器
+ *  hook 库被 LD_PRELOAD 到任意的宿主进程中，频繁调用宿主的 malloc 既影响性能，也可能与宿主的 malloc hook 形成死锁
+ *  因此对象的内存直接通过 mmap 按 slab 申请，切分成固定大小的对象，释放后进入空闲链表复用，从不归还给系统
+ *
+ *  空闲对象分为两级：
+ *  1. 线程缓存：分配和释放都只访问当前线程的空闲链表，不加锁
+ *  2. 全局仓库：线程缓存为空时从仓库批量取，线程缓存过多时批量还，线程退出时全部还给仓库
+ *  稳定状态下（对象数量不再增长）分配和释放不会调用宿主进程的 malloc，也不会再 mmap
+ *
+ *  同一类型 T 的所有实例共享一个分配器，因此所有接口都是静态的
+ *
+ * @tparam T 对象的类型
+ */
+template <typename T>
+class SlabAllocator {
+public:
+    /**
+     * @brief 空闲对象，复用对象自身的内存作为链表节点
+     *
+     */
+    struct FreeNode {
+        FreeNode* next;
+    };
+
+public:
+    /**
+     * @brief 分配一个对象的内存
+     *
+     * @return void* 申请内存失败时返回 nullptr
+     */
+    static void* allocate() {
+        if (__glibc_unlikely(tls_head_ == nullptr)) {
+            refill();
+            if (tls_head_ == nullptr) {
+                return nullptr;
+            }
+        }
+        FreeNode* node = tls_head_;
+        tls_head_ = node->next;
+        --tls_count_;
+        return node;
+    }
+
+    /**
+     * @brief 释放一个对象的内存
+     *
+     * @param ptr
+     */
+    static void deallocate(void* ptr) {
+        FreeNode* node = static_cast<FreeNode*>(ptr);
+        deallocate_list(node, node, 1);
+    }
+
+    /**
+     * @brief 批量释放一串对象的内存，只做一次链表拼接
+     *
+     * @param head 第一个对象
+     * @param tail 最后一个对象，需要由 head 沿着 next 可达
+     * @param count 对象的数量
+     */
+    static void deallocate_list(FreeNode* head, FreeNode* tail, size_t count) {
+        if (head == nullptr) {
+            return;
+        }
+        tail->next = tls_head_;
+        tls_head_ = head;
+        tls_count_ += count;
+        if (__glibc_unlikely(tls_count_ > SLAB_THREAD_CACHE_MAX)) {
+            flush(tls_count_ - SLAB_THREAD_CACHE_MAX + SLAB_BATCH_SIZE);
+        }
+    }
+
+    /**
+     * @brief 通过 mmap 申请的内存总量
+     *
+     * @return uint64_t
+     */
+    static uint64_t mapped_bytes() {
+        return mapped_bytes_.load(std::memory_order_relaxed);
+    }
+
+public:
+    /**
+     * @brief fork 前在父进程上下文执行，子进程中只有 fork 的线程存活，需要保证仓库的锁不会被其他线程带走
+     *  分配器不自己注册 fork 回调：对象通常在容器的锁（比如哈希桶的锁）内分配，
+     *  必须由容器的持有者在锁住容器之后再调用，保证全局只有一种加锁顺序：容器的锁 -> 仓库的锁
+     *
+     */
+    static void lock_prefork() {
+        depot_lock_.write_lock();
+    }
+
+    /**
+     * @brief fork 返回前，在父进程上下文执行
+     *
+     */
+    static void lock_postfork_parent() {
+        depot_lock_.write_unlock();
+    }
+
+    /**
+     * @brief fork 返回前，在子进程上下文执行
+     *  其他线程的线程缓存在子进程中不会再被使用，其中的对象泄漏，不影响正确性
+     *  fork 时在排队等锁的线程已经取了票号，只解锁会一直等不到，直接重置
+     *
+     */
+    static void lock_postfork_child() {
+        depot_lock_.reset();
+    }
+
+private:
+    // 每个对象占用的大小，至少能放下一个 FreeNode，并且满足 T 的对齐要求
+    static constexpr size_t OBJECT_ALIGN = alignof(T) > alignof(FreeNode) ? alignof(T) : alignof(FreeNode);
+    static constexpr size_t OBJECT_SIZE =
+        ((sizeof(T) > sizeof(FreeNode) ? sizeof(T) : sizeof(FreeNode)) + OBJECT_ALIGN - 1) / OBJECT_ALIGN * OBJECT_ALIGN;
+
+    /**
+     * @brief 线程缓存为空时，从全局仓库取一批，仓库也为空时申请一个新的 slab
+     *
+     */
+    static void refill() {
+        pthread_once(&once_, init_once);
+        depot_lock_.write_lock();
+        size_t count = 0;
+        FreeNode* head = depot_head_;
+        FreeNode* tail = nullptr;
+        for (FreeNode* node = head; node != nullptr && count < SLAB_BATCH_SIZE; node = node->next) {
+            tail = node;
+            ++count;
+        }
+        if (tail != nullptr) {
+            depot_head_ = tail->next;
+            depot_count_ -= count;
+        }
+        depot_lock_.write_unlock();
+        if (tail == nullptr) {
+            head = carve_slab(&tail, &count);
+            if (head == nullptr) {
+                return;
+            }
+        }
+        tail->next = tls_head_;
+        tls_head_ = head;
+        tls_count_ += count;
+        register_thread();
+    }
+
+    /**
+     * @brief 把线程缓存中的 count 个对象还给全局仓库
+     *
+     * @param count
+     */
+    static void flush(size_t count) {
+        if (count == 0 || tls_head_ == nullptr) {
+            return;
+        }
+        FreeNode* head = tls_head_;
+        FreeNode* tail = head;
+        size_t n = 1;
+        for (; n < count && tail->next != nullptr; ++n) {
+            tail = tail->next;
+        }
+        tls_head_ = tail->next;
+        tls_count_ -= n;
+        depot_lock_.write_lock();
+        tail->next = depot_head_;
+        depot_head_ = head;
+        depot_count_ += n;
+        depot_lock_.write_unlock();
+    }
+
+    /**
+     * @brief 申请一个新的 slab 并切分成对象链表
+     *
+     * @param tail 输出最后一个对象
+     * @param count 输出对象的数量
+     * @return FreeNode* 第一个对象，失败时返回 nullptr
+     */
+    static FreeNode* carve_slab(FreeNode** tail, size_t* count) {
+        void* mem = mmap(nullptr, SLAB_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mem == MAP_FAILED) {
+            return nullptr;
+        }
+        mapped_bytes_.fetch_add(SLAB_SIZE, std::memory_order_relaxed);
+        char* base = static_cast<char*>(mem);
+        size_t n = SLAB_SIZE / OBJECT_SIZE;
+        for (size_t i = 0; i + 1 < n; ++i) {
+            reinterpret_cast<FreeNode*>(base + i * OBJECT_SIZE)->next =
+                reinterpret_cast<FreeNode*>(base + (i + 1) * OBJECT_SIZE);
+        }
+        *tail = reinterpret_cast<FreeNode*>(base + (n - 1) * OBJECT_SIZE);
+        (*tail)->next = nullptr;
+        *count = n;
+        return reinterpret_cast<FreeNode*>(base);
+    }
+
+    /**
+     * @brief 注册线程退出的回调，线程退出时把线程缓存全部还给仓库
+     *
+     */
+    static void register_thread() {
+        if (!tls_registered_ && key_valid_) {
+            tls_registered_ = true;
+            pthread_setspecific(key_, reinterpret_cast<void*>(1));
+        }
+    }
+
+    static void on_thread_exit(void*) {
+        flush(tls_count_);
+        tls_registered_ = false;
+    }
+
+    static void init_once() {
+        key_valid_ = (pthread_key_create(&key_, on_thread_exit) == 0);
+    }
+
+private:
+    // 线程缓存
+    static __thread FreeNode* tls_head_;
+    static __thread size_t tls_count_;
+    static __thread bool tls_registered_;
+    // 全局仓库，临界区只有链表操作，使用自旋锁
+    static RWSpinLock depot_lock_;
+    static FreeNode* depot_head_;
+    static size_t depot_count_;
+    // 用于感知线程退出
+    static pthread_once_t once_;
+    static pthread_key_t key_;
+    static bool key_valid_;
+    static std::atomic<uint64_t> mapped_bytes_;
+};
+
+template <typename T>
+__thread typename SlabAllocator<T>::FreeNode* SlabAllocator<T>::tls_head_ = nullptr;
+template <typename T>
+__thread size_t SlabAllocator<T>::tls_count_ = 0;
+template <typename T>
+__thread bool SlabAllocator<T>::tls_registered_ = false;
+template <typename T>
+RWSpinLock SlabAllocator<T>::depot_lock_;
+template <typename T>
+typename SlabAllocator<T>::FreeNode* SlabAllocator<T>::depot_head_ = nullptr;
+template <typename T>
+size_t SlabAllocator<T>::depot_count_ = 0;
+template <typename T>
+pthread_once_t SlabAllocator<T>::once_ = PTHREAD_ONCE_INIT;
+template <typename T>
+pthread_key_t SlabAllocator<T>::key_;
+template <typename T>
+bool SlabAllocator<T>::key_valid_ = false;
+template <typename T>
+std::atomic<uint64_t> SlabAllocator<T>::mapped_bytes_(0);
+
+}  // namespace file_io_hook
@@ -0,0 +1,125 @@
+/**
+ * @file spsc_ring.h
+ * @author noahyzhang
+ * @brief 单生产者单消费者的环形队列
+ * @version 0.1
+ * @date 2023-04-18
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+namespace file_io_hook {
+
+// 跨进程使用时原子变量必须是无锁的，否则锁在各自进程的地址空间中
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "std::atomic<uint64_t> must be lock free");
+
+/**
+ * @brief 单生产者单消费者的环形队列
+ *  控制块和元素数组由调用方提供，可以放在共享内存中，生产者和消费者位于不同的进程
+ *  1. head 只被生产者写，tail 只被消费者写，两者各自独占一个缓存行
+ *  2. 生产者缓存消费者的位置，只有按缓存的位置判断队列已满时才去读取 tail 所在的缓存行
+ *  3. 位置单调递增，不回绕，下标为位置对容量取模，因此容量必须是 2 的幂
+ *  本类只是控制块和元素数组的视图，没有自己的状态，可以随时在栈上构造
+ *
+ * @tparam T 元素，需要是可以按字节复制的类型
+ */
+template <typename T>
+class SpscRing {
+public:
+    /**
+     * @brief 控制块，位置为已经写入（读取）的元素总数
+     *
+     */
+    struct Control {
+        alignas(64) std::atomic<uint64_t> head;
+        // 生产者私有，最近一次读到的 tail
+        uint64_t cached_tail;
+        alignas(64) std::atomic<uint64_t> tail;
+    };
+
+    /**
+     * @brief 构造函数
+     *
+     * @param control
+     * @param buffer 元素数组，长度为 capacity
+     * @param capacity 2 的幂
+     */
+    SpscRing(Control* control, T* buffer, uint64_t capacity)
+        : control_(control), buffer_(buffer), mask_(capacity - 1) {}
+
+    /**
+     * @brief 初始化控制块，只能在生产者和消费者开始使用之前调用一次
+     *
+     * @param control
+     */
+    static void init(Control* control) {
+        control->head.store(0, std::memory_order_relaxed);
+        control->cached_tail = 0;
+        control->tail.store(0, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief 写入一个元素，只能被生产者调用
+     *
+     * @param item
+     * @return true
+     * @return false 队列已满
+     */
+    bool push(const T& item) {
+        uint64_t head = control_->head.load(std::memory_order_relaxed);
+        if (__glibc_unlikely(head - control_->cached_tail > mask_)) {
+            control_->cached_tail = control_->tail.load(std::memory_order_acquire);
+            if (head - control_->cached_tail > mask_) {
+                return false;
+            }
+        }
+        buffer_[head & mask_] = item;
+        control_->head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief 读取至多 max_count 个元素，只能被消费者调用
+     *
+     * @tparam Fn 形如 void(const T&)
+     * @param fn
+     * @param max_count
+     * @return uint64_t 读取的元素数量
+     */
+    template <typename Fn>
+    uint64_t consume(Fn fn, uint64_t max_count = UINT64_MAX) {
+        uint64_t tail = control_->tail.load(std::memory_order_relaxed);
+        uint64_t count = control_->head.load(std::memory_order_acquire) - tail;
+        if (count > max_count) {
+            count = max_count;
+        }
+        for (uint64_t i = 0; i < count; ++i) {
+            fn(buffer_[(tail + i) & mask_]);
+        }
+        control_->tail.store(tail + count, std::memory_order_release);
+        return count;
+    }
+
+    /**
+     * @brief 队列中的元素数量，生产者和消费者都可以调用，结果是近似值
+     *
+     * @return uint64_t
+     */
+    uint64_t size() const {
+        return control_->head.load(std::memory_order_acquire) - control_->tail.load(std::memory_order_acquire);
+    }
+
+private:
+    Control* control_;
+    T* buffer_;
+    uint64_t mask_;
+};
+
+}  // namespace file_io_hook
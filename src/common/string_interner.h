@@ -0,0 +1,128 @@
+/**
+ * @file string_interner.h
+ * @author noahyzhang
+ * @brief
+ * @version 0.1
+ * @date 2023-04-18
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+
+namespace file_io_hook {
+
+// 无效的字符串 id，合法的 id 从 1 开始
+#define INVALID_STRING_ID (0)
+
+/**
+ * @brief 字符串驻留表
+ *  为每个不同的字符串分配一个稳定的 32 位 id，id 在进程生命周期内不会改变，也不会被复用
+ *  这样热路径上可以用整数代替字符串作为 key，只在需要展示时再把 id 解析回字符串
+ *
+ *  intern 和 find 都需要加锁，只适合在 open、数据收集这类低频的路径上调用
+ */
+class StringInterner {
+public:
+    StringInterner() {
+        // 占位，使得合法的 id 从 1 开始
+        id_to_str_.push_back(nullptr);
+    }
+    ~StringInterner() = default;
+    StringInterner(const StringInterner&) = delete;
+    StringInterner& operator=(const StringInterner&) = delete;
+    StringInterner(StringInterner&&) = delete;
+    StringInterner& operator=(StringInterner&&) = delete;
+
+public:
+    /**
+     * @brief 获取字符串的 id，不存在时分配一个新的 id
+     *
+     * @param str
+     * @return uint32_t id 耗尽时返回 INVALID_STRING_ID
+     */
+    uint32_t intern(const char* str) {
+        std::lock_guard<std::mutex> lock(mtx_);
+        auto iter = str_to_id_.find(str);
+        if (iter != str_to_id_.end()) {
+            return iter->second;
+        }
+        // UINT32_MAX 保留给使用者作为特殊标记
+        if (__glibc_unlikely(id_to_str_.size() >= UINT32_MAX)) {
+            return INVALID_STRING_ID;
+        }
+        uint32_t id = static_cast<uint32_t>(id_to_str_.size());
+        iter = str_to_id_.emplace(str, id).first;
+        // unordered_map 的节点地址是稳定的，可以直接引用其中的 key
+        id_to_str_.push_back(&iter->first);
+        return id;
+    }
+
+    /**
+     * @brief 查找 id 对应的字符串
+     *
+     * @param id
+     * @param str
+     * @return true
+     * @return false
+     */
+    bool find(uint32_t id, std::string& str) {
+        std::lock_guard<std::mutex> lock(mtx_);
+        if (id == INVALID_STRING_ID || id >= id_to_str_.size()) {
+            return false;
+        }
+        str = *id_to_str_[id];
+        return true;
+    }
+
+    /**
+     * @brief 已经分配的 id 的数量
+     *
+     * @return size_t
+     */
+    size_t size() {
+        std::lock_guard<std::mutex> lock(mtx_);
+        return id_to_str_.size() - 1;
+    }
+
+public:
+    /**
+     * @brief fork 调用创建子进程之前被执行，在父进程的上下文空间执行
+     *
+     */
+    void lock_prefork() {
+        mtx_.lock();
+    }
+
+    /**
+     * @brief fork 调用创建出子进程之后，而 fork 返回之前执行。在父进程的上下文执行
+     *
+     */
+    void lock_postfork_parent() {
+        mtx_.unlock();
+    }
+
+    /**
+     * @brief fork 返回之前执行，在子进程上下文中执行
+     *
+     */
+    void lock_postfork_child() {
+        mtx_.unlock();
+    }
+
+private:
+    std::mutex mtx_;
+    // 字符串到 id 的映射
+    std::unordered_map<std::string, uint32_t> str_to_id_;
+    // id 到字符串的映射，以 id 为下标
+    std::vector<const std::string*> id_to_str_;
+};
+
+}  // namespace file_io_hook
@@ -0,0 +1,244 @@
+/**
+ * @file thread_local_registry.h
+ * @author noahyzhang
+ * @brief
+ * @version 0.1
+ * @date 2023-04-18
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#pragma once
+
+#include <pthread.h>
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include "common/common.h"
+
+namespace file_io_hook {
+
+/**
+ * @brief 线程私有数据的注册表
+ *  每个线程在第一次使用时获得一个属于自己的槽位（Slot），之后只读写自己槽位中的数据，热路径上没有共享写
+ *  所有槽位串成一个只增不减的无锁单链表，消费者遍历链表收集所有线程的数据
+ *
+ *  槽位的状态流转：
+ *  1. SLOT_FREE -> SLOT_ACTIVE：线程第一次使用时认领一个空闲槽位，没有空闲槽位时新建
+ *  2. SLOT_ACTIVE -> SLOT_RETIRED：线程退出时（pthread key 的析构函数），槽位中可能还有未被收集的数据
+ *  3. SLOT_RETIRED -> SLOT_FREE：消费者收集完已退出线程的数据后，槽位可以被新线程复用
+ *  槽位从不释放，数量上限为进程中线程数量的峰值
+ *  新建槽位入链时持有 register_mtx_，fork 期间链表不会增长，fork 前后遍历的是同一批槽位
+ *
+ *  注意：消费者（harvest）只能有一个
+ *
+ * @tparam T 线程私有数据，需要可以默认构造
+ */
+template <typename T>
+class ThreadLocalRegistry {
+public:
+    /**
+     * @brief 槽位的状态
+     *
+     */
+    enum SlotState {
+        SLOT_FREE = 0,
+        SLOT_ACTIVE,
+        SLOT_RETIRED
+    };
+
+    /**
+     * @brief 槽位，每个线程独占一个
+     *
+     */
+    struct Slot {
+        // 槽位的状态
+        std::atomic<int> state;
+        // 持有此槽位的线程 tid
+        std::atomic<int64_t> tid;
+        // 线程私有的数据
+        T data;
+        // 单链表的下一个槽位，入链之后不再修改
+        Slot* next = nullptr;
+
+        Slot() : state(SLOT_ACTIVE), tid(-1) {}
+    };
+
+public:
+    ThreadLocalRegistry() {
+        // 创建失败时 key_valid_ 为 false，线程退出时不会被通知，槽位不会被复用，但是数据依然正确
+        key_valid_ = (pthread_key_create(&key_, &ThreadLocalRegistry::on_thread_exit) == 0);
+    }
+    ~ThreadLocalRegistry() {
+        if (key_valid_) {
+            pthread_key_delete(key_);
+        }
+        Slot* slot = head_.load(std::memory_order_acquire);
+        for (; slot != nullptr;) {
+            Slot* next = slot->next;
+            delete slot;
+            slot = next;
+        }
+        tls_owner_ = nullptr;
+        tls_slot_ = nullptr;
+    }
+    ThreadLocalRegistry(const ThreadLocalRegistry&) = delete;
+    ThreadLocalRegistry& operator=(const ThreadLocalRegistry&) = delete;
+    ThreadLocalRegistry(ThreadLocalRegistry&&) = delete;
+    ThreadLocalRegistry& operator=(ThreadLocalRegistry&&) = delete;
+
+public:
+    /**
+     * @brief 获取当前线程的私有数据
+     *  快速路径只有一次 TLS 读取和一次比较
+     *
+     * @return T&
+     */
+    T& get_local() {
+        if (__glibc_likely(tls_owner_ == this)) {
+            return tls_slot_->data;
+        }
+        return acquire_slot()->data;
+    }
+
+    /**
+     * @brief 遍历所有线程的数据，包括上次收集之后已经退出的线程
+     *  对于已退出的线程，回调返回之后，槽位即可被新线程复用，回调中需要把数据全部取走
+     *
+     * @tparam Fn void(int64_t tid, T& data)
+     * @param fn
+     */
+    template <typename Fn>
+    void harvest(Fn fn) {
+        Slot* slot = head_.load(std::memory_order_acquire);
+        for (; slot != nullptr; slot = slot->next) {
+            int state = slot->state.load(std::memory_order_acquire);
+            if (state == SLOT_FREE) {
+                continue;
+            }
+            fn(slot->tid.load(std::memory_order_relaxed), slot->data);
+            if (state == SLOT_RETIRED) {
+                slot->state.store(SLOT_FREE, std::memory_order_release);
+            }
+        }
+    }
+
+    /**
+     * @brief 遍历所有槽位的数据，不改变槽位状态
+     *  用于 fork 前后对各线程数据加锁解锁，需要在 lock_prefork 之后、postfork 之前调用
+     *
+     * @tparam Fn void(T& data)
+     * @param fn
+     */
+    template <typename Fn>
+    void for_each(Fn fn) {
+        Slot* slot = head_.load(std::memory_order_acquire);
+        for (; slot != nullptr; slot = slot->next) {
+            fn(slot->data);
+        }
+    }
+
+public:
+    /**
+     * @brief fork 前在父进程上下文执行，禁止新建槽位
+     *
+     */
+    void lock_prefork() {
+        register_mtx_.lock();
+    }
+
+    /**
+     * @brief fork 返回前，在父进程上下文执行
+     *
+     */
+    void lock_postfork_parent() {
+        register_mtx_.unlock();
+    }
+
+    /**
+     * @brief fork 返回之前，在子进程上下文中执行
+     *  子进程中只有调用 fork 的线程存活，其他线程的槽位视为已退出
+     *
+     */
+    void lock_postfork_child() {
+        Slot* self = (tls_owner_ == this) ? tls_slot_ : nullptr;
+        Slot* slot = head_.load(std::memory_order_acquire);
+        for (; slot != nullptr; slot = slot->next) {
+            int expected = SLOT_ACTIVE;
+            if (slot != self) {
+                slot->state.compare_exchange_strong(expected, SLOT_RETIRED);
+            }
+        }
+        if (self != nullptr) {
+            self->tid.store(Util::get_tid(), std::memory_order_relaxed);
+        }
+        register_mtx_.unlock();
+    }
+
+private:
+    /**
+     * @brief 慢速路径，为当前线程认领或者新建一个槽位
+     *
+     * @return Slot*
+     */
+    Slot* acquire_slot() {
+        Slot* slot = head_.load(std::memory_order_acquire);
+        for (; slot != nullptr; slot = slot->next) {
+            int expected = SLOT_FREE;
+            if (slot->state.load(std::memory_order_relaxed) == SLOT_FREE
+                && slot->state.compare_exchange_strong(expected, SLOT_ACTIVE, std::memory_order_acq_rel)) {
+                break;
+            }
+        }
+        if (slot == nullptr) {
+            // 在锁外构造，数据的构造可能分配内存
+            slot = new Slot();
+            std::lock_guard<std::mutex> lock(register_mtx_);
+            slot->next = head_.load(std::memory_order_relaxed);
+            head_.store(slot, std::memory_order_release);
+        }
+        slot->tid.store(Util::get_tid(), std::memory_order_relaxed);
+        tls_owner_ = this;
+        tls_slot_ = slot;
+        if (key_valid_) {
+            pthread_setspecific(key_, slot);
+        }
+        return slot;
+    }
+
+    /**
+     * @brief 线程退出时被调用，将槽位标记为已退出，等待消费者收集其中剩余的数据
+     *
+     * @param arg
+     */
+    static void on_thread_exit(void* arg) {
+        Slot* slot = static_cast<Slot*>(arg);
+        // 线程退出的后续流程中仍然可能有 IO，此时会重新认领一个槽位
+        if (tls_slot_ == slot) {
+            tls_owner_ = nullptr;
+            tls_slot_ = nullptr;
+        }
+        slot->state.store(SLOT_RETIRED, std::memory_order_release);
+    }
+
+private:
+    // 槽位单链表的头
+    std::atomic<Slot*> head_ = ATOMIC_VAR_INIT(nullptr);
+    // 新建槽位入链时持有，读者不需要
+    std::mutex register_mtx_;
+    // 用于感知线程退出
+    pthread_key_t key_;
+    bool key_valid_ = false;
+    // 当前线程的槽位缓存，tls_owner_ 用于区分同一类型的不同注册表实例
+    static __thread ThreadLocalRegistry* tls_owner_;
+    static __thread Slot* tls_slot_;
+};
+
+template <typename T>
+__thread ThreadLocalRegistry<T>* ThreadLocalRegistry<T>::tls_owner_ = nullptr;
+
+template <typename T>
+__thread typename ThreadLocalRegistry<T>::Slot* ThreadLocalRegistry<T>::tls_slot_ = nullptr;
+
+}  // namespace file_io_hook
@@ -2,14 +2,103 @@
 
 namespace file_io_hook {
 
-void FileIoInfoHandler::add_hook_info(FileOperateType, int, const char*) {
+void FileIoInfoHandler::add_hook_info(FileOperateType, int, const char*, uint64_t) {
     return;
 }
 
-void FileIoInfoHandler::add_hook_info(FileOperateType, int, size_t) {
+void FileIoInfoHandler::add_hook_info(FileOperateType, int, size_t, uint64_t) {
     return;
 }
 
+void FileIoInfoHandler::add_hook_info(FileOperateType, int, size_t, int, uint64_t, int64_t) {
+    return;
+}
+
+void FileIoInfoHandler::add_error_hook_info(FileOperateType, int, int, uint64_t) {
+    return;
+}
+
+void FileIoInfoHandler::add_transfer_hook_info(int, int, size_t, uint64_t) {
+    return;
+}
+
+void FileIoInfoHandler::add_transfer_error_hook_info(int, int, int, uint64_t) {
+    return;
+}
+
+void FileIoInfoHandler::add_async_hook_info(FileOperateType, int, size_t, int, uint32_t, uint64_t) {
+    return;
+}
+
+void FileIoInfoHandler::add_dup_hook_info(int, int) {
+    return;
+}
+
+void FileIoInfoHandler::add_seek_hook_info(int, uint64_t) {
+    return;
+}
+
+void FileIoInfoHandler::add_advance_hook_info(int, uint64_t) {
+    return;
+}
+
+void FileIoInfoHandler::add_close_range_hook_info(unsigned int, unsigned int) {
+    return;
+}
+
+FileIoInfoHandler& FileIoInfoHandler::get_instance() {
+    static FileIoInfoHandler instance;
+    return instance;
+}
+
+void FileIoInfoHandler::set_destruct_status() {
+    return;
+}
+
+void FileIoInfoHandler::set_hook_switch(uint32_t, bool) {
+    return;
+}
+
+uint32_t FileIoInfoHandler::get_hook_switch() {
+    return 0;
+}
+
+void FileIoInfoHandler::set_sample_rate(uint32_t) {
+    return;
+}
+
+void FileIoInfoHandler::set_adaptive_sample_target(uint64_t) {
+    return;
+}
+
+void FileIoInfoHandler::set_path_filter(const char*, const char*) {
+    return;
+}
+
+bool FileIoInfoHandler::enable_shm_export(const char*, uint32_t) {
+    return false;
+}
+
+bool FileIoInfoHandler::enable_trace(const char*) {
+    return false;
+}
+
+bool FileIoInfoHandler::start_background_collect(uint32_t) {
+    return false;
+}
+
+void FileIoInfoHandler::stop_background_collect() {
+    return;
+}
+
+void FileIoInfoHandler::add_snapshot_callback(const SnapshotCallback&) {
+    return;
+}
+
+bool FileIoInfoHandler::add_snapshot_sink(SnapshotSinkType, const char*) {
+    return false;
+}
+
 const std::vector<FileInfo>& FileIoInfoHandler::consume_and_parse() {
     static std::vector<FileInfo> dummy;
     return dummy;
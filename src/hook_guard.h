@@ -0,0 +1,58 @@
+/**
+ * @file hook_guard.h
+ * @author noahyzhang
+ * @brief hook 函数的重入保护
+ * @version 0.1
+ * @date 2023-04-18
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#pragma once
+
+namespace file_io_hook {
+
+/**
+ * @brief 当前线程是否正在 hook 函数内部
+ *  使用 initial-exec 模型，访问只是一次相对线程指针的偏移读写，不经过 __tls_get_addr，也不会分配内存
+ *  定义在 io_hook.cpp 中
+ */
+extern __thread bool g_inside_hook __attribute__((tls_model("initial-exec")));
+
+/**
+ * @brief 重入保护
+ *  1. hook 函数入口检查标志，已经在 hook 内部时直接调用真实函数，既不统计也不会递归
+ *  2. 库内部需要做 IO（导出、日志、落盘等）时，在作用域内构造一个 HookGuard，期间的 IO 同样直接走真实函数
+ *  允许嵌套，只有最外层的 HookGuard 析构时清除标志
+ */
+class HookGuard {
+public:
+    HookGuard() : outermost_(!g_inside_hook) {
+        g_inside_hook = true;
+    }
+    ~HookGuard() {
+        if (outermost_) {
+            g_inside_hook = false;
+        }
+    }
+    HookGuard(const HookGuard&) = delete;
+    HookGuard& operator=(const HookGuard&) = delete;
+    HookGuard(HookGuard&&) = delete;
+    HookGuard& operator=(HookGuard&&) = delete;
+
+    /**
+     * @brief 当前线程是否已经在 hook 函数（或者 HookGuard 的作用域）内部
+     *
+     * @return true
+     * @return false
+     */
+    static bool is_inside() {
+        return g_inside_hook;
+    }
+
+private:
+    bool outermost_;
+};
+
+}  // namespace file_io_hook
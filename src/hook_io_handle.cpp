@@ -1,5 +1,9 @@
+#include <errno.h>
+#include <string.h>
 #include <sstream>
 #include "common/common.h"
+#include "background_collector.h"
+#include "hook_guard.h"
 #include "hook_io_handle.h"
 
 namespace file_io_hook {
@@ -19,8 +23,65 @@ struct ProxyObjectExit {
 static ProxyObjectExit g_dummy_obj;
 }
 
-void FileIoInfoHandler::add_hook_info(FileOperateType type, int fd, const char* file_name) {
-    if (__glibc_unlikely(is_object_destruct)) {
+std::atomic<uint32_t> g_hook_switch_mask{HOOK_SWITCH_ALIVE | HOOK_SWITCH_USER_MASK};
+
+FileIoInfoHandler& FileIoInfoHandler::get_instance() {
+    static FileIoInfoHandler instance;
+    return instance;
+}
+
+void FileIoInfoHandler::set_destruct_status() {
+    g_hook_switch_mask.fetch_and(~static_cast<uint32_t>(HOOK_SWITCH_ALIVE), std::memory_order_relaxed);
+    // 之后不会再有新的事件，写入各线程块中剩余的事件
+    trace_writer_.flush_all();
+}
+
+void FileIoInfoHandler::set_hook_switch(uint32_t bits, bool enable) {
+    bits &= HOOK_SWITCH_USER_MASK;
+    if (!enable) {
+        g_hook_switch_mask.fetch_and(~bits, std::memory_order_relaxed);
+        return;
+    }
+    const uint32_t fd_tracking = HOOK_SWITCH_GLOBAL | HOOK_SWITCH_OPEN_CLOSE;
+    uint32_t old_mask = g_hook_switch_mask.load(std::memory_order_relaxed);
+    if ((old_mask & fd_tracking) != fd_tracking && ((old_mask | bits) & fd_tracking) == fd_tracking) {
+        // 关闭期间 fd 可能被关闭、复用，写入也没有被统计，之前的 fd 表项和累计的字节数都不再可信
+        // 只增加代数，表项在下一次访问时失效，不遍历 fd 表，可以在信号处理函数中调用
+        // 先失效再打开，打开之后 open 发布的对应关系带有新的代数
+        fd_generation_.fetch_add(1, std::memory_order_relaxed);
+    }
+    g_hook_switch_mask.fetch_or(bits, std::memory_order_relaxed);
+}
+
+uint32_t FileIoInfoHandler::get_hook_switch() {
+    return g_hook_switch_mask.load(std::memory_order_relaxed) & HOOK_SWITCH_USER_MASK;
+}
+
+// 采样的线程私有状态，initial-exec 模型，访问不经过 __tls_get_addr
+// 距离下一次采样还需要经过的读写次数
+static __thread uint32_t t_sample_countdown __attribute__((tls_model("initial-exec"))) = 0;
+// xorshift 的状态，避免 rand() 内部的锁
+static __thread uint32_t t_sample_rand __attribute__((tls_model("initial-exec"))) = 0;
+
+static inline uint32_t next_sample_rand() {
+    uint32_t x = t_sample_rand;
+    if (__glibc_unlikely(x == 0)) {
+        x = static_cast<uint32_t>(Util::get_tid()) * 2654435761U | 1;
+    }
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    t_sample_rand = x;
+    return x;
+}
+
+// 业务对象销毁后不可再访问
+static inline bool is_object_destruct() {
+    return !(g_hook_switch_mask.load(std::memory_order_relaxed) & HOOK_SWITCH_ALIVE);
+}
+
+void FileIoInfoHandler::add_hook_info(FileOperateType type, int fd, const char* file_name, uint64_t cost_ns) {
+    if (__glibc_unlikely(is_object_destruct())) {
         return;
     }
     if (__glibc_unlikely(type != FileOperateType::OPEN_TYPE && type != FileOperateType::CLOSE_TYPE)) {
@@ -32,74 +93,677 @@ void FileIoInfoHandler::add_hook_info(FileOperateType type, int fd, const char*
         return;
     }
     switch (type) {
-    case OPEN_TYPE:
+    case OPEN_TYPE: {
         monitor_item.open_func_call_num++;
-        fd_file_name_.insert(fd, std::string(file_name));
+        FdEntry* entry = fd_file_name_.get_or_create(fd);
+        if (entry != nullptr) {
+            // 路径规则只在这里匹配一次，被排除的文件不分配 id
+            const PathFilter* filter = path_filter_.load(std::memory_order_acquire);
+            uint32_t file_id = (filter == nullptr || filter->match(file_name))
+                ? file_name_interner_.intern(file_name) : EXCLUDED_FILE_ID;
+            entry->position.store(0, std::memory_order_relaxed);
+            entry->read_pattern.reset();
+            entry->write_pattern.reset();
+            entry->generation.store(fd_generation_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            entry->file_id.store(file_id, std::memory_order_release);
+            if (__glibc_unlikely(shm_exporter_.is_enabled()) && is_tracked_file(file_id)) {
+                shm_exporter_.publish_name(file_id, file_name);
+            }
+            if (__glibc_unlikely(trace_writer_.is_enabled()) && is_tracked_file(file_id)) {
+                trace_writer_.append(type, file_id, 0, cost_ns, -1, 0, file_name);
+            }
+            record_operate(file_id, type, 0, cost_ns);
+        }
         break;
-    case CLOSE_TYPE:
+    }
+    case CLOSE_TYPE: {
         monitor_item.close_func_call_num++;
-        fd_file_name_.erase(fd);
+        FdEntry* entry = fd_file_name_.find(fd);
+        if (entry != nullptr) {
+            // 撤销 fd 和文件的对应关系，耗时记在关闭前的文件上；文件上未刷盘的字节数保留到下一次刷盘
+            uint32_t file_id = load_file_id(entry);
+            entry->file_id.store(INVALID_STRING_ID, std::memory_order_release);
+            finish_access_pattern(entry, file_id);
+            if (__glibc_unlikely(trace_writer_.is_enabled()) && is_tracked_file(file_id)) {
+                trace_writer_.append(type, file_id, 0, cost_ns, -1, 0, nullptr);
+            }
+            record_operate(file_id, type, 0, cost_ns);
+        }
         break;
+    }
     default:
         break;
     }
 }
 
-void FileIoInfoHandler::add_hook_info(FileOperateType type, int fd, size_t rw_size)  {
-    if (__glibc_unlikely(is_object_destruct)) {
+void FileIoInfoHandler::add_hook_info(FileOperateType type, int fd, size_t rw_size, uint64_t cost_ns)  {
+    add_hook_info(type, fd, rw_size, 0, cost_ns);
+}
+
+void FileIoInfoHandler::add_hook_info(FileOperateType type, int fd, size_t rw_size, int iov_count, uint64_t cost_ns,
+    int64_t offset) {
+    if (__glibc_unlikely(is_object_destruct())) {
+        return;
+    }
+    if (__glibc_unlikely(type != FileOperateType::READ_TYPE && type != FileOperateType::WRITE_TYPE
+        && type != FileOperateType::SYNC_TYPE)) {
+        monitor_item.api_rw_param_error_num++;
+        return;
+    }
+    // 追踪记录每一次调用，在采样之前进行
+    if (__glibc_unlikely(trace_writer_.is_enabled())) {
+        const FdEntry* trace_entry = fd_file_name_.find(fd);
+        uint32_t trace_file_id = trace_entry ? load_file_id(trace_entry) : INVALID_STRING_ID;
+        if (is_tracked_file(trace_file_id)) {
+            // 不带偏移的调用从 fd 上记录的位置开始，全局采样时位置不再维护
+            int64_t trace_offset = offset;
+            if (trace_offset < 0 && type != SYNC_TYPE && sample_rate_.load(std::memory_order_relaxed) <= 1) {
+                trace_offset = static_cast<int64_t>(trace_entry->position.load(std::memory_order_relaxed));
+            }
+            trace_writer_.append(type, trace_file_id, rw_size, cost_ns, trace_offset, 0, nullptr);
+        }
+    }
+    // 刷盘次数少，并且需要完整的刷盘批次，不采样
+    bool is_sampled = (type != SYNC_TYPE);
+    uint64_t weight = is_sampled ? sample_global() : 1;
+    if (weight == 0) {
+        return;
+    }
+    FdEntry* entry = fd_file_name_.find(fd);
+    uint32_t file_id = entry ? load_file_id(entry) : INVALID_STRING_ID;
+    if (__glibc_unlikely(!is_tracked_file(file_id))) {
+        if (file_id == INVALID_STRING_ID) {
+            monitor_item.not_found_fd_file_name_num++;
+        }
+        return;
+    }
+    // 访问模式需要看到每一次读写，全局采样时不识别；按文件采样在此之后，热点文件的访问模式仍然完整
+    if (is_sampled && __glibc_likely(weight == 1) && rw_size > 0) {
+        track_access_pattern(entry, file_id, type, rw_size, offset);
+    }
+    if (is_sampled && !sample_file(file_id, weight)) {
+        return;
+    }
+    track_sync_batch(file_id, type, rw_size * weight);
+    record_operate(file_id, type, rw_size, cost_ns, iov_count, 0, weight);
+}
+
+void FileIoInfoHandler::add_transfer_hook_info(int in_fd, int out_fd, size_t size, uint64_t cost_ns) {
+    if (__glibc_unlikely(is_object_destruct())) {
+        return;
+    }
+    if (__glibc_unlikely(trace_writer_.is_enabled())) {
+        uint32_t trace_in_file_id = find_file_id(in_fd);
+        uint32_t trace_out_file_id = find_file_id(out_fd);
+        if (is_tracked_file(trace_in_file_id)) {
+            trace_writer_.append(ZERO_COPY_READ_TYPE, trace_in_file_id, size, cost_ns, -1, 0, nullptr);
+        }
+        if (is_tracked_file(trace_out_file_id)) {
+            trace_writer_.append(ZERO_COPY_WRITE_TYPE, trace_out_file_id, size, cost_ns, -1, 0, nullptr);
+        }
+    }
+    uint64_t weight = sample_global();
+    if (weight == 0) {
+        return;
+    }
+    // 一端是 socket 或管道是常态，只有两端都找不到文件时才算作异常
+    uint32_t in_file_id = find_file_id(in_fd);
+    uint32_t out_file_id = find_file_id(out_fd);
+    if (!is_tracked_file(in_file_id) && !is_tracked_file(out_file_id)) {
+        if (in_file_id == INVALID_STRING_ID && out_file_id == INVALID_STRING_ID) {
+            monitor_item.not_found_fd_file_name_num++;
+        }
+        return;
+    }
+    if (is_tracked_file(out_file_id)) {
+        track_sync_batch(out_file_id, WRITE_TYPE, size * weight);
+    }
+    record_operate(in_file_id, ZERO_COPY_READ_TYPE, size, cost_ns, 0, 0, weight);
+    record_operate(out_file_id, ZERO_COPY_WRITE_TYPE, size, cost_ns, 0, 0, weight);
+}
+
+void FileIoInfoHandler::add_async_hook_info(FileOperateType type, int fd, size_t rw_size, int iov_count,
+    uint32_t depth, uint64_t cost_ns) {
+    if (__glibc_unlikely(is_object_destruct())) {
         return;
     }
-    if (__glibc_unlikely(type != FileOperateType::READ_TYPE && type != FileOperateType::WRITE_TYPE)) {
+    if (__glibc_unlikely(type != FileOperateType::READ_TYPE && type != FileOperateType::WRITE_TYPE
+        && type != FileOperateType::SYNC_TYPE)) {
         monitor_item.api_rw_param_error_num++;
         return;
     }
-    if (data_pool_.size() > max_data_pool_size_) {
+    uint32_t file_id = find_file_id(fd);
+    if (__glibc_unlikely(!is_tracked_file(file_id))) {
+        if (file_id == INVALID_STRING_ID) {
+            monitor_item.not_found_fd_file_name_num++;
+        }
+        return;
+    }
+    if (__glibc_unlikely(trace_writer_.is_enabled())) {
+        trace_writer_.append(type, file_id, rw_size, cost_ns, -1, 0, nullptr);
+    }
+    track_sync_batch(file_id, type, rw_size);
+    record_operate(file_id, type, rw_size, cost_ns, iov_count, depth > 0 ? depth : 1);
+}
+
+void FileIoInfoHandler::add_error_hook_info(FileOperateType type, int fd, int err, uint64_t cost_ns) {
+    if (__glibc_unlikely(trace_writer_.is_enabled()) && !is_object_destruct()
+        && type >= OPEN_TYPE && type < FILE_OPERATE_TYPE_COUNT) {
+        // open 失败时没有 fd，文件 id 记为 0
+        uint32_t file_id = (type == OPEN_TYPE) ? INVALID_STRING_ID : find_file_id(fd);
+        if (type == OPEN_TYPE || is_tracked_file(file_id)) {
+            trace_writer_.append(type, file_id, 0, cost_ns, -1, err, nullptr);
+        }
+    }
+    // 块写满时会写文件，调用方返回前还要使用 errno
+    errno = err;
+}
+
+void FileIoInfoHandler::add_transfer_error_hook_info(int in_fd, int out_fd, int err, uint64_t cost_ns) {
+    add_error_hook_info(ZERO_COPY_READ_TYPE, in_fd, err, cost_ns);
+    add_error_hook_info(ZERO_COPY_WRITE_TYPE, out_fd, err, cost_ns);
+}
+
+void FileIoInfoHandler::add_dup_hook_info(int old_fd, int new_fd) {
+    if (__glibc_unlikely(is_object_destruct())) {
+        return;
+    }
+    if (old_fd < 0 || new_fd < 0 || old_fd == new_fd) {
+        return;
+    }
+    uint32_t file_id = find_file_id(old_fd);
+    FdEntry* entry = file_id == INVALID_STRING_ID ? fd_file_name_.find(new_fd) : fd_file_name_.get_or_create(new_fd);
+    if (entry == nullptr) {
+        return;
+    }
+    // dup2/dup3 会先关闭 new_fd 原来的文件，不论旧 fd 是否有对应的文件都需要覆盖
+    // 与 close 一样，先上报 new_fd 上原来的文件还没有结束的连续段
+    finish_access_pattern(entry, load_file_id(entry));
+    if (file_id != INVALID_STRING_ID) {
+        // 两个 fd 共享文件位置，复制之后各自推进，只在复制时同步一次
+        entry->position.store(fd_file_name_.find(old_fd)->position.load(std::memory_order_relaxed),
+            std::memory_order_relaxed);
+    }
+    entry->read_pattern.reset();
+    entry->write_pattern.reset();
+    entry->generation.store(fd_generation_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    entry->file_id.store(file_id, std::memory_order_release);
+}
+
+void FileIoInfoHandler::add_seek_hook_info(int fd, uint64_t position) {
+    if (__glibc_unlikely(is_object_destruct())) {
+        return;
+    }
+    FdEntry* entry = fd_file_name_.find(fd);
+    if (entry != nullptr && is_tracked_file(load_file_id(entry))) {
+        entry->position.store(position, std::memory_order_relaxed);
+    }
+}
+
+void FileIoInfoHandler::add_advance_hook_info(int fd, uint64_t size) {
+    if (__glibc_unlikely(is_object_destruct())) {
+        return;
+    }
+    FdEntry* entry = fd_file_name_.find(fd);
+    if (entry != nullptr && is_tracked_file(load_file_id(entry))) {
+        entry->position.fetch_add(size, std::memory_order_relaxed);
+    }
+}
+
+void FileIoInfoHandler::add_close_range_hook_info(unsigned int first_fd, unsigned int last_fd) {
+    if (__glibc_unlikely(is_object_destruct())) {
+        return;
+    }
+    if (first_fd > last_fd) {
+        return;
+    }
+    fd_file_name_.for_each_in_range(first_fd, last_fd, [this](int, FdEntry& entry) {
+        if (entry.file_id.load(std::memory_order_relaxed) != INVALID_STRING_ID) {
+            // 与 close 一样，上报还没有结束的连续段
+            uint32_t file_id = load_file_id(&entry);
+            entry.file_id.store(INVALID_STRING_ID, std::memory_order_release);
+            finish_access_pattern(&entry, file_id);
+        }
+    });
+}
+
+void FileIoInfoHandler::track_sync_batch(uint32_t file_id, FileOperateType type, uint64_t bytes) {
+    if (type != WRITE_TYPE && type != SYNC_TYPE) {
+        return;
+    }
+    FileEntry* entry = get_file_entry(file_id);
+    if (__glibc_unlikely(entry == nullptr)) {
+        return;
+    }
+    if (type == WRITE_TYPE) {
+        entry->unsynced_b.fetch_add(bytes, std::memory_order_relaxed);
+        return;
+    }
+    uint64_t batch = entry->unsynced_b.exchange(0, std::memory_order_relaxed);
+    if (__glibc_unlikely(shm_exporter_.is_enabled())) {
+        ShmIoRecord record;
+        memset(&record, 0, sizeof(record));
+        record.bytes = batch;
+        record.file_id = file_id;
+        record.weight = 1;
+        record.type = SYNC_BATCH_KEY_TYPE;
+        shm_exporter_.push(record);
+        return;
+    }
+    ThreadIoData& local = data_pool_.get_local();
+    if (local.data_pool.size() > max_data_pool_size_) {
         monitor_item.exceed_data_pool_size_drop_num++;
         return;
     }
-    uint64_t tid = Util::get_tid();
-    std::string file_name;
-    if (!fd_file_name_.find(fd, file_name)) {
-        monitor_item.not_found_fd_file_name_num++;
+    local.data_pool.update(make_operate_key(file_id, SYNC_BATCH_KEY_TYPE), [batch](FileOperateStat& stat) {
+        stat.call_num++;
+        stat.sample_num++;
+        stat.bytes += batch;
+        stat.latency.record(batch);
+    });
+}
+
+void FileIoInfoHandler::track_access_pattern(FdEntry* entry, uint32_t file_id, FileOperateType type, uint64_t size,
+    int64_t offset) {
+    if (type != READ_TYPE && type != WRITE_TYPE) {
+        return;
+    }
+    uint64_t access_offset = offset >= 0 ? static_cast<uint64_t>(offset)
+        : entry->position.fetch_add(size, std::memory_order_relaxed);
+    AccessPatternDetector& detector = (type == READ_TYPE) ? entry->read_pattern : entry->write_pattern;
+    AccessRunReport report;
+    if (detector.access(access_offset, size, &report)) {
+        record_access_run(file_id, type, report);
+    }
+}
+
+void FileIoInfoHandler::finish_access_pattern(FdEntry* entry, uint32_t file_id) {
+    AccessRunReport report;
+    if (entry->read_pattern.finish(&report) && is_tracked_file(file_id)) {
+        record_access_run(file_id, READ_TYPE, report);
+    }
+    if (entry->write_pattern.finish(&report) && is_tracked_file(file_id)) {
+        record_access_run(file_id, WRITE_TYPE, report);
+    }
+}
+
+void FileIoInfoHandler::record_access_run(uint32_t file_id, FileOperateType type, const AccessRunReport& report) {
+    // 导出的记录中没有访问模式
+    if (__glibc_unlikely(shm_exporter_.is_enabled())) {
+        return;
+    }
+    ThreadIoData& local = data_pool_.get_local();
+    if (local.data_pool.size() > max_data_pool_size_) {
+        monitor_item.exceed_data_pool_size_drop_num++;
+        return;
+    }
+    local.data_pool.update(make_operate_key(file_id, type), [&report](FileOperateStat& stat) {
+        stat.pattern_access_num[report.pattern] += report.access_num;
+        if (report.run_len != 0) {
+            stat.pattern_run_num[report.pattern]++;
+            stat.pattern_max_run_len[report.pattern] = std::max(stat.pattern_max_run_len[report.pattern],
+                report.run_len);
+        }
+    });
+}
+
+uint64_t FileIoInfoHandler::sample_global() {
+    uint32_t rate = sample_rate_.load(std::memory_order_relaxed);
+    if (__glibc_likely(rate <= 1)) {
+        return 1;
+    }
+    if (t_sample_countdown > 1) {
+        --t_sample_countdown;
+        return 0;
+    }
+    // 下一次采样的间隔在 [1, 2 * rate - 1] 中均匀分布，均值为 rate，
+    // 避免与固定周期的 IO 模式（比如每写 N 次刷一次）同步而产生偏差
+    t_sample_countdown = 1 + next_sample_rand() % (2 * rate - 1);
+    return rate;
+}
+
+FileIoInfoHandler::FileEntry* FileIoInfoHandler::get_file_entry(uint32_t file_id) {
+    FileEntry* entry = file_state_.get_or_create(static_cast<int>(file_id));
+    if (__glibc_unlikely(entry == nullptr)) {
+        return nullptr;
+    }
+    uint32_t generation = fd_generation_.load(std::memory_order_relaxed);
+    if (__glibc_unlikely(entry->generation.load(std::memory_order_relaxed) != generation)) {
+        // 与并发的写入竞争时可能丢失几次累加，只影响重新打开后的第一个批次
+        entry->unsynced_b.store(0, std::memory_order_relaxed);
+        entry->generation.store(generation, std::memory_order_relaxed);
+    }
+    return entry;
+}
+
+bool FileIoInfoHandler::sample_file(uint32_t file_id, uint64_t& weight) {
+    const FileEntry* entry = file_state_.find(static_cast<int>(file_id));
+    uint32_t shift = entry ? entry->sample_shift.load(std::memory_order_relaxed) : 0;
+    if (__glibc_likely(shift == 0)) {
+        return true;
+    }
+    if (next_sample_rand() & ((1U << shift) - 1)) {
+        return false;
+    }
+    weight <<= shift;
+    return true;
+}
+
+void FileIoInfoHandler::set_sample_rate(uint32_t rate) {
+    if (rate == 0) {
+        rate = 1;
+    }
+    sample_rate_.store(std::min<uint32_t>(rate, 1U << SAMPLE_MAX_SHIFT), std::memory_order_relaxed);
+}
+
+void FileIoInfoHandler::set_adaptive_sample_target(uint64_t target) {
+    adaptive_sample_target_.store(target, std::memory_order_relaxed);
+    if (target == 0) {
+        adapt_sample_rate(std::unordered_map<uint32_t, uint64_t>());
+    }
+}
+
+void FileIoInfoHandler::adapt_sample_rate(const std::unordered_map<uint32_t, uint64_t>& file_calls) {
+    uint64_t target = adaptive_sample_target_.load(std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(adapt_mtx_);
+    if (file_calls.empty() && sampled_files_.empty()) {
         return;
     }
+    std::vector<uint32_t> sampled_files;
+    if (target != 0) {
+        for (const auto& item : file_calls) {
+            uint32_t shift = 0;
+            for (; shift < SAMPLE_MAX_SHIFT && (item.second >> shift) > target; ++shift) {}
+            if (shift == 0) {
+                continue;
+            }
+            FileEntry* entry = file_state_.get_or_create(static_cast<int>(item.first));
+            if (entry != nullptr) {
+                entry->sample_shift.store(shift, std::memory_order_relaxed);
+                sampled_files.push_back(item.first);
+            }
+        }
+    }
+    // 上个周期降采样、本周期不再是热点的文件恢复精确记录
+    for (uint32_t file_id : sampled_files_) {
+        auto iter = file_calls.find(file_id);
+        if (target != 0 && iter != file_calls.end() && iter->second > target) {
+            continue;
+        }
+        FileEntry* entry = file_state_.find(static_cast<int>(file_id));
+        if (entry != nullptr) {
+            entry->sample_shift.store(0, std::memory_order_relaxed);
+        }
+    }
+    sampled_files_.swap(sampled_files);
+}
+
+void FileIoInfoHandler::set_path_filter(const char* include, const char* exclude) {
+    const PathFilter* filter = new PathFilter(include, exclude);
+    if (filter->empty()) {
+        delete filter;
+        filter = nullptr;
+    }
+    path_filter_.store(filter, std::memory_order_release);
+}
+
+bool FileIoInfoHandler::enable_shm_export(const char* prefix, uint32_t ring_capacity) {
+    if (!shm_exporter_.start(prefix, ring_capacity)) {
+        return false;
+    }
+    publish_shm_names();
+    return true;
+}
+
+bool FileIoInfoHandler::enable_trace(const char* prefix) {
+    return trace_writer_.start(prefix);
+}
+
+bool FileIoInfoHandler::start_background_collect(uint32_t interval_ms) {
+    return BackgroundCollector::get_instance().start(interval_ms);
+}
+
+void FileIoInfoHandler::stop_background_collect() {
+    BackgroundCollector::get_instance().stop();
+}
+
+void FileIoInfoHandler::add_snapshot_callback(const SnapshotCallback& callback) {
+    if (callback) {
+        BackgroundCollector::get_instance().add_sink(std::make_shared<CallbackSink>(callback));
+    }
+}
+
+bool FileIoInfoHandler::add_snapshot_sink(SnapshotSinkType type, const char* target) {
+    if (target == nullptr || *target == '\0') {
+        return false;
+    }
+    // 在业务线程中打开文件，不应该被统计
+    HookGuard guard;
+    std::shared_ptr<SnapshotSink> sink;
     switch (type) {
-    case READ_TYPE:
-        monitor_item.read_func_call_num++;
-        // data_pool_.write(std::make_shared<DoubleBallModuleKey>(tid, file_name), FileRWInfo{rw_size, 0});
-        data_pool_.write(DoubleBallModuleKey{tid, file_name}, FileRWInfo{rw_size, 0});
+    case SNAPSHOT_SINK_FILE: {
+        auto file_sink = std::make_shared<FileSink>();
+        if (!file_sink->open_file(target)) {
+            return false;
+        }
+        sink = file_sink;
         break;
-    case WRITE_TYPE:
-        monitor_item.write_func_call_num++;
-        data_pool_.write(DoubleBallModuleKey{tid, file_name}, FileRWInfo{0, rw_size});
+    }
+    case SNAPSHOT_SINK_SHM:
+        if (strchr(target, '/') != nullptr) {
+            return false;
+        }
+        sink = std::make_shared<ShmSink>(target);
         break;
-    default:
+    case SNAPSHOT_SINK_UNIX_SOCKET:
+        sink = std::make_shared<UnixSocketSink>(target);
         break;
+    default:
+        return false;
     }
+    BackgroundCollector::get_instance().add_sink(std::move(sink));
+    return true;
+}
+
+void FileIoInfoHandler::publish_shm_names() {
+    std::string file_name;
+    uint32_t count = static_cast<uint32_t>(file_name_interner_.size());
+    for (uint32_t file_id = 1; file_id <= count; ++file_id) {
+        if (file_name_interner_.find(file_id, file_name)) {
+            shm_exporter_.publish_name(file_id, file_name.c_str());
+        }
+    }
+}
+
+void FileIoInfoHandler::publish_trace_names() {
+    std::string file_name;
+    uint32_t count = static_cast<uint32_t>(file_name_interner_.size());
+    for (uint32_t file_id = 1; file_id <= count; ++file_id) {
+        if (file_name_interner_.find(file_id, file_name)) {
+            trace_writer_.append_name(file_id, file_name.c_str());
+        }
+    }
+}
+
+void FileIoInfoHandler::record_operate(uint32_t file_id, FileOperateType type, uint64_t bytes, uint64_t cost_ns,
+    int iov_count, uint32_t depth, uint64_t weight) {
+    if (__glibc_unlikely(!is_tracked_file(file_id))) {
+        return;
+    }
+    if (__glibc_unlikely(g_collector_pending.load(std::memory_order_relaxed))) {
+        BackgroundCollector::get_instance().start_if_pending();
+    }
+    if (__glibc_unlikely(shm_exporter_.is_enabled())) {
+        ShmIoRecord record;
+        record.cost_ns = cost_ns;
+        record.bytes = bytes;
+        record.file_id = file_id;
+        record.weight = weight;
+        record.depth = depth;
+        record.iov_count = static_cast<uint16_t>(std::min(iov_count, static_cast<int>(UINT16_MAX)));
+        record.type = static_cast<uint8_t>(type);
+        memset(record.reserved, 0, sizeof(record.reserved));
+        shm_exporter_.push(record);
+        return;
+    }
+    // 只访问当前线程的数据池，没有和其他线程共享的写操作
+    ThreadIoData& local = data_pool_.get_local();
+    if (local.data_pool.size() > max_data_pool_size_) {
+        monitor_item.exceed_data_pool_size_drop_num++;
+        return;
+    }
+    local.data_pool.update(make_operate_key(file_id, type),
+        [bytes, cost_ns, iov_count, depth, weight](FileOperateStat& stat) {
+        // 采样时按权重放大，放大后的次数和字节数是实际值的无偏估计
+        stat.call_num += weight;
+        stat.bytes += bytes * weight;
+        stat.sample_num++;
+        if (iov_count > 0) {
+            stat.vec_call_num += weight;
+            stat.iov_num += iov_count * weight;
+        }
+        if (depth > 0) {
+            stat.async_call_num++;
+            stat.depth_sum += depth;
+            stat.depth_max = std::max<uint64_t>(stat.depth_max, depth);
+        }
+        stat.latency.record(cost_ns, weight);
+    });
 }
 
 const std::vector<FileInfo>& FileIoInfoHandler::consume_and_parse() {
+    std::lock_guard<std::mutex> lock(consume_mtx_);
     static std::vector<FileInfo> file_io_info_vec;
     file_io_info_vec.clear();
-    if (__glibc_unlikely(is_object_destruct)) {
+    if (__glibc_unlikely(is_object_destruct())) {
         return file_io_info_vec;
     }
-    auto& io_data = data_pool_.read_and_switch();
-    auto iter = io_data.get_iterator();
-    // uint64_t tid = 0;
-    // std::string file_name;
-    for (; iter != nullptr; iter++) {
-        // if (!iter->get_key()) {
-        //     continue;
-        // }
-        // if (divide_key(iter->get_key(), &tid, &file_name) < 0) {
-        //     continue;
-        // }
-        file_io_info_vec.emplace_back(FileInfo{
-            .tid = iter->get_key().tid,
-            .file_name = iter->get_key().filename,
-            .read_b = iter->get_value().read_b,
-            .write_b = iter->get_value().write_b});
+    // 收集所有线程的数据，包括上次收集之后已经退出的线程
+    // 已退出线程的数据都在其当前写入的球中，一次切换即可全部取走
+    std::string file_name;
+    // 同一个线程中，文件 id 到结果下标的映射，用于把同一文件的不同操作合并为一条
+    std::unordered_map<uint32_t, size_t> file_pos;
+    // 自适应采样时，本周期每个文件（所有线程合计）估计的读写次数
+    bool is_adaptive = adaptive_sample_target_.load(std::memory_order_relaxed) != 0;
+    std::unordered_map<uint32_t, uint64_t> file_calls;
+    data_pool_.harvest([&](int64_t tid, ThreadIoData& data) {
+        auto* io_data = data.data_pool.read_and_switch();
+        if (io_data == nullptr) {
+            return;
+        }
+        file_pos.clear();
+        auto iter = io_data->get_iterator();
+        for (; iter != nullptr; iter++) {
+            uint32_t file_id = static_cast<uint32_t>(iter->get_key() >> 8);
+            size_t type = static_cast<size_t>(iter->get_key() & 0xff);
+            const FileOperateStat& stat = iter->get_value();
+            if (type == READ_TYPE) {
+                monitor_item.read_func_call_num += stat.call_num;
+            } else if (type == WRITE_TYPE) {
+                monitor_item.write_func_call_num += stat.call_num;
+            }
+            if (type >= FILE_OPERATE_TYPE_COUNT && type != SYNC_BATCH_KEY_TYPE) {
+                continue;
+            }
+            if (is_adaptive && (type == READ_TYPE || type == WRITE_TYPE
+                || type == ZERO_COPY_READ_TYPE || type == ZERO_COPY_WRITE_TYPE)) {
+                file_calls[file_id] += stat.call_num;
+            }
+            auto pos_iter = file_pos.find(file_id);
+            if (pos_iter == file_pos.end()) {
+                if (!file_name_interner_.find(file_id, file_name)) {
+                    continue;
+                }
+                FileInfo info;
+                memset(info.latency, 0, sizeof(info.latency));
+                info.tid = static_cast<uint64_t>(tid);
+                info.file_name = file_name;
+                info.read_b = 0;
+                info.write_b = 0;
+                info.zero_copy_read_b = 0;
+                info.zero_copy_write_b = 0;
+                info.readv_call_num = 0;
+                info.readv_iov_num = 0;
+                info.writev_call_num = 0;
+                info.writev_iov_num = 0;
+                info.async_call_num = 0;
+                info.async_max_depth = 0;
+                info.async_avg_depth = 0;
+                memset(&info.sync_batch, 0, sizeof(info.sync_batch));
+                memset(&info.read_pattern, 0, sizeof(info.read_pattern));
+                memset(&info.write_pattern, 0, sizeof(info.write_pattern));
+                info.estimated = false;
+                pos_iter = file_pos.emplace(file_id, file_io_info_vec.size()).first;
+                file_io_info_vec.emplace_back(std::move(info));
+            }
+            FileInfo& info = file_io_info_vec[pos_iter->second];
+            if (type == SYNC_BATCH_KEY_TYPE) {
+                info.sync_batch = SyncBatchStat{
+                    .sync_num = stat.call_num,
+                    .synced_b = stat.bytes,
+                    .p50_b = stat.latency.percentile(0.5),
+                    .p99_b = stat.latency.percentile(0.99),
+                    .max_b = stat.latency.max()};
+                continue;
+            }
+            info.estimated = info.estimated || stat.sample_num != stat.call_num;
+            if (type == READ_TYPE || type == WRITE_TYPE) {
+                AccessPatternStat& pattern = (type == READ_TYPE) ? info.read_pattern : info.write_pattern;
+                for (int i = 0; i < ACCESS_PATTERN_COUNT; ++i) {
+                    pattern.access_num[i] += stat.pattern_access_num[i];
+                    pattern.run_num[i] += stat.pattern_run_num[i];
+                    pattern.max_run_len[i] = std::max(pattern.max_run_len[i], stat.pattern_max_run_len[i]);
+                }
+            }
+            if (stat.call_num == 0) {
+                // 只有访问模式的连续段，本周期没有记录读写
+                continue;
+            }
+            if (type == READ_TYPE) {
+                info.read_b += stat.bytes;
+                info.readv_call_num += stat.vec_call_num;
+                info.readv_iov_num += stat.iov_num;
+            } else if (type == WRITE_TYPE) {
+                info.write_b += stat.bytes;
+                info.writev_call_num += stat.vec_call_num;
+                info.writev_iov_num += stat.iov_num;
+            } else if (type == ZERO_COPY_READ_TYPE) {
+                info.read_b += stat.bytes;
+                info.zero_copy_read_b += stat.bytes;
+            } else if (type == ZERO_COPY_WRITE_TYPE) {
+                info.write_b += stat.bytes;
+                info.zero_copy_write_b += stat.bytes;
+            }
+            if (stat.async_call_num != 0) {
+                uint64_t async_call_num = info.async_call_num + stat.async_call_num;
+                info.async_avg_depth = (info.async_avg_depth * info.async_call_num + stat.depth_sum)
+                    / async_call_num;
+                info.async_call_num = async_call_num;
+                info.async_max_depth = std::max(info.async_max_depth, stat.depth_max);
+            }
+            info.latency[type] = FileOperateLatency{
+                .call_num = stat.call_num,
+                .p50_ns = stat.latency.percentile(0.5),
+                .p99_ns = stat.latency.percentile(0.99),
+                .p999_ns = stat.latency.percentile(0.999),
+                .max_ns = stat.latency.max()};
+        }
+        data.data_pool.release();
+    });
+    if (is_adaptive) {
+        adapt_sample_rate(file_calls);
+    }
+    for (auto& info : file_io_info_vec) {
+        for (AccessPatternStat* pattern : {&info.read_pattern, &info.write_pattern}) {
+            pattern->dominant = ACCESS_PATTERN_COUNT;
+            uint64_t max_num = 0;
+            for (int i = 0; i < ACCESS_PATTERN_COUNT; ++i) {
+                if (pattern->access_num[i] > max_num) {
+                    max_num = pattern->access_num[i];
+                    pattern->dominant = static_cast<AccessPattern>(i);
+                }
+            }
+        }
     }
     // 按照读写数据量进行降序排序
     std::sort(file_io_info_vec.begin(), file_io_info_vec.end(),
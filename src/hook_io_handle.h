@@ -11,20 +11,45 @@
 
 #pragma once
 
+#include <functional>
 #include <queue>
 #include <string>
 #include <unordered_map>
 #include <memory>
+#include <mutex>
 #include <vector>
 #include <algorithm>
+#include "common/access_pattern.h"
+#include "common/common.h"
 #include "common/concurrent_hash_map.h"
+#include "common/fd_table.h"
+#include "common/lock_free_hash_map.h"
+#include "common/log_linear_histogram.h"
+#include "common/path_filter.h"
 #include "common/rw_spin_lock.h"
+#include "common/string_interner.h"
+#include "common/thread_local_registry.h"
+#include "hook_switch.h"
+#include "shm_exporter.h"
+#include "trace_writer.h"
 
 namespace file_io_hook {
 
-// 默认的数据池最多元素量
+// 默认的数据池最多元素量，每个线程的数据池单独计算
 #define DEFAULT_MAX_DATA_POOL_SIZE (10000)
 
+// 线程私有数据池中哈希桶的数量，单个线程操作的文件数量有限，取一个较小的质数
+#define DEFAULT_THREAD_HASH_BUCKET_SIZE (127)
+
+// 数据池中刷盘批次的 key 类型，与 FileOperateType 共用 key 的低 8 位，直方图中记录的是字节数
+#define SYNC_BATCH_KEY_TYPE (0xff)
+
+// fd 上的文件被路径规则排除时的文件 id，后续在该 fd 上的 IO 不做任何统计
+#define EXCLUDED_FILE_ID (UINT32_MAX)
+
+// 自适应采样时单个文件的最大采样率为 1/2^SAMPLE_MAX_SHIFT
+#define SAMPLE_MAX_SHIFT (16)
+
 /**
  * @brief hook 函数内存监控的项目
  * 
@@ -49,14 +74,46 @@ struct HookFuncMonitorItem {
 };
 
 /**
- * @brief 文件操作的类型
+ * @brief 某一类文件操作的耗时统计，单位为纳秒
+ *  分位数取自对数线性直方图，相对误差不超过 1/8
  * 
  */
-enum FileOperateType {
-    OPEN_TYPE = 0,
-    READ_TYPE,
-    WRITE_TYPE,
-    CLOSE_TYPE
+struct FileOperateLatency {
+    uint64_t call_num;
+    uint64_t p50_ns;
+    uint64_t p99_ns;
+    uint64_t p999_ns;
+    uint64_t max_ns;
+};
+
+/**
+ * @brief 刷盘批次的统计，单位为字节
+ *  每次刷盘（fsync 等）时，记录该 fd 上距上次刷盘（或打开文件）写入的字节数
+ *  批次很小说明调用方每次小写入都刷盘，适合改为组提交
+ * 
+ */
+struct SyncBatchStat {
+    uint64_t sync_num;
+    uint64_t synced_b;
+    uint64_t p50_b;
+    uint64_t p99_b;
+    uint64_t max_b;
+};
+
+/**
+ * @brief 某个方向（读或者写）上的访问模式统计
+ *  每次 read/write 按照与上一次访问的关系分类，同一模式的连续访问组成一个连续段
+ *  顺序读的连续段很短、随机访问很多的文件，内核预读（readahead）基本是浪费的；反之，大量顺序读可以加大预读
+ * 
+ */
+struct AccessPatternStat {
+    // 每种模式的访问次数，以 AccessPattern 为下标
+    uint64_t access_num[ACCESS_PATTERN_COUNT];
+    // 已经结束的连续段的数量和最大长度（访问次数），还没有结束的连续段只计入 access_num
+    uint64_t run_num[ACCESS_PATTERN_COUNT];
+    uint64_t max_run_len[ACCESS_PATTERN_COUNT];
+    // 访问次数最多的模式，没有访问时为 ACCESS_PATTERN_COUNT
+    AccessPattern dominant;
 };
 
 /**
@@ -68,8 +125,51 @@ struct FileInfo {
     std::string file_name;
     uint64_t read_b;
     uint64_t write_b;
+    // 零拷贝传输的字节数，同时也计入 read_b/write_b
+    uint64_t zero_copy_read_b;
+    uint64_t zero_copy_write_b;
+    // 向量读写（readv/writev 等）的调用次数和 iovec 的总数，iov_num / call_num 反映调用方合并 IO 的程度
+    uint64_t readv_call_num;
+    uint64_t readv_iov_num;
+    uint64_t writev_call_num;
+    uint64_t writev_iov_num;
+    // 异步 IO（native AIO、POSIX AIO）完成的请求数，以及提交时该文件上未完成请求数（队列深度）的最大值和平均值
+    uint64_t async_call_num;
+    uint64_t async_max_depth;
+    double async_avg_depth;
+    // 刷盘批次，刷盘的耗时见 latency[SYNC_TYPE]
+    SyncBatchStat sync_batch;
+    // 读和写的访问模式，不受采样放大
+    AccessPatternStat read_pattern;
+    AccessPatternStat write_pattern;
+    // 每类操作的耗时，以 FileOperateType 为下标
+    FileOperateLatency latency[FILE_OPERATE_TYPE_COUNT];
+    // 开启采样时，读写的次数、字节数以及耗时分布是否为采样后按采样率放大的估计值
+    bool estimated;
+};
+
+/**
+ * @brief 后台收集线程每个周期调用的回调，在收集线程中执行
+ * 
+ */
+typedef std::function<void(const std::vector<FileInfo>&)> SnapshotCallback;
+
+/**
+ * @brief 后台收集线程输出快照的方式，除回调外都输出 JSON Lines 格式的文本，每个 (线程, 文件) 一行
+ * 
+ */
+enum SnapshotSinkType {
+    // 追加写入文件，target 为文件路径
+    SNAPSHOT_SINK_FILE = 0,
+    // 在 /dev/shm/<target>.<pid> 中保存最近一次的快照
+    SNAPSHOT_SINK_SHM,
+    // 发送到 Unix 域套接字，target 为套接字路径
+    SNAPSHOT_SINK_UNIX_SOCKET
 };
 
+// 写线程计数器的分片数量，必须是 2 的幂
+#define DOUBLE_BALL_WRITER_SHARD_COUNT (8)
+
 /**
  * @brief 双球模型
  * 为了实现高效率的读写，采用双球模型
@@ -77,14 +177,28 @@ struct FileInfo {
  * 同样的，当一个触发条件诞生时，竞争的粒度应该尽可能的小
  * 也就是说，同一段时间只去写一个球 A，触发条件产生，进行切换球，写另外一个球 B，而此时我们再去读球 A
  * 这样就可以保证尽可能的少竞争，性能更佳
- * 
+ *
+ * 球的切换基于纪元（epoch）实现，类似 RCU：
+ * 1. 纪元的奇偶决定写哪个球。写线程进入时在自己的计数器分片上登记，离开时注销，全程不加锁，也不会等待读线程
+ * 2. 读线程把纪元加一，之后新的写入都进入另一个球，读线程只需要等待旧纪元中还没有离开的写线程
+ * 3. 读线程拿到的快照在调用 release 之前一直有效，release 时清空快照，下一次切换才能复用这个球
+ *
  * 同时，也将数据更进一层抽象化，对外屏蔽掉双球模型的细节。
  * 只提供写和读的接口保证数据的安全
+ *
+ * 球的实现由模板参数 M 决定，默认为 ConcurrentHashMap，值为 POD 计数时也可以使用 LockFreeHashMap
  */
-template <typename K, typename V, typename F = std::hash<K>>
+template <typename K, typename V, typename F = std::hash<K>,
+    template <typename, typename, typename> class M = ConcurrentHashMap>
 struct DoubleBallModule {
 public:
-    DoubleBallModule() = default;
+    /**
+     * @brief 构造函数
+     *
+     * @param hash_bucket_size 每个球的大小，ConcurrentHashMap 中为桶的数量，LockFreeHashMap 中为槽位的数量
+     */
+    explicit DoubleBallModule(size_t hash_bucket_size = DEFAULT_HASH_BUCKET_SIZE)
+        : ball_01_(hash_bucket_size), ball_02_(hash_bucket_size) {}
     ~DoubleBallModule() = default;
     DoubleBallModule(const DoubleBallModule&) = delete;
     DoubleBallModule& operator=(const DoubleBallModule&) = delete;
@@ -93,99 +207,190 @@ public:
 
 public:
     /**
-     * @brief 写数据
-     * 当 choose_ball_ 为 true 时，写 ball_01_
-     * 当 choose_ball_ 为 false 时，写 ball_01_
-     * 
-     * @param key 
-     * @param value 
+     * @brief 写数据，键存在时累加值
+     *
+     * @param key
+     * @param value
      */
     void write(const K& key, const V& value) {
-        // rw_spin_lock_.read_lock();
-        mtx_.lock();
-        ConcurrentHashMap<K, V, F>* ball = choose_ball_ ? &ball_01_ : &ball_02_;
-        ball->insert_and_inc(key, value);
-        data_count_++;
-        // rw_spin_lock_.read_unlock();
-        mtx_.unlock();
+        write_ball([&key, &value](M<K, V, F>& ball) {
+            ball.insert_and_inc(key, value);
+        });
+    }
+
+    /**
+     * @brief 写数据，在当前球中对 key 对应的值执行 fn，键不存在时先插入默认值
+     *  要求球的实现提供 update 接口（ConcurrentHashMap）
+     *
+     * @tparam Fn 形如 void(V&)
+     * @param key
+     * @param fn
+     */
+    template <typename Fn>
+    void update(const K& key, Fn fn) {
+        write_ball([&key, &fn](M<K, V, F>& ball) {
+            ball.update(key, fn);
+        });
     }
 
     /**
      * @brief 读数据
-     * 当 choose_ball_ 为 true 时，我们需要读 ball_01_
-     * 并且将 choose_ball_ 置为 false，让写数据线程写 ball_02_
-     * 实现高效的切换和高效的读写。反之亦然
-     * 
-     * @return const ConcurrentHashMap<K, V>& 
-     */
-    ConcurrentHashMap<K, V, F>& read_and_switch() {
-        // 此时所有的写线程都在操作球 A，我们对球 B 进行清理。没有竞争，这是线程安全的
-        // 因此不用放在锁内
-        choose_ball_ ? ball_02_.clear() : ball_01_.clear();
-        // 这个读写自旋锁中，写锁中的临界区比较小，效率高
-        // rw_spin_lock_.write_lock();
-        mtx_.lock();
-        ConcurrentHashMap<K, V, F>* res = choose_ball_ ? &ball_01_ : &ball_02_;
-        choose_ball_ = !choose_ball_;
-        data_count_ = 0;
-        // rw_spin_lock_.write_unlock();
-        mtx_.unlock();
-        // 到这里，已经切换了球，所有的写线程去写另外一个球了，所以操作这个球是线程安全的
-        return *res;
+     * 切换纪元，让写线程去写另一个球，等待旧纪元中的写线程离开后返回旧球作为快照
+     * 快照在调用 release 之前一直有效，在此期间不能再次切换
+     *
+     * @return M<K, V, F>* 上一个快照还没有 release 时返回 nullptr
+     */
+    M<K, V, F>* read_and_switch() {
+        if (snapshot_ != nullptr) {
+            return nullptr;
+        }
+        uint64_t old_epoch = epoch_.fetch_add(1);
+        // 只需要等待旧纪元中还没有离开的写线程，它们的临界区只有一次哈希表的插入
+        for (size_t i = 0; i < DOUBLE_BALL_WRITER_SHARD_COUNT; ++i) {
+            for (; shards_[i].writers[old_epoch & 1].load(std::memory_order_acquire) != 0;) {
+                std::this_thread::yield();
+            }
+        }
+        // 到这里，所有的写线程都去写另外一个球了，所以操作这个球是线程安全的
+        snapshot_epoch_ = old_epoch;
+        snapshot_ = &get_ball(old_epoch);
+        return snapshot_;
     }
 
+    /**
+     * @brief 释放 read_and_switch 返回的快照
+     * 快照被清空，下一次切换时写线程会重新写入这个球
+     * 此时没有写线程访问这个球，可以顺便收缩它，释放扩容时被替换的桶数组
+     * 收缩会释放 lock_prefork 要遍历的桶数组，调用者需要与 fork 前的加锁互斥（FileIoInfoHandler 中为 consume_mtx_）
+     *
+     */
+    void release() {
+        if (snapshot_ == nullptr) {
+            return;
+        }
+        snapshot_->clear();
+        snapshot_->shrink();
+        snapshot_ = nullptr;
+    }
+
+    /**
+     * @brief 当前正在写入的球中不同 key 的数量
+     *  对已有 key 的累加不增加数量
+     *
+     * @return uint64_t
+     */
     uint64_t size() const {
-        return data_count_;
+        return get_ball(epoch_.load(std::memory_order_relaxed)).size();
     }
 
 public:
     /**
      * @brief fork 前在父进程上下文执行
-     * 
+     *
      */
     void lock_prefork() {
-        // 这里只需要对 rw_spin_lock_ 加锁即可，无需对两个球加锁
-        // 因为能给 rw_spin_lock_ 加到锁，两个球内部不会有线程访问，也不会有锁，锁处于释放状态
-        // rw_spin_lock_.write_lock();
-        mtx_.lock();
+        // 写线程不持有这里的任何锁，只需要对两个球中的桶加锁
+        ball_01_.lock_prefork();
+        ball_02_.lock_prefork();
     }
 
     /**
      * @brief fork 调用创建出子进程后，fork 返回前在父进程上下文中执行
-     * 
+     *
      */
     void lock_postfork_parent() {
-        // rw_spin_lock_.write_unlock();
-        mtx_.unlock();
+        ball_01_.lock_postfork_parent();
+        ball_02_.lock_postfork_parent();
     }
 
     /**
      * @brief fork 调用创建子进程后，fork 返回前在子进程上下文中执行
-     * 
+     * 子进程中其他线程都不存在了，它们在计数器上的登记也要清除，否则下一次切换会一直等待
+     * 持有快照的读线程也不存在了，快照不会再被 release，这里释放掉，否则之后 read_and_switch 一直返回 nullptr
+     *
      */
     void lock_postfork_child() {
-        // rw_spin_lock_.write_unlock();
-        mtx_.unlock();
+        ball_01_.lock_postfork_child();
+        ball_02_.lock_postfork_child();
+        for (size_t i = 0; i < DOUBLE_BALL_WRITER_SHARD_COUNT; ++i) {
+            shards_[i].writers[0].store(0, std::memory_order_relaxed);
+            shards_[i].writers[1].store(0, std::memory_order_relaxed);
+        }
+        release();
+    }
+
+    /**
+     * @brief 对球的节点分配器加锁，所有同类型的模块共用，需要在所有模块的 lock_prefork 之后调用一次
+     *
+     */
+    static void lock_allocator_prefork() {
+        M<K, V, F>::lock_allocator_prefork();
+    }
+
+    static void lock_allocator_postfork_parent() {
+        M<K, V, F>::lock_allocator_postfork_parent();
+    }
+
+    static void lock_allocator_postfork_child() {
+        M<K, V, F>::lock_allocator_postfork_child();
     }
 
 private:
-    volatile bool choose_ball_ = true;
-    ConcurrentHashMap<K, V, F> ball_01_;
-    ConcurrentHashMap<K, V, F> ball_02_;
-    // 读写自旋锁
-    // RWSpinLock rw_spin_lock_;
-    std::mutex mtx_;
-    // 当前数据池中数据的数量
-    volatile uint64_t data_count_;
-};
+    /**
+     * @brief 写线程计数器的分片，每个分片独占一个缓存行，线程按 tid 映射到分片
+     *
+     */
+    struct WriterShard {
+        // 分别对应偶数纪元和奇数纪元中还没有离开的写线程数量
+        std::atomic<int64_t> writers[2];
+        char padding[64 - 2 * sizeof(std::atomic<int64_t>)];
+
+        WriterShard() {
+            writers[0].store(0, std::memory_order_relaxed);
+            writers[1].store(0, std::memory_order_relaxed);
+        }
+    };
 
-/**
- * @brief 检测 FileIoInfoHandler 对象是否被销毁
- * 为了检查进程退出时，先销毁了业务对象，然后调用 exit，进而调用 close/fclose 导致使用了被 hook 的 close/fclose 函数
- * 而 hook 的 close/fclose 会使用相关业务对象
- * 暂时通过一个全局变量来规避，当业务对象销毁时，让全局变量置为 true，并且不再调用 hook 函数
- */
-static bool is_object_destruct = false;
+    M<K, V, F>& get_ball(uint64_t epoch) {
+        return (epoch & 1) ? ball_02_ : ball_01_;
+    }
+    const M<K, V, F>& get_ball(uint64_t epoch) const {
+        return (epoch & 1) ? ball_02_ : ball_01_;
+    }
+
+    /**
+     * @brief 在当前纪元对应的球上执行一次写操作
+     * 纪元为偶数时写 ball_01_，为奇数时写 ball_02_
+     * 登记之后如果发现纪元已经变化，说明读线程刚刚切换了球，注销后按新的纪元重试
+     *
+     * @tparam Op 形如 void(M<K, V, F>&)
+     * @param op
+     */
+    template <typename Op>
+    void write_ball(Op op) {
+        WriterShard& shard = shards_[Util::get_tid() & (DOUBLE_BALL_WRITER_SHARD_COUNT - 1)];
+        uint64_t epoch = epoch_.load();
+        for (;;) {
+            shard.writers[epoch & 1].fetch_add(1);
+            uint64_t current = epoch_.load();
+            if (__glibc_likely(current == epoch)) break;
+            shard.writers[epoch & 1].fetch_sub(1, std::memory_order_release);
+            epoch = current;
+        }
+        op(get_ball(epoch));
+        shard.writers[epoch & 1].fetch_sub(1, std::memory_order_release);
+    }
+
+private:
+    // 当前纪元
+    std::atomic<uint64_t> epoch_ = ATOMIC_VAR_INIT(0);
+    WriterShard shards_[DOUBLE_BALL_WRITER_SHARD_COUNT];
+    M<K, V, F> ball_01_;
+    M<K, V, F> ball_02_;
+    // 读线程持有的快照，只被读线程访问
+    M<K, V, F>* snapshot_ = nullptr;
+    uint64_t snapshot_epoch_ = 0;
+};
 
 /**
  * @brief 收集文件的 IO 信息
@@ -195,7 +400,7 @@ static bool is_object_destruct = false;
 class FileIoInfoHandler {
 public:
     ~FileIoInfoHandler() {
-        is_object_destruct = true;
+        set_destruct_status();
     }
     FileIoInfoHandler(const FileIoInfoHandler&) = delete;
     FileIoInfoHandler& operator=(const FileIoInfoHandler&) = delete;
@@ -203,13 +408,11 @@ public:
     FileIoInfoHandler& operator=(FileIoInfoHandler&&) = delete;
     /**
      * @brief 单例模式
+     *  定义在 hook 库中，可执行文件（即使没有导出符号）调用时拿到的也是 hook 库中的实例，而不是自己的副本
      * 
      * @return FileIoInfoHandler& 
      */
-    static FileIoInfoHandler& get_instance() {
-        static FileIoInfoHandler instance;
-        return instance;
-    }
+    static FileIoInfoHandler& get_instance();
 
 public:
     /**
@@ -219,32 +422,234 @@ public:
      * @param type 
      * @param fd 
      * @param file_name 
+     * @param cost_ns 真实函数调用的耗时
+     */
+    void add_hook_info(FileOperateType type, int fd, const char* file_name, uint64_t cost_ns);
+
+    /**
+     * @brief 添加 read/write/sync hook io 函数的信息
+     *  此函数在 hook 函数的 HookGuard 作用域内执行，其中的 IO 函数直接调用真实函数，不会被统计
+     * @param type 
+     * @param rw_size 
+     * @param cost_ns 真实函数调用的耗时
      */
-    void add_hook_info(FileOperateType type, int fd, const char* file_name);
+    void add_hook_info(FileOperateType type, int fd, size_t rw_size, uint64_t cost_ns);
 
     /**
-     * @brief 添加 read/write hook io 函数的信息
-     *  注意：此函数内不可添加 IO 类函数，否则可能会造成死循环
-     *  比如：hook_write 调用 add_hook_info，而 add_hook_info 使用 IO 函数的话又相当于调用了 hook_write
+     * @brief 添加 readv/writev 等向量读写 hook io 函数的信息
+     *  字节数计入 read/write，同时记录调用次数和 iovec 的数量
+     * 
      * @param type 
+     * @param fd 
      * @param rw_size 
+     * @param iov_count 非向量读写为 0
+     * @param cost_ns 真实函数调用的耗时
+     * @param offset pread/pwrite 等显式给出的偏移，小于 0 为未知，只用于事件追踪
      */
-    void add_hook_info(FileOperateType type, int fd, size_t rw_size);
+    void add_hook_info(FileOperateType type, int fd, size_t rw_size, int iov_count, uint64_t cost_ns,
+        int64_t offset = -1);
+
+    /**
+     * @brief 添加调用失败的 hook io 函数的信息
+     *  只在事件追踪中记录，统计数据中不包括失败的调用。返回前恢复 errno 为 err
+     * 
+     * @param type 
+     * @param fd open 失败时为 -1
+     * @param err 
+     * @param cost_ns 真实函数调用的耗时
+     */
+    void add_error_hook_info(FileOperateType type, int fd, int err, uint64_t cost_ns);
+
+    /**
+     * @brief 添加 sendfile/splice/copy_file_range 等零拷贝传输 hook io 函数的信息
+     *  字节数记为源文件的零拷贝读和目标文件的零拷贝写，不是文件的一端（比如 socket、管道）忽略
+     * 
+     * @param in_fd 
+     * @param out_fd 
+     * @param size 
+     * @param cost_ns 真实函数调用的耗时，两端各记一次
+     */
+    void add_transfer_hook_info(int in_fd, int out_fd, size_t size, uint64_t cost_ns);
+
+    /**
+     * @brief 添加调用失败的零拷贝传输 hook io 函数的信息
+     *  两端中是文件的一端各记一个失败的零拷贝读或写，其余同 add_error_hook_info
+     * 
+     * @param in_fd 
+     * @param out_fd 
+     * @param err 
+     * @param cost_ns 真实函数调用的耗时
+     */
+    void add_transfer_error_hook_info(int in_fd, int out_fd, int err, uint64_t cost_ns);
+
+    /**
+     * @brief 添加异步 IO（io_submit、aio_read 等）完成时的信息
+     *  字节数和耗时与同步读写合并，另外记录提交时的队列深度
+     * 
+     * @param type READ_TYPE/WRITE_TYPE/SYNC_TYPE
+     * @param fd 
+     * @param rw_size 
+     * @param iov_count 向量读写的 iovec 数量，非向量读写为 0
+     * @param depth 提交时该 fd 上未完成的请求数（包括自己）
+     * @param cost_ns 从提交到观察到完成的耗时
+     */
+    void add_async_hook_info(FileOperateType type, int fd, size_t rw_size, int iov_count, uint32_t depth,
+        uint64_t cost_ns);
+
+    /**
+     * @brief 添加 dup/dup2/dup3/fcntl(F_DUPFD) hook io 函数的信息
+     *  新 fd 与旧 fd 指向同一个文件，复制文件 id；旧 fd 没有对应的文件时，清除新 fd 上原来的对应关系
+     * 
+     * @param old_fd 
+     * @param new_fd 
+     */
+    void add_dup_hook_info(int old_fd, int new_fd);
+
+    /**
+     * @brief 添加 lseek/lseek64 hook io 函数的信息
+     *  read/write 等不带偏移的调用从 fd 上记录的位置开始访问，lseek 修改这个位置
+     * 
+     * @param fd 
+     * @param position lseek 返回的新位置
+     */
+    void add_seek_hook_info(int fd, uint64_t position);
+
+    /**
+     * @brief 不带偏移的零拷贝传输（sendfile/splice/copy_file_range）从 fd 上记录的位置开始读写，并推进这个位置
+     * 
+     * @param fd 
+     * @param size 传输的字节数
+     */
+    void add_advance_hook_info(int fd, uint64_t size);
+
+    /**
+     * @brief 添加 close_range/closefrom hook io 函数的信息
+     *  撤销 [first_fd, last_fd] 范围内所有 fd 和文件的对应关系
+     * 
+     * @param first_fd 
+     * @param last_fd 包含
+     */
+    void add_close_range_hook_info(unsigned int first_fd, unsigned int last_fd);
 
     /**
      * @brief 消费所有信息，并且解析后返回
+     *  全程持有 consume_mtx_，与 fork 前的加锁互斥，fork 时不会有线程持有数据池的快照或者正在收缩球
      * 
      * @return const std::vector<FileInfo>& 
      */
     const std::vector<FileInfo>& consume_and_parse();
 
+    /**
+     * @brief 设置全局的采样率，每个线程每 rate 次读写（平均）记录一次，记录时按 rate 放大
+     *  采样在访问 fd 表和数据池之前进行，未被采样的读写只有一次线程私有计数器的递减
+     *  只对读写、零拷贝传输生效，open/close/刷盘/异步 IO 总是全部记录
+     * 
+     * @param rate 1 为不采样，最大为 2^SAMPLE_MAX_SHIFT
+     */
+    void set_sample_rate(uint32_t rate);
+
+    /**
+     * @brief 设置自适应采样的目标
+     *  每次 consume_and_parse 时，估计每个文件在本周期内的读写次数，
+     *  超过 target 的文件在下一个周期按 1/2^n 采样（n 取使采样次数不超过 target 的最小值），
+     *  其余文件恢复为全部记录，因此访问少的文件保持精确，热点文件被采样
+     * 
+     * @param target 每个文件每个周期期望记录的读写次数，0 为关闭自适应采样
+     */
+    void set_adaptive_sample_target(uint64_t target);
+
+    /**
+     * @brief 设置路径的包含/排除规则，规则的格式见 PathFilter
+     *  规则只在 open 时匹配一次，不匹配的 fd 在 fd 表中标记为 EXCLUDED_FILE_ID，
+     *  之后在该 fd 上的读写只需要一次比较即可跳过，也不会为其分配文件 id
+     *  新规则只对之后 open 的文件生效；旧规则不会被释放，其他线程可能仍在使用
+     * 
+     * @param include 包含规则，为空时包含所有路径
+     * @param exclude 排除规则
+     */
+    void set_path_filter(const char* include, const char* exclude);
+
+    /**
+     * @brief 打开共享内存导出，之后的记录不再进入进程内的数据池，consume_and_parse 不再返回数据
+     *  每个线程把记录写入段中属于自己的环形队列，由进程外的收集器（tools/fio_collector）读取，见 ShmExporter
+     *  自适应采样依赖进程内的收集，导出时不生效
+     * 
+     * @param prefix 段名的前缀，段名为 /<prefix>.<pid>
+     * @param ring_capacity 每个线程的环形队列可以容纳的记录数，向上取整为 2 的幂
+     * @return true 
+     * @return false 参数不合法、已经打开过或者创建共享内存失败
+     */
+    bool enable_shm_export(const char* prefix, uint32_t ring_capacity = SHM_DEFAULT_RING_CAPACITY);
+
+    /**
+     * @brief 打开事件追踪，之后每次调用（包括失败的调用）都作为一个事件写入 <prefix>.<pid>.trace
+     *  与统计数据互不影响，也不受采样影响；文件格式见 trace_format.h，可以用 tools/fio_analyze 分析
+     * 
+     * @param prefix 文件名的前缀，可以包含目录
+     * @return true 
+     * @return false 参数不合法、已经打开过或者创建文件失败
+     */
+    bool enable_trace(const char* prefix);
+
+    /**
+     * @brief 启动库内部的后台收集线程，按间隔调用 consume_and_parse，把快照交给注册的输出方式
+     *  启动之后业务不能再调用 consume_and_parse；已经启动时只修改间隔
+     *  也可以通过环境变量 FILE_IO_HOOK_COLLECT_INTERVAL_MS 等配置，此时线程在第一次记录 IO 时启动
+     * 
+     * @param interval_ms 收集间隔，0 为默认值
+     * @return true 
+     * @return false 创建线程失败
+     */
+    bool start_background_collect(uint32_t interval_ms);
+
+    /**
+     * @brief 停止后台收集线程，等待它退出
+     * 
+     */
+    void stop_background_collect();
+
+    /**
+     * @brief 注册后台收集线程每个周期调用的回调
+     * 
+     * @param callback 
+     */
+    void add_snapshot_callback(const SnapshotCallback& callback);
+
+    /**
+     * @brief 注册后台收集线程的输出方式
+     * 
+     * @param type 
+     * @param target 文件路径、共享内存名或者套接字路径
+     * @return true 
+     * @return false 参数不合法或者打开文件失败
+     */
+    bool add_snapshot_sink(SnapshotSinkType type, const char* target);
+
     /**
      * @brief Set the destruct status object
+     *  定义在 hook 库中，这样可执行文件调用时修改的是 hook 库中的状态，而不是自己的副本
+     *  业务对象销毁或者进程退出时调用，之后所有 hook 函数直接调用真实函数，不可再打开
      * 
      */
-    void set_destruct_status() {
-        is_object_destruct = true;
-    }
+    void set_destruct_status();
+
+    /**
+     * @brief 打开或者关闭 hook 的统计
+     *  重新打开 open/close 的统计时（总开关或者 HOOK_SWITCH_OPEN_CLOSE），关闭期间 fd 可能已经被关闭并复用，
+     *  先清空 fd 和文件的对应关系，之后只统计重新打开后 open 的文件
+     *  只使用原子操作，可以在信号处理函数中调用
+     * 
+     * @param bits HookSwitchBit 的组合，HOOK_SWITCH_USER_MASK 之外的位被忽略
+     * @param enable 
+     */
+    void set_hook_switch(uint32_t bits, bool enable);
+
+    /**
+     * @brief 获取 hook 开关的当前值
+     * 
+     * @return uint32_t HookSwitchBit 的组合
+     */
+    uint32_t get_hook_switch();
 
 public:
     /**
@@ -252,9 +657,18 @@ public:
      * 
      */
     void lock_prefork() {
-        // 这两个没有顺序区分
+        // 等待正在进行的 consume_and_parse 结束，它持有快照并且可能正在收缩球中的桶数组
+        // 之后遍历各个球加锁时，桶数组不会被释放或者替换成更小的
+        consume_mtx_.lock();
+        // 先禁止新建槽位，保证 fork 前后加锁解锁的是同一批线程的数据
+        // 写线程在桶锁内分配节点，节点分配器的锁要在所有桶的锁之后获取，解锁顺序相反
         data_pool_.lock_prefork();
-        fd_file_name_.lock_prefork();
+        data_pool_.for_each([](ThreadIoData& data) {
+            data.data_pool.lock_prefork();
+        });
+        decltype(ThreadIoData::data_pool)::lock_allocator_prefork();
+        file_name_interner_.lock_prefork();
+        trace_writer_.lock_prefork();
     }
 
     /**
@@ -262,8 +676,14 @@ public:
      * 
      */
     void lock_postfork_parent() {
+        decltype(ThreadIoData::data_pool)::lock_allocator_postfork_parent();
+        data_pool_.for_each([](ThreadIoData& data) {
+            data.data_pool.lock_postfork_parent();
+        });
         data_pool_.lock_postfork_parent();
-        fd_file_name_.lock_postfork_parent();
+        file_name_interner_.lock_postfork_parent();
+        trace_writer_.lock_postfork_parent();
+        consume_mtx_.unlock();
     }
 
     /**
@@ -271,8 +691,22 @@ public:
      * 
      */
     void lock_postfork_child() {
+        decltype(ThreadIoData::data_pool)::lock_allocator_postfork_child();
+        data_pool_.for_each([](ThreadIoData& data) {
+            data.data_pool.lock_postfork_child();
+        });
         data_pool_.lock_postfork_child();
-        fd_file_name_.lock_postfork_child();
+        file_name_interner_.lock_postfork_child();
+        // 子进程导出到自己的段中，新段中没有 fork 前打开的文件名
+        if (shm_exporter_.lock_postfork_child()) {
+            publish_shm_names();
+        }
+        // 子进程追踪到新文件中，新文件中没有 fork 前打开的文件名
+        trace_writer_.lock_postfork_child();
+        if (trace_writer_.is_enabled()) {
+            publish_trace_names();
+        }
+        consume_mtx_.unlock();
     }
 
 private:
@@ -298,50 +732,253 @@ private:
      */
     int divide_key(const std::string& key, uint64_t* tid, std::string* file_name);
 
+    /**
+     * @brief 在当前线程的数据池中记录一次文件操作
+     *
+     * @param file_id
+     * @param type
+     * @param bytes
+     * @param cost_ns
+     * @param iov_count 向量读写的 iovec 数量，其他操作为 0
+     * @param depth 异步请求提交时的队列深度，同步操作为 0
+     * @param weight 采样的权重，次数、字节数和耗时分布都按权重放大
+     */
+    void record_operate(uint32_t file_id, FileOperateType type, uint64_t bytes, uint64_t cost_ns,
+        int iov_count = 0, uint32_t depth = 0, uint64_t weight = 1);
+
+    /**
+     * @brief 把已经分配 id 的所有文件名写入共享内存的文件名表
+     *
+     */
+    void publish_shm_names();
+
+    /**
+     * @brief 把已经记录的所有文件名写入追踪文件，fork 出的子进程打开新的追踪文件之后调用
+     *
+     */
+    void publish_trace_names();
+
+    /**
+     * @brief 全局采样，使用线程私有的倒计数，不访问任何共享数据
+     *
+     * @return uint64_t 本次读写的权重，0 为不记录
+     */
+    uint64_t sample_global();
+
+    struct FdEntry;
+    struct FileEntry;
+
+    /**
+     * @brief 写入和刷盘时维护文件上未刷盘的字节数
+     *  按文件而不是 fd 累计：通过 dup 出的 fd 或者另外打开的 fd 刷盘、写入的 fd 在刷盘前关闭，批次都是完整的
+     *  写入时累加，刷盘时取出清零，并记录到 (文件 id, 刷盘批次) 中
+     * 
+     * @param file_id 
+     * @param type 
+     * @param bytes 
+     */
+    void track_sync_batch(uint32_t file_id, FileOperateType type, uint64_t bytes);
+
+    /**
+     * @brief 识别一次读写的访问模式，结束或者累积够长的连续段记录到数据池中
+     *  不带偏移的调用使用并推进 fd 上记录的位置
+     * 
+     * @param entry 
+     * @param file_id 
+     * @param type READ_TYPE/WRITE_TYPE
+     * @param size 
+     * @param offset 小于 0 时为 fd 上记录的位置
+     */
+    void track_access_pattern(FdEntry* entry, uint32_t file_id, FileOperateType type, uint64_t size,
+        int64_t offset);
+
+    /**
+     * @brief 结束 fd 上读和写的连续段，关闭文件时调用
+     * 
+     * @param entry 
+     * @param file_id 
+     */
+    void finish_access_pattern(FdEntry* entry, uint32_t file_id);
+
+    /**
+     * @brief 在当前线程的数据池中记录一个连续段
+     * 
+     * @param file_id 
+     * @param type 
+     * @param report 
+     */
+    void record_access_run(uint32_t file_id, FileOperateType type, const AccessRunReport& report);
+
+    /**
+     * @brief 按文件的采样率采样
+     *
+     * @param file_id
+     * @param weight 全局采样的权重，被采样时乘以文件的采样率的倒数
+     * @return true 记录本次读写
+     * @return false
+     */
+    bool sample_file(uint32_t file_id, uint64_t& weight);
+
+    /**
+     * @brief 根据本周期每个文件估计的读写次数，调整文件的采样率
+     *  只访问本周期有读写的文件和上周期被降采样的文件，没有读写时不做任何事
+     *
+     * @param file_calls 文件 id -> 读写次数
+     */
+    void adapt_sample_rate(const std::unordered_map<uint32_t, uint64_t>& file_calls);
+
+    /**
+     * @brief 数据池的 key，高位为文件 id，低 8 位为操作类型（FileOperateType 或 SYNC_BATCH_KEY_TYPE）
+     *
+     * @param file_id
+     * @param type
+     * @return uint64_t
+     */
+    static uint64_t make_operate_key(uint32_t file_id, uint32_t type) {
+        return (static_cast<uint64_t>(file_id) << 8) | static_cast<uint64_t>(type);
+    }
+
+    /**
+     * @brief 查找 fd 当前对应的文件 id
+     *
+     * @param fd
+     * @return uint32_t 没有对应的文件时返回 INVALID_STRING_ID
+     */
+    uint32_t find_file_id(int fd) {
+        const FdEntry* entry = fd_file_name_.find(fd);
+        return entry ? load_file_id(entry) : INVALID_STRING_ID;
+    }
+
+    /**
+     * @brief fd 表项上的文件 id，打开 fd 跟踪之前（fd_generation_ 变化之前）发布的对应关系视为无效
+     *
+     * @param entry
+     * @return uint32_t
+     */
+    uint32_t load_file_id(const FdEntry* entry) const {
+        uint32_t file_id = entry->file_id.load(std::memory_order_acquire);
+        if (__glibc_unlikely(entry->generation.load(std::memory_order_relaxed)
+            != fd_generation_.load(std::memory_order_relaxed))) {
+            return INVALID_STRING_ID;
+        }
+        return file_id;
+    }
+
+    /**
+     * @brief 文件上的状态，fd 跟踪重新打开后第一次访问时清除之前累计的字节数
+     *
+     * @param file_id
+     * @return FileEntry* id 超出上限时返回 nullptr
+     */
+    FileEntry* get_file_entry(uint32_t file_id);
+
+    /**
+     * @brief 文件 id 是否需要统计，即不是 INVALID_STRING_ID 也不是 EXCLUDED_FILE_ID
+     *  两个特殊值分别为最小值和最大值，一次无符号比较即可判断
+     *
+     * @param file_id
+     * @return true
+     * @return false
+     */
+    static bool is_tracked_file(uint32_t file_id) {
+        return file_id - 1U < EXCLUDED_FILE_ID - 1U;
+    }
+
 private:
     FileIoInfoHandler() = default;
 
 private:
-    struct FileRWInfo {
-        uint64_t read_b;
-        uint64_t write_b;
-
-        FileRWInfo& operator+=(const FileRWInfo& info) {
-            read_b += info.read_b;
-            write_b += info.write_b;
-            return *this;
-        }
+    /**
+     * @brief 某个文件上某一类操作的统计
+     *  直方图大小固定，原地更新，不分配内存
+     */
+    struct FileOperateStat {
+        uint64_t call_num = 0;
+        uint64_t bytes = 0;
+        // 向量读写的调用次数和 iovec 的总数
+        uint64_t vec_call_num = 0;
+        uint64_t iov_num = 0;
+        // 异步请求的数量、提交时队列深度的总和与最大值
+        uint64_t async_call_num = 0;
+        uint64_t depth_sum = 0;
+        uint64_t depth_max = 0;
+        // 实际记录的次数，采样时小于 call_num
+        uint64_t sample_num = 0;
+        // 读写的访问模式，见 AccessPatternStat
+        uint64_t pattern_access_num[ACCESS_PATTERN_COUNT] = {0};
+        uint64_t pattern_run_num[ACCESS_PATTERN_COUNT] = {0};
+        uint64_t pattern_max_run_len[ACCESS_PATTERN_COUNT] = {0};
+        // 耗时的分布；刷盘批次（SYNC_BATCH_KEY_TYPE）中记录的是每批的字节数
+        LogLinearHistogram latency;
     };
-    struct DoubleBallModuleKey {
-        uint64_t tid;
-        std::string filename;
-        DoubleBallModuleKey(uint64_t tid, const std::string& filename)
-            : tid(tid), filename(filename) {}
-
-        bool operator==(const DoubleBallModuleKey& key) const {
-            return tid == key.tid && filename == key.filename;
-        }
-        bool operator!=(const DoubleBallModuleKey& key) const {
-            return !(*this == key);
-        }
+    /**
+     * @brief fd 表中的元素
+     *  open 时发布文件 id（被路径规则排除时为 EXCLUDED_FILE_ID），close 时撤销，read/write 只需要一次原子读
+     */
+    struct FdEntry {
+        std::atomic<uint32_t> file_id{INVALID_STRING_ID};
+        // 发布 file_id 时的 fd_generation_，不相等时 file_id 无效
+        std::atomic<uint32_t> generation{0};
+        // 文件位置，open 时为 0，read/write 时推进，lseek 时修改；O_APPEND 的文件只有相对位置是准确的
+        std::atomic<uint64_t> position{0};
+        // 读和写分别识别访问模式
+        AccessPatternDetector read_pattern;
+        AccessPatternDetector write_pattern;
     };
-    struct DoubleBallModuleKeyHash {
-        std::size_t operator()(const DoubleBallModuleKey& obj) const {
-            std::size_t h1 = std::hash<uint64_t>()(obj.tid);
-            std::size_t h2 = std::hash<std::string>()(obj.filename);
-            return h1 ^ (h2 << 1);
-        }
+
+    /**
+     * @brief 文件上的状态，以文件 id 为下标，不随 fd 的打开关闭而清除
+     *
+     */
+    struct FileEntry {
+        // 自上次刷盘以来（通过任意 fd）写入的字节数
+        std::atomic<uint64_t> unsynced_b{0};
+        // unsynced_b 累计时的 fd_generation_，不相等时先清零
+        std::atomic<uint32_t> generation{0};
+        // 自适应采样时该文件的采样率为 1/2^sample_shift，0 为全部记录
+        std::atomic<uint32_t> sample_shift{0};
+    };
+    /**
+     * @brief 线程私有的数据
+     *  线程只写自己的数据池，key 为 (文件 id, 操作类型)，tid 由所属线程隐含
+     *  因此数据池的 key 实际上是 (tid, file_id, type) 这一组整数，文件名只在收集时才被解析
+     */
+    struct ThreadIoData {
+        ThreadIoData() : data_pool(DEFAULT_THREAD_HASH_BUCKET_SIZE) {}
+
+        DoubleBallModule<uint64_t, FileOperateStat> data_pool;
     };
 
 private:
-    // 数据池子，只管写数据、读数据，无需关心线程安全性，已经保证
-    // key 为 "tid + file_name"
-    // DoubleBallModule<std::shared_ptr<DoubleBallModuleKey>, FileRWInfo> data_pool_;
-    DoubleBallModule<DoubleBallModuleKey, FileRWInfo, DoubleBallModuleKeyHash> data_pool_;
+    // 数据池子，每个线程一份，只管写数据、读数据，无需关心线程安全性，已经保证
+    // 收集时遍历所有线程（包括已经退出的线程）的数据池进行合并
+    ThreadLocalRegistry<ThreadIoData> data_pool_;
     // 默认的数据池中最大的元素数量
     const uint64_t max_data_pool_size_ = DEFAULT_MAX_DATA_POOL_SIZE;
-    // 存储文件描述符和文件名的对应关系
-    ConcurrentHashMap<uint64_t, std::string> fd_file_name_;
+    // 存储文件描述符和文件 id 的对应关系，以 fd 为下标
+    FdTable<FdEntry> fd_file_name_;
+    // 文件上的状态，以文件 id 为下标，id 超出上限的文件不统计刷盘批次
+    FdTable<FileEntry> file_state_{FD_TABLE_MAX_FD};
+    // fd 跟踪每次从关闭变为打开时加一，使之前的 fd 表项和文件上累计的字节数失效，不需要遍历
+    std::atomic<uint32_t> fd_generation_{0};
+    // 文件名驻留表，open 时为文件名分配 id，收集时把 id 解析回文件名
+    StringInterner file_name_interner_;
+    // 路径规则，为空时统计所有路径
+    std::atomic<const PathFilter*> path_filter_{nullptr};
+    // 共享内存导出，打开后记录不再进入数据池
+    ShmExporter shm_exporter_;
+    // 事件追踪
+    TraceWriter trace_writer_;
+    // 全局采样率，1 为不采样
+    std::atomic<uint32_t> sample_rate_{1};
+    // 自适应采样的目标，0 为关闭
+    std::atomic<uint64_t> adaptive_sample_target_{0};
+    // 被降采样（sample_shift 不为 0）的文件，下个周期没有读写时恢复
+    std::vector<uint32_t> sampled_files_;
+    // 保护 sampled_files_，收集线程和 set_adaptive_sample_target 都会调整采样率
+    std::mutex adapt_mtx_;
+    // consume_and_parse 期间持有，fork 前加锁
+    std::mutex consume_mtx_;
     // hook 函数监控项目
     HookFuncMonitorItem monitor_item;
 };
@@ -0,0 +1,66 @@
+/**
+ * @file hook_switch.h
+ * @author noahyzhang
+ * @brief hook 的运行时开关
+ * @version 0.1
+ * @date 2023-04-18
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+
+namespace file_io_hook {
+
+/**
+ * @brief 开关的各个位
+ *  总开关和某一类操作的开关同时打开时，这一类操作才会被统计
+ */
+enum HookSwitchBit : uint32_t {
+    // 总开关
+    HOOK_SWITCH_GLOBAL = 1U << 0,
+    // open/creat/openat/close/dup/fcntl(F_DUPFD)/close_range/closefrom
+    HOOK_SWITCH_OPEN_CLOSE = 1U << 1,
+    // read/write/pread/pwrite/readv/writev 等同步读写
+    HOOK_SWITCH_READ_WRITE = 1U << 2,
+    // sendfile/splice/tee/copy_file_range
+    HOOK_SWITCH_ZERO_COPY = 1U << 3,
+    // fsync/fdatasync/sync_file_range/syncfs
+    HOOK_SWITCH_SYNC = 1U << 4,
+    // io_uring、native AIO、POSIX AIO
+    HOOK_SWITCH_ASYNC = 1U << 5,
+    // fopen/fread/fwrite/fclose 等带缓冲的 IO
+    HOOK_SWITCH_STDIO = 1U << 6,
+    // 所有操作类型
+    HOOK_SWITCH_ALL_OPERATE = HOOK_SWITCH_OPEN_CLOSE | HOOK_SWITCH_READ_WRITE | HOOK_SWITCH_ZERO_COPY
+        | HOOK_SWITCH_SYNC | HOOK_SWITCH_ASYNC | HOOK_SWITCH_STDIO,
+    // 可以通过接口设置的位
+    HOOK_SWITCH_USER_MASK = HOOK_SWITCH_GLOBAL | HOOK_SWITCH_ALL_OPERATE,
+    // 内部使用：进程退出、业务对象销毁后清除，清除后不可再打开
+    HOOK_SWITCH_ALIVE = 1U << 31,
+};
+
+/**
+ * @brief 开关的当前值，定义在 hook_io_handle.cpp 中
+ *  std::atomic 的构造函数是 constexpr 的，常量初始化，早于任何构造函数就绪
+ */
+extern std::atomic<uint32_t> g_hook_switch_mask;
+
+/**
+ * @brief 某一类操作当前是否需要统计
+ *  关闭时 hook 函数只多一次读取和一个可预测的分支，随后直接调用真实函数
+ *
+ * @param operate_bit HOOK_SWITCH_OPEN_CLOSE 等
+ * @return true
+ * @return false
+ */
+inline bool hook_enabled(uint32_t operate_bit) {
+    uint32_t need = HOOK_SWITCH_ALIVE | HOOK_SWITCH_GLOBAL | operate_bit;
+    return (g_hook_switch_mask.load(std::memory_order_relaxed) & need) == need;
+}
+
+}  // namespace file_io_hook
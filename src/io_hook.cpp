@@ -4,9 +4,33 @@
 #include <stdarg.h>
 #include <sys/syscall.h>
 #include <stdint.h>
+#include <sys/uio.h>
+#include <sys/sendfile.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <linux/io_uring.h>
+#include <linux/aio_abi.h>
+#include <aio.h>
+#include "common/real_func_table.h"
+#include "aio_tracker.h"
+#include "background_collector.h"
+#include "hook_guard.h"
 #include "hook_io_handle.h"
+#include "hook_switch.h"
+#include "io_uring_tracker.h"
 #include "io_hook.h"
 
+// 存在 liburing 头文件时，hook liburing 的提交函数
+#if defined(__has_include)
+#if __has_include(<liburing.h>)
+#include <liburing.h>
+#define FILE_IO_HOOK_LIBURING 1
+#endif
+#endif
+
 /* 
  * 定义需要 hook 的函数类型
  */
@@ -23,7 +47,48 @@ typedef ssize_t (*pread_func_type)(int fd, void *buf, size_t count, off_t offset
 typedef ssize_t (*pread64_func_type)(int __fd, void *__buf, size_t __nbytes, __off64_t __offset);
 typedef ssize_t (*pwrite_func_type)(int fd, const void *buf, size_t count, off_t offset);
 typedef ssize_t (*pwrite64_func_type)(int __fd, const void *__buf, size_t n, __off64_t __offset);
+typedef off_t (*lseek_func_type)(int fd, off_t offset, int whence);
+typedef __off64_t (*lseek64_func_type)(int fd, __off64_t offset, int whence);
+typedef ssize_t (*readv_func_type)(int fd, const struct iovec *iov, int iovcnt);
+typedef ssize_t (*writev_func_type)(int fd, const struct iovec *iov, int iovcnt);
+typedef ssize_t (*preadv_func_type)(int fd, const struct iovec *iov, int iovcnt, off_t offset);
+typedef ssize_t (*preadv64_func_type)(int fd, const struct iovec *iov, int iovcnt, __off64_t offset);
+typedef ssize_t (*pwritev_func_type)(int fd, const struct iovec *iov, int iovcnt, off_t offset);
+typedef ssize_t (*pwritev64_func_type)(int fd, const struct iovec *iov, int iovcnt, __off64_t offset);
+typedef ssize_t (*preadv2_func_type)(int fd, const struct iovec *iov, int iovcnt, off_t offset, int flags);
+typedef ssize_t (*preadv64v2_func_type)(int fd, const struct iovec *iov, int iovcnt, __off64_t offset, int flags);
+typedef ssize_t (*pwritev2_func_type)(int fd, const struct iovec *iov, int iovcnt, off_t offset, int flags);
+typedef ssize_t (*pwritev64v2_func_type)(int fd, const struct iovec *iov, int iovcnt, __off64_t offset, int flags);
+typedef ssize_t (*sendfile_func_type)(int out_fd, int in_fd, off_t *offset, size_t count);
+typedef ssize_t (*sendfile64_func_type)(int out_fd, int in_fd, __off64_t *offset, size_t count);
+typedef ssize_t (*splice_func_type)(int fd_in, __off64_t *off_in, int fd_out, __off64_t *off_out,
+    size_t len, unsigned int flags);
+typedef ssize_t (*tee_func_type)(int fd_in, int fd_out, size_t len, unsigned int flags);
+typedef ssize_t (*copy_file_range_func_type)(int fd_in, __off64_t *off_in, int fd_out, __off64_t *off_out,
+    size_t len, unsigned int flags);
+typedef int (*fsync_func_type)(int fd);
+typedef int (*fdatasync_func_type)(int fd);
+typedef int (*sync_file_range_func_type)(int fd, __off64_t offset, __off64_t nbytes, unsigned int flags);
+typedef int (*syncfs_func_type)(int fd);
+typedef long (*syscall_func_type)(long number, ...);
+typedef int (*aio_read_func_type)(struct aiocb *aiocbp);
+typedef int (*aio_read64_func_type)(struct aiocb64 *aiocbp);
+typedef int (*aio_write_func_type)(struct aiocb *aiocbp);
+typedef int (*aio_write64_func_type)(struct aiocb64 *aiocbp);
+typedef int (*aio_fsync_func_type)(int operation, struct aiocb *aiocbp);
+typedef int (*aio_fsync64_func_type)(int operation, struct aiocb64 *aiocbp);
+typedef int (*lio_listio_func_type)(int mode, struct aiocb *const list[], int nent, struct sigevent *sig);
+typedef int (*lio_listio64_func_type)(int mode, struct aiocb64 *const list[], int nent, struct sigevent *sig);
+typedef ssize_t (*aio_return_func_type)(struct aiocb *aiocbp);
+typedef ssize_t (*aio_return64_func_type)(struct aiocb64 *aiocbp);
 typedef int (*close_func_type)(int fd);
+typedef int (*dup_func_type)(int oldfd);
+typedef int (*dup2_func_type)(int oldfd, int newfd);
+typedef int (*dup3_func_type)(int oldfd, int newfd, int flags);
+typedef int (*fcntl_func_type)(int fd, int cmd, ...);
+typedef int (*fcntl64_func_type)(int fd, int cmd, ...);
+typedef int (*close_range_func_type)(unsigned int first, unsigned int last, int flags);
+typedef void (*closefrom_func_type)(int lowfd);
 
 // 带缓冲的操作 IO 的函数类型
 typedef FILE* (*fopen_func_type)(const char *__restrict filename, const char *__restrict modes);
@@ -31,72 +96,192 @@ typedef FILE* (*fopen64_func_type)(const char *__restrict filename, const char *
 typedef FILE* (*freopen_func_type)(const char *pathname, const char *mode, FILE *stream);
 typedef size_t (*fread_func_type)(void *__restrict ptr, size_t size, size_t n, FILE *__restrict stream);
 typedef size_t (*fwrite_func_type)(const void *__restrict ptr, size_t size, size_t n, FILE *__restrict __s);
+typedef int (*fseek_func_type)(FILE *stream, long offset, int whence);
+typedef int (*fseeko_func_type)(FILE *stream, off_t offset, int whence);
+typedef int (*fseeko64_func_type)(FILE *stream, __off64_t offset, int whence);
+typedef void (*rewind_func_type)(FILE *stream);
 typedef int (*fclose_func_type)(FILE *stream);
 
+#ifdef FILE_IO_HOOK_LIBURING
+// liburing 的函数类型
+typedef int (*io_uring_submit_func_type)(struct io_uring *ring);
+typedef int (*io_uring_submit_and_wait_func_type)(struct io_uring *ring, unsigned wait_nr);
+typedef int (*io_uring_get_cqe_func_type)(struct io_uring *ring, struct io_uring_cqe **cqe_ptr,
+    unsigned submit, unsigned wait_nr, sigset_t *sigmask);
+typedef void (*io_uring_queue_exit_func_type)(struct io_uring *ring);
+#endif
+
 // 加载文件 IO 信息收集类
 using file_io_hook::FileIoInfoHandler;
 using file_io_hook::FileOperateType;
+using file_io_hook::Util;
+using file_io_hook::IoUringTracker;
+using file_io_hook::IoUringLayout;
+using file_io_hook::AioTracker;
+using file_io_hook::BackgroundCollector;
+using file_io_hook::HookGuard;
+using file_io_hook::RealFuncTable;
+using file_io_hook::hook_enabled;
+using file_io_hook::HOOK_SWITCH_GLOBAL;
+using file_io_hook::HOOK_SWITCH_ALL_OPERATE;
+using file_io_hook::HOOK_SWITCH_OPEN_CLOSE;
+using file_io_hook::HOOK_SWITCH_READ_WRITE;
+using file_io_hook::HOOK_SWITCH_ZERO_COPY;
+using file_io_hook::HOOK_SWITCH_SYNC;
+using file_io_hook::HOOK_SWITCH_ASYNC;
+using file_io_hook::HOOK_SWITCH_STDIO;
+using file_io_hook::SnapshotSinkType;
+using file_io_hook::SNAPSHOT_SINK_FILE;
+using file_io_hook::SNAPSHOT_SINK_SHM;
+using file_io_hook::SNAPSHOT_SINK_UNIX_SOCKET;
+
+// 线程是否在 hook 函数内部，声明见 hook_guard.h
+namespace file_io_hook {
+__thread bool g_inside_hook __attribute__((tls_model("initial-exec"))) = false;
+}  // namespace file_io_hook
+
+// 需要 hook 的函数列表：X(下标, 函数指针类型, 函数名)
+// 下标枚举、函数名数组以及下标到函数指针类型的对应关系都由这个列表生成，增加函数只需要增加一行
+#define FILE_IO_BASE_FUNC_LIST(X) \
+    X(OPEN_FUNC_TYPE, open_func_type, "open") \
+    X(OPEN64_FUNC_TYPE, open64_func_type, "open64") \
+    X(CREAT_FUNC_TYPE, creat_func_type, "creat") \
+    X(CREAT64_FUNC_TYPE, creat64_func_type, "creat64") \
+    X(OPENAT_FUNC_TYPE, openat_func_type, "openat") \
+    X(OPENAT64_FUNC_TYPE, openat64_func_type, "openat64") \
+    X(READ_FUNC_TYPE, read_func_type, "read") \
+    X(WRITE_FUNC_TYPE, write_func_type, "write") \
+    X(PREAD_FUNC_TYPE, pread_func_type, "pread") \
+    X(PREAD64_FUNC_TYPE, pread64_func_type, "pread64") \
+    X(PWRITE_FUNC_TYPE, pwrite_func_type, "pwrite") \
+    X(PWRITE64_FUNC_TYPE, pwrite64_func_type, "pwrite64") \
+    X(LSEEK_FUNC_TYPE, lseek_func_type, "lseek") \
+    X(LSEEK64_FUNC_TYPE, lseek64_func_type, "lseek64") \
+    X(READV_FUNC_TYPE, readv_func_type, "readv") \
+    X(WRITEV_FUNC_TYPE, writev_func_type, "writev") \
+    X(PREADV_FUNC_TYPE, preadv_func_type, "preadv") \
+    X(PREADV64_FUNC_TYPE, preadv64_func_type, "preadv64") \
+    X(PWRITEV_FUNC_TYPE, pwritev_func_type, "pwritev") \
+    X(PWRITEV64_FUNC_TYPE, pwritev64_func_type, "pwritev64") \
+    X(PREADV2_FUNC_TYPE, preadv2_func_type, "preadv2") \
+    X(PREADV64V2_FUNC_TYPE, preadv64v2_func_type, "preadv64v2") \
+    X(PWRITEV2_FUNC_TYPE, pwritev2_func_type, "pwritev2") \
+    X(PWRITEV64V2_FUNC_TYPE, pwritev64v2_func_type, "pwritev64v2") \
+    X(SENDFILE_FUNC_TYPE, sendfile_func_type, "sendfile") \
+    X(SENDFILE64_FUNC_TYPE, sendfile64_func_type, "sendfile64") \
+    X(SPLICE_FUNC_TYPE, splice_func_type, "splice") \
+    X(TEE_FUNC_TYPE, tee_func_type, "tee") \
+    X(COPY_FILE_RANGE_FUNC_TYPE, copy_file_range_func_type, "copy_file_range") \
+    X(FSYNC_FUNC_TYPE, fsync_func_type, "fsync") \
+    X(FDATASYNC_FUNC_TYPE, fdatasync_func_type, "fdatasync") \
+    X(SYNC_FILE_RANGE_FUNC_TYPE, sync_file_range_func_type, "sync_file_range") \
+    X(SYNCFS_FUNC_TYPE, syncfs_func_type, "syncfs") \
+    X(SYSCALL_FUNC_TYPE, syscall_func_type, "syscall") \
+    X(AIO_READ_FUNC_TYPE, aio_read_func_type, "aio_read") \
+    X(AIO_READ64_FUNC_TYPE, aio_read64_func_type, "aio_read64") \
+    X(AIO_WRITE_FUNC_TYPE, aio_write_func_type, "aio_write") \
+    X(AIO_WRITE64_FUNC_TYPE, aio_write64_func_type, "aio_write64") \
+    X(AIO_FSYNC_FUNC_TYPE, aio_fsync_func_type, "aio_fsync") \
+    X(AIO_FSYNC64_FUNC_TYPE, aio_fsync64_func_type, "aio_fsync64") \
+    X(LIO_LISTIO_FUNC_TYPE, lio_listio_func_type, "lio_listio") \
+    X(LIO_LISTIO64_FUNC_TYPE, lio_listio64_func_type, "lio_listio64") \
+    X(AIO_RETURN_FUNC_TYPE, aio_return_func_type, "aio_return") \
+    X(AIO_RETURN64_FUNC_TYPE, aio_return64_func_type, "aio_return64") \
+    X(CLOSE_FUNC_TYPE, close_func_type, "close") \
+    X(DUP_FUNC_TYPE, dup_func_type, "dup") \
+    X(DUP2_FUNC_TYPE, dup2_func_type, "dup2") \
+    X(DUP3_FUNC_TYPE, dup3_func_type, "dup3") \
+    X(FCNTL_FUNC_TYPE, fcntl_func_type, "fcntl") \
+    X(FCNTL64_FUNC_TYPE, fcntl64_func_type, "fcntl64") \
+    X(CLOSE_RANGE_FUNC_TYPE, close_range_func_type, "close_range") \
+    X(CLOSEFROM_FUNC_TYPE, closefrom_func_type, "closefrom") \
+    X(FOPEN_FUNC_TYPE, fopen_func_type, "fopen") \
+    X(FOPEN64_FUNC_TYPE, fopen64_func_type, "fopen64") \
+    X(FREOPEN_FUNC_TYPE, freopen_func_type, "freopen") \
+    X(FREAD_FUNC_TYPE, fread_func_type, "fread") \
+    X(FWRITE_FUNC_TYPE, fwrite_func_type, "fwrite") \
+    X(FSEEK_FUNC_TYPE, fseek_func_type, "fseek") \
+    X(FSEEKO_FUNC_TYPE, fseeko_func_type, "fseeko") \
+    X(FSEEKO64_FUNC_TYPE, fseeko64_func_type, "fseeko64") \
+    X(REWIND_FUNC_TYPE, rewind_func_type, "rewind") \
+    X(FCLOSE_FUNC_TYPE, fclose_func_type, "fclose")
 
-// 定义数组 file_io_real_func_point 的长度
-// 注意增加宏定义，需要增加长度
-#define FILE_IO_FUNC_TYPE_COUNT 19
-// 定义文件 IO 函数宏定义，作为数组的下标.
+#ifdef FILE_IO_HOOK_LIBURING
+#define FILE_IO_LIBURING_FUNC_LIST(X) \
+    X(IO_URING_SUBMIT_FUNC_TYPE, io_uring_submit_func_type, "io_uring_submit") \
+    X(IO_URING_SUBMIT_AND_WAIT_FUNC_TYPE, io_uring_submit_and_wait_func_type, "io_uring_submit_and_wait") \
+    X(IO_URING_GET_CQE_FUNC_TYPE, io_uring_get_cqe_func_type, "__io_uring_get_cqe") \
+    X(IO_URING_QUEUE_EXIT_FUNC_TYPE, io_uring_queue_exit_func_type, "io_uring_queue_exit")
+#else
+#define FILE_IO_LIBURING_FUNC_LIST(X)
+#endif
+
+#define FILE_IO_FUNC_LIST(X) FILE_IO_BASE_FUNC_LIST(X) FILE_IO_LIBURING_FUNC_LIST(X)
+
+// 定义文件 IO 函数的下标，作为函数指针表的下标
+#define FILE_IO_FUNC_ENUM(type, func_type, name) type,
 typedef enum FILE_IO_FUNC_TYPE {
-    OPEN_FUNC_TYPE = 0,
-    OPEN64_FUNC_TYPE,
-    CREAT_FUNC_TYPE,
-    CREAT64_FUNC_TYPE,
-    OPENAT_FUNC_TYPE,
-    OPENAT64_FUNC_TYPE,
-    READ_FUNC_TYPE,
-    WRITE_FUNC_TYPE,
-    PREAD_FUNC_TYPE,
-    PREAD64_FUNC_TYPE,
-    PWRITE_FUNC_TYPE,
-    PWRITE64_FUNC_TYPE,
-    CLOSE_FUNC_TYPE,
-    FOPEN_FUNC_TYPE,
-    FOPEN64_FUNC_TYPE,
-    FREOPEN_FUNC_TYPE,
-    FREAD_FUNC_TYPE,
-    FWRITE_FUNC_TYPE,
-    FCLOSE_FUNC_TYPE,
+    FILE_IO_FUNC_LIST(FILE_IO_FUNC_ENUM)
+    FILE_IO_FUNC_TYPE_COUNT
 } FILE_IO_FUNC_TYPE;
+#undef FILE_IO_FUNC_ENUM
+
+// 下标对应的函数指针类型，取函数指针时由下标确定类型，不需要强制转换
+template <FILE_IO_FUNC_TYPE type>
+struct RealFuncTraits;
+#define FILE_IO_FUNC_TRAITS(type, func_type, name) \
+    template <> struct RealFuncTraits<type> { typedef func_type func; };
+FILE_IO_FUNC_LIST(FILE_IO_FUNC_TRAITS)
+#undef FILE_IO_FUNC_TRAITS
+
+// 函数名，与下标一一对应
+#define FILE_IO_FUNC_NAME(type, func_type, name) name,
+static const char* const file_io_func_names[FILE_IO_FUNC_TYPE_COUNT] = {
+    FILE_IO_FUNC_LIST(FILE_IO_FUNC_NAME)
+};
+#undef FILE_IO_FUNC_NAME
 
 // 存储 IO 函数指针
 // 注意：不能使用 STL 容器，STL 容器的初始化在 constructor 中会有问题
-static void* file_io_real_func_pointer[FILE_IO_FUNC_TYPE_COUNT] = {0};
+// 函数指针表是常量初始化的，早于任何构造函数就绪
+static RealFuncTable<FILE_IO_FUNC_TYPE_COUNT> file_io_real_funcs(file_io_func_names);
 
-// 封装存储 IO 函数指针的数组，避免用户直接使用数组
-static void* get_real_func_pointer(FILE_IO_FUNC_TYPE func_type) {
-    return file_io_real_func_pointer[func_type];
+// 获取真实函数指针，找不到时为空
+template <FILE_IO_FUNC_TYPE type>
+static inline typename RealFuncTraits<type>::func get_real_func() {
+    return file_io_real_funcs.get<typename RealFuncTraits<type>::func>(type);
 }
 
 // 初始化函数
 static void io_hook_init() {
-    // 注意：要保证数组长度，而且要保证和 FILE_IO_FUNC_TYPE 定义的顺序一致
-    static const char* hook_func[FILE_IO_FUNC_TYPE_COUNT] = {
-        "open", "open64", "creat", "creat64", "openat", "openat64",
-        "read", "write", "pread", "pread64", "pwrite", "pwrite64", "close",
-        "fopen", "fopen64", "freopen", "fread", "fwrite", "fclose"};
-    for (size_t i = 0; i < sizeof(hook_func)/sizeof(const char*); ++i) {
-        file_io_real_func_pointer[i] = dlsym(RTLD_NEXT, hook_func[i]);
-    }
+    file_io_real_funcs.resolve_all();
 }
 
 // fork 调用前，在父进程的上下文中执行
 static void io_hook_prefork() {
+    // 收集线程在 consume_and_parse 之外才持有自己的锁，最先加锁
+    BackgroundCollector::get_instance().lock_prefork();
+    // 与正常路径的加锁顺序一致：先 io_uring 的实例，再文件信息
+    IoUringTracker::get_instance().lock_prefork();
+    AioTracker::get_instance().lock_prefork();
     FileIoInfoHandler::get_instance().lock_prefork();
 }
 
 // fork 返回前，在父进程的上下文中执行
 static void io_hook_postfork_parent() {
     FileIoInfoHandler::get_instance().lock_postfork_parent();
+    AioTracker::get_instance().lock_postfork_parent();
+    IoUringTracker::get_instance().lock_postfork_parent();
+    BackgroundCollector::get_instance().lock_postfork_parent();
 }
 
 // fork 返回前，在子进程的上下文执行
 static void io_hook_postfork_child() {
+    Util::reset_tid();
     FileIoInfoHandler::get_instance().lock_postfork_child();
+    AioTracker::get_instance().lock_postfork_child();
+    IoUringTracker::get_instance().lock_postfork_child();
+    BackgroundCollector::get_instance().lock_postfork_child();
 }
 
 // 处理多进程的共享资源（锁）问题
@@ -110,278 +295,1679 @@ static void init_hard_atfork() {
     }
 }
 
+// 环境变量 FILE_IO_HOOK_ENABLE 中可以使用的操作类型
+static const struct {
+    const char* name;
+    uint32_t bit;
+} hook_switch_names[] = {
+    {"open", HOOK_SWITCH_OPEN_CLOSE},
+    {"rw", HOOK_SWITCH_READ_WRITE},
+    {"zero_copy", HOOK_SWITCH_ZERO_COPY},
+    {"sync", HOOK_SWITCH_SYNC},
+    {"async", HOOK_SWITCH_ASYNC},
+    {"stdio", HOOK_SWITCH_STDIO},
+};
+
+// 解析环境变量 FILE_IO_HOOK_ENABLE，设置启动时的开关
+// 1. 未设置、"1"、"on"、"all"：全部打开（默认）
+// 2. "0"、"off"：关闭总开关，之后打开总开关即统计所有操作
+// 3. 以逗号分隔的操作类型，比如 "rw,sync"：只统计这些操作
+// 构造函数中执行，不使用 STL 容器
+static void init_hook_switch() {
+    const char* value = getenv("FILE_IO_HOOK_ENABLE");
+    if (value == nullptr || *value == '\0' || strcmp(value, "1") == 0 || strcmp(value, "on") == 0
+        || strcmp(value, "all") == 0) {
+        return;
+    }
+    FileIoInfoHandler& handler = FileIoInfoHandler::get_instance();
+    handler.set_hook_switch(HOOK_SWITCH_GLOBAL | HOOK_SWITCH_ALL_OPERATE, false);
+    if (strcmp(value, "0") == 0 || strcmp(value, "off") == 0) {
+        handler.set_hook_switch(HOOK_SWITCH_ALL_OPERATE, true);
+        return;
+    }
+    uint32_t bits = HOOK_SWITCH_GLOBAL;
+    while (*value != '\0') {
+        size_t len = strcspn(value, ",");
+        for (const auto& item : hook_switch_names) {
+            if (strlen(item.name) == len && strncmp(value, item.name, len) == 0) {
+                bits |= item.bit;
+            }
+        }
+        value += value[len] == ',' ? len + 1 : len;
+    }
+    handler.set_hook_switch(bits, true);
+}
+
+// 切换总开关，只有原子操作，是异步信号安全的
+static void hook_switch_signal_handler(int) {
+    int saved_errno = errno;
+    FileIoInfoHandler& handler = FileIoInfoHandler::get_instance();
+    handler.set_hook_switch(HOOK_SWITCH_GLOBAL, !(handler.get_hook_switch() & HOOK_SWITCH_GLOBAL));
+    errno = saved_errno;
+}
+
+// 设置了环境变量 FILE_IO_HOOK_TOGGLE_SIGNAL（信号编号，比如 SIGUSR2 为 12）时，
+// 运行时通过 kill -<信号> <pid> 切换总开关。默认不注册，避免覆盖业务的信号处理函数
+static void init_hook_switch_signal() {
+    const char* value = getenv("FILE_IO_HOOK_TOGGLE_SIGNAL");
+    if (value == nullptr || *value == '\0') {
+        return;
+    }
+    char* end = nullptr;
+    long signo = strtol(value, &end, 10);
+    if (*end != '\0' || signo <= 0 || signo >= NSIG || signo == SIGKILL || signo == SIGSTOP) {
+        return;
+    }
+    // 信号处理函数中不能做单例的初始化（加锁、分配内存），这里先初始化
+    FileIoInfoHandler::get_instance();
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = hook_switch_signal_handler;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(static_cast<int>(signo), &action, nullptr);
+}
+
+// 解析环境变量中的正整数，未设置或者不合法时返回 0
+static uint64_t get_env_number(const char* name) {
+    const char* value = getenv(name);
+    if (value == nullptr || *value == '\0') {
+        return 0;
+    }
+    char* end = nullptr;
+    unsigned long long number = strtoull(value, &end, 10);
+    return *end == '\0' ? number : 0;
+}
+
+// 采样的配置
+// 1. FILE_IO_HOOK_SAMPLE_RATE：全局采样率，每 N 次读写记录一次
+// 2. FILE_IO_HOOK_SAMPLE_TARGET：自适应采样的目标，每个文件每个收集周期期望记录的读写次数
+static void init_sample() {
+    uint64_t rate = get_env_number("FILE_IO_HOOK_SAMPLE_RATE");
+    uint64_t target = get_env_number("FILE_IO_HOOK_SAMPLE_TARGET");
+    if (rate == 0 && target == 0) {
+        return;
+    }
+    FileIoInfoHandler& handler = FileIoInfoHandler::get_instance();
+    if (rate > 1) {
+        handler.set_sample_rate(static_cast<uint32_t>(std::min<uint64_t>(rate, UINT32_MAX)));
+    }
+    if (target > 0) {
+        handler.set_adaptive_sample_target(target);
+    }
+}
+
+// 路径规则，以逗号分隔，格式见 PathFilter
+// 1. FILE_IO_HOOK_INCLUDE：只统计匹配的路径，比如 "/data/,*.db"
+// 2. FILE_IO_HOOK_EXCLUDE：不统计匹配的路径，比如 "/proc/,/sys/,*.so"
+static void init_path_filter() {
+    const char* include = getenv("FILE_IO_HOOK_INCLUDE");
+    const char* exclude = getenv("FILE_IO_HOOK_EXCLUDE");
+    if ((include == nullptr || *include == '\0') && (exclude == nullptr || *exclude == '\0')) {
+        return;
+    }
+    FileIoInfoHandler::get_instance().set_path_filter(include, exclude);
+}
+
+// 共享内存导出，由进程外的 tools/fio_collector 读取
+// 1. FILE_IO_HOOK_SHM_EXPORT：段名的前缀，设置时打开导出，段名为 /<前缀>.<pid>
+// 2. FILE_IO_HOOK_SHM_RING_SIZE：每个线程的环形队列可以容纳的记录数
+static void init_shm_export() {
+    const char* prefix = getenv("FILE_IO_HOOK_SHM_EXPORT");
+    if (prefix == nullptr || *prefix == '\0') {
+        return;
+    }
+    uint64_t ring_size = get_env_number("FILE_IO_HOOK_SHM_RING_SIZE");
+    FileIoInfoHandler::get_instance().enable_shm_export(prefix, ring_size == 0
+        ? SHM_DEFAULT_RING_CAPACITY : static_cast<uint32_t>(std::min<uint64_t>(ring_size, UINT32_MAX)));
+}
+
+// 事件追踪，FILE_IO_HOOK_TRACE：追踪文件名的前缀，设置时打开，文件名为 <前缀>.<pid>.trace，用 tools/fio_analyze 分析
+static void init_trace() {
+    const char* prefix = getenv("FILE_IO_HOOK_TRACE");
+    if (prefix == nullptr || *prefix == '\0') {
+        return;
+    }
+    FileIoInfoHandler::get_instance().enable_trace(prefix);
+}
+
+// 后台收集线程，设置任意一个输出方式时启用，线程在第一次记录 IO 时启动
+// 1. FILE_IO_HOOK_COLLECT_INTERVAL_MS：收集间隔，默认 1000
+// 2. FILE_IO_HOOK_COLLECT_FILE：追加写入的文件
+// 3. FILE_IO_HOOK_COLLECT_SHM：在 /dev/shm/<名字>.<pid> 中保存最近一次的快照
+// 4. FILE_IO_HOOK_COLLECT_SOCKET：Unix 域套接字的路径
+static void init_background_collect() {
+    static const struct {
+        const char* env;
+        SnapshotSinkType type;
+    } sink_envs[] = {
+        {"FILE_IO_HOOK_COLLECT_FILE", SNAPSHOT_SINK_FILE},
+        {"FILE_IO_HOOK_COLLECT_SHM", SNAPSHOT_SINK_SHM},
+        {"FILE_IO_HOOK_COLLECT_SOCKET", SNAPSHOT_SINK_UNIX_SOCKET},
+    };
+    bool has_sink = false;
+    for (const auto& item : sink_envs) {
+        const char* target = getenv(item.env);
+        if (target != nullptr && *target != '\0') {
+            has_sink = FileIoInfoHandler::get_instance().add_snapshot_sink(item.type, target) || has_sink;
+        }
+    }
+    if (!has_sink) {
+        return;
+    }
+    uint64_t interval_ms = get_env_number("FILE_IO_HOOK_COLLECT_INTERVAL_MS");
+    BackgroundCollector::get_instance().start_lazily(static_cast<uint32_t>(std::min<uint64_t>(interval_ms, UINT32_MAX)));
+}
+
 // 系统自动调用
 __attribute__((constructor)) static void io_hook_constructor() {
     io_hook_init();
+    init_hook_switch();
+    init_hook_switch_signal();
+    init_sample();
+    init_path_filter();
+    init_shm_export();
+    init_trace();
+    init_background_collect();
     init_hard_atfork();
 }
 
 // ----------- 重写 IO hook 函数 ---------------
 
 int open(const char *pathname, int flags, ...) {
-    static open_func_type real_open = (open_func_type)get_real_func_pointer(OPEN_FUNC_TYPE);
+    open_func_type real_open = get_real_func<OPEN_FUNC_TYPE>();
     if (__glibc_unlikely(!real_open)) {
         return -1;
     }
-    va_list args;
-    va_start(args, flags);
-    int ret = real_open(pathname, flags, args);
-    va_end(args);
+    // 与 glibc 一致，只有 O_CREAT/O_TMPFILE 时才有第三个参数 mode
+    mode_t mode = 0;
+    if (flags & (O_CREAT | O_TMPFILE)) {
+        va_list args;
+        va_start(args, flags);
+        mode = static_cast<mode_t>(va_arg(args, int));
+        va_end(args);
+    }
+    if (__glibc_unlikely(!hook_enabled(HOOK_SWITCH_OPEN_CLOSE) || HookGuard::is_inside())) {
+        return real_open(pathname, flags, mode);
+    }
+    HookGuard guard;
+    uint64_t start_ns = Util::get_time_ns();
+    int ret = real_open(pathname, flags, mode);
+    uint64_t cost_ns = Util::get_time_ns() - start_ns;
     if (ret >= 0) {
         FileIoInfoHandler::get_instance().add_hook_info(
-            FileOperateType::OPEN_TYPE, ret, pathname);
+            FileOperateType::OPEN_TYPE, ret, pathname, cost_ns);
+    } else {
+        FileIoInfoHandler::get_instance().add_error_hook_info(FileOperateType::OPEN_TYPE, -1, errno, cost_ns);
     }
     return ret;
 }
 
 int open64(const char *file, int flag, ...) {
-    static open64_func_type real_open64 = (open64_func_type)get_real_func_pointer(OPEN64_FUNC_TYPE);
+    open64_func_type real_open64 = get_real_func<OPEN64_FUNC_TYPE>();
     if (__glibc_unlikely(!real_open64)) {
         return -1;
     }
-    va_list args;
-    va_start(args, flag);
-    int ret = real_open64(file, flag, args);
-    va_end(args);
+    mode_t mode = 0;
+    if (flag & (O_CREAT | O_TMPFILE)) {
+        va_list args;
+        va_start(args, flag);
+        mode = static_cast<mode_t>(va_arg(args, int));
+        va_end(args);
+    }
+    if (__glibc_unlikely(!hook_enabled(HOOK_SWITCH_OPEN_CLOSE) || HookGuard::is_inside())) {
+        return real_open64(file, flag, mode);
+    }
+    HookGuard guard;
+    uint64_t start_ns = Util::get_time_ns();
+    int ret = real_open64(file, flag, mode);
+    uint64_t cost_ns = Util::get_time_ns() - start_ns;
     if (ret >= 0) {
         FileIoInfoHandler::get_instance().add_hook_info(
-            FileOperateType::OPEN_TYPE, ret, file);
+            FileOperateType::OPEN_TYPE, ret, file, cost_ns);
+    } else {
+        FileIoInfoHandler::get_instance().add_error_hook_info(FileOperateType::OPEN_TYPE, -1, errno, cost_ns);
     }
     return ret;
 }
 
 int creat(const char *pathname, mode_t mode) {
-    static creat_func_type real_creat = (creat_func_type)get_real_func_pointer(CREAT_FUNC_TYPE);
+    creat_func_type real_creat = get_real_func<CREAT_FUNC_TYPE>();
     if (__glibc_unlikely(!real_creat)) {
         return -1;
     }
+    if (__glibc_unlikely(!hook_enabled(HOOK_SWITCH_OPEN_CLOSE) || HookGuard::is_inside())) {
+        return real_creat(pathname, mode);
+    }
+    HookGuard guard;
+    uint64_t start_ns = Util::get_time_ns();
     int ret = real_creat(pathname, mode);
+    uint64_t cost_ns = Util::get_time_ns() - start_ns;
     if (ret >= 0) {
         FileIoInfoHandler::get_instance().add_hook_info(
-            FileOperateType::OPEN_TYPE, ret, pathname);
+            FileOperateType::OPEN_TYPE, ret, pathname, cost_ns);
+    } else {
+        FileIoInfoHandler::get_instance().add_error_hook_info(FileOperateType::OPEN_TYPE, -1, errno, cost_ns);
     }
     return ret;
 }
 
 int creat64(const char *file, mode_t mode) {
-    static creat64_func_type real_creat64 = (creat64_func_type)get_real_func_pointer(CREAT64_FUNC_TYPE);
+    creat64_func_type real_creat64 = get_real_func<CREAT64_FUNC_TYPE>();
     if (__glibc_unlikely(!real_creat64)) {
         return -1;
     }
+    if (__glibc_unlikely(!hook_enabled(HOOK_SWITCH_OPEN_CLOSE) || HookGuard::is_inside())) {
+        return real_creat64(file, mode);
+    }
+    HookGuard guard;
+    uint64_t start_ns = Util::get_time_ns();
     int ret = real_creat64(file, mode);
+    uint64_t cost_ns = Util::get_time_ns() - start_ns;
     if (ret >= 0) {
         FileIoInfoHandler::get_instance().add_hook_info(
-            FileOperateType::OPEN_TYPE, ret, file);
+            FileOperateType::OPEN_TYPE, ret, file, cost_ns);
+    } else {
+        FileIoInfoHandler::get_instance().add_error_hook_info(FileOperateType::OPEN_TYPE, -1, errno, cost_ns);
     }
     return ret;
 }
 
 int openat(int dirfd, const char *pathname, int flags, ...) {
-    static openat_func_type real_openat = (openat_func_type)get_real_func_pointer(OPENAT_FUNC_TYPE);
+    openat_func_type real_openat = get_real_func<OPENAT_FUNC_TYPE>();
     if (__glibc_unlikely(!real_openat)) {
         return -1;
     }
-    va_list args;
-    va_start(args, flags);
-    int ret = real_openat(dirfd, pathname, flags, args);
-    va_end(args);
+    mode_t mode = 0;
+    if (flags & (O_CREAT | O_TMPFILE)) {
+        va_list args;
+        va_start(args, flags);
+        mode = static_cast<mode_t>(va_arg(args, int));
+        va_end(args);
+    }
+    if (__glibc_unlikely(!hook_enabled(HOOK_SWITCH_OPEN_CLOSE) || HookGuard::is_inside())) {
+        return real_openat(dirfd, pathname, flags, mode);
+    }
+    HookGuard guard;
+    uint64_t start_ns = Util::get_time_ns();
+    int ret = real_openat(dirfd, pathname, flags, mode);
+    uint64_t cost_ns = Util::get_time_ns() - start_ns;
     if (ret >= 0) {
         FileIoInfoHandler::get_instance().add_hook_info(
-            FileOperateType::OPEN_TYPE, ret, pathname);
+            FileOperateType::OPEN_TYPE, ret, pathname, cost_ns);
+    } else {
+        FileIoInfoHandler::get_instance().add_error_hook_info(FileOperateType::OPEN_TYPE, -1, errno, cost_ns);
     }
     return ret;
 }
 
 int openat64(int dirfd, const char *file, int flag, ...) {
-    static openat64_func_type real_openat64 = (openat64_func_type)get_real_func_pointer(OPENAT64_FUNC_TYPE);
+    openat64_func_type real_openat64 = get_real_func<OPENAT64_FUNC_TYPE>();
     if (__glibc_unlikely(!real_openat64)) {
         return -1;
     }
-    va_list args;
-    va_start(args, flag);
-    int ret = real_openat64(dirfd, file, flag, args);
-    va_end(args);
+    mode_t mode = 0;
+    if (flag & (O_CREAT | O_TMPFILE)) {
+        va_list args;
+        va_start(args, flag);
+        mode = static_cast<mode_t>(va_arg(args, int));
+        va_end(args);
+    }
+    if (__glibc_unlikely(!hook_enabled(HOOK_SWITCH_OPEN_CLOSE) || HookGuard::is_inside())) {
+        return real_openat64(dirfd, file, flag, mode);
+    }
+    HookGuard guard;
+    uint64_t start_ns = Util::get_time_ns();
+    int ret = real_openat64(dirfd, file, flag, mode);
+    uint64_t cost_ns = Util::get_time_ns() - start_ns;
     if (ret >= 0) {
         FileIoInfoHandler::get_instance().add_hook_info(
-            FileOperateType::OPEN_TYPE, ret, file);
+            FileOperateType::OPEN_TYPE, ret, file, cost_ns);
+    } else {
+        FileIoInfoHandler::get_instance().add_error_hook_info(FileOperateType::OPEN_TYPE, -1, errno, cost_ns);
     }
     return ret;
 }
 
 ssize_t read(int fd, void *buf, size_t count) {
-    static read_func_type real_read = (read_func_type)get_real_func_pointer(READ_FUNC_TYPE);
+    read_func_type real_read = get_real_func<READ_FUNC_TYPE>();
     if (__glibc_unlikely(!real_read)) {
         return -1;
     }
+    if (__glibc_unlikely(!hook_enabled(HOOK_SWITCH_READ_WRITE) || HookGuard::is_inside())) {
+        return real_read(fd, buf, count);
+    }
+    HookGuard guard;
+    uint64_t start_ns = Util::get_time_ns();
     ssize_t ret = real_read(fd, buf, count);
+    uint64_t cost_ns = Util::get_time_ns() - start_ns;
     if (ret >= 0) {
         FileIoInfoHandler::get_instance().add_hook_info(
-            FileOperateType::READ_TYPE, fd, ret);
+            FileOperateType::READ_TYPE, fd, ret, cost_ns);
+    } else {
+        FileIoInfoHandler::get_instance().add_error_hook_info(FileOperateType::READ_TYPE, fd, errno, cost_ns);
     }
     return ret;
 }
 
 ssize_t write(int fd, const void *buf, size_t count) {
-    static write_func_type real_write = (write_func_type)get_real_func_pointer(WRITE_FUNC_TYPE);
+    write_func_type real_write = get_real_func<WRITE_FUNC_TYPE>();
     if (__glibc_unlikely(!real_write)) {
         return -1;
     }
+    if (__glibc_unlikely(!hook_enabled(HOOK_SWITCH_READ_WRITE) || HookGuard::is_inside())) {
+        return real_write(fd, buf, count);
+    }
+    HookGuard guard;
+    uint64_t start_ns = Util::get_time_ns();
     ssize_t ret = real_write(fd, buf, count);
+    uint64_t cost_ns = Util::get_time_ns() - start_ns;
     if (ret >= 0) {
         FileIoInfoHandler::get_instance().add_hook_info(
-            FileOperateType::WRITE_TYPE, fd, ret);
+            FileOperateType::WRITE_TYPE, fd, ret, cost_ns);
+    } else {
+        FileIoInfoHandler::get_instance().add_error_hook_info(FileOperateType::WRITE_TYPE, fd, errno, cost_ns);
     }
     return ret;
 }
 
 ssize_t pread(int fd, void *buf, size_t count, off_t offset) {
-    static pread_func_type real_pread = (pread_func_type)get_real_func_pointer(PREAD_FUNC_TYPE);
+    pread_func_type real_pread = get_real_func<PREAD_FUNC_TYPE>();
     if (__glibc_unlikely(!real_pread)) {
         return -1;
     }
+    if (__glibc_unlikely(!hook_enabled(HOOK_SWITCH_READ_WRITE) || HookGuard::is_inside())) {
+        return real_pread(fd, buf, count, offset);
+    }
+    HookGuard guard;
+    uint64_t start_ns = Util::get_time_ns();
     ssize_t ret = real_pread(fd, buf, count, offset);
+    uint64_t cost_ns = Util::get_time_ns() - start_ns;
     if (ret >= 0) {
         FileIoInfoHandler::get_instance().add_hook_info(
-            FileOperateType::READ_TYPE, fd, ret);
+            FileOperateType::READ_TYPE, fd, ret, 0, cost_ns, offset);
+    } else {
+        FileIoInfoHandler::get_instance().add_error_hook_info(FileOperateType::READ_TYPE, fd, errno, cost_ns);
     }
     return ret;
 }
 
 ssize_t pread64(int fd, void *buf, size_t nbytes, __off64_t offset) {
-    static pread64_func_type real_pread64 = (pread64_func_type)get_real_func_pointer(PREAD64_FUNC_TYPE);
+    pread64_func_type real_pread64 = get_real_func<PREAD64_FUNC_TYPE>();
     if (__glibc_unlikely(!real_pread64)) {
         return -1;
     }
+    if (__glibc_unlikely(!hook_enabled(HOOK_SWITCH_READ_WRITE) || HookGuard::is_inside())) {
+        return real_pread64(fd, buf, nbytes, offset);
+    }
+    HookGuard guard;
+    uint64_t start_ns = Util::get_time_ns();
     ssize_t ret = real_pread64(fd, buf, nbytes, offset);
+    uint64_t cost_ns = Util::get_time_ns() - start_ns;
     if (ret >= 0) {
         FileIoInfoHandler::get_instance().add_hook_info(
-            FileOperateType::READ_TYPE, fd, ret);
+            FileOperateType::READ_TYPE, fd, ret, 0, cost_ns, offset);
+    } else {
+        FileIoInfoHandler::get_instance().add_error_hook_info(FileOperateType::READ_TYPE, fd, errno, cost_ns);
     }
     return ret;
 }
 
 ssize_t pwrite(int fd, const void *buf, size_t count, off_t offset) {
-    static pwrite_func_type real_pwrite = (pwrite_func_type)get_real_func_pointer(PWRITE_FUNC_TYPE);
+    pwrite_func_type real_pwrite = get_real_func<PWRITE_FUNC_TYPE>();
     if (__glibc_unlikely(!real_pwrite)) {
         return -1;
     }
+    if (__glibc_unlikely(!hook_enabled(HOOK_SWITCH_READ_WRITE) || HookGuard::is_inside())) {
+        return real_pwrite(fd, buf, count, offset);
+    }
+    HookGuard guard;
+    uint64_t start_ns = Util::get_time_ns();
     ssize_t ret = real_pwrite(fd, buf, count, offset);
+    uint64_t cost_ns = Util::get_time_ns() - start_ns;
     if (ret >= 0) {
         FileIoInfoHandler::get_instance().add_hook_info(
-            FileOperateType::WRITE_TYPE, fd, ret);
+            FileOperateType::WRITE_TYPE, fd, ret, 0, cost_ns, offset);
+    } else {
+        FileIoInfoHandler::get_instance().add_error_hook_info(FileOperateType::WRITE_TYPE, fd, errno, cost_ns);
     }
     return ret;
 }
 
 ssize_t pwrite64(int fd, const void *buf, size_t n, __off64_t offset) {
-    static pwrite64_func_type real_pwrite64 = (pwrite64_func_type)get_real_func_pointer(PWRITE64_FUNC_TYPE);
+    pwrite64_func_type real_pwrite64 = get_real_func<PWRITE64_FUNC_TYPE>();
     if (__glibc_unlikely(!real_pwrite64)) {
         return -1;
     }
+    if (__glibc_unlikely(!hook_enabled(HOOK_SWITCH_READ_WRITE) || HookGuard::is_inside())) {
+        return real_pwrite64(fd, buf, n, offset);
+    }
+    HookGuard guard;
+    uint64_t start_ns = Util::get_time_ns();
     ssize_t ret = real_pwrite64(fd, buf, n, offset);
+    uint64_t cost_ns = Util::get_time_ns() - start_ns;
+    if (ret >= 0) {
+        FileIoInfoHandler::get_instance().add_hook_info(
+            FileOperateType::WRITE_TYPE, fd, ret, 0, cost_ns, offset);
+    } else {
+        FileIoInfoHandler::get_instance().add_error_hook_info(FileOperateType::WRITE_TYPE, fd, errno, cost_ns);
+    }
+    return ret;
+}
+
+// 只有位置会被记录，不统计次数和耗时
+off_t lseek(int fd, off_t offset, int whence) __THROW {
+    lseek_func_type real_lseek = get_real_func<LSEEK_FUNC_TYPE>();
+    if (__glibc_unlikely(!real_lseek)) {
+        return -1;
+    }
+    if (__glibc_unlikely(!hook_enabled(HOOK_SWITCH_READ_WRITE) || HookGuard::is_inside())) {
+        return real_lseek(fd, offset, whence);
+    }
+    HookGuard guard;
+    off_t ret = real_lseek(fd, offset, whence);
+    if (ret >= 0) {
+        FileIoInfoHandler::get_instance().add_seek_hook_info(fd, static_cast<uint64_t>(ret));
+    }
+    return ret;
+}
+
+__off64_t lseek64(int fd, __off64_t offset, int whence) __THROW {
+    lseek64_func_type real_lseek64 = get_real_func<LSEEK64_FUNC_TYPE>();
+    if (__glibc_unlikely(!real_lseek64)) {
+        return -1;
+    }
+    if (__glibc_unlikely(!hook_enabled(HOOK_SWITCH_READ_WRITE) || HookGuard::is_inside())) {
+        return real_lseek64(fd, offset, whence);
+    }
+    HookGuard guard;
+    __off64_t ret = real_lseek64(fd, offset, whence);
+    if (ret >= 0) {
+        FileIoInfoHandler::get_instance().add_seek_hook_info(fd, static_cast<uint64_t>(ret));
+    }
+    return ret;
+}
+
+ssize_t readv(int fd, const struct iovec *iov, int iovcnt) {
+    readv_func_type real_readv = get_real_func<READV_FUNC_TYPE>();
+    if (__glibc_unlikely(!real_readv)) {
+        return -1;
+    }
+    if (__glibc_unlikely(!hook_enabled(HOOK_SWITCH_READ_WRITE) || HookGuard::is_inside())) {
+        return real_readv(fd, iov, iovcnt);
+    }
+    HookGuard guard;
+    uint64_t start_ns = Util::get_time_ns();
+    ssize_t ret = real_readv(fd, iov, iovcnt);
+    uint64_t cost_ns = Util::get_time_ns() - start_ns;
+    if (ret >= 0) {
+        FileIoInfoHandler::get_instance().add_hook_info(
+            FileOperateType::READ_TYPE, fd, ret, iovcnt, cost_ns);
+    } else {
+        FileIoInfoHandler::get_instance().add_error_hook_info(FileOperateType::READ_TYPE, fd, errno, cost_ns);
+    }
+    return ret;
+}
+
+ssize_t writev(int fd, const struct iovec *iov, int iovcnt) {
+    writev_func_type real_writev = get_real_func<WRITEV_FUNC_TYPE>();
+    if (__glibc_unlikely(!real_writev)) {
+        return -1;
+    }
+    if (__glibc_unlikely(!hook_enabled(HOOK_SWITCH_READ_WRITE) || HookGuard::is_inside())) {
+        return real_writev(fd, iov, iovcnt);
+    }
+    HookGuard guard;
+    uint64_t start_ns = Util::get_time_ns();
+    ssize_t ret = real_writev(fd, iov, iovcnt);
+    uint64_t cost_ns = Util::get_time_ns() - start_ns;
+    if (ret >= 0) {
+        FileIoInfoHandler::get_instance().add_hook_info(
+            FileOperateType::WRITE_TYPE, fd, ret, iovcnt, cost_ns);
+    } else {
+        FileIoInfoHandler::get_instance().add_error_hook_info(FileOperateType::WRITE_TYPE, fd, errno, cost_ns);
+    }
+    return ret;
+}
+
+ssize_t preadv(int fd, const struct iovec *iov, int iovcnt, off_t offset) {
+    preadv_func_type real_preadv = get_real_func<PREADV_FUNC_TYPE>();
+    if (__glibc_unlikely(!real_preadv)) {
+        return -1;
+    }
+    if (__glibc_unlikely(!hook_enabled(HOOK_SWITCH_READ_WRITE) || HookGuard::is_inside())) {
+        return real_preadv(fd, iov, iovcnt, offset);
+    }
+    HookGuard guard;
+    uint64_t start_ns = Util::get_time_ns();
+    ssize_t ret = real_preadv(fd, iov, iovcnt, offset);
+    uint64_t cost_ns = Util::get_time_ns() - start_ns;
+    if (ret >= 0) {
+        FileIoInfoHandler::get_instance().add_hook_info(
+            FileOperateType::READ_TYPE, fd, ret, iovcnt, cost_ns, offset);
+    } else {
+        FileIoInfoHandler::get_instance().add_error_hook_info(FileOperateType::READ_TYPE, fd, errno, cost_ns);
+    }
+    return ret;
+}
+
+ssize_t preadv64(int fd, const struct iovec *iov, int iovcnt, __off64_t offset) {
+    preadv64_func_type real_preadv64 = get_real_func<PREADV64_FUNC_TYPE>();
+    if (__glibc_unlikely(!real_preadv64)) {
+        return -1;
+    }
+    if (__glibc_unlikely(!hook_enabled(HOOK_SWITCH_READ_WRITE) || HookGuard::is_inside())) {
+        return real_preadv64(fd, iov, iovcnt, offset);
+    }
+    HookGuard guard;
+    uint64_t start_ns = Util::get_time_ns();
+    ssize_t ret = real_preadv64(fd, iov, iovcnt, offset);
+    uint64_t cost_ns = Util::get_time_ns() - start_ns;
+    if (ret >= 0) {
+        FileIoInfoHandler::get_instance().add_hook_info(
+            FileOperateType::READ_TYPE, fd, ret, iovcnt, cost_ns, offset);
+    } else {
+        FileIoInfoHandler::get_instance().add_error_hook_info(FileOperateType::READ_TYPE, fd, errno, cost_ns);
+    }
+    return ret;
+}
+
+ssize_t pwritev(int fd, const struct iovec *iov, int iovcnt, off_t offset) {
+    pwritev_func_type real_pwritev = get_real_func<PWRITEV_FUNC_TYPE>();
+    if (__glibc_unlikely(!real_pwritev)) {
+        return -1;
+    }
+    if (__glibc_unlikely(!hook_enabled(HOOK_SWITCH_READ_WRITE) || HookGuard::is_inside())) {
+        return real_pwritev(fd, iov, iovcnt, offset);
+    }
+    HookGuard guard;
+    uint64_t start_ns = Util::get_time_ns();
+    ssize_t ret = real_pwritev(fd, iov, iovcnt, offset);
+    uint64_t cost_ns = Util::get_time_ns() - start_ns;
+    if (ret >= 0) {
+        FileIoInfoHandler::get_instance().add_hook_info(
+            FileOperateType::WRITE_TYPE, fd, ret, iovcnt, cost_ns, offset);
+    } else {
+        FileIoInfoHandler::get_instance().add_error_hook_info(FileOperateType::WRITE_TYPE, fd, errno, cost_ns);
+    }
+    return ret;
+}
+
+ssize_t pwritev64(int fd, const struct iovec *iov, int iovcnt, __off64_t offset) {
+    pwritev64_func_type real_pwritev64 = get_real_func<PWRITEV64_FUNC_TYPE>();
+    if (__glibc_unlikely(!real_pwritev64)) {
+        return -1;
+    }
+    if (__glibc_unlikely(!hook_enabled(HOOK_SWITCH_READ_WRITE) || HookGuard::is_inside())) {
+        return real_pwritev64(fd, iov, iovcnt, offset);
+    }
+    HookGuard guard;
+    uint64_t start_ns = Util::get_time_ns();
+    ssize_t ret = real_pwritev64(fd, iov, iovcnt, offset);
+    uint64_t cost_ns = Util::get_time_ns() - start_ns;
+    if (ret >= 0) {
+        FileIoInfoHandler::get_instance().add_hook_info(
+            FileOperateType::WRITE_TYPE, fd, ret, iovcnt, cost_ns, offset);
+    } else {
+        FileIoInfoHandler::get_instance().add_error_hook_info(FileOperateType::WRITE_TYPE, fd, errno, cost_ns);
+    }
+    return ret;
+}
+
+ssize_t preadv2(int fd, const struct iovec *iov, int iovcnt, off_t offset, int flags) {
+    preadv2_func_type real_preadv2 = get_real_func<PREADV2_FUNC_TYPE>();
+    if (__glibc_unlikely(!real_preadv2)) {
+        return -1;
+    }
+    if (__glibc_unlikely(!hook_enabled(HOOK_SWITCH_READ_WRITE) || HookGuard::is_inside())) {
+        return real_preadv2(fd, iov, iovcnt, offset, flags);
+    }
+    HookGuard guard;
+    uint64_t start_ns = Util::get_time_ns();
+    ssize_t ret = real_preadv2(fd, iov, iovcnt, offset, flags);
+    uint64_t cost_ns = Util::get_time_ns() - start_ns;
+    if (ret >= 0) {
+        FileIoInfoHandler::get_instance().add_hook_info(
+            FileOperateType::READ_TYPE, fd, ret, iovcnt, cost_ns, offset);
+    } else {
+        FileIoInfoHandler::get_instance().add_error_hook_info(FileOperateType::READ_TYPE, fd, errno, cost_ns);
+    }
+    return ret;
+}
+
+ssize_t preadv64v2(int fd, const struct iovec *iov, int iovcnt, __off64_t offset, int flags) {
+    preadv64v2_func_type real_preadv64v2 = get_real_func<PREADV64V2_FUNC_TYPE>();
+    if (__glibc_unlikely(!real_preadv64v2)) {
+        return -1;
+    }
+    if (__glibc_unlikely(!hook_enabled(HOOK_SWITCH_READ_WRITE) || HookGuard::is_inside())) {
+        return real_preadv64v2(fd, iov, iovcnt, offset, flags);
+    }
+    HookGuard guard;
+    uint64_t start_ns = Util::get_time_ns();
+    ssize_t ret = real_preadv64v2(fd, iov, iovcnt, offset, flags);
+    uint64_t cost_ns = Util::get_time_ns() - start_ns;
+    if (ret >= 0) {
+        FileIoInfoHandler::get_instance().add_hook_info(
+            FileOperateType::READ_TYPE, fd, ret, iovcnt, cost_ns, offset);
+    } else {
+        FileIoInfoHandler::get_instance().add_error_hook_info(FileOperateType::READ_TYPE, fd, errno, cost_ns);
+    }
+    return ret;
+}
+
+ssize_t pwritev2(int fd, const struct iovec *iov, int iovcnt, off_t offset, int flags) {
+    pwritev2_func_type real_pwritev2 = get_real_func<PWRITEV2_FUNC_TYPE>();
+    if (__glibc_unlikely(!real_pwritev2)) {
+        return -1;
+    }
+    if (__glibc_unlikely(!hook_enabled(HOOK_SWITCH_READ_WRITE) || HookGuard::is_inside())) {
+        return real_pwritev2(fd, iov, iovcnt, offset, flags);
+    }
+    HookGuard guard;
+    uint64_t start_ns = Util::get_time_ns();
+    ssize_t ret = real_pwritev2(fd, iov, iovcnt, offset, flags);
+    uint64_t cost_ns = Util::get_time_ns() - start_ns;
+    if (ret >= 0) {
+        FileIoInfoHandler::get_instance().add_hook_info(
+            FileOperateType::WRITE_TYPE, fd, ret, iovcnt, cost_ns, offset);
+    } else {
+        FileIoInfoHandler::get_instance().add_error_hook_info(FileOperateType::WRITE_TYPE, fd, errno, cost_ns);
+    }
+    return ret;
+}
+
+ssize_t pwritev64v2(int fd, const struct iovec *iov, int iovcnt, __off64_t offset, int flags) {
+    pwritev64v2_func_type real_pwritev64v2 = get_real_func<PWRITEV64V2_FUNC_TYPE>();
+    if (__glibc_unlikely(!real_pwritev64v2)) {
+        return -1;
+    }
+    if (__glibc_unlikely(!hook_enabled(HOOK_SWITCH_READ_WRITE) || HookGuard::is_inside())) {
+        return real_pwritev64v2(fd, iov, iovcnt, offset, flags);
+    }
+    HookGuard guard;
+    uint64_t start_ns = Util::get_time_ns();
+    ssize_t ret = real_pwritev64v2(fd, iov, iovcnt, offset, flags);
+    uint64_t cost_ns = Util::get_time_ns() - start_ns;
     if (ret >= 0) {
         FileIoInfoHandler::get_instance().add_hook_info(
-            FileOperateType::WRITE_TYPE, fd, ret);
+            FileOperateType::WRITE_TYPE, fd, ret, iovcnt, cost_ns, offset);
+    } else {
+        FileIoInfoHandler::get_instance().add_error_hook_info(FileOperateType::WRITE_TYPE, fd, errno, cost_ns);
+    }
+    return ret;
+}
+
+// 零拷贝传输中不带偏移的一端从 fd 的文件位置开始读写，内核会推进这个位置，这里同步推进 fd 上记录的位置
+// 管道、socket 等不在 fd 表中，会被忽略
+static void advance_transfer_position(int in_fd, bool in_at_position, int out_fd, bool out_at_position, ssize_t bytes) {
+    if (bytes <= 0) return;
+    if (in_at_position) {
+        FileIoInfoHandler::get_instance().add_advance_hook_info(in_fd, bytes);
+    }
+    if (out_at_position) {
+        FileIoInfoHandler::get_instance().add_advance_hook_info(out_fd, bytes);
+    }
+}
+
+ssize_t sendfile(int out_fd, int in_fd, off_t *offset, size_t count) __THROW {
+    sendfile_func_type real_sendfile = get_real_func<SENDFILE_FUNC_TYPE>();
+    if (__glibc_unlikely(!real_sendfile)) {
+        return -1;
+    }
+    if (__glibc_unlikely(!hook_enabled(HOOK_SWITCH_ZERO_COPY) || HookGuard::is_inside())) {
+        return real_sendfile(out_fd, in_fd, offset, count);
+    }
+    HookGuard guard;
+    uint64_t start_ns = Util::get_time_ns();
+    ssize_t ret = real_sendfile(out_fd, in_fd, offset, count);
+    uint64_t cost_ns = Util::get_time_ns() - start_ns;
+    if (ret >= 0) {
+        FileIoInfoHandler::get_instance().add_transfer_hook_info(in_fd, out_fd, ret, cost_ns);
+        // out_fd 没有偏移参数，总是从文件位置开始写入（out_fd 为普通文件时）
+        advance_transfer_position(in_fd, offset == NULL, out_fd, true, ret);
+    } else {
+        FileIoInfoHandler::get_instance().add_transfer_error_hook_info(in_fd, out_fd, errno, cost_ns);
+    }
+    return ret;
+}
+
+ssize_t sendfile64(int out_fd, int in_fd, __off64_t *offset, size_t count) __THROW {
+    sendfile64_func_type real_sendfile64 = get_real_func<SENDFILE64_FUNC_TYPE>();
+    if (__glibc_unlikely(!real_sendfile64)) {
+        return -1;
+    }
+    if (__glibc_unlikely(!hook_enabled(HOOK_SWITCH_ZERO_COPY) || HookGuard::is_inside())) {
+        return real_sendfile64(out_fd, in_fd, offset, count);
+    }
+    HookGuard guard;
+    uint64_t start_ns = Util::get_time_ns();
+    ssize_t ret = real_sendfile64(out_fd, in_fd, offset, count);
+    uint64_t cost_ns = Util::get_time_ns() - start_ns;
+    if (ret >= 0) {
+        FileIoInfoHandler::get_instance().add_transfer_hook_info(in_fd, out_fd, ret, cost_ns);
+        advance_transfer_position(in_fd, offset == NULL, out_fd, true, ret);
+    } else {
+        FileIoInfoHandler::get_instance().add_transfer_error_hook_info(in_fd, out_fd, errno, cost_ns);
+    }
+    return ret;
+}
+
+ssize_t splice(int fd_in, __off64_t *off_in, int fd_out, __off64_t *off_out, size_t len, unsigned int flags) {
+    splice_func_type real_splice = get_real_func<SPLICE_FUNC_TYPE>();
+    if (__glibc_unlikely(!real_splice)) {
+        return -1;
+    }
+    if (__glibc_unlikely(!hook_enabled(HOOK_SWITCH_ZERO_COPY) || HookGuard::is_inside())) {
+        return real_splice(fd_in, off_in, fd_out, off_out, len, flags);
+    }
+    HookGuard guard;
+    uint64_t start_ns = Util::get_time_ns();
+    ssize_t ret = real_splice(fd_in, off_in, fd_out, off_out, len, flags);
+    uint64_t cost_ns = Util::get_time_ns() - start_ns;
+    if (ret >= 0) {
+        FileIoInfoHandler::get_instance().add_transfer_hook_info(fd_in, fd_out, ret, cost_ns);
+        advance_transfer_position(fd_in, off_in == NULL, fd_out, off_out == NULL, ret);
+    } else {
+        FileIoInfoHandler::get_instance().add_transfer_error_hook_info(fd_in, fd_out, errno, cost_ns);
+    }
+    return ret;
+}
+
+ssize_t tee(int fd_in, int fd_out, size_t len, unsigned int flags) {
+    tee_func_type real_tee = get_real_func<TEE_FUNC_TYPE>();
+    if (__glibc_unlikely(!real_tee)) {
+        return -1;
+    }
+    if (__glibc_unlikely(!hook_enabled(HOOK_SWITCH_ZERO_COPY) || HookGuard::is_inside())) {
+        return real_tee(fd_in, fd_out, len, flags);
+    }
+    HookGuard guard;
+    uint64_t start_ns = Util::get_time_ns();
+    ssize_t ret = real_tee(fd_in, fd_out, len, flags);
+    uint64_t cost_ns = Util::get_time_ns() - start_ns;
+    if (ret >= 0) {
+        FileIoInfoHandler::get_instance().add_transfer_hook_info(fd_in, fd_out, ret, cost_ns);
+    } else {
+        FileIoInfoHandler::get_instance().add_transfer_error_hook_info(fd_in, fd_out, errno, cost_ns);
+    }
+    return ret;
+}
+
+ssize_t copy_file_range(int fd_in, __off64_t *off_in, int fd_out, __off64_t *off_out,
+    size_t len, unsigned int flags) {
+    copy_file_range_func_type real_copy_file_range = get_real_func<COPY_FILE_RANGE_FUNC_TYPE>();
+    if (__glibc_unlikely(!real_copy_file_range)) {
+        return -1;
+    }
+    if (__glibc_unlikely(!hook_enabled(HOOK_SWITCH_ZERO_COPY) || HookGuard::is_inside())) {
+        return real_copy_file_range(fd_in, off_in, fd_out, off_out, len, flags);
+    }
+    HookGuard guard;
+    uint64_t start_ns = Util::get_time_ns();
+    ssize_t ret = real_copy_file_range(fd_in, off_in, fd_out, off_out, len, flags);
+    uint64_t cost_ns = Util::get_time_ns() - start_ns;
+    if (ret >= 0) {
+        FileIoInfoHandler::get_instance().add_transfer_hook_info(fd_in, fd_out, ret, cost_ns);
+        advance_transfer_position(fd_in, off_in == NULL, fd_out, off_out == NULL, ret);
+    } else {
+        FileIoInfoHandler::get_instance().add_transfer_error_hook_info(fd_in, fd_out, errno, cost_ns);
+    }
+    return ret;
+}
+
+int fsync(int fd) {
+    fsync_func_type real_fsync = get_real_func<FSYNC_FUNC_TYPE>();
+    if (__glibc_unlikely(!real_fsync)) {
+        return -1;
+    }
+    if (__glibc_unlikely(!hook_enabled(HOOK_SWITCH_SYNC) || HookGuard::is_inside())) {
+        return real_fsync(fd);
+    }
+    HookGuard guard;
+    uint64_t start_ns = Util::get_time_ns();
+    int ret = real_fsync(fd);
+    uint64_t cost_ns = Util::get_time_ns() - start_ns;
+    if (ret == 0) {
+        FileIoInfoHandler::get_instance().add_hook_info(FileOperateType::SYNC_TYPE, fd, static_cast<size_t>(0), cost_ns);
+    } else {
+        FileIoInfoHandler::get_instance().add_error_hook_info(FileOperateType::SYNC_TYPE, fd, errno, cost_ns);
+    }
+    return ret;
+}
+
+int fdatasync(int fd) {
+    fdatasync_func_type real_fdatasync = get_real_func<FDATASYNC_FUNC_TYPE>();
+    if (__glibc_unlikely(!real_fdatasync)) {
+        return -1;
     }
+    if (__glibc_unlikely(!hook_enabled(HOOK_SWITCH_SYNC) || HookGuard::is_inside())) {
+        return real_fdatasync(fd);
+    }
+    HookGuard guard;
+    uint64_t start_ns = Util::get_time_ns();
+    int ret = real_fdatasync(fd);
+    uint64_t cost_ns = Util::get_time_ns() - start_ns;
+    if (ret == 0) {
+        FileIoInfoHandler::get_instance().add_hook_info(FileOperateType::SYNC_TYPE, fd, static_cast<size_t>(0), cost_ns);
+    } else {
+        FileIoInfoHandler::get_instance().add_error_hook_info(FileOperateType::SYNC_TYPE, fd, errno, cost_ns);
+    }
+    return ret;
+}
+
+int sync_file_range(int fd, __off64_t offset, __off64_t nbytes, unsigned int flags) {
+    sync_file_range_func_type real_sync_file_range = get_real_func<SYNC_FILE_RANGE_FUNC_TYPE>();
+    if (__glibc_unlikely(!real_sync_file_range)) {
+        return -1;
+    }
+    if (__glibc_unlikely(!hook_enabled(HOOK_SWITCH_SYNC) || HookGuard::is_inside())) {
+        return real_sync_file_range(fd, offset, nbytes, flags);
+    }
+    HookGuard guard;
+    uint64_t start_ns = Util::get_time_ns();
+    int ret = real_sync_file_range(fd, offset, nbytes, flags);
+    uint64_t cost_ns = Util::get_time_ns() - start_ns;
+    if (ret == 0) {
+        FileIoInfoHandler::get_instance().add_hook_info(FileOperateType::SYNC_TYPE, fd, static_cast<size_t>(0), cost_ns);
+    } else {
+        FileIoInfoHandler::get_instance().add_error_hook_info(FileOperateType::SYNC_TYPE, fd, errno, cost_ns);
+    }
+    return ret;
+}
+
+int syncfs(int fd) __THROW {
+    syncfs_func_type real_syncfs = get_real_func<SYNCFS_FUNC_TYPE>();
+    if (__glibc_unlikely(!real_syncfs)) {
+        return -1;
+    }
+    if (__glibc_unlikely(!hook_enabled(HOOK_SWITCH_SYNC) || HookGuard::is_inside())) {
+        return real_syncfs(fd);
+    }
+    HookGuard guard;
+    uint64_t start_ns = Util::get_time_ns();
+    int ret = real_syncfs(fd);
+    uint64_t cost_ns = Util::get_time_ns() - start_ns;
+    if (ret == 0) {
+        FileIoInfoHandler::get_instance().add_hook_info(FileOperateType::SYNC_TYPE, fd, static_cast<size_t>(0), cost_ns);
+    } else {
+        FileIoInfoHandler::get_instance().add_error_hook_info(FileOperateType::SYNC_TYPE, fd, errno, cost_ns);
+    }
+    return ret;
+}
+
+// 转发给真实的 syscall
+static inline long call_real_syscall(syscall_func_type real_syscall, long number, const long* args) {
+    return real_syscall(number, args[0], args[1], args[2], args[3], args[4], args[5]);
+}
+
+// io_uring_setup/io_uring_enter
+static long io_uring_syscall(syscall_func_type real_syscall, long number, const long* args) {
+    IoUringTracker& tracker = IoUringTracker::get_instance();
+    if (number == SYS_io_uring_setup) {
+        long ret = call_real_syscall(real_syscall, number, args);
+        if (ret >= 0) {
+            tracker.on_setup(static_cast<int>(ret), reinterpret_cast<const struct io_uring_params*>(args[1]));
+        }
+        return ret;
+    }
+    // 已注册的实例 fd 是内核中的下标，不是进程的 fd
+    if (!tracker.has_rings() || (static_cast<unsigned>(args[3]) & IORING_ENTER_REGISTERED_RING)) {
+        return call_real_syscall(real_syscall, number, args);
+    }
+    IoUringTracker::SubmitContext ctx = tracker.before_submit(static_cast<int>(args[0]),
+        static_cast<uint32_t>(args[1]), nullptr);
+    long ret = call_real_syscall(real_syscall, number, args);
+    int saved_errno = errno;
+    tracker.after_submit(ctx, ret);
+    errno = saved_errno;
+    return ret;
+}
+
+// 记录一个即将通过 io_submit 提交的 iocb
+static void submit_iocb(AioTracker& tracker, const struct iocb* cb) {
+    if (cb == nullptr) {
+        return;
+    }
+    uint64_t key = reinterpret_cast<uintptr_t>(cb);
+    int fd = static_cast<int>(cb->aio_fildes);
+    switch (cb->aio_lio_opcode) {
+    case IOCB_CMD_PREAD:
+        tracker.on_submit(key, fd, FileOperateType::READ_TYPE, 0);
+        break;
+    case IOCB_CMD_PWRITE:
+        tracker.on_submit(key, fd, FileOperateType::WRITE_TYPE, 0);
+        break;
+    // 向量读写时 aio_nbytes 为 iovec 的数量
+    case IOCB_CMD_PREADV:
+        tracker.on_submit(key, fd, FileOperateType::READ_TYPE, static_cast<int>(cb->aio_nbytes));
+        break;
+    case IOCB_CMD_PWRITEV:
+        tracker.on_submit(key, fd, FileOperateType::WRITE_TYPE, static_cast<int>(cb->aio_nbytes));
+        break;
+    case IOCB_CMD_FSYNC:
+    case IOCB_CMD_FDSYNC:
+        tracker.on_submit(key, fd, FileOperateType::SYNC_TYPE, 0);
+        break;
+    default:
+        break;
+    }
+}
+
+// io_submit/io_getevents/io_pgetevents/io_cancel
+static long aio_syscall(syscall_func_type real_syscall, long number, const long* args) {
+    AioTracker& tracker = AioTracker::get_instance();
+    if (number == SYS_io_submit) {
+        long nr = args[1];
+        struct iocb** iocbs = reinterpret_cast<struct iocb**>(args[2]);
+        if (nr <= 0 || iocbs == nullptr) {
+            return call_real_syscall(real_syscall, number, args);
+        }
+        // 先记录再提交，其他线程可能在 io_submit 返回前就收割到完成事件
+        for (long i = 0; i < nr; ++i) {
+            submit_iocb(tracker, iocbs[i]);
+        }
+        long ret = call_real_syscall(real_syscall, number, args);
+        int saved_errno = errno;
+        for (long i = ret < 0 ? 0 : ret; i < nr; ++i) {
+            tracker.on_cancel(reinterpret_cast<uintptr_t>(iocbs[i]));
+        }
+        errno = saved_errno;
+        return ret;
+    }
+    long ret = call_real_syscall(real_syscall, number, args);
+    int saved_errno = errno;
+    if (number == SYS_io_cancel) {
+        // 新内核取消成功时返回 EINPROGRESS，结果仍然通过 io_getevents 返回
+        if (ret == 0) {
+            tracker.on_cancel(static_cast<uint64_t>(args[1]));
+        }
+    } else if (ret > 0) {
+        const struct io_event* events = reinterpret_cast<const struct io_event*>(args[3]);
+        for (long i = 0; i < ret; ++i) {
+            tracker.on_complete(events[i].obj, events[i].res);
+        }
+    }
+    errno = saved_errno;
+    return ret;
+}
+
+long syscall(long number, ...) __THROW {
+    // 本库内部也会调用 syscall（比如获取线程 id），可能早于构造函数执行，此时在这里解析
+    syscall_func_type real_syscall = get_real_func<SYSCALL_FUNC_TYPE>();
+    if (__glibc_unlikely(!real_syscall)) {
+        errno = ENOSYS;
+        return -1;
+    }
+    // 与 glibc 的实现一致，总是取 6 个参数
+    long args[6];
+    va_list ap;
+    va_start(ap, number);
+    for (int i = 0; i < 6; ++i) {
+        args[i] = va_arg(ap, long);
+    }
+    va_end(ap);
+    if (__glibc_unlikely(!hook_enabled(HOOK_SWITCH_ASYNC) || HookGuard::is_inside())) {
+        return call_real_syscall(real_syscall, number, args);
+    }
+    HookGuard guard;
+    switch (number) {
+    case SYS_io_uring_setup:
+    case SYS_io_uring_enter:
+        return io_uring_syscall(real_syscall, number, args);
+    case SYS_io_submit:
+    case SYS_io_getevents:
+#ifdef SYS_io_pgetevents
+    case SYS_io_pgetevents:
+#endif
+    case SYS_io_cancel:
+        return aio_syscall(real_syscall, number, args);
+    default:
+        return call_real_syscall(real_syscall, number, args);
+    }
+}
+
+// 记录一个即将通过 POSIX AIO 提交的请求
+static void submit_aiocb(AioTracker& tracker, const void* aiocbp, int fd, int lio_opcode) {
+    switch (lio_opcode) {
+    case LIO_READ:
+        tracker.on_submit(reinterpret_cast<uintptr_t>(aiocbp), fd, FileOperateType::READ_TYPE, 0);
+        break;
+    case LIO_WRITE:
+        tracker.on_submit(reinterpret_cast<uintptr_t>(aiocbp), fd, FileOperateType::WRITE_TYPE, 0);
+        break;
+    default:
+        break;
+    }
+}
+
+int aio_read(struct aiocb *aiocbp) __THROW {
+    aio_read_func_type real_aio_read = get_real_func<AIO_READ_FUNC_TYPE>();
+    if (__glibc_unlikely(!real_aio_read)) {
+        return -1;
+    }
+    if (__glibc_unlikely(!hook_enabled(HOOK_SWITCH_ASYNC) || HookGuard::is_inside())) {
+        return real_aio_read(aiocbp);
+    }
+    HookGuard guard;
+    AioTracker& tracker = AioTracker::get_instance();
+    submit_aiocb(tracker, aiocbp, aiocbp->aio_fildes, LIO_READ);
+    int ret = real_aio_read(aiocbp);
+    if (ret != 0) {
+        tracker.on_cancel(reinterpret_cast<uintptr_t>(aiocbp));
+    }
+    return ret;
+}
+
+int aio_read64(struct aiocb64 *aiocbp) __THROW {
+    aio_read64_func_type real_aio_read64 = get_real_func<AIO_READ64_FUNC_TYPE>();
+    if (__glibc_unlikely(!real_aio_read64)) {
+        return -1;
+    }
+    if (__glibc_unlikely(!hook_enabled(HOOK_SWITCH_ASYNC) || HookGuard::is_inside())) {
+        return real_aio_read64(aiocbp);
+    }
+    HookGuard guard;
+    AioTracker& tracker = AioTracker::get_instance();
+    submit_aiocb(tracker, aiocbp, aiocbp->aio_fildes, LIO_READ);
+    int ret = real_aio_read64(aiocbp);
+    if (ret != 0) {
+        tracker.on_cancel(reinterpret_cast<uintptr_t>(aiocbp));
+    }
+    return ret;
+}
+
+int aio_write(struct aiocb *aiocbp) __THROW {
+    aio_write_func_type real_aio_write = get_real_func<AIO_WRITE_FUNC_TYPE>();
+    if (__glibc_unlikely(!real_aio_write)) {
+        return -1;
+    }
+    if (__glibc_unlikely(!hook_enabled(HOOK_SWITCH_ASYNC) || HookGuard::is_inside())) {
+        return real_aio_write(aiocbp);
+    }
+    HookGuard guard;
+    AioTracker& tracker = AioTracker::get_instance();
+    submit_aiocb(tracker, aiocbp, aiocbp->aio_fildes, LIO_WRITE);
+    int ret = real_aio_write(aiocbp);
+    if (ret != 0) {
+        tracker.on_cancel(reinterpret_cast<uintptr_t>(aiocbp));
+    }
+    return ret;
+}
+
+int aio_write64(struct aiocb64 *aiocbp) __THROW {
+    aio_write64_func_type real_aio_write64 = get_real_func<AIO_WRITE64_FUNC_TYPE>();
+    if (__glibc_unlikely(!real_aio_write64)) {
+        return -1;
+    }
+    if (__glibc_unlikely(!hook_enabled(HOOK_SWITCH_ASYNC) || HookGuard::is_inside())) {
+        return real_aio_write64(aiocbp);
+    }
+    HookGuard guard;
+    AioTracker& tracker = AioTracker::get_instance();
+    submit_aiocb(tracker, aiocbp, aiocbp->aio_fildes, LIO_WRITE);
+    int ret = real_aio_write64(aiocbp);
+    if (ret != 0) {
+        tracker.on_cancel(reinterpret_cast<uintptr_t>(aiocbp));
+    }
+    return ret;
+}
+
+int aio_fsync(int operation, struct aiocb *aiocbp) __THROW {
+    aio_fsync_func_type real_aio_fsync = get_real_func<AIO_FSYNC_FUNC_TYPE>();
+    if (__glibc_unlikely(!real_aio_fsync)) {
+        return -1;
+    }
+    if (__glibc_unlikely(!hook_enabled(HOOK_SWITCH_ASYNC) || HookGuard::is_inside())) {
+        return real_aio_fsync(operation, aiocbp);
+    }
+    HookGuard guard;
+    AioTracker& tracker = AioTracker::get_instance();
+    tracker.on_submit(reinterpret_cast<uintptr_t>(aiocbp), aiocbp->aio_fildes, FileOperateType::SYNC_TYPE, 0);
+    int ret = real_aio_fsync(operation, aiocbp);
+    if (ret != 0) {
+        tracker.on_cancel(reinterpret_cast<uintptr_t>(aiocbp));
+    }
+    return ret;
+}
+
+int aio_fsync64(int operation, struct aiocb64 *aiocbp) __THROW {
+    aio_fsync64_func_type real_aio_fsync64 = get_real_func<AIO_FSYNC64_FUNC_TYPE>();
+    if (__glibc_unlikely(!real_aio_fsync64)) {
+        return -1;
+    }
+    if (__glibc_unlikely(!hook_enabled(HOOK_SWITCH_ASYNC) || HookGuard::is_inside())) {
+        return real_aio_fsync64(operation, aiocbp);
+    }
+    HookGuard guard;
+    AioTracker& tracker = AioTracker::get_instance();
+    tracker.on_submit(reinterpret_cast<uintptr_t>(aiocbp), aiocbp->aio_fildes, FileOperateType::SYNC_TYPE, 0);
+    int ret = real_aio_fsync64(operation, aiocbp);
+    if (ret != 0) {
+        tracker.on_cancel(reinterpret_cast<uintptr_t>(aiocbp));
+    }
+    return ret;
+}
+
+int lio_listio(int mode, struct aiocb *const list[], int nent, struct sigevent *sig) __THROW {
+    lio_listio_func_type real_lio_listio = get_real_func<LIO_LISTIO_FUNC_TYPE>();
+    if (__glibc_unlikely(!real_lio_listio)) {
+        return -1;
+    }
+    if (__glibc_unlikely(!hook_enabled(HOOK_SWITCH_ASYNC) || HookGuard::is_inside())) {
+        return real_lio_listio(mode, list, nent, sig);
+    }
+    HookGuard guard;
+    AioTracker& tracker = AioTracker::get_instance();
+    for (int i = 0; i < nent; ++i) {
+        if (list[i] != nullptr) {
+            submit_aiocb(tracker, list[i], list[i]->aio_fildes, list[i]->aio_lio_opcode);
+        }
+    }
+    int ret = real_lio_listio(mode, list, nent, sig);
+    // EIO 时部分请求已经入队，结果由 aio_return 返回；其他错误时没有请求入队
+    if (ret != 0 && errno != EIO) {
+        for (int i = 0; i < nent; ++i) {
+            tracker.on_cancel(reinterpret_cast<uintptr_t>(list[i]));
+        }
+    }
+    return ret;
+}
+
+int lio_listio64(int mode, struct aiocb64 *const list[], int nent, struct sigevent *sig) __THROW {
+    lio_listio64_func_type real_lio_listio64 = get_real_func<LIO_LISTIO64_FUNC_TYPE>();
+    if (__glibc_unlikely(!real_lio_listio64)) {
+        return -1;
+    }
+    if (__glibc_unlikely(!hook_enabled(HOOK_SWITCH_ASYNC) || HookGuard::is_inside())) {
+        return real_lio_listio64(mode, list, nent, sig);
+    }
+    HookGuard guard;
+    AioTracker& tracker = AioTracker::get_instance();
+    for (int i = 0; i < nent; ++i) {
+        if (list[i] != nullptr) {
+            submit_aiocb(tracker, list[i], list[i]->aio_fildes, list[i]->aio_lio_opcode);
+        }
+    }
+    int ret = real_lio_listio64(mode, list, nent, sig);
+    if (ret != 0 && errno != EIO) {
+        for (int i = 0; i < nent; ++i) {
+            tracker.on_cancel(reinterpret_cast<uintptr_t>(list[i]));
+        }
+    }
+    return ret;
+}
+
+ssize_t aio_return(struct aiocb *aiocbp) __THROW {
+    aio_return_func_type real_aio_return = get_real_func<AIO_RETURN_FUNC_TYPE>();
+    if (__glibc_unlikely(!real_aio_return)) {
+        return -1;
+    }
+    if (__glibc_unlikely(!hook_enabled(HOOK_SWITCH_ASYNC) || HookGuard::is_inside())) {
+        return real_aio_return(aiocbp);
+    }
+    HookGuard guard;
+    // aio_return 失败时只返回 -1，错误码需要在它之前通过 aio_error 取得
+    int err = aio_error(aiocbp);
+    ssize_t ret = real_aio_return(aiocbp);
+    AioTracker::get_instance().on_complete(reinterpret_cast<uintptr_t>(aiocbp), ret < 0 ? -err : ret);
+    return ret;
+}
+
+ssize_t aio_return64(struct aiocb64 *aiocbp) __THROW {
+    aio_return64_func_type real_aio_return64 = get_real_func<AIO_RETURN64_FUNC_TYPE>();
+    if (__glibc_unlikely(!real_aio_return64)) {
+        return -1;
+    }
+    if (__glibc_unlikely(!hook_enabled(HOOK_SWITCH_ASYNC) || HookGuard::is_inside())) {
+        return real_aio_return64(aiocbp);
+    }
+    HookGuard guard;
+    int err = aio_error64(aiocbp);
+    ssize_t ret = real_aio_return64(aiocbp);
+    AioTracker::get_instance().on_complete(reinterpret_cast<uintptr_t>(aiocbp), ret < 0 ? -err : ret);
     return ret;
 }
 
+#ifdef FILE_IO_HOOK_LIBURING
+// liburing 已经映射好了队列，直接使用它的地址
+static void attach_liburing_ring(struct io_uring *ring) {
+    if (ring->flags & IORING_SETUP_SQPOLL) {
+        return;
+    }
+    IoUringLayout layout;
+    layout.sq_head = ring->sq.khead;
+    layout.sq_tail = ring->sq.ktail;
+    layout.sq_mask = *ring->sq.kring_mask;
+    layout.sq_entries = *ring->sq.kring_entries;
+    // liburing 中提交队列的位置与 sqes 的下标一一对应，提交前索引数组可能还没有填充
+    layout.sq_array = nullptr;
+    layout.sqes = reinterpret_cast<const char*>(ring->sq.sqes);
+    layout.sqe_size = (ring->flags & IORING_SETUP_SQE128) ? 2 * sizeof(struct io_uring_sqe)
+        : sizeof(struct io_uring_sqe);
+    layout.cq_tail = ring->cq.ktail;
+    layout.cq_mask = *ring->cq.kring_mask;
+    layout.cq_entries = *ring->cq.kring_entries;
+    layout.cqes = reinterpret_cast<const char*>(ring->cq.cqes);
+    layout.cqe_size = (ring->flags & IORING_SETUP_CQE32) ? 2 * sizeof(struct io_uring_cqe)
+        : sizeof(struct io_uring_cqe);
+    IoUringTracker::get_instance().attach(ring->ring_fd, layout);
+}
+
+int io_uring_submit(struct io_uring *ring) {
+    io_uring_submit_func_type real_io_uring_submit = get_real_func<IO_URING_SUBMIT_FUNC_TYPE>();
+    if (__glibc_unlikely(!real_io_uring_submit)) {
+        return -ENOSYS;
+    }
+    if (__glibc_unlikely(!hook_enabled(HOOK_SWITCH_ASYNC) || HookGuard::is_inside())) {
+        return real_io_uring_submit(ring);
+    }
+    HookGuard guard;
+    attach_liburing_ring(ring);
+    IoUringTracker& tracker = IoUringTracker::get_instance();
+    IoUringTracker::SubmitContext ctx = tracker.before_submit(ring->ring_fd,
+        ring->sq.sqe_tail - *ring->sq.khead, &ring->sq.sqe_tail);
+    int ret = real_io_uring_submit(ring);
+    tracker.after_submit(ctx, ret);
+    return ret;
+}
+
+int io_uring_submit_and_wait(struct io_uring *ring, unsigned wait_nr) {
+    io_uring_submit_and_wait_func_type real_io_uring_submit_and_wait = get_real_func<IO_URING_SUBMIT_AND_WAIT_FUNC_TYPE>();
+    if (__glibc_unlikely(!real_io_uring_submit_and_wait)) {
+        return -ENOSYS;
+    }
+    if (__glibc_unlikely(!hook_enabled(HOOK_SWITCH_ASYNC) || HookGuard::is_inside())) {
+        return real_io_uring_submit_and_wait(ring, wait_nr);
+    }
+    HookGuard guard;
+    attach_liburing_ring(ring);
+    IoUringTracker& tracker = IoUringTracker::get_instance();
+    IoUringTracker::SubmitContext ctx = tracker.before_submit(ring->ring_fd,
+        ring->sq.sqe_tail - *ring->sq.khead, &ring->sq.sqe_tail);
+    int ret = real_io_uring_submit_and_wait(ring, wait_nr);
+    tracker.after_submit(ctx, ret);
+    return ret;
+}
+
+int __io_uring_get_cqe(struct io_uring *ring, struct io_uring_cqe **cqe_ptr,
+    unsigned submit, unsigned wait_nr, sigset_t *sigmask) {
+    io_uring_get_cqe_func_type real_io_uring_get_cqe = get_real_func<IO_URING_GET_CQE_FUNC_TYPE>();
+    if (__glibc_unlikely(!real_io_uring_get_cqe)) {
+        return -ENOSYS;
+    }
+    if (__glibc_unlikely(!hook_enabled(HOOK_SWITCH_ASYNC) || HookGuard::is_inside())) {
+        return real_io_uring_get_cqe(ring, cqe_ptr, submit, wait_nr, sigmask);
+    }
+    HookGuard guard;
+    // 返回值不是提交的数量，这里只收割
+    int ret = real_io_uring_get_cqe(ring, cqe_ptr, submit, wait_nr, sigmask);
+    IoUringTracker::get_instance().reap(ring->ring_fd);
+    return ret;
+}
+
+void io_uring_queue_exit(struct io_uring *ring) {
+    io_uring_queue_exit_func_type real_io_uring_queue_exit = get_real_func<IO_URING_QUEUE_EXIT_FUNC_TYPE>();
+    // 队列的内存在 io_uring_queue_exit 中释放，需要先停止跟踪
+    HookGuard guard;
+    IoUringTracker::get_instance().detach(ring->ring_fd);
+    if (__glibc_likely(real_io_uring_queue_exit != nullptr)) {
+        real_io_uring_queue_exit(ring);
+    }
+}
+#endif
+
 int close(int fd) {
-    static close_func_type real_close = (close_func_type)get_real_func_pointer(CLOSE_FUNC_TYPE);
+    close_func_type real_close = get_real_func<CLOSE_FUNC_TYPE>();
     if (__glibc_unlikely(!real_close)) {
         return -1;
     }
+    if (__glibc_unlikely(!hook_enabled(HOOK_SWITCH_OPEN_CLOSE) || HookGuard::is_inside())) {
+        return real_close(fd);
+    }
+    HookGuard guard;
+    // 关闭 io_uring 实例前先解除映射，避免 fd 被复用后对应到新的实例
+    IoUringTracker& tracker = IoUringTracker::get_instance();
+    if (__glibc_unlikely(tracker.has_rings())) {
+        tracker.detach(fd);
+    }
+    uint64_t start_ns = Util::get_time_ns();
     int ret = real_close(fd);
+    uint64_t cost_ns = Util::get_time_ns() - start_ns;
     if (ret == 0) {
         FileIoInfoHandler::get_instance().add_hook_info(
-            FileOperateType::CLOSE_TYPE, fd, "");
+            FileOperateType::CLOSE_TYPE, fd, "", cost_ns);
+    } else {
+        FileIoInfoHandler::get_instance().add_error_hook_info(FileOperateType::CLOSE_TYPE, fd, errno, cost_ns);
+    }
+    return ret;
+}
+
+int dup(int oldfd) __THROW {
+    dup_func_type real_dup = get_real_func<DUP_FUNC_TYPE>();
+    if (__glibc_unlikely(!real_dup)) {
+        return -1;
+    }
+    if (__glibc_unlikely(!hook_enabled(HOOK_SWITCH_OPEN_CLOSE) || HookGuard::is_inside())) {
+        return real_dup(oldfd);
+    }
+    HookGuard guard;
+    int ret = real_dup(oldfd);
+    if (ret >= 0) {
+        FileIoInfoHandler::get_instance().add_dup_hook_info(oldfd, ret);
     }
     return ret;
 }
 
+int dup2(int oldfd, int newfd) __THROW {
+    dup2_func_type real_dup2 = get_real_func<DUP2_FUNC_TYPE>();
+    if (__glibc_unlikely(!real_dup2)) {
+        return -1;
+    }
+    if (__glibc_unlikely(!hook_enabled(HOOK_SWITCH_OPEN_CLOSE) || HookGuard::is_inside())) {
+        return real_dup2(oldfd, newfd);
+    }
+    HookGuard guard;
+    int ret = real_dup2(oldfd, newfd);
+    if (ret >= 0) {
+        FileIoInfoHandler::get_instance().add_dup_hook_info(oldfd, ret);
+    }
+    return ret;
+}
+
+int dup3(int oldfd, int newfd, int flags) __THROW {
+    dup3_func_type real_dup3 = get_real_func<DUP3_FUNC_TYPE>();
+    if (__glibc_unlikely(!real_dup3)) {
+        return -1;
+    }
+    if (__glibc_unlikely(!hook_enabled(HOOK_SWITCH_OPEN_CLOSE) || HookGuard::is_inside())) {
+        return real_dup3(oldfd, newfd, flags);
+    }
+    HookGuard guard;
+    int ret = real_dup3(oldfd, newfd, flags);
+    if (ret >= 0) {
+        FileIoInfoHandler::get_instance().add_dup_hook_info(oldfd, ret);
+    }
+    return ret;
+}
+
+// fcntl 的第三个参数是整数或者指针，与 glibc 的实现一致按指针取出再原样传递
+int fcntl(int fd, int cmd, ...) {
+    fcntl_func_type real_fcntl = get_real_func<FCNTL_FUNC_TYPE>();
+    if (__glibc_unlikely(!real_fcntl)) {
+        return -1;
+    }
+    va_list args;
+    va_start(args, cmd);
+    void* arg = va_arg(args, void*);
+    va_end(args);
+    if (__glibc_unlikely(!hook_enabled(HOOK_SWITCH_OPEN_CLOSE) || HookGuard::is_inside())) {
+        return real_fcntl(fd, cmd, arg);
+    }
+    HookGuard guard;
+    int ret = real_fcntl(fd, cmd, arg);
+    if (ret >= 0 && (cmd == F_DUPFD || cmd == F_DUPFD_CLOEXEC)) {
+        FileIoInfoHandler::get_instance().add_dup_hook_info(fd, ret);
+    }
+    return ret;
+}
+
+int fcntl64(int fd, int cmd, ...) {
+    fcntl64_func_type real_fcntl64 = get_real_func<FCNTL64_FUNC_TYPE>();
+    if (__glibc_unlikely(!real_fcntl64)) {
+        return -1;
+    }
+    va_list args;
+    va_start(args, cmd);
+    void* arg = va_arg(args, void*);
+    va_end(args);
+    if (__glibc_unlikely(!hook_enabled(HOOK_SWITCH_OPEN_CLOSE) || HookGuard::is_inside())) {
+        return real_fcntl64(fd, cmd, arg);
+    }
+    HookGuard guard;
+    int ret = real_fcntl64(fd, cmd, arg);
+    if (ret >= 0 && (cmd == F_DUPFD || cmd == F_DUPFD_CLOEXEC)) {
+        FileIoInfoHandler::get_instance().add_dup_hook_info(fd, ret);
+    }
+    return ret;
+}
+
+#if __GLIBC_PREREQ(2, 34)
+int close_range(unsigned int first, unsigned int last, int flags) __THROW {
+    close_range_func_type real_close_range = get_real_func<CLOSE_RANGE_FUNC_TYPE>();
+    if (__glibc_unlikely(!real_close_range)) {
+        errno = ENOSYS;
+        return -1;
+    }
+    if (__glibc_unlikely(!hook_enabled(HOOK_SWITCH_OPEN_CLOSE) || HookGuard::is_inside())) {
+        return real_close_range(first, last, flags);
+    }
+    HookGuard guard;
+    // 与 close 一致，先解除范围内 io_uring 实例的映射
+    bool is_close = !(static_cast<unsigned int>(flags) & CLOSE_RANGE_CLOEXEC);
+    IoUringTracker& tracker = IoUringTracker::get_instance();
+    if (is_close && __glibc_unlikely(tracker.has_rings())) {
+        tracker.detach_range(first, last);
+    }
+    int ret = real_close_range(first, last, flags);
+    if (ret == 0 && is_close) {
+        FileIoInfoHandler::get_instance().add_close_range_hook_info(first, last);
+    }
+    return ret;
+}
+
+void closefrom(int lowfd) __THROW {
+    closefrom_func_type real_closefrom = get_real_func<CLOSEFROM_FUNC_TYPE>();
+    if (__glibc_unlikely(!real_closefrom)) {
+        return;
+    }
+    if (__glibc_unlikely(!hook_enabled(HOOK_SWITCH_OPEN_CLOSE) || HookGuard::is_inside())) {
+        return real_closefrom(lowfd);
+    }
+    HookGuard guard;
+    unsigned int first = lowfd < 0 ? 0 : static_cast<unsigned int>(lowfd);
+    IoUringTracker& tracker = IoUringTracker::get_instance();
+    if (__glibc_unlikely(tracker.has_rings())) {
+        tracker.detach_range(first, ~0U);
+    }
+    real_closefrom(lowfd);
+    // closefrom 没有返回值，失败时会终止进程
+    FileIoInfoHandler::get_instance().add_close_range_hook_info(first, ~0U);
+}
+#endif
+
 FILE *fopen(const char *__restrict filename, const char *__restrict modes) {
-    static fopen_func_type real_fopen = (fopen_func_type)get_real_func_pointer(FOPEN_FUNC_TYPE);
+    fopen_func_type real_fopen = get_real_func<FOPEN_FUNC_TYPE>();
     if (__glibc_unlikely(!real_fopen)) {
         return NULL;
     }
+    if (__glibc_unlikely(!hook_enabled(HOOK_SWITCH_STDIO) || HookGuard::is_inside())) {
+        return real_fopen(filename, modes);
+    }
+    HookGuard guard;
+    uint64_t start_ns = Util::get_time_ns();
     FILE* stream = real_fopen(filename, modes);
+    uint64_t cost_ns = Util::get_time_ns() - start_ns;
     if (stream != NULL) {
         int fd = fileno(stream);
         if (fd < 0) return stream;
         FileIoInfoHandler::get_instance().add_hook_info(
-            FileOperateType::OPEN_TYPE, fd, filename);
+            FileOperateType::OPEN_TYPE, fd, filename, cost_ns);
     }
     return stream;
 }
 
 FILE *fopen64(const char *__restrict filename, const char *__restrict modes) {
-    static fopen64_func_type real_fopen64 = (fopen64_func_type)get_real_func_pointer(FOPEN64_FUNC_TYPE);
+    fopen64_func_type real_fopen64 = get_real_func<FOPEN64_FUNC_TYPE>();
     if (__glibc_unlikely(!real_fopen64)) {
         return NULL;
     }
+    if (__glibc_unlikely(!hook_enabled(HOOK_SWITCH_STDIO) || HookGuard::is_inside())) {
+        return real_fopen64(filename, modes);
+    }
+    HookGuard guard;
+    uint64_t start_ns = Util::get_time_ns();
     FILE* stream = real_fopen64(filename, modes);
+    uint64_t cost_ns = Util::get_time_ns() - start_ns;
     if (stream != NULL) {
         int fd = fileno(stream);
         if (fd < 0) return stream;
         FileIoInfoHandler::get_instance().add_hook_info(
-            FileOperateType::OPEN_TYPE, fd, filename);
+            FileOperateType::OPEN_TYPE, fd, filename, cost_ns);
     }
     return stream;
 }
 
 FILE *freopen(const char *pathname, const char *mode, FILE *stream) {
-    static freopen_func_type real_freopen = (freopen_func_type)get_real_func_pointer(FREOPEN_FUNC_TYPE);
+    freopen_func_type real_freopen = get_real_func<FREOPEN_FUNC_TYPE>();
     if (__glibc_unlikely(!real_freopen)) {
         return NULL;
     }
+    if (__glibc_unlikely(!hook_enabled(HOOK_SWITCH_STDIO) || HookGuard::is_inside())) {
+        return real_freopen(pathname, mode, stream);
+    }
+    HookGuard guard;
+    uint64_t start_ns = Util::get_time_ns();
     FILE* new_stream = real_freopen(pathname, mode, stream);
+    uint64_t cost_ns = Util::get_time_ns() - start_ns;
     if (new_stream != NULL) {
         int fd = fileno(new_stream);
         if (fd < 0) return new_stream;
         FileIoInfoHandler::get_instance().add_hook_info(
-            FileOperateType::OPEN_TYPE, fd, pathname);
+            FileOperateType::OPEN_TYPE, fd, pathname, cost_ns);
     }
     return new_stream;
 }
 
 size_t fread(void *__restrict ptr, size_t size, size_t n, FILE *__restrict stream) {
-    static fread_func_type real_fread = (fread_func_type)get_real_func_pointer(FREAD_FUNC_TYPE);
+    fread_func_type real_fread = get_real_func<FREAD_FUNC_TYPE>();
     if (__glibc_unlikely(!real_fread)) {
         return 0;
     }
+    if (__glibc_unlikely(!hook_enabled(HOOK_SWITCH_STDIO) || HookGuard::is_inside())) {
+        return real_fread(ptr, size, n, stream);
+    }
+    HookGuard guard;
+    uint64_t start_ns = Util::get_time_ns();
     size_t ret = real_fread(ptr, size, n, stream);
+    uint64_t cost_ns = Util::get_time_ns() - start_ns;
     int fd = fileno(stream);
     if (fd < 0) return ret;
     FileIoInfoHandler::get_instance().add_hook_info(
-        FileOperateType::READ_TYPE, fd, (ret*size));
+        FileOperateType::READ_TYPE, fd, (ret*size), cost_ns);
     return ret;
 }
 
 size_t fwrite(const void *__restrict ptr, size_t size, size_t n, FILE *__restrict stream) {
-    static fwrite_func_type real_fwrite = (fwrite_func_type)get_real_func_pointer(FWRITE_FUNC_TYPE);
+    fwrite_func_type real_fwrite = get_real_func<FWRITE_FUNC_TYPE>();
     if (__glibc_unlikely(!real_fwrite)) {
         return 0;
     }
+    if (__glibc_unlikely(!hook_enabled(HOOK_SWITCH_STDIO) || HookGuard::is_inside())) {
+        return real_fwrite(ptr, size, n, stream);
+    }
+    HookGuard guard;
+    uint64_t start_ns = Util::get_time_ns();
     ssize_t ret = real_fwrite(ptr, size, n, stream);
+    uint64_t cost_ns = Util::get_time_ns() - start_ns;
     int fd = fileno(stream);
     if (fd < 0) return ret;
     FileIoInfoHandler::get_instance().add_hook_info(
-        FileOperateType::WRITE_TYPE, fd, (ret*size));
+        FileOperateType::WRITE_TYPE, fd, (ret*size), cost_ns);
     return ret;
 }
 
+// 流的位置修改之后，把新位置同步到流的 fd 上
+// 新位置取 ftello，是调用方看到的逻辑位置，与 fread/fwrite 推进的位置一致
+static void add_stream_seek_hook_info(FILE *stream) {
+    int fd = fileno(stream);
+    if (fd < 0) return;
+    off_t position = ftello(stream);
+    if (position < 0) return;
+    FileIoInfoHandler::get_instance().add_seek_hook_info(fd, static_cast<uint64_t>(position));
+}
+
+// 只有位置会被记录，不统计次数和耗时
+int fseek(FILE *stream, long offset, int whence) {
+    fseek_func_type real_fseek = get_real_func<FSEEK_FUNC_TYPE>();
+    if (__glibc_unlikely(!real_fseek)) {
+        return -1;
+    }
+    if (__glibc_unlikely(!hook_enabled(HOOK_SWITCH_STDIO) || HookGuard::is_inside())) {
+        return real_fseek(stream, offset, whence);
+    }
+    HookGuard guard;
+    int ret = real_fseek(stream, offset, whence);
+    if (ret == 0) {
+        add_stream_seek_hook_info(stream);
+    }
+    return ret;
+}
+
+int fseeko(FILE *stream, off_t offset, int whence) {
+    fseeko_func_type real_fseeko = get_real_func<FSEEKO_FUNC_TYPE>();
+    if (__glibc_unlikely(!real_fseeko)) {
+        return -1;
+    }
+    if (__glibc_unlikely(!hook_enabled(HOOK_SWITCH_STDIO) || HookGuard::is_inside())) {
+        return real_fseeko(stream, offset, whence);
+    }
+    HookGuard guard;
+    int ret = real_fseeko(stream, offset, whence);
+    if (ret == 0) {
+        add_stream_seek_hook_info(stream);
+    }
+    return ret;
+}
+
+int fseeko64(FILE *stream, __off64_t offset, int whence) {
+    fseeko64_func_type real_fseeko64 = get_real_func<FSEEKO64_FUNC_TYPE>();
+    if (__glibc_unlikely(!real_fseeko64)) {
+        return -1;
+    }
+    if (__glibc_unlikely(!hook_enabled(HOOK_SWITCH_STDIO) || HookGuard::is_inside())) {
+        return real_fseeko64(stream, offset, whence);
+    }
+    HookGuard guard;
+    int ret = real_fseeko64(stream, offset, whence);
+    if (ret == 0) {
+        add_stream_seek_hook_info(stream);
+    }
+    return ret;
+}
+
+void rewind(FILE *stream) {
+    rewind_func_type real_rewind = get_real_func<REWIND_FUNC_TYPE>();
+    if (__glibc_unlikely(!real_rewind)) {
+        return;
+    }
+    if (__glibc_unlikely(!hook_enabled(HOOK_SWITCH_STDIO) || HookGuard::is_inside())) {
+        real_rewind(stream);
+        return;
+    }
+    HookGuard guard;
+    real_rewind(stream);
+    add_stream_seek_hook_info(stream);
+}
+
 int fclose(FILE *stream) {
-    static fclose_func_type real_fclose = (fclose_func_type)get_real_func_pointer(FCLOSE_FUNC_TYPE);
+    fclose_func_type real_fclose = get_real_func<FCLOSE_FUNC_TYPE>();
     if (__glibc_unlikely(!real_fclose)) {
         return -1;
     }
+    if (__glibc_unlikely(!hook_enabled(HOOK_SWITCH_STDIO) || HookGuard::is_inside())) {
+        return real_fclose(stream);
+    }
+    HookGuard guard;
     // 在流关闭前获取文件描述符
     int fd = fileno(stream);
+    uint64_t start_ns = Util::get_time_ns();
     int ret = real_fclose(stream);
+    uint64_t cost_ns = Util::get_time_ns() - start_ns;
     if (ret == 0) {
         if (fd < 0) return ret;
         FileIoInfoHandler::get_instance().add_hook_info(
-            FileOperateType::CLOSE_TYPE, fd, "");
+            FileOperateType::CLOSE_TYPE, fd, "", cost_ns);
     }
     return ret;
 }
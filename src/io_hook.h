@@ -12,10 +12,14 @@
 #pragma once
 
 #include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/sendfile.h>
 #include <stdio.h>
+#include <aio.h>
 
 /*
- * 1. HOOK io 操作的系统调用尽量在其内部不要使用 io 操作，否则可能出现死循环。待一个更好的解决方案
+ * 1. hook 函数入口通过线程局部的标志（见 hook_guard.h）判断是否重入，重入时直接调用真实函数，
+ *    因此 hook 函数内部以及库内部在 HookGuard 作用域中的 IO 不会被统计，也不会出现死循环
  * 2. 为了精简化，目前只计算文件的读写情况，对于打开、关闭的操作暂时不关注，以免太多杂糅，影响本身功能
  */
 
@@ -58,12 +62,102 @@ extern ssize_t pread64(int fd, void *buf, size_t nbytes, __off64_t offset);
 extern ssize_t pwrite(int fd, const void *buf, size_t count, off_t offset);
 extern ssize_t pwrite64(int fd, const void *buf, size_t n, __off64_t offset);
 
+/*
+ * 修改文件位置，之后的 read/write 从新位置开始，用于识别访问模式
+ */
+extern off_t lseek(int fd, off_t offset, int whence) __THROW;
+extern __off64_t lseek64(int fd, __off64_t offset, int whence) __THROW;
+
+/*
+ * 向量读写（分散读、聚集写），一次调用读写多个缓冲区
+ * 存储引擎、日志库常用 writev/pwritev 批量追加，iovcnt 可以反映调用方合并 IO 的程度
+ * 后缀为 2 的版本额外支持 RWF_* 标志，后缀为 64 的意为大文件
+ */
+extern ssize_t readv(int fd, const struct iovec *iov, int iovcnt);
+extern ssize_t writev(int fd, const struct iovec *iov, int iovcnt);
+extern ssize_t preadv(int fd, const struct iovec *iov, int iovcnt, off_t offset);
+extern ssize_t preadv64(int fd, const struct iovec *iov, int iovcnt, __off64_t offset);
+extern ssize_t pwritev(int fd, const struct iovec *iov, int iovcnt, off_t offset);
+extern ssize_t pwritev64(int fd, const struct iovec *iov, int iovcnt, __off64_t offset);
+extern ssize_t preadv2(int fd, const struct iovec *iov, int iovcnt, off_t offset, int flags);
+extern ssize_t preadv64v2(int fd, const struct iovec *iov, int iovcnt, __off64_t offset, int flags);
+extern ssize_t pwritev2(int fd, const struct iovec *iov, int iovcnt, off_t offset, int flags);
+extern ssize_t pwritev64v2(int fd, const struct iovec *iov, int iovcnt, __off64_t offset, int flags);
+
+/*
+ * 零拷贝传输，数据在内核中直接从 in_fd 搬到 out_fd，不经过 read/write
+ * 字节数同时记为源文件的读和目标文件的写，操作类型与普通读写区分开
+ * 1. sendfile：文件到任意 fd（一般是 socket），sendfile64 为大文件版本。glibc 中声明为不抛异常，这里保持一致
+ * 2. splice/tee：至少一端为管道，tee 两端都是管道
+ * 3. copy_file_range：文件到文件，可能在文件系统内部完成（比如 reflink）
+ */
+extern ssize_t sendfile(int out_fd, int in_fd, off_t *offset, size_t count) __THROW;
+extern ssize_t sendfile64(int out_fd, int in_fd, __off64_t *offset, size_t count) __THROW;
+extern ssize_t splice(int fd_in, __off64_t *off_in, int fd_out, __off64_t *off_out, size_t len, unsigned int flags);
+extern ssize_t tee(int fd_in, int fd_out, size_t len, unsigned int flags);
+extern ssize_t copy_file_range(int fd_in, __off64_t *off_in, int fd_out, __off64_t *off_out,
+    size_t len, unsigned int flags);
+
+/*
+ * 刷盘相关的系统调用，是尾延迟的主要来源，按文件记录耗时
+ * 同时记录每次刷盘时距上次刷盘写入的字节数（刷盘批次）
+ * 1. fsync 刷数据和元数据，fdatasync 只刷必要的元数据
+ * 2. sync_file_range 只刷文件的一个区间，不保证元数据
+ * 3. syncfs 刷 fd 所在的整个文件系统，这里只记在该 fd 的文件上
+ */
+extern int fsync(int fd);
+extern int fdatasync(int fd);
+extern int sync_file_range(int fd, __off64_t offset, __off64_t nbytes, unsigned int flags);
+extern int syncfs(int fd) __THROW;
+
+/*
+ * io_uring 的读写不经过上面的函数，只能在提交和收割的边界上观察
+ * 1. glibc 没有封装 io_uring_setup/io_uring_enter，应用（包括 liburing）通过 syscall 调用
+ *    这里只处理这两个系统调用号，其余的原样转发
+ * 2. 编译时存在 liburing 头文件时，额外 hook liburing 的提交和退出函数，
+ *    liburing 新版本在 io_uring_submit 中直接内联系统调用，不经过 syscall
+ */
+extern long syscall(long number, ...) __THROW;
+
+/*
+ * 异步 IO，请求从提交到完成按控制块的地址跟踪，完成时按文件记录字节数、耗时和提交时的队列深度
+ * 1. Linux native AIO（libaio、直接系统调用）：glibc 没有封装，io_submit/io_getevents/io_pgetevents/io_cancel
+ *    都经过上面的 syscall
+ * 2. POSIX AIO：aio_read/aio_write/aio_fsync/lio_listio 提交，aio_return 获取结果时视为完成
+ *    glibc 2.34 之前位于 librt 中，后缀为 64 的意为大文件
+ */
+extern int aio_read(struct aiocb *aiocbp) __THROW __nonnull((1));
+extern int aio_read64(struct aiocb64 *aiocbp) __THROW __nonnull((1));
+extern int aio_write(struct aiocb *aiocbp) __THROW __nonnull((1));
+extern int aio_write64(struct aiocb64 *aiocbp) __THROW __nonnull((1));
+extern int aio_fsync(int operation, struct aiocb *aiocbp) __THROW __nonnull((2));
+extern int aio_fsync64(int operation, struct aiocb64 *aiocbp) __THROW __nonnull((2));
+extern int lio_listio(int mode, struct aiocb *const list[], int nent, struct sigevent *sig) __THROW __nonnull((2));
+extern int lio_listio64(int mode, struct aiocb64 *const list[], int nent, struct sigevent *sig) __THROW __nonnull((2));
+extern ssize_t aio_return(struct aiocb *aiocbp) __THROW __nonnull((1));
+extern ssize_t aio_return64(struct aiocb64 *aiocbp) __THROW __nonnull((1));
+
 /*
  * 当一个进程终止时，内核会自动关闭它所有打开的文件
  * 读写完文件不关闭可能会造成文件描述符泄漏
  */
 extern int close(int fd);
 
+/*
+ * 复制和批量关闭文件描述符，维护 fd 与文件的对应关系
+ * 1. dup/dup2/dup3/fcntl(F_DUPFD/F_DUPFD_CLOEXEC)：新 fd 指向同一个文件，比如把日志 fd 复制到标准输出
+ * 2. close_range/closefrom：批量关闭，glibc 2.34 开始提供；close_range 带 CLOSE_RANGE_CLOEXEC 时只设置标志，不关闭
+ */
+extern int dup(int oldfd) __THROW;
+extern int dup2(int oldfd, int newfd) __THROW;
+extern int dup3(int oldfd, int newfd, int flags) __THROW;
+extern int fcntl(int fd, int cmd, ...);
+extern int fcntl64(int fd, int cmd, ...);
+#if __GLIBC_PREREQ(2, 34)
+extern int close_range(unsigned int first, unsigned int last, int flags) __THROW;
+extern void closefrom(int lowfd) __THROW;
+#endif
+
 /*
  * 如下为带缓冲的 IO，比如：fopen、fread、fwrite、fclose 之类
  * 这些系统调用的实现不一定是 open/read/write/close 之类的，在 GUN C 库中，他的实现可能为 mmap
@@ -93,6 +187,12 @@ extern size_t fread(void *__restrict ptr, size_t size, size_t n, FILE *__restric
 // 向流中写入数据
 extern size_t fwrite(const void *__restrict ptr, size_t size, size_t n, FILE *__restrict stream);
 
+// 修改流的位置，之后的 fread/fwrite 从新位置开始，用于识别访问模式
+extern int fseek(FILE *stream, long offset, int whence);
+extern int fseeko(FILE *stream, off_t offset, int whence);
+extern int fseeko64(FILE *stream, __off64_t offset, int whence);
+extern void rewind(FILE *stream);
+
 // 关闭流
 extern int fclose(FILE *stream);
 
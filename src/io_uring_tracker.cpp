@@ -0,0 +1,423 @@
+#include <errno.h>
+#include <sys/mman.h>
+#include <algorithm>
+#include <thread>
+#include "common/common.h"
+#include "hook_io_handle.h"
+#include "io_uring_tracker.h"
+
+namespace file_io_hook {
+
+// 失败的请求只进入事件追踪；在 io_uring_enter 中调用，不能改变它返回给业务的 errno
+static void add_failed_completion(FileOperateType type, int fd, int32_t res, uint64_t cost_ns) {
+    int saved_errno = errno;
+    FileIoInfoHandler::get_instance().add_error_hook_info(type, fd, -res, cost_ns);
+    errno = saved_errno;
+}
+
+IoUringTracker::~IoUringTracker() {
+    for (size_t i = 0; i < IO_URING_MAX_RING_COUNT; ++i) {
+        delete rings_[i].state.exchange(nullptr);
+    }
+}
+
+IoUringTracker::RingState::~RingState() {
+    for (size_t i = 0; i < sizeof(maps) / sizeof(maps[0]); ++i) {
+        // 单次映射（IORING_FEAT_SINGLE_MMAP）时完成队列与提交队列共用一块内存
+        if (maps[i] != nullptr && (i == 0 || maps[i] != maps[0])) {
+            munmap(maps[i], map_sizes[i]);
+        }
+    }
+}
+
+void IoUringTracker::on_setup(int ring_fd, const struct io_uring_params* params) {
+    if (__glibc_unlikely(params == nullptr)) {
+        return;
+    }
+    // SQPOLL 模式下应用不需要调用 io_uring_enter 提交，观察不到提交
+    if (params->flags & IORING_SETUP_SQPOLL) {
+        return;
+    }
+#ifdef IORING_SETUP_NO_MMAP
+    // 队列内存由应用提供，内核不支持再次映射
+    if (params->flags & IORING_SETUP_NO_MMAP) {
+        return;
+    }
+#endif
+    size_t sqe_size = (params->flags & IORING_SETUP_SQE128) ? 2 * sizeof(struct io_uring_sqe)
+        : sizeof(struct io_uring_sqe);
+    size_t cqe_size = (params->flags & IORING_SETUP_CQE32) ? 2 * sizeof(struct io_uring_cqe)
+        : sizeof(struct io_uring_cqe);
+    size_t sq_size = params->sq_off.array + params->sq_entries * sizeof(uint32_t);
+    size_t cq_size = params->cq_off.cqes + params->cq_entries * cqe_size;
+    bool single_mmap = params->features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap) {
+        sq_size = cq_size = std::max(sq_size, cq_size);
+    }
+
+    // 只读映射，不会改变应用看到的队列状态
+    RingState* ring = new RingState();
+    ring->ring_fd = ring_fd;
+    ring->map_sizes[0] = sq_size;
+    ring->maps[0] = mmap(nullptr, sq_size, PROT_READ, MAP_SHARED, ring_fd, IORING_OFF_SQ_RING);
+    ring->map_sizes[1] = cq_size;
+    ring->maps[1] = single_mmap ? ring->maps[0]
+        : mmap(nullptr, cq_size, PROT_READ, MAP_SHARED, ring_fd, IORING_OFF_CQ_RING);
+    ring->map_sizes[2] = sqe_size * params->sq_entries;
+    ring->maps[2] = mmap(nullptr, ring->map_sizes[2], PROT_READ, MAP_SHARED, ring_fd, IORING_OFF_SQES);
+    for (size_t i = 0; i < sizeof(ring->maps) / sizeof(ring->maps[0]); ++i) {
+        if (ring->maps[i] == MAP_FAILED) {
+            ring->maps[i] = nullptr;
+            delete ring;
+            return;
+        }
+    }
+
+    const char* sq_ptr = static_cast<const char*>(ring->maps[0]);
+    const char* cq_ptr = static_cast<const char*>(ring->maps[1]);
+    IoUringLayout& layout = ring->layout;
+    layout.sq_head = reinterpret_cast<const uint32_t*>(sq_ptr + params->sq_off.head);
+    layout.sq_tail = reinterpret_cast<const uint32_t*>(sq_ptr + params->sq_off.tail);
+    layout.sq_mask = *reinterpret_cast<const uint32_t*>(sq_ptr + params->sq_off.ring_mask);
+    layout.sq_entries = params->sq_entries;
+    layout.sq_array = reinterpret_cast<const uint32_t*>(sq_ptr + params->sq_off.array);
+#ifdef IORING_SETUP_NO_SQARRAY
+    if (params->flags & IORING_SETUP_NO_SQARRAY) {
+        layout.sq_array = nullptr;
+    }
+#endif
+    layout.sqes = static_cast<const char*>(ring->maps[2]);
+    layout.sqe_size = sqe_size;
+    layout.cq_tail = reinterpret_cast<const uint32_t*>(cq_ptr + params->cq_off.tail);
+    layout.cq_mask = *reinterpret_cast<const uint32_t*>(cq_ptr + params->cq_off.ring_mask);
+    layout.cq_entries = params->cq_entries;
+    layout.cqes = cq_ptr + params->cq_off.cqes;
+    layout.cqe_size = cqe_size;
+    ring->cq_seen = __atomic_load_n(layout.cq_tail, __ATOMIC_ACQUIRE);
+    add_ring(ring);
+}
+
+void IoUringTracker::attach(int ring_fd, const IoUringLayout& layout) {
+    RingState* exist = find_ring(ring_fd);
+    if (exist != nullptr) {
+        release_ring(exist);
+        return;
+    }
+    RingState* ring = new RingState();
+    ring->ring_fd = ring_fd;
+    ring->layout = layout;
+    ring->cq_seen = __atomic_load_n(layout.cq_tail, __ATOMIC_ACQUIRE);
+    add_ring(ring);
+}
+
+void IoUringTracker::detach(int ring_fd) {
+    RingState* ring = nullptr;
+    RingSlot* slot = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(rings_mtx_);
+        for (size_t i = 0; i < IO_URING_MAX_RING_COUNT; ++i) {
+            if (rings_[i].ring_fd.load(std::memory_order_acquire) == ring_fd) {
+                slot = &rings_[i];
+                slot->ring_fd.store(-1, std::memory_order_release);
+                ring = slot->state.exchange(nullptr);
+                ring_count_.fetch_sub(1, std::memory_order_relaxed);
+                break;
+            }
+        }
+    }
+    if (ring == nullptr) {
+        return;
+    }
+    // 已经摘除，之后的查找拿不到它；等待摘除前读到指针、还没有增加引用的线程，窗口只有几条指令
+    for (; slot->readers.load(std::memory_order_seq_cst) != 0;) {
+        std::this_thread::yield();
+    }
+    // 其他线程仍然持有引用时（比如阻塞在 io_uring_enter 中），由最后一个释放的线程销毁
+    release_ring(ring);
+}
+
+void IoUringTracker::detach_range(unsigned int first_fd, unsigned int last_fd) {
+    for (size_t i = 0; i < IO_URING_MAX_RING_COUNT; ++i) {
+        int ring_fd = rings_[i].ring_fd.load(std::memory_order_acquire);
+        if (ring_fd >= 0 && static_cast<unsigned int>(ring_fd) >= first_fd
+            && static_cast<unsigned int>(ring_fd) <= last_fd) {
+            detach(ring_fd);
+        }
+    }
+}
+
+IoUringTracker::SubmitContext IoUringTracker::before_submit(int ring_fd, uint32_t to_submit,
+    const uint32_t* local_tail) {
+    SubmitContext ctx = {nullptr, 0, 0};
+    RingState* ring = find_ring(ring_fd);
+    if (ring == nullptr) {
+        return ctx;
+    }
+    reap_ring(ring);
+    const IoUringLayout& layout = ring->layout;
+    uint32_t head = __atomic_load_n(layout.sq_head, __ATOMIC_ACQUIRE);
+    uint32_t tail = local_tail ? *local_tail : __atomic_load_n(layout.sq_tail, __ATOMIC_ACQUIRE);
+    uint32_t ready = tail - head;
+    if (ready > layout.sq_entries) {
+        release_ring(ring);
+        return ctx;
+    }
+    uint32_t count = std::min(ready, to_submit);
+    uint64_t now_ns = Util::get_time_ns();
+    for (uint32_t i = 0; i < count; ++i) {
+        const struct io_uring_sqe* sqe = sqe_at(ring, head + i);
+        if (sqe != nullptr) {
+            decode(ring, sqe, now_ns);
+        }
+    }
+    ctx.ring = ring;
+    ctx.head = head;
+    ctx.decoded = count;
+    return ctx;
+}
+
+void IoUringTracker::after_submit(const SubmitContext& ctx, long submitted) {
+    RingState* ring = static_cast<RingState*>(ctx.ring);
+    if (ring == nullptr) {
+        return;
+    }
+    // 失败或者只提交了一部分，没有提交的 SQE 下次还会再解码
+    uint32_t done = submitted < 0 ? 0 : static_cast<uint32_t>(submitted);
+    for (uint32_t i = done; i < ctx.decoded; ++i) {
+        const struct io_uring_sqe* sqe = sqe_at(ring, ctx.head + i);
+        if (sqe != nullptr) {
+            ring->pending.erase(sqe->user_data);
+        }
+    }
+    reap_ring(ring);
+    release_ring(ring);
+}
+
+void IoUringTracker::reap(int ring_fd) {
+    RingState* ring = find_ring(ring_fd);
+    if (ring != nullptr) {
+        reap_ring(ring);
+        release_ring(ring);
+    }
+}
+
+void IoUringTracker::lock_prefork() {
+    rings_mtx_.lock();
+    for (size_t i = 0; i < IO_URING_MAX_RING_COUNT; ++i) {
+        RingState* ring = rings_[i].state.load(std::memory_order_acquire);
+        if (ring != nullptr) {
+            ring->mtx.lock();
+            ring->pending.lock_prefork();
+        }
+    }
+    // 所有实例的待完成表共用一个节点分配器，在所有桶的锁之后获取
+    decltype(RingState::pending)::lock_allocator_prefork();
+}
+
+void IoUringTracker::lock_postfork_parent() {
+    decltype(RingState::pending)::lock_allocator_postfork_parent();
+    for (size_t i = 0; i < IO_URING_MAX_RING_COUNT; ++i) {
+        RingState* ring = rings_[i].state.load(std::memory_order_acquire);
+        if (ring != nullptr) {
+            ring->pending.lock_postfork_parent();
+            ring->mtx.unlock();
+        }
+    }
+    rings_mtx_.unlock();
+}
+
+void IoUringTracker::lock_postfork_child() {
+    // 子进程继承了实例的 fd 和映射，继续跟踪
+    // 其他线程在子进程中不存在，它们的登记清零；它们持有的引用不会再释放，实例关闭后不销毁，只泄漏状态
+    decltype(RingState::pending)::lock_allocator_postfork_child();
+    for (size_t i = 0; i < IO_URING_MAX_RING_COUNT; ++i) {
+        rings_[i].readers.store(0, std::memory_order_relaxed);
+        RingState* ring = rings_[i].state.load(std::memory_order_acquire);
+        if (ring != nullptr) {
+            ring->pending.lock_postfork_child();
+            ring->mtx.unlock();
+        }
+    }
+    rings_mtx_.unlock();
+}
+
+IoUringTracker::RingState* IoUringTracker::find_ring(int ring_fd) {
+    if (!has_rings()) {
+        return nullptr;
+    }
+    for (size_t i = 0; i < IO_URING_MAX_RING_COUNT; ++i) {
+        RingSlot& slot = rings_[i];
+        if (slot.ring_fd.load(std::memory_order_acquire) != ring_fd) {
+            continue;
+        }
+        // 与 detach 中的 exchange 和等待配合：先登记再读取，detach 要么等到这里结束，要么这里读不到被摘除的实例
+        slot.readers.fetch_add(1, std::memory_order_seq_cst);
+        RingState* ring = slot.state.load(std::memory_order_seq_cst);
+        if (ring != nullptr && ring->ring_fd == ring_fd) {
+            ring->refs.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            ring = nullptr;
+        }
+        slot.readers.fetch_sub(1, std::memory_order_release);
+        return ring;
+    }
+    return nullptr;
+}
+
+void IoUringTracker::release_ring(RingState* ring) {
+    if (ring->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        delete ring;
+    }
+}
+
+void IoUringTracker::add_ring(RingState* ring) {
+    {
+        std::lock_guard<std::mutex> lock(rings_mtx_);
+        for (size_t i = 0; i < IO_URING_MAX_RING_COUNT; ++i) {
+            if (rings_[i].state.load(std::memory_order_relaxed) == nullptr) {
+                rings_[i].state.store(ring, std::memory_order_release);
+                rings_[i].ring_fd.store(ring->ring_fd, std::memory_order_release);
+                ring_count_.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+        }
+    }
+    // 实例数超过上限，不再跟踪
+    delete ring;
+}
+
+const struct io_uring_sqe* IoUringTracker::sqe_at(const RingState* ring, uint32_t pos) const {
+    const IoUringLayout& layout = ring->layout;
+    uint32_t index = pos & layout.sq_mask;
+    if (layout.sq_array != nullptr) {
+        index = __atomic_load_n(&layout.sq_array[index], __ATOMIC_RELAXED);
+    }
+    if (__glibc_unlikely(index >= layout.sq_entries)) {
+        return nullptr;
+    }
+    return reinterpret_cast<const struct io_uring_sqe*>(layout.sqes + index * layout.sqe_size);
+}
+
+void IoUringTracker::decode(RingState* ring, const struct io_uring_sqe* sqe, uint64_t now_ns) {
+    // 注册文件只有下标，无法对应到 fd
+    if (sqe->flags & IOSQE_FIXED_FILE) {
+        return;
+    }
+    PendingSqe pending;
+    pending.opcode = sqe->opcode;
+    pending.fd = sqe->fd;
+    pending.start_ns = now_ns;
+    switch (sqe->opcode) {
+    case IORING_OP_READV:
+    case IORING_OP_WRITEV:
+        pending.iov_count = static_cast<int>(sqe->len);
+        break;
+    case IORING_OP_READ:
+    case IORING_OP_WRITE:
+    case IORING_OP_READ_FIXED:
+    case IORING_OP_WRITE_FIXED:
+    case IORING_OP_FSYNC:
+        break;
+    case IORING_OP_CLOSE:
+        // 关闭直接描述符
+        if (sqe->file_index != 0) {
+            return;
+        }
+        break;
+    case IORING_OP_OPENAT:
+    case IORING_OP_OPENAT2: {
+        // 打开到直接描述符，fd 不会出现在进程的文件表中
+        if (sqe->file_index != 0) {
+            return;
+        }
+        const char* path = reinterpret_cast<const char*>(static_cast<uintptr_t>(sqe->addr));
+        if (path == nullptr) {
+            return;
+        }
+        pending.path = path;
+        break;
+    }
+    default:
+        return;
+    }
+    ring->pending.insert(sqe->user_data, pending);
+}
+
+void IoUringTracker::reap_ring(RingState* ring) {
+    std::lock_guard<std::mutex> lock(ring->mtx);
+    const IoUringLayout& layout = ring->layout;
+    uint32_t tail = __atomic_load_n(layout.cq_tail, __ATOMIC_ACQUIRE);
+    // 超过队列长度的部分已经被内核覆盖
+    if (tail - ring->cq_seen > layout.cq_entries) {
+        uint32_t lost = tail - ring->cq_seen - layout.cq_entries;
+        lost_cqe_num_.fetch_add(lost, std::memory_order_relaxed);
+        ring->cq_seen += lost;
+    }
+    if (ring->cq_seen == tail) {
+        return;
+    }
+    uint64_t now_ns = Util::get_time_ns();
+    for (; ring->cq_seen != tail; ++ring->cq_seen) {
+        const struct io_uring_cqe* cqe = reinterpret_cast<const struct io_uring_cqe*>(
+            layout.cqes + (ring->cq_seen & layout.cq_mask) * layout.cqe_size);
+        complete(ring, cqe->user_data, cqe->res, now_ns);
+    }
+}
+
+void IoUringTracker::complete(RingState* ring, uint64_t user_data, int32_t res, uint64_t now_ns) {
+    PendingSqe pending;
+    if (!ring->pending.find(user_data, pending)) {
+        return;
+    }
+    ring->pending.erase(user_data);
+    uint64_t cost_ns = now_ns - pending.start_ns;
+    FileIoInfoHandler& handler = FileIoInfoHandler::get_instance();
+    switch (pending.opcode) {
+    case IORING_OP_READ:
+    case IORING_OP_READV:
+    case IORING_OP_READ_FIXED:
+        if (res >= 0) {
+            handler.add_hook_info(FileOperateType::READ_TYPE, pending.fd, static_cast<size_t>(res),
+                pending.iov_count, cost_ns);
+        } else {
+            add_failed_completion(FileOperateType::READ_TYPE, pending.fd, res, cost_ns);
+        }
+        break;
+    case IORING_OP_WRITE:
+    case IORING_OP_WRITEV:
+    case IORING_OP_WRITE_FIXED:
+        if (res >= 0) {
+            handler.add_hook_info(FileOperateType::WRITE_TYPE, pending.fd, static_cast<size_t>(res),
+                pending.iov_count, cost_ns);
+        } else {
+            add_failed_completion(FileOperateType::WRITE_TYPE, pending.fd, res, cost_ns);
+        }
+        break;
+    case IORING_OP_FSYNC:
+        if (res == 0) {
+            handler.add_hook_info(FileOperateType::SYNC_TYPE, pending.fd, static_cast<size_t>(0), cost_ns);
+        } else if (res < 0) {
+            add_failed_completion(FileOperateType::SYNC_TYPE, pending.fd, res, cost_ns);
+        }
+        break;
+    case IORING_OP_OPENAT:
+    case IORING_OP_OPENAT2:
+        if (res >= 0) {
+            handler.add_hook_info(FileOperateType::OPEN_TYPE, res, pending.path.c_str(), cost_ns);
+        } else {
+            add_failed_completion(FileOperateType::OPEN_TYPE, -1, res, cost_ns);
+        }
+        break;
+    case IORING_OP_CLOSE:
+        if (res == 0) {
+            handler.add_hook_info(FileOperateType::CLOSE_TYPE, pending.fd, "", cost_ns);
+        } else if (res < 0) {
+            add_failed_completion(FileOperateType::CLOSE_TYPE, pending.fd, res, cost_ns);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+}  // namespace file_io_hook
@@ -0,0 +1,267 @@
+/**
+ * @file io_uring_tracker.h
+ * @author noahyzhang
+ * @brief 用于收集 io_uring 的 IO 信息
+ * @version 0.1
+ * @date 2023-04-18
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#pragma once
+
+#include <linux/io_uring.h>
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include "common/concurrent_hash_map.h"
+
+namespace file_io_hook {
+
+// 能同时跟踪的 io_uring 实例的数量，超过后新的实例不再跟踪
+#define IO_URING_MAX_RING_COUNT (64)
+// 每个实例中已提交、未完成的请求表的初始桶数量
+#define IO_URING_PENDING_BUCKET_SIZE (127)
+
+/**
+ * @brief io_uring 环形队列的内存布局，指针都指向与内核共享的内存
+ *
+ */
+struct IoUringLayout {
+    // 提交队列
+    const uint32_t* sq_head;
+    const uint32_t* sq_tail;
+    uint32_t sq_mask;
+    uint32_t sq_entries;
+    // 为空时表示没有索引数组，提交队列的位置直接对应 sqes 中的下标
+    const uint32_t* sq_array;
+    const char* sqes;
+    size_t sqe_size;
+    // 完成队列
+    const uint32_t* cq_tail;
+    uint32_t cq_mask;
+    uint32_t cq_entries;
+    const char* cqes;
+    size_t cqe_size;
+};
+
+/**
+ * @brief 跟踪 io_uring 的提交和完成
+ *  io_uring 的读写不经过 read/write 等函数，只能在 io_uring_enter 的边界上观察：
+ *  1. 提交前：解码提交队列中即将提交的 SQE，记录 (user_data -> fd, 操作类型, 提交时间)
+ *  2. 每次进出 io_uring_enter 时：扫描完成队列中新出现的 CQE，按 user_data 找到对应的请求
+ *     把字节数和耗时按文件记录到 FileIoInfoHandler 中，与同步 IO 的统计合并在一起
+ *
+ *  通过系统调用创建的实例，在 io_uring_setup 成功后以只读方式重新映射一份提交队列和完成队列
+ *  通过 liburing 创建的实例，直接使用 liburing 已经映射好的地址
+ *
+ *  限制：
+ *  1. 只解码 READ/WRITE/READV/WRITEV/READ_FIXED/WRITE_FIXED/FSYNC/OPENAT/OPENAT2/CLOSE
+ *     使用注册文件（IOSQE_FIXED_FILE、直接描述符）的请求无法对应到文件，忽略
+ *  2. SQPOLL 模式下内核线程直接消费提交队列，观察不到提交，不跟踪
+ *  3. 完成时间为观察到 CQE 的时间，耗时是上界；应用在两次 io_uring_enter 之间消费并且
+ *     内核又覆盖了的 CQE 会丢失，计入 lost_cqe_num
+ *  4. 多个未完成的请求使用相同的 user_data 时，只有最后一个能被匹配
+ *
+ *  实例的状态带有引用计数：跟踪表持有一个引用，查找时再增加一个，用完后释放，最后一个引用释放时才销毁
+ *  close 与另一个线程中的 io_uring_enter 并发时，正在使用的状态不会被释放
+ */
+class IoUringTracker {
+public:
+    /**
+     * @brief 一次提交的上下文，在提交前后之间传递
+     *
+     */
+    struct SubmitContext {
+        // 持有实例的一个引用，由 after_submit 释放
+        void* ring;
+        uint32_t head;
+        uint32_t decoded;
+    };
+
+public:
+    ~IoUringTracker();
+    IoUringTracker(const IoUringTracker&) = delete;
+    IoUringTracker& operator=(const IoUringTracker&) = delete;
+    IoUringTracker(IoUringTracker&&) = delete;
+    IoUringTracker& operator=(IoUringTracker&&) = delete;
+
+    static IoUringTracker& get_instance() {
+        static IoUringTracker instance;
+        return instance;
+    }
+
+public:
+    /**
+     * @brief io_uring_setup 成功后调用，映射实例的提交队列和完成队列
+     *
+     * @param ring_fd
+     * @param params 内核填充过的参数
+     */
+    void on_setup(int ring_fd, const struct io_uring_params* params);
+
+    /**
+     * @brief 跟踪一个已经映射好的实例（liburing），已经在跟踪时忽略
+     *
+     * @param ring_fd
+     * @param layout
+     */
+    void attach(int ring_fd, const IoUringLayout& layout);
+
+    /**
+     * @brief 停止跟踪一个实例，在实例的 fd 关闭时调用
+     *
+     * @param ring_fd
+     */
+    void detach(int ring_fd);
+
+    /**
+     * @brief 停止跟踪 [first_fd, last_fd] 范围内的实例，在 close_range/closefrom 时调用
+     *
+     * @param first_fd
+     * @param last_fd 包含
+     */
+    void detach_range(unsigned int first_fd, unsigned int last_fd);
+
+    /**
+     * @brief 提交前调用，先收割已经完成的请求，再解码即将提交的 SQE
+     *
+     * @param ring_fd
+     * @param to_submit 应用要提交的数量
+     * @param local_tail 应用本地还没有同步到内核的队尾（liburing），为空时使用共享内存中的队尾
+     * @return SubmitContext
+     */
+    SubmitContext before_submit(int ring_fd, uint32_t to_submit, const uint32_t* local_tail);
+
+    /**
+     * @brief 提交后调用，撤销没有提交成功的请求，再收割已经完成的请求
+     *
+     * @param ctx
+     * @param submitted io_uring_enter 的返回值
+     */
+    void after_submit(const SubmitContext& ctx, long submitted);
+
+    /**
+     * @brief 收割实例中新完成的请求
+     *
+     * @param ring_fd
+     */
+    void reap(int ring_fd);
+
+    /**
+     * @brief 是否有正在跟踪的实例，没有时 close 等路径可以跳过查找
+     *
+     * @return true
+     * @return false
+     */
+    bool has_rings() const {
+        return ring_count_.load(std::memory_order_relaxed) > 0;
+    }
+
+    /**
+     * @brief 没来得及观察就被覆盖的 CQE 数量
+     *
+     * @return uint64_t
+     */
+    uint64_t lost_cqe_num() const {
+        return lost_cqe_num_.load(std::memory_order_relaxed);
+    }
+
+public:
+    /**
+     * @brief fork 前在父进程上下文执行
+     *
+     */
+    void lock_prefork();
+
+    /**
+     * @brief fork 返回前，在父进程上下文执行
+     *
+     */
+    void lock_postfork_parent();
+
+    /**
+     * @brief fork 返回前，在子进程上下文执行
+     *
+     */
+    void lock_postfork_child();
+
+private:
+    IoUringTracker() = default;
+
+    /**
+     * @brief 已提交、未完成的请求
+     *
+     */
+    struct PendingSqe {
+        uint8_t opcode = 0;
+        int fd = -1;
+        // READV/WRITEV 的 iovec 数量
+        int iov_count = 0;
+        uint64_t start_ns = 0;
+        // OPENAT 的文件名，提交之后应用就可以释放文件名的内存，因此需要复制一份
+        std::string path;
+    };
+
+    /**
+     * @brief 一个被跟踪的实例
+     *
+     */
+    struct RingState {
+        RingState() : pending(IO_URING_PENDING_BUCKET_SIZE) {}
+        ~RingState();
+
+        int ring_fd = -1;
+        // 跟踪表持有一个引用，find_ring 返回的每个指针各持有一个引用
+        std::atomic<uint32_t> refs{1};
+        IoUringLayout layout;
+        // 已经观察过的完成队列位置
+        uint32_t cq_seen = 0;
+        // 保护 cq_seen，保证同一个 CQE 只被处理一次
+        std::mutex mtx;
+        // user_data -> 请求
+        ConcurrentHashMap<uint64_t, PendingSqe> pending;
+        // on_setup 中自己映射的内存，attach 的实例为空
+        void* maps[3] = {nullptr, nullptr, nullptr};
+        size_t map_sizes[3] = {0, 0, 0};
+    };
+
+    struct RingSlot {
+        std::atomic<int> ring_fd{-1};
+        std::atomic<RingState*> state{nullptr};
+        // 正在从 state 读取指针并增加引用的线程数，摘除实例后等它归零，之后不会再有新的引用
+        std::atomic<uint32_t> readers{0};
+    };
+
+    /**
+     * @brief 查找实例并增加一个引用，用完后需要调用 release_ring
+     *
+     * @param ring_fd
+     * @return RingState* 没有跟踪时返回 nullptr
+     */
+    RingState* find_ring(int ring_fd);
+
+    /**
+     * @brief 释放一个引用，最后一个引用释放时销毁
+     *
+     * @param ring
+     */
+    static void release_ring(RingState* ring);
+
+    void add_ring(RingState* ring);
+    const struct io_uring_sqe* sqe_at(const RingState* ring, uint32_t pos) const;
+    void decode(RingState* ring, const struct io_uring_sqe* sqe, uint64_t now_ns);
+    void reap_ring(RingState* ring);
+    void complete(RingState* ring, uint64_t user_data, int32_t res, uint64_t now_ns);
+
+private:
+    RingSlot rings_[IO_URING_MAX_RING_COUNT];
+    std::atomic<int> ring_count_{0};
+    // 保护实例的增加和删除
+    std::mutex rings_mtx_;
+    std::atomic<uint64_t> lost_cqe_num_{0};
+};
+
+}  // namespace file_io_hook
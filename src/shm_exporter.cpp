@@ -0,0 +1,164 @@
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include "common/common.h"
+#include "hook_guard.h"
+#include "shm_exporter.h"
+
+namespace file_io_hook {
+
+// 当前线程的环形队列，initial-exec 模型，访问不经过 __tls_get_addr
+static __thread ShmRingHeader* t_shm_ring __attribute__((tls_model("initial-exec"))) = nullptr;
+// 没有空闲队列时，距离下一次重新认领还需要经过的记录数，避免每次记录都遍历所有队列
+static __thread uint32_t t_shm_retry_countdown __attribute__((tls_model("initial-exec"))) = 0;
+
+// 认领队列失败后，每隔多少条记录重试一次
+#define SHM_ACQUIRE_RETRY_INTERVAL (1024)
+
+bool ShmExporter::start(const char* prefix, uint32_t ring_capacity) {
+    if (prefix == nullptr || *prefix == '\0' || strlen(prefix) > SHM_PREFIX_MAX_LEN || strchr(prefix, '/')) {
+        return false;
+    }
+    if (is_enabled() || prefix_[0] != '\0') {
+        return false;
+    }
+    uint32_t capacity = 64;
+    for (; capacity < ring_capacity && capacity < (1U << 20); capacity <<= 1) {}
+    strcpy(prefix_, prefix);
+    ring_capacity_ = capacity;
+    key_valid_ = (pthread_key_create(&key_, &ShmExporter::on_thread_exit) == 0);
+    ShmHeader* header = create_segment();
+    if (header == nullptr) {
+        return false;
+    }
+    header_.store(header, std::memory_order_release);
+    return true;
+}
+
+ShmHeader* ShmExporter::create_segment() {
+    // shm_open 内部调用 open，close 也会进入 hook 函数，都不应该被统计
+    HookGuard guard;
+    char name[SHM_PREFIX_MAX_LEN + 32];
+    snprintf(name, sizeof(name), "/%s.%d", prefix_, static_cast<int>(getpid()));
+    // pid 被复用时可能残留同名的段，收集器可能还映射着它，不能复用
+    shm_unlink(name);
+    int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) {
+        return nullptr;
+    }
+    uint64_t total_size = shm_init_header(nullptr, SHM_DEFAULT_RING_COUNT, ring_capacity_, 0);
+    void* addr = MAP_FAILED;
+    if (ftruncate(fd, static_cast<off_t>(total_size)) == 0) {
+        addr = mmap(nullptr, total_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (addr == MAP_FAILED) {
+        shm_unlink(name);
+        return nullptr;
+    }
+    // ftruncate 扩展出的内容都是 0，原子变量、队列的状态和文件名的长度都已经是初始值
+    ShmHeader* header = static_cast<ShmHeader*>(addr);
+    shm_init_header(header, SHM_DEFAULT_RING_COUNT, ring_capacity_, static_cast<int32_t>(getpid()));
+    for (uint32_t i = 0; i < header->ring_count; ++i) {
+        SpscRing<ShmIoRecord>::init(&shm_ring_header(header, i)->control);
+    }
+    return header;
+}
+
+void ShmExporter::push(ShmIoRecord& record) {
+    ShmHeader* header = header_.load(std::memory_order_acquire);
+    if (__glibc_unlikely(header == nullptr)) {
+        return;
+    }
+    ShmRingHeader* ring = t_shm_ring;
+    if (__glibc_unlikely(ring == nullptr)) {
+        if (t_shm_retry_countdown > 0) {
+            --t_shm_retry_countdown;
+            header->no_ring_drop_num.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        ring = acquire_ring(header);
+        if (ring == nullptr) {
+            t_shm_retry_countdown = SHM_ACQUIRE_RETRY_INTERVAL;
+            header->no_ring_drop_num.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+    }
+    record.time_ns = Util::get_time_ns();
+    if (__glibc_unlikely(!shm_ring(header, ring).push(record))) {
+        // 只有当前线程写这个计数，不需要原子的读改写
+        ring->drop_num.store(ring->drop_num.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+}
+
+ShmRingHeader* ShmExporter::acquire_ring(ShmHeader* header) {
+    for (uint32_t i = 0; i < header->ring_count; ++i) {
+        ShmRingHeader* ring = shm_ring_header(header, i);
+        uint32_t state = ring->state.load(std::memory_order_acquire);
+        // 已退出线程的队列读空之后也可以直接认领，这样没有收集器时队列也不会被耗尽
+        if (state == SHM_RING_ACTIVE || (state == SHM_RING_RETIRED && shm_ring(header, ring).size() != 0)) {
+            continue;
+        }
+        if (!ring->state.compare_exchange_strong(state, SHM_RING_ACTIVE, std::memory_order_acq_rel)) {
+            continue;
+        }
+        ring->tid.store(static_cast<int32_t>(Util::get_tid()), std::memory_order_relaxed);
+        t_shm_ring = ring;
+        if (key_valid_) {
+            pthread_setspecific(key_, ring);
+        }
+        return ring;
+    }
+    return nullptr;
+}
+
+void ShmExporter::on_thread_exit(void* arg) {
+    ShmRingHeader* ring = static_cast<ShmRingHeader*>(arg);
+    // 线程退出的后续流程中仍然可能有 IO，此时会重新认领一个队列
+    if (t_shm_ring == ring) {
+        t_shm_ring = nullptr;
+    }
+    ring->state.store(SHM_RING_RETIRED, std::memory_order_release);
+}
+
+void ShmExporter::publish_name(uint32_t file_id, const char* file_name) {
+    ShmHeader* header = header_.load(std::memory_order_acquire);
+    if (header == nullptr) {
+        return;
+    }
+    if (file_id >= header->name_slot_count) {
+        header->name_overflow_num.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    ShmNameSlot* slot = shm_name_slot(header, file_id);
+    if (slot->length.load(std::memory_order_acquire) != 0) {
+        return;
+    }
+    // 多个线程同时打开同一个新文件时写入的内容相同
+    size_t length = std::min(strlen(file_name), sizeof(slot->name) - 1);
+    memcpy(slot->name, file_name, length);
+    slot->name[length] = '\0';
+    slot->length.store(static_cast<uint32_t>(length), std::memory_order_release);
+}
+
+bool ShmExporter::lock_postfork_child() {
+    ShmHeader* header = header_.load(std::memory_order_relaxed);
+    if (header == nullptr) {
+        return false;
+    }
+    header_.store(nullptr, std::memory_order_relaxed);
+    t_shm_ring = nullptr;
+    t_shm_retry_countdown = 0;
+    if (key_valid_) {
+        pthread_setspecific(key_, nullptr);
+    }
+    munmap(header, header->total_size);
+    header = create_segment();
+    header_.store(header, std::memory_order_release);
+    return header != nullptr;
+}
+
+}  // namespace file_io_hook
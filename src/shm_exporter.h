@@ -0,0 +1,124 @@
+/**
+ * @file shm_exporter.h
+ * @author noahyzhang
+ * @brief 通过共享内存把 IO 记录导出给进程外的收集器
+ * @version 0.1
+ * @date 2023-04-18
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#pragma once
+
+#include <pthread.h>
+#include <stdint.h>
+#include <atomic>
+#include "shm_layout.h"
+
+namespace file_io_hook {
+
+// 段名前缀的最大长度
+#define SHM_PREFIX_MAX_LEN (64)
+
+/**
+ * @brief 共享内存导出
+ *  打开后，每个线程在段中认领一个属于自己的环形队列，之后的每次记录都按固定大小写入自己的队列，
+ *  与业务线程之间、业务线程与收集器之间都没有共享的锁，收集器在另一个进程中读取所有队列
+ *  1. 段名为 /<prefix>.<pid>，位于 /dev/shm 下，布局见 shm_layout.h
+ *  2. 队列已满时丢弃记录并计数，不会阻塞业务线程；没有空闲队列的线程同样丢弃并计数
+ *  3. 文件名在 open 时写入段中的文件名表，收集器按文件 id 查找
+ *  4. fork 出的子进程在自己的段中导出，段名中是子进程的 pid
+ *  自身的 IO（创建段）在 HookGuard 的作用域内执行，不会被统计
+ */
+class ShmExporter {
+public:
+    ShmExporter() = default;
+    ~ShmExporter() = default;
+    ShmExporter(const ShmExporter&) = delete;
+    ShmExporter& operator=(const ShmExporter&) = delete;
+    ShmExporter(ShmExporter&&) = delete;
+    ShmExporter& operator=(ShmExporter&&) = delete;
+
+public:
+    /**
+     * @brief 创建段，开始导出，只能调用一次
+     *
+     * @param prefix 段名的前缀，不能包含 '/'
+     * @param ring_capacity 每个环形队列的记录数，向上取整为 2 的幂
+     * @return true
+     * @return false 参数不合法、已经开始导出或者创建段失败
+     */
+    bool start(const char* prefix, uint32_t ring_capacity);
+
+    /**
+     * @brief 是否正在导出
+     *
+     * @return true
+     * @return false
+     */
+    bool is_enabled() const {
+        return header_.load(std::memory_order_relaxed) != nullptr;
+    }
+
+    /**
+     * @brief 把一条记录写入当前线程的环形队列
+     *
+     * @param record time_ns 在这里填充
+     */
+    void push(ShmIoRecord& record);
+
+    /**
+     * @brief 把文件名写入文件名表，文件 id 不会被复用，已经写入的不再写
+     *
+     * @param file_id
+     * @param file_name
+     */
+    void publish_name(uint32_t file_id, const char* file_name);
+
+public:
+    /**
+     * @brief fork 返回前，在子进程上下文执行
+     *  父进程的段中，调用 fork 的线程的队列仍然属于父进程的线程，子进程不能再写入，
+     *  解除映射并清除当前线程（子进程中唯一的线程）缓存的队列，再按子进程的 pid 重新创建段，
+     *  新段的文件名表为空，需要调用方重新写入
+     *
+     * @return true 子进程继续导出
+     * @return false
+     */
+    bool lock_postfork_child();
+
+private:
+    /**
+     * @brief 创建并映射当前进程的段
+     *
+     * @return ShmHeader* 失败时为空
+     */
+    ShmHeader* create_segment();
+
+    /**
+     * @brief 为当前线程认领一个环形队列
+     *
+     * @param header
+     * @return ShmRingHeader* 没有空闲的队列时为空
+     */
+    ShmRingHeader* acquire_ring(ShmHeader* header);
+
+    /**
+     * @brief 线程退出时被调用，把队列标记为已退出，等待收集器读完其中剩余的记录
+     *
+     * @param arg 线程的队列
+     */
+    static void on_thread_exit(void* arg);
+
+private:
+    // 当前映射的段，为空时不导出
+    std::atomic<ShmHeader*> header_{nullptr};
+    char prefix_[SHM_PREFIX_MAX_LEN + 1] = {0};
+    uint32_t ring_capacity_ = SHM_DEFAULT_RING_CAPACITY;
+    // 用于感知线程退出
+    pthread_key_t key_;
+    bool key_valid_ = false;
+};
+
+}  // namespace file_io_hook
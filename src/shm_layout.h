@@ -0,0 +1,209 @@
+/**
+ * @file shm_layout.h
+ * @author noahyzhang
+ * @brief 共享内存导出的内存布局，被 hook 库和进程外的收集器（tools/fio_collector）共同使用
+ * @version 0.1
+ * @date 2023-04-18
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include "common/spsc_ring.h"
+
+namespace file_io_hook {
+
+// 段的魔数，"FIOH"
+#define SHM_EXPORT_MAGIC (0x484f4946U)
+
+// 布局的版本，任何结构体的字段、大小或者排列发生变化时都需要加一，收集器拒绝不认识的版本
+#define SHM_EXPORT_VERSION (2U)
+
+// 默认的环形队列数量，即可以同时导出的线程数量
+#define SHM_DEFAULT_RING_COUNT (64)
+
+// 默认每个环形队列的记录数量，必须是 2 的幂
+#define SHM_DEFAULT_RING_CAPACITY (4096)
+
+// 文件名表的槽位数量，文件 id 超出的文件名不导出
+#define SHM_NAME_SLOT_COUNT (4096)
+
+// 文件名表每个槽位的大小，包括长度字段，更长的文件名被截断
+#define SHM_NAME_SLOT_SIZE (256)
+
+/**
+ * @brief 导出的一条 IO 记录
+ *  字段与 FileIoInfoHandler 数据池中的一次记录一一对应，tid 由所在的环形队列隐含
+ */
+struct ShmIoRecord {
+    // 记录时的单调时钟（CLOCK_MONOTONIC），单位为纳秒
+    uint64_t time_ns;
+    // 真实函数调用的耗时；type 为 SYNC_BATCH_KEY_TYPE 时为 0
+    uint64_t cost_ns;
+    // 字节数；type 为 SYNC_BATCH_KEY_TYPE 时为本次刷盘的批次大小
+    uint64_t bytes;
+    // 采样的权重，未采样时为 1，全局采样与文件采样叠加时可以超过 32 位
+    uint64_t weight;
+    // 文件 id，文件名在文件名表中
+    uint32_t file_id;
+    // 异步请求提交时的队列深度，同步操作为 0
+    uint32_t depth;
+    // 向量读写的 iovec 数量，其他操作为 0
+    uint16_t iov_count;
+    // FileOperateType 或者 SYNC_BATCH_KEY_TYPE
+    uint8_t type;
+    uint8_t reserved[5];
+};
+static_assert(sizeof(ShmIoRecord) == 48, "ShmIoRecord layout changed, bump SHM_EXPORT_VERSION");
+
+/**
+ * @brief 环形队列的状态
+ *  1. SHM_RING_FREE -> SHM_RING_ACTIVE：线程第一次导出时认领
+ *  2. SHM_RING_ACTIVE -> SHM_RING_RETIRED：线程退出
+ *  3. SHM_RING_RETIRED -> SHM_RING_FREE：收集器读完已退出线程的记录后释放；
+ *     没有收集器时，新线程也可以直接认领已经读空的 SHM_RING_RETIRED 队列
+ */
+enum ShmRingState : uint32_t {
+    SHM_RING_FREE = 0,
+    SHM_RING_ACTIVE,
+    SHM_RING_RETIRED
+};
+
+/**
+ * @brief 环形队列的头部，之后紧跟 ring_capacity 条 ShmIoRecord
+ *  队列被新线程复用时位置不清零，收集器不需要感知复用
+ */
+struct ShmRingHeader {
+    SpscRing<ShmIoRecord>::Control control;
+    alignas(64) std::atomic<uint32_t> state;
+    // 持有此队列的线程 tid
+    std::atomic<int32_t> tid;
+    // 队列已满被丢弃的记录数，只被生产者写
+    std::atomic<uint64_t> drop_num;
+};
+static_assert(sizeof(ShmRingHeader) == 192, "ShmRingHeader layout changed, bump SHM_EXPORT_VERSION");
+
+/**
+ * @brief 文件名表的槽位，以文件 id 为下标
+ *  写入方先写名字再以 release 发布长度，长度不为 0 时名字可读
+ */
+struct ShmNameSlot {
+    std::atomic<uint32_t> length;
+    char name[SHM_NAME_SLOT_SIZE - sizeof(uint32_t)];
+};
+static_assert(sizeof(ShmNameSlot) == SHM_NAME_SLOT_SIZE, "ShmNameSlot layout changed, bump SHM_EXPORT_VERSION");
+
+/**
+ * @brief 段的头部，位于段的起始位置
+ *  段的布局：ShmHeader | ring_count 个 (ShmRingHeader + 记录数组) | name_slot_count 个 ShmNameSlot
+ *  除了原子变量之外的字段在创建后不再修改，收集器先检查 magic、version 和各结构体的大小
+ */
+struct ShmHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t ring_header_size;
+    uint32_t record_size;
+    uint32_t name_slot_size;
+    uint32_t ring_count;
+    uint32_t ring_capacity;
+    uint32_t name_slot_count;
+    // 被监控进程的 pid
+    int32_t pid;
+    uint64_t ring_offset;
+    // 相邻两个环形队列头部之间的距离
+    uint64_t ring_stride;
+    uint64_t name_offset;
+    uint64_t total_size;
+    // 没有空闲的环形队列而丢弃的记录数
+    alignas(64) std::atomic<uint64_t> no_ring_drop_num;
+    // 文件 id 超出文件名表而没有导出的文件名数量
+    std::atomic<uint64_t> name_overflow_num;
+};
+
+/**
+ * @brief 段中各部分的位置，由 ShmHeader 中的字段计算
+ *
+ */
+inline ShmRingHeader* shm_ring_header(ShmHeader* header, uint32_t index) {
+    return reinterpret_cast<ShmRingHeader*>(reinterpret_cast<char*>(header) + header->ring_offset
+        + header->ring_stride * index);
+}
+
+inline ShmIoRecord* shm_ring_records(ShmRingHeader* ring) {
+    return reinterpret_cast<ShmIoRecord*>(ring + 1);
+}
+
+inline SpscRing<ShmIoRecord> shm_ring(ShmHeader* header, ShmRingHeader* ring) {
+    return SpscRing<ShmIoRecord>(&ring->control, shm_ring_records(ring), header->ring_capacity);
+}
+
+inline ShmNameSlot* shm_name_slot(ShmHeader* header, uint32_t file_id) {
+    return reinterpret_cast<ShmNameSlot*>(reinterpret_cast<char*>(header) + header->name_offset) + file_id;
+}
+
+/**
+ * @brief 初始化段的头部（不包括各个环形队列和文件名表），返回段的总大小
+ *
+ * @param header 为空时只计算大小
+ * @param ring_count
+ * @param ring_capacity 2 的幂
+ * @param pid
+ * @return uint64_t
+ */
+inline uint64_t shm_init_header(ShmHeader* header, uint32_t ring_count, uint32_t ring_capacity, int32_t pid) {
+    uint64_t ring_offset = (sizeof(ShmHeader) + 63) & ~63ULL;
+    uint64_t ring_stride = (sizeof(ShmRingHeader) + sizeof(ShmIoRecord) * ring_capacity + 63) & ~63ULL;
+    uint64_t name_offset = ring_offset + ring_stride * ring_count;
+    uint64_t total_size = name_offset + sizeof(ShmNameSlot) * SHM_NAME_SLOT_COUNT;
+    if (header != nullptr) {
+        header->magic = SHM_EXPORT_MAGIC;
+        header->version = SHM_EXPORT_VERSION;
+        header->header_size = sizeof(ShmHeader);
+        header->ring_header_size = sizeof(ShmRingHeader);
+        header->record_size = sizeof(ShmIoRecord);
+        header->name_slot_size = sizeof(ShmNameSlot);
+        header->ring_count = ring_count;
+        header->ring_capacity = ring_capacity;
+        header->name_slot_count = SHM_NAME_SLOT_COUNT;
+        header->pid = pid;
+        header->ring_offset = ring_offset;
+        header->ring_stride = ring_stride;
+        header->name_offset = name_offset;
+        header->total_size = total_size;
+    }
+    return total_size;
+}
+
+/**
+ * @brief 收集器检查段的头部是否与自己的布局一致
+ *
+ * @param header
+ * @param size 映射的大小
+ * @return true
+ * @return false
+ */
+inline bool shm_check_header(const ShmHeader* header, uint64_t size) {
+    if (size < sizeof(ShmHeader) || header->magic != SHM_EXPORT_MAGIC || header->version != SHM_EXPORT_VERSION) {
+        return false;
+    }
+    if (header->header_size != sizeof(ShmHeader) || header->ring_header_size != sizeof(ShmRingHeader)
+        || header->record_size != sizeof(ShmIoRecord) || header->name_slot_size != sizeof(ShmNameSlot)) {
+        return false;
+    }
+    if (header->ring_capacity == 0 || (header->ring_capacity & (header->ring_capacity - 1)) != 0) {
+        return false;
+    }
+    ShmHeader expected;
+    uint64_t total_size = shm_init_header(&expected, header->ring_count, header->ring_capacity, header->pid);
+    return total_size <= size && header->total_size == total_size && header->ring_offset == expected.ring_offset
+        && header->ring_stride == expected.ring_stride && header->name_offset == expected.name_offset
+        && header->name_slot_count == expected.name_slot_count;
+}
+
+}  // namespace file_io_hook
@@ -0,0 +1,201 @@
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "snapshot_sink.h"
+
+namespace file_io_hook {
+
+// 与 AccessPattern 一一对应
+static const char* const snapshot_pattern_names[ACCESS_PATTERN_COUNT] = {
+    "sequential", "reverse", "strided", "random"};
+
+// 发送快照的超时时间
+#define SNAPSHOT_SOCKET_TIMEOUT_MS (100)
+
+static void append_json_string(std::string& text, const std::string& str) {
+    text.push_back('"');
+    for (unsigned char c : str) {
+        if (c == '"' || c == '\\') {
+            text.push_back('\\');
+            text.push_back(static_cast<char>(c));
+        } else if (c < 0x20) {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\u%04x", c);
+            text.append(buf);
+        } else {
+            text.push_back(static_cast<char>(c));
+        }
+    }
+    text.push_back('"');
+}
+
+// 写完整个缓冲区，被信号打断时重试
+static bool write_all(int fd, const char* data, size_t size) {
+    for (; size > 0;) {
+        ssize_t res = ::write(fd, data, size);
+        if (res < 0 && errno == EINTR) {
+            continue;
+        }
+        if (res <= 0) {
+            return false;
+        }
+        data += res;
+        size -= static_cast<size_t>(res);
+    }
+    return true;
+}
+
+void SnapshotSink::format(const std::vector<FileInfo>& infos, std::string& text) {
+    text.clear();
+    struct timeval now;
+    gettimeofday(&now, nullptr);
+    uint64_t time_ms = static_cast<uint64_t>(now.tv_sec) * 1000 + now.tv_usec / 1000;
+    char buf[512];
+    for (const auto& info : infos) {
+        snprintf(buf, sizeof(buf), "{\"time_ms\":%lu,\"pid\":%d,\"tid\":%lu,\"file\":",
+            time_ms, static_cast<int>(getpid()), info.tid);
+        text.append(buf);
+        append_json_string(text, info.file_name);
+        snprintf(buf, sizeof(buf), ",\"read_b\":%lu,\"write_b\":%lu,\"zero_copy_read_b\":%lu,"
+            "\"zero_copy_write_b\":%lu,\"readv_call_num\":%lu,\"readv_iov_num\":%lu,\"writev_call_num\":%lu,"
+            "\"writev_iov_num\":%lu,\"async_call_num\":%lu,\"async_max_depth\":%lu,\"async_avg_depth\":%.2f,"
+            "\"estimated\":%s",
+            info.read_b, info.write_b, info.zero_copy_read_b, info.zero_copy_write_b, info.readv_call_num,
+            info.readv_iov_num, info.writev_call_num, info.writev_iov_num, info.async_call_num,
+            info.async_max_depth, info.async_avg_depth, info.estimated ? "true" : "false");
+        text.append(buf);
+        if (info.sync_batch.sync_num != 0) {
+            snprintf(buf, sizeof(buf), ",\"sync_batch\":{\"sync_num\":%lu,\"synced_b\":%lu,\"p50_b\":%lu,"
+                "\"p99_b\":%lu,\"max_b\":%lu}", info.sync_batch.sync_num, info.sync_batch.synced_b,
+                info.sync_batch.p50_b, info.sync_batch.p99_b, info.sync_batch.max_b);
+            text.append(buf);
+        }
+        const AccessPatternStat* patterns[2] = {&info.read_pattern, &info.write_pattern};
+        for (int i = 0; i < 2; ++i) {
+            const AccessPatternStat& pattern = *patterns[i];
+            if (pattern.dominant == ACCESS_PATTERN_COUNT) {
+                continue;
+            }
+            snprintf(buf, sizeof(buf), ",\"%s_pattern\":{\"dominant\":\"%s\"", i == 0 ? "read" : "write",
+                snapshot_pattern_names[pattern.dominant]);
+            text.append(buf);
+            for (int p = 0; p < ACCESS_PATTERN_COUNT; ++p) {
+                snprintf(buf, sizeof(buf), ",\"%s\":{\"access_num\":%lu,\"run_num\":%lu,\"max_run_len\":%lu}",
+                    snapshot_pattern_names[p], pattern.access_num[p], pattern.run_num[p], pattern.max_run_len[p]);
+                text.append(buf);
+            }
+            text.push_back('}');
+        }
+        text.append(",\"latency\":{");
+        bool first = true;
+        for (int op = 0; op < FILE_OPERATE_TYPE_COUNT; ++op) {
+            const FileOperateLatency& latency = info.latency[op];
+            if (latency.call_num == 0) {
+                continue;
+            }
+            snprintf(buf, sizeof(buf), "%s\"%s\":{\"call_num\":%lu,\"p50_ns\":%lu,\"p99_ns\":%lu,\"p999_ns\":%lu,"
+                "\"max_ns\":%lu}", first ? "" : ",", FILE_OPERATE_TYPE_NAMES[op], latency.call_num, latency.p50_ns,
+                latency.p99_ns, latency.p999_ns, latency.max_ns);
+            text.append(buf);
+            first = false;
+        }
+        text.append("}}\n");
+    }
+}
+
+FileSink::~FileSink() {
+    if (fd_ >= 0) {
+        close(fd_);
+    }
+}
+
+bool FileSink::open_file(const char* path) {
+    fd_ = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    return fd_ >= 0;
+}
+
+void FileSink::write(const std::vector<FileInfo>&, const std::string& text) {
+    if (fd_ >= 0 && !text.empty()) {
+        write_all(fd_, text.data(), text.size());
+    }
+}
+
+void ShmSink::write(const std::vector<FileInfo>&, const std::string& text) {
+    char path[256];
+    char tmp_path[272];
+    snprintf(path, sizeof(path), "/dev/shm/%s.%d", name_.c_str(), static_cast<int>(getpid()));
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return;
+    }
+    bool ok = write_all(fd, text.data(), text.size());
+    close(fd);
+    if (!ok || rename(tmp_path, path) != 0) {
+        unlink(tmp_path);
+    }
+}
+
+UnixSocketSink::~UnixSocketSink() {
+    close_socket();
+}
+
+bool UnixSocketSink::connect_socket() {
+    struct sockaddr_un addr;
+    if (path_.size() >= sizeof(addr.sun_path)) {
+        return false;
+    }
+    fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd_ < 0) {
+        return false;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, path_.c_str(), path_.size());
+    struct timeval timeout = {0, SNAPSHOT_SOCKET_TIMEOUT_MS * 1000};
+    setsockopt(fd_, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    if (connect(fd_, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) != 0) {
+        close_socket();
+        return false;
+    }
+    return true;
+}
+
+void UnixSocketSink::close_socket() {
+    if (fd_ >= 0) {
+        close(fd_);
+        fd_ = -1;
+    }
+}
+
+void UnixSocketSink::write(const std::vector<FileInfo>&, const std::string& text) {
+    if (text.empty() || (fd_ < 0 && !connect_socket())) {
+        return;
+    }
+    const char* data = text.data();
+    size_t size = text.size();
+    for (; size > 0;) {
+        ssize_t res = send(fd_, data, size, MSG_NOSIGNAL);
+        if (res < 0 && errno == EINTR) {
+            continue;
+        }
+        if (res <= 0) {
+            // 超时或者对端关闭，已经发送的部分可能截断了一行，关闭连接让接收方感知
+            close_socket();
+            return;
+        }
+        data += res;
+        size -= static_cast<size_t>(res);
+    }
+}
+
+void UnixSocketSink::reset_after_fork() {
+    close_socket();
+}
+
+}  // namespace file_io_hook
@@ -0,0 +1,146 @@
+/**
+ * @file snapshot_sink.h
+ * @author noahyzhang
+ * @brief 收集线程输出快照的方式
+ * @version 0.1
+ * @date 2023-04-18
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include "hook_io_handle.h"
+
+namespace file_io_hook {
+
+/**
+ * @brief 快照的输出方式
+ *  只在收集线程中被调用，收集线程全程处于 HookGuard 的作用域内，其中的 IO 不会被统计
+ */
+class SnapshotSink {
+public:
+    virtual ~SnapshotSink() = default;
+
+    /**
+     * @brief 输出一次快照
+     *
+     * @param infos 本周期的文件 IO 信息
+     * @param text infos 格式化后的 JSON Lines 文本，need_text 为 false 时为空
+     */
+    virtual void write(const std::vector<FileInfo>& infos, const std::string& text) = 0;
+
+    /**
+     * @brief 是否需要格式化后的文本
+     *
+     * @return true
+     * @return false
+     */
+    virtual bool need_text() const {
+        return true;
+    }
+
+    /**
+     * @brief fork 返回前，在子进程上下文执行，不能与父进程共用的资源在这里释放
+     *
+     */
+    virtual void reset_after_fork() {}
+
+    /**
+     * @brief 把快照格式化为 JSON Lines，每个 (线程, 文件) 一行
+     *
+     * @param infos
+     * @param text
+     */
+    static void format(const std::vector<FileInfo>& infos, std::string& text);
+};
+
+/**
+ * @brief 调用业务注册的回调
+ *
+ */
+class CallbackSink : public SnapshotSink {
+public:
+    explicit CallbackSink(const SnapshotCallback& callback) : callback_(callback) {}
+
+    void write(const std::vector<FileInfo>& infos, const std::string&) override {
+        callback_(infos);
+    }
+
+    bool need_text() const override {
+        return false;
+    }
+
+private:
+    SnapshotCallback callback_;
+};
+
+/**
+ * @brief 追加写入文件，多个进程（比如 fork 出的子进程）可以写同一个文件，每行带有 pid
+ *
+ */
+class FileSink : public SnapshotSink {
+public:
+    ~FileSink() override;
+
+    /**
+     * @brief 打开文件
+     *
+     * @param path
+     * @return true
+     * @return false
+     */
+    bool open_file(const char* path);
+
+    void write(const std::vector<FileInfo>& infos, const std::string& text) override;
+
+private:
+    int fd_ = -1;
+};
+
+/**
+ * @brief 在 /dev/shm/<name>.<pid> 中保存最近一次的快照
+ *  先写临时文件再 rename，读者（比如 cat）总是看到一次完整的快照
+ *
+ */
+class ShmSink : public SnapshotSink {
+public:
+    explicit ShmSink(const char* name) : name_(name) {}
+
+    void write(const std::vector<FileInfo>& infos, const std::string& text) override;
+
+private:
+    std::string name_;
+};
+
+/**
+ * @brief 发送到 Unix 域套接字（SOCK_STREAM），接收方需要先监听
+ *  连接失败或者发送失败时关闭连接，下一次快照时重新连接，不会阻塞收集线程太久
+ *
+ */
+class UnixSocketSink : public SnapshotSink {
+public:
+    explicit UnixSocketSink(const char* path) : path_(path) {}
+    ~UnixSocketSink() override;
+
+    void write(const std::vector<FileInfo>& infos, const std::string& text) override;
+
+    /**
+     * @brief 子进程不能与父进程共用同一个连接，否则两边的数据会交错
+     *
+     */
+    void reset_after_fork() override;
+
+private:
+    bool connect_socket();
+    void close_socket();
+
+private:
+    std::string path_;
+    int fd_ = -1;
+};
+
+}  // namespace file_io_hook
@@ -0,0 +1,132 @@
+/**
+ * @file trace_format.h
+ * @author noahyzhang
+ * @brief 事件追踪文件的格式，被 hook 库和离线分析工具（tools/fio_analyze）共同使用
+ * @version 0.1
+ * @date 2023-04-18
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace file_io_hook {
+
+/**
+ * 文件由一个文件头和若干个固定大小的块组成，都按块大小对齐：
+ * 1. 文件头（TraceFileHeader）占用第一个块
+ * 2. 每个块只包含一个线程的事件，块头（TraceBlockHeader）之后是编码后的事件，剩余部分填 0
+ *    各线程的块按写满（或者超时）的先后顺序追加，同一个块内的事件按时间有序，块之间需要按时间重新排序
+ *
+ * 每个事件的编码：
+ *   1 字节       低 4 位为操作类型（FileOperateType），其余位为 TRACE_FLAG_*
+ *   varint       距离上一个事件（块内第一个事件为块头中的 base_time_ns）的时间，纳秒
+ *   varint       zigzag(文件 id - 上一个事件的文件 id)，块内初始为 0
+ *   varint       字节数
+ *   varint       耗时，纳秒
+ *   [varint]     TRACE_FLAG_OFFSET：zigzag(偏移 - 预期偏移)，预期偏移为上一个带偏移的事件的偏移加字节数，块内初始为 0
+ *   [varint]     TRACE_FLAG_ERRNO：errno
+ *   [varint+字节] TRACE_FLAG_NAME：文件名的长度和内容，只出现在 open 事件和 TRACE_OP_NAME 记录中
+ * 操作类型为 TRACE_OP_NAME 的记录只携带文件名，不对应任何调用，解码时只更新文件名
+ * fork 出的子进程在自己的文件中为继承来的文件 id 写入这种记录，继承来的 fd 上的事件也能找到文件名
+ * 顺序读写时时间差、文件 id 差和偏移差都很小，大部分事件只需要 5 ~ 8 个字节
+ */
+
+// 文件头的魔数
+#define TRACE_FILE_MAGIC (0x45434152544f4946ULL)  // "FIOTRACE"
+
+// 块头的魔数，"FIOB"
+#define TRACE_BLOCK_MAGIC (0x424f4946U)
+
+// 格式的版本，编码或者结构体发生变化时加一
+#define TRACE_FORMAT_VERSION (2U)
+
+// 块的大小，也是写入的对齐单位
+#define TRACE_BLOCK_SIZE (64 * 1024)
+
+// 单个事件（不包括文件名）编码后的最大长度
+#define TRACE_EVENT_MAX_SIZE (1 + 10 * 6)
+
+// 事件中的标志位
+#define TRACE_OP_MASK (0x0f)
+#define TRACE_FLAG_OFFSET (0x10)
+#define TRACE_FLAG_ERRNO (0x20)
+#define TRACE_FLAG_NAME (0x40)
+
+// 只携带文件名的记录的操作类型，不与 FileOperateType 重叠
+#define TRACE_OP_NAME (0x0f)
+
+/**
+ * @brief 文件头，位于文件的第一个块
+ *
+ */
+struct TraceFileHeader {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t block_size;
+    int32_t pid;
+    uint32_t reserved;
+    // 开始追踪时的单调时钟和墙上时钟，用于把事件的时间换算为墙上时间
+    uint64_t start_monotonic_ns;
+    uint64_t start_realtime_ns;
+};
+
+/**
+ * @brief 块头
+ *
+ */
+struct TraceBlockHeader {
+    uint32_t magic;
+    // 块头之后编码后的事件占用的字节数
+    uint32_t used_bytes;
+    int32_t tid;
+    uint32_t event_count;
+    // 块内第一个事件的时间差以此为基准，单调时钟
+    uint64_t base_time_ns;
+    uint64_t reserved;
+};
+static_assert(sizeof(TraceBlockHeader) == 32, "TraceBlockHeader layout changed, bump TRACE_FORMAT_VERSION");
+
+/**
+ * @brief 写入 varint（LEB128），返回写入之后的位置
+ *
+ */
+inline uint8_t* trace_put_varint(uint8_t* pos, uint64_t value) {
+    for (; value >= 0x80; value >>= 7) {
+        *pos++ = static_cast<uint8_t>(value | 0x80);
+    }
+    *pos++ = static_cast<uint8_t>(value);
+    return pos;
+}
+
+/**
+ * @brief 读取 varint，返回读取之后的位置，数据不完整时返回空
+ *
+ */
+inline const uint8_t* trace_get_varint(const uint8_t* pos, const uint8_t* end, uint64_t* value) {
+    uint64_t result = 0;
+    for (int shift = 0; pos < end && shift < 64; shift += 7) {
+        uint8_t byte = *pos++;
+        result |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            *value = result;
+            return pos;
+        }
+    }
+    return nullptr;
+}
+
+// 有符号数映射为无符号数，绝对值小的数编码后也短
+inline uint64_t trace_zigzag_encode(int64_t value) {
+    return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+inline int64_t trace_zigzag_decode(uint64_t value) {
+    return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+}  // namespace file_io_hook
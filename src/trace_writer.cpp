@@ -0,0 +1,278 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "common/common.h"
+#include "hook_guard.h"
+#include "trace_writer.h"
+
+namespace file_io_hook {
+
+// 当前线程的块，initial-exec 模型，访问不经过 __tls_get_addr
+static __thread void* t_trace_buffer __attribute__((tls_model("initial-exec"))) = nullptr;
+
+static_assert(TRACE_BLOCK_SIZE % 4096 == 0, "trace block must be page aligned");
+static_assert(sizeof(TraceFileHeader) <= TRACE_BLOCK_SIZE, "trace file header must fit in one block");
+
+// 在 offset 处写入完整的一个块，被信号打断时重试
+static bool write_block(int fd, const uint8_t* data, uint64_t offset) {
+    size_t done = 0;
+    for (; done < TRACE_BLOCK_SIZE;) {
+        ssize_t res = pwrite(fd, data + done, TRACE_BLOCK_SIZE - done, static_cast<off_t>(offset + done));
+        if (res < 0 && errno == EINTR) {
+            continue;
+        }
+        if (res <= 0) {
+            return false;
+        }
+        done += static_cast<size_t>(res);
+    }
+    return true;
+}
+
+bool TraceWriter::start(const char* prefix) {
+    if (prefix == nullptr || *prefix == '\0' || strlen(prefix) > TRACE_PREFIX_MAX_LEN) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (prefix_[0] != '\0') {
+        return false;
+    }
+    strcpy(prefix_, prefix);
+    key_valid_ = (pthread_key_create(&key_, &TraceWriter::on_thread_exit) == 0);
+    return open_file();
+}
+
+bool TraceWriter::open_file() {
+    // 追踪文件自身的 IO 不应该被统计
+    HookGuard guard;
+    char path[TRACE_PREFIX_MAX_LEN + 32];
+    snprintf(path, sizeof(path), "%s.%d.trace", prefix_, static_cast<int>(getpid()));
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    void* block = nullptr;
+    if (posix_memalign(&block, 4096, TRACE_BLOCK_SIZE) != 0) {
+        close(fd);
+        return false;
+    }
+    memset(block, 0, TRACE_BLOCK_SIZE);
+    TraceFileHeader* header = static_cast<TraceFileHeader*>(block);
+    header->magic = TRACE_FILE_MAGIC;
+    header->version = TRACE_FORMAT_VERSION;
+    header->block_size = TRACE_BLOCK_SIZE;
+    header->pid = static_cast<int32_t>(getpid());
+    header->start_monotonic_ns = Util::get_time_ns();
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    header->start_realtime_ns = static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+    bool ok = write_block(fd, static_cast<uint8_t*>(block), 0);
+    free(block);
+    if (!ok) {
+        close(fd);
+        return false;
+    }
+    next_offset_.store(TRACE_BLOCK_SIZE, std::memory_order_relaxed);
+    fd_.store(fd, std::memory_order_release);
+    return true;
+}
+
+TraceWriter::TraceBuffer* TraceWriter::acquire_buffer() {
+    void* data = nullptr;
+    if (posix_memalign(&data, 4096, TRACE_BLOCK_SIZE) != 0) {
+        return nullptr;
+    }
+    TraceBuffer* buffer = new TraceBuffer();
+    buffer->owner = this;
+    buffer->data = static_cast<uint8_t*>(data);
+    buffer->tid = static_cast<int32_t>(Util::get_tid());
+    reset_buffer(buffer, Util::get_time_ns());
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        buffer->next = buffers_;
+        if (buffers_ != nullptr) {
+            buffers_->prev = buffer;
+        }
+        buffers_ = buffer;
+    }
+    t_trace_buffer = buffer;
+    if (key_valid_) {
+        pthread_setspecific(key_, buffer);
+    }
+    return buffer;
+}
+
+void TraceWriter::reset_buffer(TraceBuffer* buffer, uint64_t now_ns) {
+    buffer->pos = buffer->data + sizeof(TraceBlockHeader);
+    buffer->event_count = 0;
+    buffer->base_time_ns = now_ns;
+    buffer->last_time_ns = now_ns;
+    buffer->last_file_id = 0;
+    buffer->expected_offset = 0;
+}
+
+void TraceWriter::lock_buffer(TraceBuffer* buffer) {
+    // 只有进程退出时的 flush_all 会与所属线程竞争，竞争时间很短
+    for (; buffer->busy.exchange(true, std::memory_order_acquire);) {
+        sched_yield();
+    }
+}
+
+void TraceWriter::unlock_buffer(TraceBuffer* buffer) {
+    buffer->busy.store(false, std::memory_order_release);
+}
+
+void TraceWriter::flush_buffer(TraceBuffer* buffer, uint64_t now_ns) {
+    int fd = fd_.load(std::memory_order_acquire);
+    if (buffer->event_count != 0 && fd >= 0) {
+        TraceBlockHeader* header = reinterpret_cast<TraceBlockHeader*>(buffer->data);
+        header->magic = TRACE_BLOCK_MAGIC;
+        header->used_bytes = static_cast<uint32_t>(buffer->pos - buffer->data - sizeof(TraceBlockHeader));
+        header->tid = buffer->tid;
+        header->event_count = buffer->event_count;
+        header->base_time_ns = buffer->base_time_ns;
+        header->reserved = 0;
+        // 填 0 保证文件内容确定，分析工具也不会读到上一个块残留的事件
+        memset(buffer->pos, 0, buffer->data + TRACE_BLOCK_SIZE - buffer->pos);
+        uint64_t offset = next_offset_.fetch_add(TRACE_BLOCK_SIZE, std::memory_order_relaxed);
+        HookGuard guard;
+        if (!write_block(fd, buffer->data, offset)) {
+            drop_block_num_.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    reset_buffer(buffer, now_ns);
+}
+
+void TraceWriter::append(uint8_t op, uint32_t file_id, uint64_t size, uint64_t cost_ns, int64_t offset, int err,
+    const char* file_name) {
+    TraceBuffer* buffer = static_cast<TraceBuffer*>(t_trace_buffer);
+    if (__glibc_unlikely(buffer == nullptr)) {
+        buffer = acquire_buffer();
+        if (buffer == nullptr) {
+            return;
+        }
+    }
+    size_t name_len = 0;
+    if (file_name != nullptr) {
+        name_len = strnlen(file_name, TRACE_NAME_MAX_LEN);
+    }
+    uint64_t now_ns = Util::get_time_ns();
+    lock_buffer(buffer);
+    size_t need_size = TRACE_EVENT_MAX_SIZE + (file_name != nullptr ? 10 + name_len : 0);
+    if (__glibc_unlikely(static_cast<size_t>(buffer->data + TRACE_BLOCK_SIZE - buffer->pos) < need_size
+        || now_ns - buffer->base_time_ns > TRACE_FLUSH_INTERVAL_NS)) {
+        flush_buffer(buffer, now_ns);
+    }
+    uint8_t flags = op & TRACE_OP_MASK;
+    if (offset >= 0) {
+        flags |= TRACE_FLAG_OFFSET;
+    }
+    if (err != 0) {
+        flags |= TRACE_FLAG_ERRNO;
+    }
+    if (file_name != nullptr) {
+        flags |= TRACE_FLAG_NAME;
+    }
+    uint8_t* pos = buffer->pos;
+    *pos++ = flags;
+    pos = trace_put_varint(pos, now_ns - buffer->last_time_ns);
+    pos = trace_put_varint(pos, trace_zigzag_encode(
+        static_cast<int64_t>(file_id) - static_cast<int64_t>(buffer->last_file_id)));
+    pos = trace_put_varint(pos, size);
+    pos = trace_put_varint(pos, cost_ns);
+    if (offset >= 0) {
+        pos = trace_put_varint(pos, trace_zigzag_encode(offset - static_cast<int64_t>(buffer->expected_offset)));
+        buffer->expected_offset = static_cast<uint64_t>(offset) + size;
+    }
+    if (err != 0) {
+        pos = trace_put_varint(pos, static_cast<uint64_t>(err));
+    }
+    if (file_name != nullptr) {
+        pos = trace_put_varint(pos, name_len);
+        memcpy(pos, file_name, name_len);
+        pos += name_len;
+    }
+    buffer->pos = pos;
+    buffer->last_time_ns = now_ns;
+    buffer->last_file_id = file_id;
+    ++buffer->event_count;
+    unlock_buffer(buffer);
+}
+
+void TraceWriter::flush_all() {
+    if (!is_enabled()) {
+        return;
+    }
+    uint64_t now_ns = Util::get_time_ns();
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (TraceBuffer* buffer = buffers_; buffer != nullptr; buffer = buffer->next) {
+        lock_buffer(buffer);
+        flush_buffer(buffer, now_ns);
+        unlock_buffer(buffer);
+    }
+}
+
+void TraceWriter::on_thread_exit(void* arg) {
+    TraceBuffer* buffer = static_cast<TraceBuffer*>(arg);
+    TraceWriter* writer = buffer->owner;
+    // 线程退出的后续流程中仍然可能有 IO，此时会重新分配一个块
+    if (t_trace_buffer == buffer) {
+        t_trace_buffer = nullptr;
+    }
+    {
+        std::lock_guard<std::mutex> lock(writer->mutex_);
+        if (buffer->prev != nullptr) {
+            buffer->prev->next = buffer->next;
+        } else {
+            writer->buffers_ = buffer->next;
+        }
+        if (buffer->next != nullptr) {
+            buffer->next->prev = buffer->prev;
+        }
+    }
+    // 已经从链表中摘除，flush_all 不会再访问它
+    writer->flush_buffer(buffer, 0);
+    free(buffer->data);
+    delete buffer;
+}
+
+void TraceWriter::lock_postfork_child() {
+    int fd = fd_.load(std::memory_order_relaxed);
+    if (fd < 0) {
+        mutex_.unlock();
+        return;
+    }
+    fd_.store(-1, std::memory_order_relaxed);
+    {
+        HookGuard guard;
+        close(fd);
+    }
+    // 其他线程在子进程中不存在，它们的块直接释放；当前线程的块中是父进程的事件，丢弃
+    uint64_t now_ns = Util::get_time_ns();
+    TraceBuffer* current = static_cast<TraceBuffer*>(t_trace_buffer);
+    for (TraceBuffer* buffer = buffers_; buffer != nullptr;) {
+        TraceBuffer* next = buffer->next;
+        if (buffer != current) {
+            free(buffer->data);
+            delete buffer;
+        }
+        buffer = next;
+    }
+    buffers_ = current;
+    if (current != nullptr) {
+        current->prev = nullptr;
+        current->next = nullptr;
+        current->busy.store(false, std::memory_order_relaxed);
+        current->tid = static_cast<int32_t>(Util::get_tid());
+        reset_buffer(current, now_ns);
+    }
+    open_file();
+    mutex_.unlock();
+}
+
+}  // namespace file_io_hook
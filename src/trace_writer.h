@@ -0,0 +1,201 @@
+/**
+ * @file trace_writer.h
+ * @author noahyzhang
+ * @brief 逐次调用的事件追踪
+ * @version 0.1
+ * @date 2023-04-18
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#pragma once
+
+#include <pthread.h>
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include "trace_format.h"
+
+namespace file_io_hook {
+
+// 追踪文件名前缀的最大长度
+#define TRACE_PREFIX_MAX_LEN (1024)
+
+// 事件中文件名的最大长度，更长的被截断
+#define TRACE_NAME_MAX_LEN (4096)
+
+// 块中最早的事件超过这个时间还没有写入文件时，在下一次追加时写入，避免不活跃线程的事件迟迟不落盘
+#define TRACE_FLUSH_INTERVAL_NS (1000000000ULL)
+
+/**
+ * @brief 事件追踪
+ *  打开后，每次调用（包括失败的调用）都编码为一个事件追加到线程私有的块中，格式见 trace_format.h
+ *  1. 追加只访问线程私有的块，块写满、超时、线程退出或者进程退出时写入文件
+ *  2. 写入时原子地分配文件中的位置，每次写入一个完整的块，偏移和长度都按块大小对齐，不需要加锁
+ *  3. 文件名为 <prefix>.<pid>.trace，fork 出的子进程丢弃继承来的事件，写入自己的文件
+ *  写文件在 HookGuard 的作用域内，不会被统计
+ */
+class TraceWriter {
+public:
+    TraceWriter() = default;
+    ~TraceWriter() = default;
+    TraceWriter(const TraceWriter&) = delete;
+    TraceWriter& operator=(const TraceWriter&) = delete;
+    TraceWriter(TraceWriter&&) = delete;
+    TraceWriter& operator=(TraceWriter&&) = delete;
+
+public:
+    /**
+     * @brief 创建追踪文件，开始追踪，只能调用一次
+     *
+     * @param prefix 文件名的前缀，可以包含目录
+     * @return true
+     * @return false
+     */
+    bool start(const char* prefix);
+
+    /**
+     * @brief 是否正在追踪
+     *
+     * @return true
+     * @return false
+     */
+    bool is_enabled() const {
+        return fd_.load(std::memory_order_relaxed) >= 0;
+    }
+
+    /**
+     * @brief 追加一个事件
+     *
+     * @param op FileOperateType
+     * @param file_id
+     * @param size
+     * @param cost_ns
+     * @param offset 小于 0 为未知
+     * @param err 0 为成功
+     * @param file_name 只在 open 事件中给出，其他为空
+     */
+    void append(uint8_t op, uint32_t file_id, uint64_t size, uint64_t cost_ns, int64_t offset, int err,
+        const char* file_name);
+
+    /**
+     * @brief 追加一个只携带文件名的记录（TRACE_OP_NAME）
+     *
+     * @param file_id
+     * @param file_name
+     */
+    void append_name(uint32_t file_id, const char* file_name) {
+        append(TRACE_OP_NAME, file_id, 0, 0, -1, 0, file_name);
+    }
+
+    /**
+     * @brief 把所有线程块中的事件写入文件，进程退出时调用
+     *
+     */
+    void flush_all();
+
+public:
+    /**
+     * @brief fork 前在父进程上下文执行
+     *
+     */
+    void lock_prefork() {
+        mutex_.lock();
+    }
+
+    /**
+     * @brief fork 返回前，在父进程上下文执行
+     *
+     */
+    void lock_postfork_parent() {
+        mutex_.unlock();
+    }
+
+    /**
+     * @brief fork 返回前，在子进程上下文执行
+     *  继承来的事件属于父进程，已经或者将会由父进程写入，子进程丢弃后写入自己的文件
+     */
+    void lock_postfork_child();
+
+private:
+    /**
+     * @brief 线程私有的块
+     *
+     */
+    struct TraceBuffer {
+        TraceWriter* owner = nullptr;
+        // 只与进程退出时的 flush_all 互斥
+        std::atomic<bool> busy{false};
+        TraceBuffer* prev = nullptr;
+        TraceBuffer* next = nullptr;
+        // 按块大小对齐的缓冲区，起始位置为块头
+        uint8_t* data = nullptr;
+        uint8_t* pos = nullptr;
+        int32_t tid = 0;
+        uint32_t event_count = 0;
+        uint64_t base_time_ns = 0;
+        // 编码的上下文，含义见 trace_format.h
+        uint64_t last_time_ns = 0;
+        uint32_t last_file_id = 0;
+        uint64_t expected_offset = 0;
+    };
+
+    /**
+     * @brief 打开当前进程的追踪文件并写入文件头，需要持有 mutex_
+     *
+     * @return true
+     * @return false
+     */
+    bool open_file();
+
+    /**
+     * @brief 为当前线程分配块
+     *
+     * @return TraceBuffer*
+     */
+    TraceBuffer* acquire_buffer();
+
+    /**
+     * @brief 写入块中的事件并清空，需要持有块的 busy
+     *
+     * @param buffer
+     * @param now_ns 新块的基准时间
+     */
+    void flush_buffer(TraceBuffer* buffer, uint64_t now_ns);
+
+    /**
+     * @brief 清空块，丢弃其中的事件
+     *
+     * @param buffer
+     * @param now_ns
+     */
+    static void reset_buffer(TraceBuffer* buffer, uint64_t now_ns);
+
+    static void lock_buffer(TraceBuffer* buffer);
+    static void unlock_buffer(TraceBuffer* buffer);
+
+    /**
+     * @brief 线程退出时被调用，写入剩余的事件并释放块
+     *
+     * @param arg
+     */
+    static void on_thread_exit(void* arg);
+
+private:
+    // 追踪文件，小于 0 时不追踪
+    std::atomic<int> fd_{-1};
+    // 下一个块在文件中的偏移
+    std::atomic<uint64_t> next_offset_{0};
+    // 写入失败而丢弃的块数
+    std::atomic<uint64_t> drop_block_num_{0};
+    // 保护块的链表
+    std::mutex mutex_;
+    TraceBuffer* buffers_ = nullptr;
+    char prefix_[TRACE_PREFIX_MAX_LEN + 1] = {0};
+    // 用于感知线程退出
+    pthread_key_t key_;
+    bool key_valid_ = false;
+};
+
+}  // namespace file_io_hook
@@ -0,0 +1,116 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <vector>
+#include "hook_io_handle.h"
+
+using file_io_hook::ConcurrentHashMap;
+using file_io_hook::LockFreeHashMap;
+using file_io_hook::DoubleBallModule;
+
+// 与 FileIoInfoHandler 中的 FileRWInfo 相同的布局
+struct RWInfo {
+    uint64_t read_b;
+    uint64_t write_b;
+
+    RWInfo& operator+=(const RWInfo& info) {
+        read_b += info.read_b;
+        write_b += info.write_b;
+        return *this;
+    }
+    bool operator==(const RWInfo& info) const {
+        return read_b == info.read_b && write_b == info.write_b;
+    }
+};
+
+uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// 多个线程同时对 map 执行 insert_and_inc，返回每个线程每次操作的平均耗时（纳秒）
+template <typename Map>
+double run_insert_and_inc(Map& map, int thread_count, uint32_t key_count, uint64_t op_count) {
+    std::vector<pthread_t> threads(thread_count);
+    struct Arg {
+        Map* map;
+        uint32_t key_count;
+        uint64_t op_count;
+        uint32_t seed;
+    };
+    std::vector<Arg> args(thread_count);
+    uint64_t start = now_ns();
+    for (int i = 0; i < thread_count; i++) {
+        args[i] = Arg{&map, key_count, op_count, static_cast<uint32_t>(i + 1)};
+        pthread_create(&threads[i], nullptr, [](void* p)->void* {
+            Arg* arg = static_cast<Arg*>(p);
+            uint32_t x = arg->seed;
+            for (uint64_t n = 0; n < arg->op_count; n++) {
+                // xorshift，避免 rand() 内部的锁影响结果
+                x ^= x << 13;
+                x ^= x >> 17;
+                x ^= x << 5;
+                arg->map->insert_and_inc(x % arg->key_count + 1, RWInfo{1, 0});
+            }
+            return nullptr;
+        }, &args[i]);
+    }
+    for (int i = 0; i < thread_count; i++) {
+        pthread_join(threads[i], nullptr);
+    }
+    uint64_t cost = now_ns() - start;
+    return static_cast<double>(cost) / op_count;
+}
+
+// 通过 DoubleBallModule 写入时的适配
+template <typename Module>
+struct ModuleWriter {
+    Module* module;
+    void insert_and_inc(uint32_t key, const RWInfo& value) {
+        module->write(key, value);
+    }
+};
+
+int main(int argc, char* argv[]) {
+    if (argc != 3) {
+        printf("Usage: %s <max_thread_count> <op_count_per_thread>\n", argv[0]);
+        return -1;
+    }
+    int max_thread_count = atoi(argv[1]);
+    uint64_t op_count = strtoull(argv[2], nullptr, 10);
+    const uint32_t key_counts[] = {16, 1024};
+
+    printf("%-28s %8s %8s %12s\n", "case", "threads", "keys", "ns/op");
+    for (uint32_t key_count : key_counts) {
+        for (int thread_count = 1; thread_count <= max_thread_count; thread_count *= 2) {
+            {
+                ConcurrentHashMap<uint32_t, RWInfo> map;
+                printf("%-28s %8d %8u %12.2f\n", "ConcurrentHashMap", thread_count, key_count,
+                    run_insert_and_inc(map, thread_count, key_count, op_count));
+            }
+            {
+                LockFreeHashMap<uint32_t, RWInfo> map;
+                printf("%-28s %8d %8u %12.2f\n", "LockFreeHashMap", thread_count, key_count,
+                    run_insert_and_inc(map, thread_count, key_count, op_count));
+            }
+            {
+                typedef DoubleBallModule<uint32_t, RWInfo> Module;
+                Module module;
+                ModuleWriter<Module> writer{&module};
+                printf("%-28s %8d %8u %12.2f\n", "DoubleBall<Concurrent>", thread_count, key_count,
+                    run_insert_and_inc(writer, thread_count, key_count, op_count));
+            }
+            {
+                typedef DoubleBallModule<uint32_t, RWInfo, std::hash<uint32_t>, LockFreeHashMap> Module;
+                Module module;
+                ModuleWriter<Module> writer{&module};
+                printf("%-28s %8d %8u %12.2f\n", "DoubleBall<LockFree>", thread_count, key_count,
+                    run_insert_and_inc(writer, thread_count, key_count, op_count));
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,356 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <libgen.h>
+#include <limits.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include "hook_io_handle.h"
+
+/**
+ * hook 开销测试
+ *  同一个测试程序以三种模式运行，分别测量每个被 hook 函数单次调用的耗时分布：
+ *  1. normal：不加载 hook 库
+ *  2. disabled：LD_PRELOAD 加载 hook 库，但是关闭总开关，只剩下符号拦截、一次开关检查和转发的固定开销
+ *  3. enabled：LD_PRELOAD 加载 hook 库，正常收集数据，同时有一个线程周期性的消费数据
+ *  每次调用只写 64 字节，目标为 tmpfs 上的文件和 /dev/null，尽量排除磁盘 IO 的干扰
+ *  disabled/enabled 相对于 normal 的差值即为 hook 增加的耗时
+ *
+ *  主进程负责遍历模式、目标和线程数，每个组合启动一个子进程（--worker）执行测试并输出结果
+ */
+
+// 每次读写的字节数
+#define OVERHEAD_IO_SIZE (64)
+// 每个线程测试文件的大小，读到末尾时回到开头
+#define OVERHEAD_FILE_SIZE (64 * 1024)
+// enabled 模式下消费数据的周期，需要保证每个线程的数据池不会写满
+#define OVERHEAD_CONSUME_INTERVAL_US (10000)
+
+enum Func {
+    FUNC_OPEN = 0,
+    FUNC_CLOSE,
+    FUNC_READ,
+    FUNC_WRITE,
+    FUNC_PREAD64,
+    FUNC_PWRITE64,
+    FUNC_PREADV,
+    FUNC_WRITEV,
+    FUNC_FOPEN,
+    FUNC_FCLOSE,
+    FUNC_FREAD,
+    FUNC_FWRITE,
+    FUNC_COUNT
+};
+
+static const char* g_func_names[FUNC_COUNT] = {
+    "open", "close", "read", "write", "pread64", "pwrite64", "preadv", "writev",
+    "fopen", "fclose", "fread", "fwrite"};
+
+static const char* g_modes[] = {"normal", "disabled", "enabled"};
+
+uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// ------------------------- worker -------------------------
+
+/**
+ * @brief 每个线程每个函数的耗时样本，预先分配好，测量期间不分配内存
+ *
+ */
+struct Samples {
+    std::vector<uint64_t> cost[FUNC_COUNT];
+
+    explicit Samples(uint64_t call_count) {
+        for (int i = 0; i < FUNC_COUNT; i++) {
+            cost[i].reserve(call_count);
+        }
+    }
+};
+
+// 计时一次调用，结果放入对应函数的样本中
+#define TIMED_CALL(samples, func, expr) do { \
+    uint64_t start_ns = now_ns(); \
+    expr; \
+    (samples).cost[func].push_back(now_ns() - start_ns); \
+} while (0)
+
+void prepare_file(const std::string& path) {
+    std::vector<char> buf(OVERHEAD_FILE_SIZE, 'x');
+    FILE* fp = fopen(path.c_str(), "w");
+    if (fp == nullptr) {
+        return;
+    }
+    fwrite(buf.data(), 1, buf.size(), fp);
+    fclose(fp);
+}
+
+void run_worker_thread(const std::string& path, uint64_t call_count, Samples& samples) {
+    char buf[OVERHEAD_IO_SIZE];
+    memset(buf, 'y', sizeof(buf));
+    bool is_regular = (path != "/dev/null");
+
+    for (uint64_t n = 0; n < call_count; n++) {
+        int fd;
+        TIMED_CALL(samples, FUNC_OPEN, fd = open(path.c_str(), O_RDWR));
+        TIMED_CALL(samples, FUNC_CLOSE, close(fd));
+    }
+
+    int fd = open(path.c_str(), O_RDWR);
+    for (uint64_t n = 0; n < call_count; n++) {
+        ssize_t res;
+        TIMED_CALL(samples, FUNC_READ, res = read(fd, buf, sizeof(buf)));
+        if (res <= 0 && is_regular) {
+            lseek(fd, 0, SEEK_SET);
+        }
+    }
+    lseek(fd, 0, SEEK_SET);
+    for (uint64_t n = 0; n < call_count; n++) {
+        TIMED_CALL(samples, FUNC_WRITE, (void)write(fd, buf, sizeof(buf)));
+        if (is_regular && (n + 1) % (OVERHEAD_FILE_SIZE / OVERHEAD_IO_SIZE) == 0) {
+            lseek(fd, 0, SEEK_SET);
+        }
+    }
+    for (uint64_t n = 0; n < call_count; n++) {
+        off64_t offset = (n * OVERHEAD_IO_SIZE) % OVERHEAD_FILE_SIZE;
+        TIMED_CALL(samples, FUNC_PREAD64, (void)pread64(fd, buf, sizeof(buf), offset));
+    }
+    for (uint64_t n = 0; n < call_count; n++) {
+        off64_t offset = (n * OVERHEAD_IO_SIZE) % OVERHEAD_FILE_SIZE;
+        TIMED_CALL(samples, FUNC_PWRITE64, (void)pwrite64(fd, buf, sizeof(buf), offset));
+    }
+    // 向量读写，两个各占一半的缓冲区
+    struct iovec iov[2] = {{buf, sizeof(buf) / 2}, {buf + sizeof(buf) / 2, sizeof(buf) / 2}};
+    for (uint64_t n = 0; n < call_count; n++) {
+        off_t offset = (n * OVERHEAD_IO_SIZE) % OVERHEAD_FILE_SIZE;
+        TIMED_CALL(samples, FUNC_PREADV, (void)preadv(fd, iov, 2, offset));
+    }
+    lseek(fd, 0, SEEK_SET);
+    for (uint64_t n = 0; n < call_count; n++) {
+        TIMED_CALL(samples, FUNC_WRITEV, (void)writev(fd, iov, 2));
+        if (is_regular && (n + 1) % (OVERHEAD_FILE_SIZE / OVERHEAD_IO_SIZE) == 0) {
+            lseek(fd, 0, SEEK_SET);
+        }
+    }
+    close(fd);
+
+    for (uint64_t n = 0; n < call_count; n++) {
+        FILE* fp;
+        TIMED_CALL(samples, FUNC_FOPEN, fp = fopen(path.c_str(), "r+"));
+        TIMED_CALL(samples, FUNC_FCLOSE, fclose(fp));
+    }
+
+    FILE* fp = fopen(path.c_str(), "r+");
+    for (uint64_t n = 0; n < call_count; n++) {
+        size_t res;
+        TIMED_CALL(samples, FUNC_FREAD, res = fread(buf, 1, sizeof(buf), fp));
+        if (res == 0) {
+            rewind(fp);
+        }
+    }
+    rewind(fp);
+    for (uint64_t n = 0; n < call_count; n++) {
+        TIMED_CALL(samples, FUNC_FWRITE, (void)fwrite(buf, 1, sizeof(buf), fp));
+        if (is_regular && (n + 1) % (OVERHEAD_FILE_SIZE / OVERHEAD_IO_SIZE) == 0) {
+            rewind(fp);
+        }
+    }
+    fclose(fp);
+}
+
+uint64_t percentile(const std::vector<uint64_t>& sorted, double quantile) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    size_t pos = static_cast<size_t>(quantile * (sorted.size() - 1) + 0.5);
+    return sorted[pos];
+}
+
+/**
+ * @brief 子进程：按指定的模式、目标和线程数执行测试，每个函数输出一行结果
+ *  输出格式：func mean p50 p90 p99 p999
+ *
+ */
+int run_worker(const char* mode, const char* target, int thread_count, uint64_t call_count) {
+    if (strcmp(mode, "disabled") == 0) {
+        file_io_hook::FileIoInfoHandler::get_instance().set_hook_switch(file_io_hook::HOOK_SWITCH_GLOBAL, false);
+    }
+    std::vector<std::string> paths(thread_count, target);
+    if (strcmp(target, "/dev/null") != 0) {
+        for (int i = 0; i < thread_count; i++) {
+            paths[i] = std::string(target) + "/fio_overhead_" + std::to_string(getpid()) + "_" + std::to_string(i);
+            prepare_file(paths[i]);
+        }
+    }
+
+    // 没有加载 hook 库时，消费的是 default_hook 中的空实现，三种模式的负载保持一致
+    std::atomic<bool> stop(false);
+    std::thread consumer([&]() {
+        for (; !stop.load();) {
+            file_io_hook::FileIoInfoHandler::get_instance().consume_and_parse();
+            usleep(OVERHEAD_CONSUME_INTERVAL_US);
+        }
+    });
+
+    std::vector<Samples*> samples;
+    std::vector<std::thread> threads;
+    for (int i = 0; i < thread_count; i++) {
+        samples.push_back(new Samples(call_count));
+    }
+    for (int i = 0; i < thread_count; i++) {
+        threads.emplace_back([&, i]() {
+            run_worker_thread(paths[i], call_count, *samples[i]);
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    stop.store(true);
+    consumer.join();
+
+    for (int func = 0; func < FUNC_COUNT; func++) {
+        std::vector<uint64_t> all;
+        uint64_t sum = 0;
+        for (int i = 0; i < thread_count; i++) {
+            all.insert(all.end(), samples[i]->cost[func].begin(), samples[i]->cost[func].end());
+        }
+        for (uint64_t cost : all) {
+            sum += cost;
+        }
+        std::sort(all.begin(), all.end());
+        printf("%s %.1f %lu %lu %lu %lu\n", g_func_names[func], all.empty() ? 0.0 : static_cast<double>(sum) / all.size(),
+            percentile(all, 0.5), percentile(all, 0.9), percentile(all, 0.99), percentile(all, 0.999));
+    }
+    for (int i = 0; i < thread_count; i++) {
+        if (paths[i] != "/dev/null") {
+            unlink(paths[i].c_str());
+        }
+        delete samples[i];
+    }
+    return 0;
+}
+
+// ------------------------- driver -------------------------
+
+struct Row {
+    std::string mode;
+    std::string target;
+    std::string func;
+    int threads;
+    double mean;
+    uint64_t p50;
+    uint64_t p90;
+    uint64_t p99;
+    uint64_t p999;
+};
+
+/**
+ * @brief 启动一个子进程执行测试，解析其输出
+ *
+ */
+bool run_case(const char* self, const std::string& hook_lib, const char* mode, const std::string& target_name,
+    const std::string& target, int thread_count, uint64_t call_count, std::vector<Row>& rows) {
+    std::string cmd;
+    if (strcmp(mode, "normal") != 0) {
+        cmd = "LD_PRELOAD='" + hook_lib + "' ";
+    }
+    cmd += std::string("'") + self + "' --worker " + mode + " '" + target + "' "
+        + std::to_string(thread_count) + " " + std::to_string(call_count);
+    FILE* pipe = popen(cmd.c_str(), "r");
+    if (pipe == nullptr) {
+        return false;
+    }
+    char func[32];
+    Row row;
+    for (; fscanf(pipe, "%31s %lf %lu %lu %lu %lu", func, &row.mean, &row.p50, &row.p90, &row.p99, &row.p999) == 6;) {
+        row.mode = mode;
+        row.target = target_name;
+        row.func = func;
+        row.threads = thread_count;
+        rows.push_back(row);
+    }
+    return pclose(pipe) == 0;
+}
+
+const Row* find_baseline(const std::vector<Row>& rows, const Row& row) {
+    for (const auto& base : rows) {
+        if (base.mode == "normal" && base.target == row.target && base.func == row.func && base.threads == row.threads) {
+            return &base;
+        }
+    }
+    return nullptr;
+}
+
+int64_t diff(uint64_t value, uint64_t base) {
+    return static_cast<int64_t>(value) - static_cast<int64_t>(base);
+}
+
+int main(int argc, char* argv[]) {
+    if (argc == 6 && strcmp(argv[1], "--worker") == 0) {
+        return run_worker(argv[2], argv[3], atoi(argv[4]), strtoull(argv[5], nullptr, 10));
+    }
+    if (argc < 3 || argc > 5) {
+        printf("Usage: %s <max_thread_count> <call_count_per_thread> [tmpfs_dir] [io_hook_lib]\n", argv[0]);
+        printf("  tmpfs_dir defaults to /dev/shm, io_hook_lib defaults to libio_hook.so next to this binary\n");
+        return -1;
+    }
+    int max_thread_count = atoi(argv[1]);
+    uint64_t call_count = strtoull(argv[2], nullptr, 10);
+    std::string tmpfs_dir = argc >= 4 ? argv[3] : "/dev/shm";
+
+    char self[PATH_MAX] = {0};
+    if (readlink("/proc/self/exe", self, sizeof(self) - 1) < 0) {
+        fprintf(stderr, "readlink /proc/self/exe failed\n");
+        return -1;
+    }
+    std::string hook_lib;
+    if (argc == 5) {
+        hook_lib = argv[4];
+    } else {
+        char dir[PATH_MAX];
+        snprintf(dir, sizeof(dir), "%s", self);
+        hook_lib = std::string(dirname(dir)) + "/libio_hook.so";
+    }
+    if (access(hook_lib.c_str(), R_OK) != 0) {
+        fprintf(stderr, "hook library not found: %s\n", hook_lib.c_str());
+        return -1;
+    }
+
+    const std::pair<std::string, std::string> targets[] = {{"tmpfs", tmpfs_dir}, {"devnull", "/dev/null"}};
+    std::vector<Row> rows;
+    for (const auto& target : targets) {
+        for (int thread_count = 1; thread_count <= max_thread_count; thread_count *= 2) {
+            for (const char* mode : g_modes) {
+                fprintf(stderr, "running target=%s threads=%d mode=%s\n", target.first.c_str(), thread_count, mode);
+                if (!run_case(self, hook_lib, mode, target.first, target.second, thread_count, call_count, rows)) {
+                    fprintf(stderr, "worker failed: target=%s threads=%d mode=%s\n",
+                        target.first.c_str(), thread_count, mode);
+                }
+            }
+        }
+    }
+
+    // 所有耗时的单位都是纳秒，added_* 为相对于同一目标、函数、线程数下 normal 模式的增量
+    printf("target,func,threads,mode,mean,p50,p90,p99,p999,added_mean,added_p50,added_p90,added_p99,added_p999\n");
+    for (const auto& row : rows) {
+        const Row* base = find_baseline(rows, row);
+        printf("%s,%s,%d,%s,%.1f,%lu,%lu,%lu,%lu,%.1f,%ld,%ld,%ld,%ld\n", row.target.c_str(), row.func.c_str(),
+            row.threads, row.mode.c_str(), row.mean, row.p50, row.p90, row.p99, row.p999,
+            base ? row.mean - base->mean : 0.0,
+            base ? diff(row.p50, base->p50) : 0, base ? diff(row.p90, base->p90) : 0,
+            base ? diff(row.p99, base->p99) : 0, base ? diff(row.p999, base->p999) : 0);
+    }
+    return 0;
+}
@@ -0,0 +1,457 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "hook_io_handle.h"
+#include "common/real_func_table.h"
+
+using file_io_hook::ConcurrentHashMap;
+using file_io_hook::DoubleBallModule;
+using file_io_hook::RWSpinLock;
+using file_io_hook::RealFuncTable;
+using file_io_hook::Util;
+
+// 与 FileIoInfoHandler 中早期的 FileRWInfo 相同的布局，便于和 benchmark_hash_map 的结果对照
+struct RWInfo {
+    uint64_t read_b;
+    uint64_t write_b;
+
+    RWInfo& operator+=(const RWInfo& info) {
+        read_b += info.read_b;
+        write_b += info.write_b;
+        return *this;
+    }
+    bool operator==(const RWInfo& info) const {
+        return read_b == info.read_b && write_b == info.write_b;
+    }
+};
+
+/**
+ * @brief 一次测量的结果
+ *
+ */
+struct Result {
+    std::string bench;
+    std::string variant;
+    int threads;
+    uint32_t keys;
+    int read_pct;
+    uint64_t total_ops;
+    uint64_t wall_ns;
+
+    // 每个线程每次操作的平均耗时
+    double ns_per_op() const {
+        return total_ops ? static_cast<double>(wall_ns) * threads / total_ops : 0;
+    }
+    // 所有线程合计的吞吐，单位为百万次每秒
+    double mops() const {
+        return wall_ns ? static_cast<double>(total_ops) * 1000 / wall_ns : 0;
+    }
+};
+
+static std::vector<Result> g_results;
+
+uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// xorshift，避免 rand() 内部的锁影响结果
+inline uint32_t next_rand(uint32_t& x) {
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return x;
+}
+
+/**
+ * @brief 启动 thread_count 个线程同时执行 body(线程下标)，返回从同时开始到全部结束的耗时
+ *  线程创建的耗时不计入结果
+ *
+ * @tparam Body
+ * @param thread_count
+ * @param body
+ * @return uint64_t
+ */
+template <typename Body>
+uint64_t run_threads(int thread_count, Body body) {
+    std::atomic<int> ready(0);
+    std::atomic<bool> start(false);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < thread_count; i++) {
+        threads.emplace_back([&, i]() {
+            ready.fetch_add(1);
+            for (; !start.load(std::memory_order_acquire);) {
+                std::this_thread::yield();
+            }
+            body(i);
+        });
+    }
+    for (; ready.load() != thread_count;) {
+        std::this_thread::yield();
+    }
+    uint64_t begin = now_ns();
+    start.store(true, std::memory_order_release);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    return now_ns() - begin;
+}
+
+void add_result(const char* bench, const char* variant, int threads, uint32_t keys, int read_pct,
+    uint64_t total_ops, uint64_t wall_ns) {
+    g_results.push_back(Result{bench, variant, threads, keys, read_pct, total_ops, wall_ns});
+    fprintf(stderr, "%-20s %-22s threads=%-3d keys=%-6u read=%3d%% %10.2f ns/op\n",
+        bench, variant, threads, keys, read_pct, g_results.back().ns_per_op());
+}
+
+// ------------------------- ConcurrentHashMap -------------------------
+
+typedef ConcurrentHashMap<uint32_t, RWInfo> Map;
+
+void prefill(Map& map, uint32_t key_count) {
+    for (uint32_t key = 0; key < key_count; key++) {
+        map.insert(key, RWInfo{key, 0});
+    }
+}
+
+void bench_hash_map(int thread_count, uint32_t key_count, uint64_t op_count) {
+    {
+        Map map;
+        prefill(map, key_count);
+        uint64_t cost = run_threads(thread_count, [&](int idx) {
+            uint32_t x = idx + 1;
+            RWInfo value;
+            for (uint64_t n = 0; n < op_count; n++) {
+                map.find(next_rand(x) % key_count, value);
+            }
+        });
+        add_result("hash_map", "find", thread_count, key_count, 100, op_count * thread_count, cost);
+    }
+    {
+        Map map;
+        uint64_t cost = run_threads(thread_count, [&](int idx) {
+            uint32_t x = idx + 1;
+            for (uint64_t n = 0; n < op_count; n++) {
+                map.insert(next_rand(x) % key_count, RWInfo{n, 0});
+            }
+        });
+        add_result("hash_map", "insert", thread_count, key_count, 0, op_count * thread_count, cost);
+    }
+    {
+        Map map;
+        uint64_t cost = run_threads(thread_count, [&](int idx) {
+            uint32_t x = idx + 1;
+            for (uint64_t n = 0; n < op_count; n++) {
+                map.insert_and_inc(next_rand(x) % key_count, RWInfo{1, 0});
+            }
+        });
+        add_result("hash_map", "insert_and_inc", thread_count, key_count, 0, op_count * thread_count, cost);
+    }
+    {
+        // 单纯的 erase 很快就会把表删空，之后测到的只是查找失败，所以每次删除后再插回去
+        Map map;
+        prefill(map, key_count);
+        uint64_t cost = run_threads(thread_count, [&](int idx) {
+            uint32_t x = idx + 1;
+            for (uint64_t n = 0; n < op_count; n++) {
+                uint32_t key = next_rand(x) % key_count;
+                map.erase(key);
+                map.insert(key, RWInfo{n, 0});
+            }
+        });
+        add_result("hash_map", "erase+insert", thread_count, key_count, 0, op_count * thread_count, cost);
+    }
+    const int read_pcts[] = {50, 90};
+    for (int read_pct : read_pcts) {
+        Map map;
+        prefill(map, key_count);
+        uint64_t cost = run_threads(thread_count, [&](int idx) {
+            uint32_t x = idx + 1;
+            RWInfo value;
+            for (uint64_t n = 0; n < op_count; n++) {
+                uint32_t r = next_rand(x);
+                if (static_cast<int>((r >> 16) % 100) < read_pct) {
+                    map.find(r % key_count, value);
+                } else {
+                    map.insert_and_inc(r % key_count, RWInfo{1, 0});
+                }
+            }
+        });
+        add_result("hash_map", "find/insert_and_inc", thread_count, key_count, read_pct,
+            op_count * thread_count, cost);
+    }
+}
+
+void bench_hash_map_clear(uint32_t key_count) {
+    // clear 只在收集线程中调用，只测单线程，结果为每个节点的耗时
+    const int rounds = 20;
+    Map map;
+    uint64_t cost = 0;
+    for (int i = 0; i < rounds; i++) {
+        prefill(map, key_count);
+        uint64_t begin = now_ns();
+        map.clear();
+        cost += now_ns() - begin;
+    }
+    add_result("hash_map", "clear", 1, key_count, 0, static_cast<uint64_t>(rounds) * key_count, cost);
+}
+
+// ------------------------- 锁 -------------------------
+
+/**
+ * @brief 对不同的读写锁做统一的适配
+ *
+ */
+struct SpinLockAdapter {
+    RWSpinLock lock;
+    void read_lock() { lock.read_lock(); }
+    void read_unlock() { lock.read_unlock(); }
+    void write_lock() { lock.write_lock(); }
+    void write_unlock() { lock.write_unlock(); }
+};
+
+struct MutexAdapter {
+    std::mutex lock;
+    void read_lock() { lock.lock(); }
+    void read_unlock() { lock.unlock(); }
+    void write_lock() { lock.lock(); }
+    void write_unlock() { lock.unlock(); }
+};
+
+struct PthreadRWLockAdapter {
+    pthread_rwlock_t lock = PTHREAD_RWLOCK_INITIALIZER;
+    void read_lock() { pthread_rwlock_rdlock(&lock); }
+    void read_unlock() { pthread_rwlock_unlock(&lock); }
+    void write_lock() { pthread_rwlock_wrlock(&lock); }
+    void write_unlock() { pthread_rwlock_unlock(&lock); }
+};
+
+template <typename Lock>
+void bench_lock(const char* variant, int thread_count, int read_pct, uint64_t op_count) {
+    Lock lock;
+    // 临界区为读或者修改一个共享的计数，与数据结构中的临界区规模相当
+    volatile uint64_t shared = 0;
+    uint64_t cost = run_threads(thread_count, [&](int idx) {
+        uint32_t x = idx + 1;
+        uint64_t sum = 0;
+        for (uint64_t n = 0; n < op_count; n++) {
+            if (static_cast<int>(next_rand(x) % 100) < read_pct) {
+                lock.read_lock();
+                sum += shared;
+                lock.read_unlock();
+            } else {
+                lock.write_lock();
+                shared = shared + 1;
+                lock.write_unlock();
+            }
+        }
+        (void)sum;
+    });
+    add_result("lock", variant, thread_count, 1, read_pct, op_count * thread_count, cost);
+}
+
+// ------------------------- DoubleBallModule -------------------------
+
+typedef DoubleBallModule<uint32_t, RWInfo> Module;
+
+void bench_double_ball(int thread_count, uint32_t key_count, uint64_t op_count) {
+    {
+        Module module;
+        uint64_t cost = run_threads(thread_count, [&](int idx) {
+            uint32_t x = idx + 1;
+            for (uint64_t n = 0; n < op_count; n++) {
+                module.write(next_rand(x) % key_count, RWInfo{1, 0});
+            }
+        });
+        add_result("double_ball", "write", thread_count, key_count, 0, op_count * thread_count, cost);
+    }
+    {
+        // 写线程运行期间，收集线程不断的切换球，观察切换对写入的影响
+        Module module;
+        std::atomic<bool> stop(false);
+        std::thread reader([&]() {
+            for (; !stop.load();) {
+                if (module.read_and_switch() != nullptr) {
+                    module.release();
+                }
+                usleep(1000);
+            }
+        });
+        uint64_t cost = run_threads(thread_count, [&](int idx) {
+            uint32_t x = idx + 1;
+            for (uint64_t n = 0; n < op_count; n++) {
+                module.write(next_rand(x) % key_count, RWInfo{1, 0});
+            }
+        });
+        stop.store(true);
+        reader.join();
+        add_result("double_ball", "write+switch_1ms", thread_count, key_count, 0, op_count * thread_count, cost);
+    }
+}
+
+void bench_double_ball_switch(uint32_t key_count) {
+    // 结果为每次 read_and_switch + release 的耗时，球中有 key_count 个节点
+    const int rounds = 50;
+    Module module;
+    uint64_t cost = 0;
+    for (int i = 0; i < rounds; i++) {
+        for (uint32_t key = 0; key < key_count; key++) {
+            module.write(key, RWInfo{1, 0});
+        }
+        uint64_t begin = now_ns();
+        if (module.read_and_switch() != nullptr) {
+            module.release();
+        }
+        cost += now_ns() - begin;
+    }
+    add_result("double_ball", "read_and_switch", 1, key_count, 0, rounds, cost);
+}
+
+// ------------------------- Util::get_tid -------------------------
+
+void bench_get_tid(int thread_count, uint64_t op_count) {
+    {
+        uint64_t cost = run_threads(thread_count, [&](int) {
+            volatile int64_t tid = 0;
+            for (uint64_t n = 0; n < op_count; n++) {
+                tid = Util::get_tid();
+            }
+            (void)tid;
+        });
+        add_result("get_tid", "Util::get_tid", thread_count, 0, 100, op_count * thread_count, cost);
+    }
+    {
+        // 对照：每次都走系统调用，次数减少到 1/16，避免耗时过长
+        uint64_t syscall_count = op_count / 16 + 1;
+        uint64_t cost = run_threads(thread_count, [&](int) {
+            volatile int64_t tid = 0;
+            for (uint64_t n = 0; n < syscall_count; n++) {
+                tid = syscall(SYS_gettid);
+            }
+            (void)tid;
+        });
+        add_result("get_tid", "syscall(SYS_gettid)", thread_count, 0, 100, syscall_count * thread_count, cost);
+    }
+}
+
+// ------------------------- 真实函数指针 -------------------------
+
+typedef long (*labs_func_type)(long value);
+
+// hook 函数中原来的写法：函数内的局部静态变量，每次调用都要检查初始化守卫
+__attribute__((noinline)) long call_by_static_local(long value) {
+    static labs_func_type real_labs = (labs_func_type)dlsym(RTLD_NEXT, "labs");
+    return real_labs(value);
+}
+
+static const char* const g_real_func_names[] = {"labs"};
+static RealFuncTable<1> g_real_funcs(g_real_func_names);
+
+// 常量初始化的函数指针表，命中时只有一次读取
+__attribute__((noinline)) long call_by_real_func_table(long value) {
+    labs_func_type real_labs = g_real_funcs.get<labs_func_type>(0);
+    return real_labs(value);
+}
+
+template <typename Call>
+void bench_real_func_variant(const char* variant, int thread_count, uint64_t op_count, Call call) {
+    uint64_t cost = run_threads(thread_count, [&](int) {
+        volatile long sum = 0;
+        for (uint64_t n = 0; n < op_count; n++) {
+            sum = sum + call(static_cast<long>(n));
+        }
+        (void)sum;
+    });
+    add_result("real_func", variant, thread_count, 0, 100, op_count * thread_count, cost);
+}
+
+void bench_real_func(int thread_count, uint64_t op_count) {
+    bench_real_func_variant("static local", thread_count, op_count, call_by_static_local);
+    bench_real_func_variant("RealFuncTable", thread_count, op_count, call_by_real_func_table);
+}
+
+// ------------------------- 输出 -------------------------
+
+// 相对于同一用例单线程吞吐的倍数，即扩展曲线
+double scaling_of(const Result& result) {
+    for (const auto& base : g_results) {
+        if (base.threads == 1 && base.bench == result.bench && base.variant == result.variant
+            && base.keys == result.keys && base.read_pct == result.read_pct) {
+            return base.mops() > 0 ? result.mops() / base.mops() : 0;
+        }
+    }
+    return 0;
+}
+
+void print_csv() {
+    printf("bench,variant,threads,keys,read_pct,total_ops,wall_ns,ns_per_op,mops,scaling\n");
+    for (const auto& r : g_results) {
+        printf("%s,%s,%d,%u,%d,%lu,%lu,%.2f,%.3f,%.3f\n", r.bench.c_str(), r.variant.c_str(), r.threads,
+            r.keys, r.read_pct, r.total_ops, r.wall_ns, r.ns_per_op(), r.mops(), scaling_of(r));
+    }
+}
+
+void print_json() {
+    printf("[\n");
+    for (size_t i = 0; i < g_results.size(); i++) {
+        const Result& r = g_results[i];
+        printf("  {\"bench\": \"%s\", \"variant\": \"%s\", \"threads\": %d, \"keys\": %u, \"read_pct\": %d, "
+            "\"total_ops\": %lu, \"wall_ns\": %lu, \"ns_per_op\": %.2f, \"mops\": %.3f, \"scaling\": %.3f}%s\n",
+            r.bench.c_str(), r.variant.c_str(), r.threads, r.keys, r.read_pct, r.total_ops, r.wall_ns,
+            r.ns_per_op(), r.mops(), scaling_of(r), i + 1 == g_results.size() ? "" : ",");
+    }
+    printf("]\n");
+}
+
+int main(int argc, char* argv[]) {
+    if (argc != 3 && argc != 4) {
+        printf("Usage: %s <max_thread_count> <op_count_per_thread> [csv|json]\n", argv[0]);
+        return -1;
+    }
+    int max_thread_count = atoi(argv[1]);
+    uint64_t op_count = strtoull(argv[2], nullptr, 10);
+    bool json = (argc == 4 && strcmp(argv[3], "json") == 0);
+    if (max_thread_count <= 0 || op_count == 0) {
+        printf("Usage: %s <max_thread_count> <op_count_per_thread> [csv|json]\n", argv[0]);
+        return -1;
+    }
+    const uint32_t key_counts[] = {16, 1024, 65536};
+    const int lock_read_pcts[] = {0, 90, 100};
+
+    // 进度输出到 stderr，结果输出到 stdout
+    for (int thread_count = 1; thread_count <= max_thread_count; thread_count *= 2) {
+        for (uint32_t key_count : key_counts) {
+            bench_hash_map(thread_count, key_count, op_count);
+            bench_double_ball(thread_count, key_count, op_count);
+        }
+        for (int read_pct : lock_read_pcts) {
+            bench_lock<SpinLockAdapter>("RWSpinLock", thread_count, read_pct, op_count);
+            bench_lock<MutexAdapter>("std::mutex", thread_count, read_pct, op_count);
+            bench_lock<PthreadRWLockAdapter>("pthread_rwlock", thread_count, read_pct, op_count);
+        }
+        bench_get_tid(thread_count, op_count);
+        bench_real_func(thread_count, op_count);
+    }
+    for (uint32_t key_count : key_counts) {
+        bench_hash_map_clear(key_count);
+        bench_double_ball_switch(key_count);
+    }
+
+    if (json) {
+        print_json();
+    } else {
+        print_csv();
+    }
+    return 0;
+}
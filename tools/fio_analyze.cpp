@@ -0,0 +1,393 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "common/common.h"
+#include "trace_format.h"
+
+/*
+ * 离线分析 hook 库的追踪文件（FILE_IO_HOOK_TRACE），只依赖 trace_format.h 中的格式和 common.h 中的操作类型，不链接 hook 库
+ * 运行方式：
+ *   FILE_IO_HOOK_TRACE=/tmp/fio LD_PRELOAD=./libio_hook.so ./server
+ *   ./fio_analyze [--top N] [--slice ms] [--from ms] [--to ms] /tmp/fio.<pid>.trace
+ * 输出概要、每类操作的统计、按字节数和耗时排序的文件、最慢的调用、耗时分布以及按时间分片的统计
+ * --from/--to 为相对开始追踪的时间，只分析这个区间内的事件
+ */
+
+using namespace file_io_hook;
+
+// 耗时分布的桶数，第 i 个桶为 [2^i, 2^(i+1)) 纳秒
+static const int LATENCY_BUCKET_COUNT = 40;
+
+/**
+ * @brief 解码后的事件
+ *
+ */
+struct TraceEvent {
+    // 相对开始追踪的时间，调用结束时
+    uint64_t time_ns;
+    uint64_t size;
+    uint64_t cost_ns;
+    int64_t offset;
+    uint32_t file_id;
+    int32_t tid;
+    int32_t err;
+    uint8_t op;
+};
+
+/**
+ * @brief 某个文件或者某类操作的汇总
+ *
+ */
+struct Summary {
+    uint64_t call_num = 0;
+    uint64_t error_num = 0;
+    uint64_t read_b = 0;
+    uint64_t write_b = 0;
+    uint64_t cost_sum_ns = 0;
+    uint64_t cost_max_ns = 0;
+
+    void add(const TraceEvent& event) {
+        call_num++;
+        if (event.err != 0) {
+            error_num++;
+        }
+        if (event.op == 1 || event.op == 4) {
+            read_b += event.size;
+        } else if (event.op == 2 || event.op == 5) {
+            write_b += event.size;
+        }
+        cost_sum_ns += event.cost_ns;
+        cost_max_ns = std::max(cost_max_ns, event.cost_ns);
+    }
+};
+
+static bool read_all(int fd, uint8_t* data, size_t size, off_t offset) {
+    for (size_t done = 0; done < size;) {
+        ssize_t res = pread(fd, data + done, size - done, offset + static_cast<off_t>(done));
+        if (res < 0 && errno == EINTR) {
+            continue;
+        }
+        if (res <= 0) {
+            return false;
+        }
+        done += static_cast<size_t>(res);
+    }
+    return true;
+}
+
+/**
+ * @brief 解码一个块中的事件
+ *
+ * @return false 块不完整或者已损坏，已经解码的事件仍然保留
+ */
+static bool decode_block(const uint8_t* block, uint32_t block_size, uint64_t start_ns, std::vector<TraceEvent>& events,
+    std::unordered_map<uint32_t, std::string>& names) {
+    const TraceBlockHeader* header = reinterpret_cast<const TraceBlockHeader*>(block);
+    if (header->magic != TRACE_BLOCK_MAGIC || header->used_bytes > block_size - sizeof(TraceBlockHeader)) {
+        return false;
+    }
+    const uint8_t* pos = block + sizeof(TraceBlockHeader);
+    const uint8_t* end = pos + header->used_bytes;
+    uint64_t time_ns = header->base_time_ns;
+    uint64_t file_id = 0;
+    uint64_t expected_offset = 0;
+    for (uint32_t i = 0; i < header->event_count; ++i) {
+        if (pos >= end) {
+            return false;
+        }
+        uint8_t flags = *pos++;
+        uint64_t delta_ns = 0;
+        uint64_t file_delta = 0;
+        TraceEvent event;
+        memset(&event, 0, sizeof(event));
+        pos = trace_get_varint(pos, end, &delta_ns);
+        pos = pos ? trace_get_varint(pos, end, &file_delta) : nullptr;
+        pos = pos ? trace_get_varint(pos, end, &event.size) : nullptr;
+        pos = pos ? trace_get_varint(pos, end, &event.cost_ns) : nullptr;
+        event.offset = -1;
+        if (pos && (flags & TRACE_FLAG_OFFSET)) {
+            uint64_t value = 0;
+            pos = trace_get_varint(pos, end, &value);
+            event.offset = static_cast<int64_t>(expected_offset) + trace_zigzag_decode(value);
+            expected_offset = static_cast<uint64_t>(event.offset) + event.size;
+        }
+        if (pos && (flags & TRACE_FLAG_ERRNO)) {
+            uint64_t value = 0;
+            pos = trace_get_varint(pos, end, &value);
+            event.err = static_cast<int32_t>(value);
+        }
+        time_ns += delta_ns;
+        file_id += static_cast<uint64_t>(trace_zigzag_decode(file_delta));
+        if (pos && (flags & TRACE_FLAG_NAME)) {
+            uint64_t length = 0;
+            pos = trace_get_varint(pos, end, &length);
+            if (pos == nullptr || length > static_cast<uint64_t>(end - pos)) {
+                return false;
+            }
+            names[static_cast<uint32_t>(file_id)].assign(reinterpret_cast<const char*>(pos), length);
+            pos += length;
+        }
+        if (pos == nullptr) {
+            return false;
+        }
+        if ((flags & TRACE_OP_MASK) == TRACE_OP_NAME) {
+            continue;
+        }
+        event.time_ns = time_ns >= start_ns ? time_ns - start_ns : 0;
+        event.file_id = static_cast<uint32_t>(file_id);
+        event.tid = header->tid;
+        event.op = flags & TRACE_OP_MASK;
+        events.push_back(event);
+    }
+    return true;
+}
+
+static std::string file_name(const std::unordered_map<uint32_t, std::string>& names, uint32_t file_id) {
+    if (file_id == 0) {
+        return "-";
+    }
+    auto iter = names.find(file_id);
+    return iter != names.end() ? iter->second : "#" + std::to_string(file_id);
+}
+
+static void print_files(const char* title, std::vector<std::pair<uint32_t, Summary>>& files, size_t top,
+    const std::unordered_map<uint32_t, std::string>& names) {
+    fprintf(stdout, "%s\n", title);
+    fprintf(stdout, "%10s %10s %14s %14s %14s %12s  %s\n", "calls", "errors", "read_b", "write_b", "total(ns)",
+        "max(ns)", "file");
+    for (size_t i = 0; i < files.size() && i < top; ++i) {
+        const Summary& summary = files[i].second;
+        fprintf(stdout, "%10lu %10lu %14lu %14lu %14lu %12lu  %s\n", summary.call_num, summary.error_num,
+            summary.read_b, summary.write_b, summary.cost_sum_ns, summary.cost_max_ns,
+            file_name(names, files[i].first).c_str());
+    }
+    fprintf(stdout, "\n");
+}
+
+static void print_histogram(const char* name, const uint64_t* buckets) {
+    int first = 0;
+    int last = LATENCY_BUCKET_COUNT - 1;
+    for (; first <= last && buckets[first] == 0; ++first) {}
+    for (; last >= first && buckets[last] == 0; --last) {}
+    if (first > last) {
+        return;
+    }
+    uint64_t max_count = *std::max_element(buckets + first, buckets + last + 1);
+    fprintf(stdout, "%s latency (ns)\n", name);
+    for (int i = first; i <= last; ++i) {
+        int width = static_cast<int>(buckets[i] * 50 / max_count);
+        if (width == 0 && buckets[i] != 0) {
+            width = 1;
+        }
+        fprintf(stdout, "  [%12lu, %12lu) %10lu |%.*s\n", 1UL << i, 1UL << (i + 1), buckets[i], width,
+            "##################################################");
+    }
+}
+
+static uint64_t percentile(std::vector<uint64_t>& values, double ratio) {
+    if (values.empty()) {
+        return 0;
+    }
+    size_t index = std::min(values.size() - 1, static_cast<size_t>(values.size() * ratio));
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
+
+static void usage(const char* name) {
+    fprintf(stderr, "usage: %s [--top N] [--slice ms] [--from ms] [--to ms] <trace file, e.g. fio.1234.trace>\n",
+        name);
+}
+
+int main(int argc, char* argv[]) {
+    size_t top = 10;
+    uint64_t slice_ms = 1000;
+    uint64_t from_ms = 0;
+    uint64_t to_ms = UINT64_MAX;
+    const char* path = nullptr;
+    for (int i = 1; i < argc; ++i) {
+        bool has_value = (i + 1 < argc);
+        if (strcmp(argv[i], "--top") == 0 && has_value) {
+            top = strtoul(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--slice") == 0 && has_value) {
+            slice_ms = strtoull(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--from") == 0 && has_value) {
+            from_ms = strtoull(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--to") == 0 && has_value) {
+            to_ms = strtoull(argv[++i], nullptr, 10);
+        } else if (argv[i][0] != '-' && path == nullptr) {
+            path = argv[i];
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (path == nullptr) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (slice_ms == 0) {
+        slice_ms = 1000;
+    }
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        fprintf(stderr, "call open %s failed, err: %s\n", path, strerror(errno));
+        return 1;
+    }
+    TraceFileHeader header;
+    if (!read_all(fd, reinterpret_cast<uint8_t*>(&header), sizeof(header), 0) || header.magic != TRACE_FILE_MAGIC) {
+        fprintf(stderr, "%s is not a trace file\n", path);
+        close(fd);
+        return 1;
+    }
+    if (header.version != TRACE_FORMAT_VERSION || header.block_size < sizeof(TraceBlockHeader)) {
+        fprintf(stderr, "%s has unknown format, version: %u, expected version: %u\n", path, header.version,
+            TRACE_FORMAT_VERSION);
+        close(fd);
+        return 1;
+    }
+
+    // 文件末尾可能有进程被杀时没有写完的块，以及并发写入时还没有填上的空洞，都跳过
+    std::vector<TraceEvent> events;
+    std::unordered_map<uint32_t, std::string> names;
+    std::vector<uint8_t> block(header.block_size);
+    uint64_t block_num = 0;
+    uint64_t bad_block_num = 0;
+    for (off_t offset = header.block_size;; offset += header.block_size) {
+        if (!read_all(fd, block.data(), block.size(), offset)) {
+            break;
+        }
+        if (reinterpret_cast<const TraceBlockHeader*>(block.data())->magic == 0) {
+            continue;
+        }
+        block_num++;
+        if (!decode_block(block.data(), header.block_size, header.start_monotonic_ns, events, names)) {
+            bad_block_num++;
+        }
+    }
+    close(fd);
+    std::stable_sort(events.begin(), events.end(), [](const TraceEvent& left, const TraceEvent& right) {
+        return left.time_ns < right.time_ns;
+    });
+    uint64_t from_ns = from_ms * 1000000ULL;
+    uint64_t to_ns = to_ms == UINT64_MAX ? UINT64_MAX : to_ms * 1000000ULL;
+    events.erase(std::remove_if(events.begin(), events.end(), [from_ns, to_ns](const TraceEvent& event) {
+        return event.time_ns < from_ns || event.time_ns >= to_ns;
+    }), events.end());
+
+    // 概要
+    time_t start_sec = static_cast<time_t>(header.start_realtime_ns / 1000000000ULL);
+    struct tm start_tm;
+    char start_text[64];
+    localtime_r(&start_sec, &start_tm);
+    strftime(start_text, sizeof(start_text), "%Y-%m-%d %H:%M:%S", &start_tm);
+    std::set<int32_t> tids;
+    for (const TraceEvent& event : events) {
+        tids.insert(event.tid);
+    }
+    uint64_t duration_ns = events.empty() ? 0 : events.back().time_ns - events.front().time_ns;
+    fprintf(stdout, "pid: %d, start: %s, blocks: %lu (bad: %lu), events: %lu, threads: %lu, files: %lu, "
+        "duration: %.3f ms\n\n", header.pid, start_text, block_num, bad_block_num, events.size(), tids.size(),
+        names.size(), duration_ns / 1e6);
+    if (events.empty()) {
+        return 0;
+    }
+
+    // 每类操作
+    Summary op_summaries[FILE_OPERATE_TYPE_COUNT];
+    std::vector<uint64_t> op_costs[FILE_OPERATE_TYPE_COUNT];
+    uint64_t op_buckets[FILE_OPERATE_TYPE_COUNT][LATENCY_BUCKET_COUNT] = {{0}};
+    std::unordered_map<uint32_t, Summary> file_summaries;
+    for (const TraceEvent& event : events) {
+        if (event.op >= FILE_OPERATE_TYPE_COUNT) {
+            continue;
+        }
+        op_summaries[event.op].add(event);
+        op_costs[event.op].push_back(event.cost_ns);
+        int bucket = event.cost_ns == 0 ? 0 : 63 - __builtin_clzll(event.cost_ns);
+        op_buckets[event.op][std::min(bucket, LATENCY_BUCKET_COUNT - 1)]++;
+        if (event.file_id != 0) {
+            file_summaries[event.file_id].add(event);
+        }
+    }
+    fprintf(stdout, "%-10s %10s %10s %14s %12s %12s %12s %12s\n", "op", "calls", "errors", "bytes", "avg(ns)",
+        "p50(ns)", "p99(ns)", "max(ns)");
+    for (size_t op = 0; op < FILE_OPERATE_TYPE_COUNT; ++op) {
+        const Summary& summary = op_summaries[op];
+        if (summary.call_num == 0) {
+            continue;
+        }
+        fprintf(stdout, "%-10s %10lu %10lu %14lu %12lu %12lu %12lu %12lu\n", FILE_OPERATE_TYPE_NAMES[op],
+            summary.call_num, summary.error_num, summary.read_b + summary.write_b, summary.cost_sum_ns / summary.call_num,
+            percentile(op_costs[op], 0.5), percentile(op_costs[op], 0.99), summary.cost_max_ns);
+    }
+    fprintf(stdout, "\n");
+
+    // 文件
+    std::vector<std::pair<uint32_t, Summary>> files(file_summaries.begin(), file_summaries.end());
+    std::sort(files.begin(), files.end(), [](const std::pair<uint32_t, Summary>& left,
+        const std::pair<uint32_t, Summary>& right) {
+        return left.second.read_b + left.second.write_b > right.second.read_b + right.second.write_b;
+    });
+    print_files("top files by bytes", files, top, names);
+    std::sort(files.begin(), files.end(), [](const std::pair<uint32_t, Summary>& left,
+        const std::pair<uint32_t, Summary>& right) {
+        return left.second.cost_sum_ns > right.second.cost_sum_ns;
+    });
+    print_files("top files by total latency", files, top, names);
+
+    // 最慢的调用
+    std::vector<const TraceEvent*> slowest;
+    slowest.reserve(events.size());
+    for (const TraceEvent& event : events) {
+        slowest.push_back(&event);
+    }
+    size_t slow_num = std::min(top, slowest.size());
+    std::partial_sort(slowest.begin(), slowest.begin() + slow_num, slowest.end(),
+        [](const TraceEvent* left, const TraceEvent* right) {
+            return left->cost_ns > right->cost_ns;
+        });
+    fprintf(stdout, "slowest calls\n");
+    fprintf(stdout, "%12s %8s %-10s %14s %10s %12s %-8s  %s\n", "time(ms)", "tid", "op", "offset", "size",
+        "cost(ns)", "errno", "file");
+    for (size_t i = 0; i < slow_num; ++i) {
+        const TraceEvent* event = slowest[i];
+        std::string offset = event->offset >= 0 ? std::to_string(event->offset) : "-";
+        std::string err = event->err != 0 ? std::to_string(event->err) : "-";
+        fprintf(stdout, "%12.3f %8d %-10s %14s %10lu %12lu %-8s  %s\n", event->time_ns / 1e6, event->tid,
+            file_operate_type_name(event->op), offset.c_str(), event->size, event->cost_ns, err.c_str(),
+            file_name(names, event->file_id).c_str());
+    }
+    fprintf(stdout, "\n");
+
+    // 耗时分布
+    for (size_t op = 0; op < FILE_OPERATE_TYPE_COUNT; ++op) {
+        print_histogram(FILE_OPERATE_TYPE_NAMES[op], op_buckets[op]);
+    }
+    fprintf(stdout, "\n");
+
+    // 按时间分片
+    uint64_t slice_ns = slice_ms * 1000000ULL;
+    fprintf(stdout, "time slices (%lu ms)\n", slice_ms);
+    fprintf(stdout, "%12s %10s %10s %14s %14s %12s\n", "from(ms)", "events", "errors", "read_b", "write_b",
+        "max(ns)");
+    for (size_t i = 0; i < events.size();) {
+        uint64_t slice_index = events[i].time_ns / slice_ns;
+        Summary summary;
+        for (; i < events.size() && events[i].time_ns / slice_ns == slice_index; ++i) {
+            summary.add(events[i]);
+        }
+        fprintf(stdout, "%12lu %10lu %10lu %14lu %14lu %12lu\n", slice_index * slice_ms, summary.call_num,
+            summary.error_num, summary.read_b, summary.write_b, summary.cost_max_ns);
+    }
+    return 0;
+}
@@ -0,0 +1,184 @@
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "common/common.h"
+#include "shm_layout.h"
+
+/*
+ * 进程外的收集器，读取 hook 库导出到共享内存中的 IO 记录，按 (线程, 文件, 操作类型) 汇总后定期输出
+ * 只依赖 shm_layout.h 中的布局和 common.h 中的操作类型，不链接 hook 库，与被监控进程之间没有共享的锁
+ * 运行方式：
+ *   FILE_IO_HOOK_SHM_EXPORT=fio_hook LD_PRELOAD=./libio_hook.so ./server &
+ *   ./fio_collector fio_hook.<pid> [间隔(ms)，默认 1000] [输出次数，默认直到被监控进程退出]
+ * 被监控进程退出后，读完剩余的记录，输出最后一次并删除共享内存段
+ */
+
+using namespace file_io_hook;
+
+static const uint8_t SYNC_BATCH_TYPE = 0xff;
+
+/**
+ * @brief 某个线程在某个文件上某一类操作的汇总
+ *
+ */
+struct OperateSummary {
+    int32_t tid = 0;
+    uint32_t file_id = 0;
+    uint8_t type = 0;
+    // 按采样权重放大后的次数和字节数
+    uint64_t call_num = 0;
+    uint64_t bytes = 0;
+    // 实际收到的记录数
+    uint64_t record_num = 0;
+    uint64_t cost_sum_ns = 0;
+    uint64_t cost_max_ns = 0;
+};
+
+static uint64_t summary_key(int32_t tid, uint32_t file_id, uint8_t type) {
+    return (static_cast<uint64_t>(static_cast<uint32_t>(tid)) << 40) ^ (static_cast<uint64_t>(file_id) << 8) ^ type;
+}
+
+static std::string file_name(ShmHeader* header, uint32_t file_id) {
+    if (file_id < header->name_slot_count) {
+        ShmNameSlot* slot = shm_name_slot(header, file_id);
+        uint32_t length = slot->length.load(std::memory_order_acquire);
+        if (length != 0) {
+            return std::string(slot->name, std::min<size_t>(length, sizeof(slot->name) - 1));
+        }
+    }
+    return "#" + std::to_string(file_id);
+}
+
+// 读空所有队列，返回读到的记录数
+static uint64_t drain(ShmHeader* header, std::unordered_map<uint64_t, OperateSummary>& summaries) {
+    uint64_t count = 0;
+    for (uint32_t i = 0; i < header->ring_count; ++i) {
+        ShmRingHeader* ring = shm_ring_header(header, i);
+        uint32_t state = ring->state.load(std::memory_order_acquire);
+        if (state == SHM_RING_FREE) {
+            continue;
+        }
+        int32_t tid = ring->tid.load(std::memory_order_relaxed);
+        count += shm_ring(header, ring).consume([&](const ShmIoRecord& record) {
+            OperateSummary& summary = summaries[summary_key(tid, record.file_id, record.type)];
+            summary.tid = tid;
+            summary.file_id = record.file_id;
+            summary.type = record.type;
+            summary.call_num += record.weight;
+            summary.bytes += record.bytes * record.weight;
+            summary.record_num++;
+            summary.cost_sum_ns += record.cost_ns;
+            summary.cost_max_ns = std::max(summary.cost_max_ns, record.cost_ns);
+        });
+        // 已退出线程的队列读空之后释放，交给新线程使用；失败说明已经被新线程直接认领
+        uint32_t expected = SHM_RING_RETIRED;
+        if (state == SHM_RING_RETIRED && shm_ring(header, ring).size() == 0) {
+            ring->state.compare_exchange_strong(expected, SHM_RING_FREE, std::memory_order_acq_rel);
+        }
+    }
+    return count;
+}
+
+static uint64_t total_ring_drop(ShmHeader* header) {
+    uint64_t drop_num = 0;
+    for (uint32_t i = 0; i < header->ring_count; ++i) {
+        drop_num += shm_ring_header(header, i)->drop_num.load(std::memory_order_relaxed);
+    }
+    return drop_num;
+}
+
+static void print_summaries(ShmHeader* header, std::unordered_map<uint64_t, OperateSummary>& summaries,
+    uint64_t record_num, uint64_t ring_drop_num, uint64_t no_ring_drop_num) {
+    std::vector<const OperateSummary*> rows;
+    rows.reserve(summaries.size());
+    for (const auto& item : summaries) {
+        rows.push_back(&item.second);
+    }
+    std::sort(rows.begin(), rows.end(), [](const OperateSummary* left, const OperateSummary* right) {
+        return left->bytes != right->bytes ? left->bytes > right->bytes : left->call_num > right->call_num;
+    });
+    fprintf(stdout, "pid: %d, records: %lu, dropped (ring full): %lu, dropped (no ring): %lu, names not exported: %lu\n",
+        header->pid, record_num, ring_drop_num, no_ring_drop_num,
+        header->name_overflow_num.load(std::memory_order_relaxed));
+    fprintf(stdout, "%8s %-10s %10s %14s %12s %12s  %s\n", "tid", "op", "calls", "bytes", "avg(ns)", "max(ns)", "file");
+    for (const OperateSummary* row : rows) {
+        const char* op = row->type == SYNC_BATCH_TYPE ? "sync_batch" : file_operate_type_name(row->type);
+        // 刷盘批次没有耗时，avg 列为每批的平均字节数
+        uint64_t avg = row->type == SYNC_BATCH_TYPE ? row->bytes / row->call_num
+            : row->cost_sum_ns / row->record_num;
+        fprintf(stdout, "%8d %-10s %10lu %14lu %12lu %12lu  %s\n", row->tid, op, row->call_num, row->bytes, avg,
+            row->cost_max_ns, file_name(header, row->file_id).c_str());
+    }
+    fprintf(stdout, "\n");
+    fflush(stdout);
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <segment, e.g. fio_hook.1234> [interval_ms] [count]\n", argv[0]);
+        return 1;
+    }
+    std::string name = argv[1][0] == '/' ? argv[1] : std::string("/") + argv[1];
+    long interval_ms = argc > 2 ? strtol(argv[2], nullptr, 10) : 1000;
+    long count = argc > 3 ? strtol(argv[3], nullptr, 10) : 0;
+    if (interval_ms <= 0) {
+        interval_ms = 1000;
+    }
+
+    int fd = shm_open(name.c_str(), O_RDWR, 0);
+    if (fd < 0) {
+        fprintf(stderr, "call shm_open %s failed, err: %s\n", name.c_str(), strerror(errno));
+        return 1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(ShmHeader)) {
+        fprintf(stderr, "segment %s is too small\n", name.c_str());
+        close(fd);
+        return 1;
+    }
+    void* addr = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        fprintf(stderr, "call mmap failed, err: %s\n", strerror(errno));
+        return 1;
+    }
+    ShmHeader* header = static_cast<ShmHeader*>(addr);
+    if (!shm_check_header(header, st.st_size)) {
+        fprintf(stderr, "segment %s has unknown layout, magic: %#x, version: %u, expected version: %u\n",
+            name.c_str(), header->magic, header->version, SHM_EXPORT_VERSION);
+        return 1;
+    }
+
+    std::unordered_map<uint64_t, OperateSummary> summaries;
+    uint64_t last_ring_drop = total_ring_drop(header);
+    uint64_t last_no_ring_drop = header->no_ring_drop_num.load(std::memory_order_relaxed);
+    for (long round = 0; count == 0 || round < count; ++round) {
+        usleep(static_cast<useconds_t>(interval_ms) * 1000);
+        // 先判断进程是否存活再读，这样退出前写入的记录都能被读到
+        bool exited = (kill(header->pid, 0) != 0 && errno == ESRCH);
+        summaries.clear();
+        uint64_t record_num = drain(header, summaries);
+        uint64_t ring_drop = total_ring_drop(header);
+        uint64_t no_ring_drop = header->no_ring_drop_num.load(std::memory_order_relaxed);
+        print_summaries(header, summaries, record_num, ring_drop - last_ring_drop, no_ring_drop - last_no_ring_drop);
+        last_ring_drop = ring_drop;
+        last_no_ring_drop = no_ring_drop;
+        if (exited) {
+            fprintf(stdout, "process %d exited\n", header->pid);
+            shm_unlink(name.c_str());
+            break;
+        }
+    }
+    munmap(addr, st.st_size);
+    return 0;
+}